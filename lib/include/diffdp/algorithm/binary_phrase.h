@@ -1,8 +1,10 @@
 #pragma once
 
+#include <algorithm>
 #include <cassert>
 #include <functional>
 #include <memory>
+#include <vector>
 
 #include "diffdp/chart.h"
 #include "diffdp/deduction_operations.h"
@@ -11,25 +13,84 @@ namespace diffdp
 {
 
 
+/**
+ * Chart of the relaxed CKY algorithms over binary bracketings.
+ *
+ * Bounded spans: if max_span_length > 0, the constituents (i, j) have a length j - i of at most max_span_length
+ * (i.e. at most max_span_length + 1 words), except the constituents (i, size - 1) of the top-level right-branching spine,
+ * which collects the short constituents from left to right.
+ * The sentence is then stored reversed, so that the spine is made of the spans (0, j) of the chart
+ * and only the band of the chart is stored (see MirroredMatrix and SpanTensor3D):
+ * the time is O(n w^2) and the memory O(n w^2) for the split weights and O(n w) for the spans, with w = max_span_length.
+ * The output and the gradient of the spans outside the band are exactly zero.
+ */
 struct BinaryPhraseStructureChart
 {
-    const unsigned size;
-    const unsigned size_3d;
-    const unsigned size_2d;
+    unsigned size;
+    std::size_t size_3d;
+    std::size_t size_2d;
+    SplitWeightsMode split_weights_mode;
+    // maximum length of the constituents below the spine, 0 if unbounded
+    unsigned max_span_length;
     float* _memory = nullptr;
     const bool _erase_memory;
+    // number of cells of the memory, bounds the size of the chart
+    std::size_t memory_cells;
 
-    Tensor3D<float> split_weights, backptr;
-    Matrix<float> weight, soft_selection;
+    // split_weights is not allocated in the Recomputed mode
+    SpanTensor3D<float> split_weights, backptr;
+    // cells are read by rows and by columns
+    MirroredMatrix<float> weight, soft_selection;
 
-    BinaryPhraseStructureChart(unsigned size);
-    BinaryPhraseStructureChart(unsigned size, float* mem);
+    BinaryPhraseStructureChart(unsigned size, SplitWeightsMode mode = SplitWeightsMode::Stored, unsigned max_span_length = 0u);
+    BinaryPhraseStructureChart(unsigned size, float* mem, SplitWeightsMode mode = SplitWeightsMode::Stored, unsigned max_span_length = 0u);
     ~BinaryPhraseStructureChart();
 
+    // change the size of the chart, reusing its memory (it must be large enough)
+    void resize(unsigned size, SplitWeightsMode mode = SplitWeightsMode::Stored, unsigned max_span_length = 0u);
+    // change the size and the memory of a chart that does not own its memory
+    void rebind(unsigned size, float* mem, SplitWeightsMode mode = SplitWeightsMode::Stored, unsigned max_span_length = 0u);
+
     void zeros();
+    // set to zero the cells that are read before being written by the forward (resp. backward) pass,
+    // i.e. the base cases and the accumulators: the tensors are never initialized
+    void init_forward();
+    void init_backward();
+
+    // number of spans (i, i + length) of the chart that are built: with a bound, only the spine has longer spans
+    inline unsigned n_spans(const unsigned length) const noexcept
+    {
+        return max_span_length == 0u || length <= max_span_length ? size - length : 1u;
+    }
+    // one past the last span (i, j) of the chart that is built
+    inline unsigned row_end(const unsigned i) const noexcept
+    {
+        return max_span_length == 0u || i == 0u ? size : std::min(size, i + max_span_length + 1u);
+    }
+    // first split k of the span (i, j) of the chart: the right antecedent (k + 1, j) of a spine span is not longer than the bound
+    inline unsigned first_split(const unsigned i, const unsigned j) const noexcept
+    {
+        return max_span_length == 0u || j - i <= max_span_length ? i : j - max_span_length - 1u;
+    }
+
+    // the span (left, right) of the sentence is built
+    inline bool in_band(const unsigned left, const unsigned right) const noexcept
+    {
+        return max_span_length == 0u || right - left <= max_span_length || right == size - 1u;
+    }
+    // the span (left, right) of the sentence is the span (cell_left(left, right), cell_right(left, right)) of the chart,
+    // and conversely, as the sentence is reversed with a bound
+    inline unsigned cell_left(const unsigned left, const unsigned right) const noexcept
+    {
+        return max_span_length == 0u ? left : size - 1u - right;
+    }
+    inline unsigned cell_right(const unsigned left, const unsigned right) const noexcept
+    {
+        return max_span_length == 0u ? right : size - 1u - left;
+    }
 
-    static std::size_t required_memory(const unsigned size);
-    static unsigned required_cells(const unsigned size);
+    static std::size_t required_memory(const unsigned size, const SplitWeightsMode mode = SplitWeightsMode::Stored, const unsigned max_span_length = 0u);
+    static std::size_t required_cells(const unsigned size, const SplitWeightsMode mode = SplitWeightsMode::Stored, const unsigned max_span_length = 0u);
 };
 
 
@@ -38,11 +99,15 @@ struct AlgorithmicDifferentiableBinaryPhraseStructure
 {
     unsigned _size;
 
-    std::shared_ptr<BinaryPhraseStructureChart> chart_forward;
-    std::shared_ptr<BinaryPhraseStructureChart> chart_backward;
+    // charts allocated by the engine itself, if any
+    std::unique_ptr<BinaryPhraseStructureChart> _owned_chart_forward;
+    std::unique_ptr<BinaryPhraseStructureChart> _owned_chart_backward;
+
+    BinaryPhraseStructureChart* chart_forward;
+    BinaryPhraseStructureChart* chart_backward;
 
-    explicit AlgorithmicDifferentiableBinaryPhraseStructure(const unsigned t_size);
-    AlgorithmicDifferentiableBinaryPhraseStructure(std::shared_ptr<BinaryPhraseStructureChart> chart_forward, std::shared_ptr<BinaryPhraseStructureChart> chart_backward);
+    explicit AlgorithmicDifferentiableBinaryPhraseStructure(const unsigned t_size, const SplitWeightsMode mode = SplitWeightsMode::Stored, const unsigned max_span_length = 0u);
+    AlgorithmicDifferentiableBinaryPhraseStructure(BinaryPhraseStructureChart* chart_forward, BinaryPhraseStructureChart* chart_backward);
 
     template<class Functor>
     void forward(Functor&& weight_callback);
@@ -50,11 +115,11 @@ struct AlgorithmicDifferentiableBinaryPhraseStructure
     template<class Functor>
     void backward(Functor&& gradient_callback);
 
-    static void forward_maximize(std::shared_ptr<BinaryPhraseStructureChart>& chart_forward);
-    static void forward_backtracking(std::shared_ptr<BinaryPhraseStructureChart>& chart_forward);
+    static void forward_maximize(BinaryPhraseStructureChart* chart_forward);
+    static void forward_backtracking(BinaryPhraseStructureChart* chart_forward);
 
-    static void backward_maximize(std::shared_ptr<BinaryPhraseStructureChart>& chart_forward, std::shared_ptr<BinaryPhraseStructureChart>& chart_backward);
-    static void backward_backtracking(std::shared_ptr<BinaryPhraseStructureChart>& chart_forward, std::shared_ptr<BinaryPhraseStructureChart>& chart_backward);
+    static void backward_maximize(BinaryPhraseStructureChart* chart_forward, BinaryPhraseStructureChart* chart_backward);
+    static void backward_backtracking(BinaryPhraseStructureChart* chart_forward, BinaryPhraseStructureChart* chart_backward);
 
     float output(const unsigned head, const unsigned mod) const;
     float gradient(const unsigned left, const unsigned right) const;
@@ -63,15 +128,59 @@ struct AlgorithmicDifferentiableBinaryPhraseStructure
 };
 
 
+/*
+ * Sparse variant of AlgorithmicDifferentiableBinaryPhraseStructure: the split distributions are computed with a sparsemax,
+ * the backtracking and the backward pass only visit the non-zero backpointers (see SparsemaxEisner).
+ */
+struct SparsemaxBinaryPhraseStructure
+{
+    unsigned _size;
+
+    // charts allocated by the engine itself, if any
+    std::unique_ptr<BinaryPhraseStructureChart> _owned_chart_forward;
+    std::unique_ptr<BinaryPhraseStructureChart> _owned_chart_backward;
+
+    BinaryPhraseStructureChart* chart_forward;
+    BinaryPhraseStructureChart* chart_backward;
+
+    // non-zero backpointers of chart_forward, set by the forward pass
+    SplitSupports supports;
+
+    explicit SparsemaxBinaryPhraseStructure(const unsigned t_size, const SplitWeightsMode mode = SplitWeightsMode::Stored);
+    SparsemaxBinaryPhraseStructure(BinaryPhraseStructureChart* chart_forward, BinaryPhraseStructureChart* chart_backward);
+
+    template<class Functor>
+    void forward(Functor&& weight_callback);
+
+    template<class Functor>
+    void backward(Functor&& gradient_callback);
+
+    static void forward_maximize(BinaryPhraseStructureChart* chart_forward, SplitSupports* supports);
+    static void forward_backtracking(BinaryPhraseStructureChart* chart_forward, const SplitSupports* supports);
+
+    static void backward_maximize(BinaryPhraseStructureChart* chart_forward, BinaryPhraseStructureChart* chart_backward, const SplitSupports* supports);
+    static void backward_backtracking(BinaryPhraseStructureChart* chart_forward, BinaryPhraseStructureChart* chart_backward, const SplitSupports* supports);
+
+    float output(const unsigned left, const unsigned right) const;
+    float gradient(const unsigned left, const unsigned right) const;
+
+    unsigned size() const;
+};
+
+
 struct EntropyRegularizedBinaryPhraseStructure
 {
     unsigned _size;
 
-    std::shared_ptr<BinaryPhraseStructureChart> chart_forward;
-    std::shared_ptr<BinaryPhraseStructureChart> chart_backward;
+    // charts allocated by the engine itself, if any
+    std::unique_ptr<BinaryPhraseStructureChart> _owned_chart_forward;
+    std::unique_ptr<BinaryPhraseStructureChart> _owned_chart_backward;
+
+    BinaryPhraseStructureChart* chart_forward;
+    BinaryPhraseStructureChart* chart_backward;
 
-    explicit EntropyRegularizedBinaryPhraseStructure(const unsigned t_size);
-    EntropyRegularizedBinaryPhraseStructure(std::shared_ptr<BinaryPhraseStructureChart> chart_forward, std::shared_ptr<BinaryPhraseStructureChart> chart_backward);
+    explicit EntropyRegularizedBinaryPhraseStructure(const unsigned t_size, const SplitWeightsMode mode = SplitWeightsMode::Stored, const unsigned max_span_length = 0u);
+    EntropyRegularizedBinaryPhraseStructure(BinaryPhraseStructureChart* chart_forward, BinaryPhraseStructureChart* chart_backward);
 
 
     template<class Functor>
@@ -80,11 +189,11 @@ struct EntropyRegularizedBinaryPhraseStructure
     template<class Functor>
     void backward(Functor&& gradient_callback);
 
-    static void forward_maximize(std::shared_ptr<BinaryPhraseStructureChart>& chart_forward);
-    static void forward_backtracking(std::shared_ptr<BinaryPhraseStructureChart>& chart_forward);
+    static void forward_maximize(BinaryPhraseStructureChart* chart_forward);
+    static void forward_backtracking(BinaryPhraseStructureChart* chart_forward);
 
-    static void backward_maximize(std::shared_ptr<BinaryPhraseStructureChart>& chart_forward, std::shared_ptr<BinaryPhraseStructureChart>& chart_backward);
-    static void backward_backtracking(std::shared_ptr<BinaryPhraseStructureChart>& chart_forward, std::shared_ptr<BinaryPhraseStructureChart>& chart_backward);
+    static void backward_maximize(BinaryPhraseStructureChart* chart_forward, BinaryPhraseStructureChart* chart_backward);
+    static void backward_backtracking(BinaryPhraseStructureChart* chart_forward, BinaryPhraseStructureChart* chart_backward);
 
     float output(const unsigned head, const unsigned mod) const;
     float gradient(const unsigned head, const unsigned mod) const;
@@ -100,12 +209,12 @@ void AlgorithmicDifferentiableBinaryPhraseStructure::forward(Functor&& weight_ca
 {
     const unsigned size = chart_forward->size;
 
-    chart_forward->zeros(); // we could skip some zeros here
+    chart_forward->init_forward();
     for (unsigned i = 0; i < size; ++i)
     {
-        for (unsigned j = i + 1; j < size; ++j)
+        for (unsigned j = i + 1; j < chart_forward->row_end(i); ++j)
         {
-            chart_forward->weight(i, j) = weight_callback(i, j);
+            chart_forward->weight(i, j) = weight_callback(chart_forward->cell_left(i, j), chart_forward->cell_right(i, j));
         }
     }
 
@@ -118,13 +227,13 @@ void AlgorithmicDifferentiableBinaryPhraseStructure::backward(Functor&& gradient
 {
     const unsigned size = chart_forward->size;
 
-    chart_backward->zeros();
+    chart_backward->init_backward();
     // init gradient here
     for (unsigned i = 0; i < size; ++i)
     {
-        for (unsigned j = i + 1; j < size; ++j)
+        for (unsigned j = i + 1; j < chart_forward->row_end(i); ++j)
         {
-            chart_backward->soft_selection(i, j) = gradient_callback(i, j);
+            chart_backward->soft_selection(i, j) = gradient_callback(chart_forward->cell_left(i, j), chart_forward->cell_right(i, j));
         }
     }
 
@@ -133,11 +242,11 @@ void AlgorithmicDifferentiableBinaryPhraseStructure::backward(Functor&& gradient
 }
 
 template<class Functor>
-void EntropyRegularizedBinaryPhraseStructure::forward(Functor&& weight_callback)
+void SparsemaxBinaryPhraseStructure::forward(Functor&& weight_callback)
 {
     const unsigned size = chart_forward->size;
 
-    chart_forward->zeros(); // we could skip some zeros here
+    chart_forward->init_forward();
     for (unsigned i = 0; i < size; ++i)
     {
         for (unsigned j = i + 1; j < size; ++j)
@@ -146,6 +255,42 @@ void EntropyRegularizedBinaryPhraseStructure::forward(Functor&& weight_callback)
         }
     }
 
+    SparsemaxBinaryPhraseStructure::forward_maximize(chart_forward, &supports);
+    SparsemaxBinaryPhraseStructure::forward_backtracking(chart_forward, &supports);
+}
+
+template<class Functor>
+void SparsemaxBinaryPhraseStructure::backward(Functor&& gradient_callback)
+{
+    const unsigned size = chart_forward->size;
+
+    chart_backward->init_backward();
+    for (unsigned i = 0; i < size; ++i)
+    {
+        for (unsigned j = i + 1; j < size; ++j)
+        {
+            chart_backward->soft_selection(i, j) = gradient_callback(i, j);
+        }
+    }
+
+    SparsemaxBinaryPhraseStructure::backward_backtracking(chart_forward, chart_backward, &supports);
+    SparsemaxBinaryPhraseStructure::backward_maximize(chart_forward, chart_backward, &supports);
+}
+
+template<class Functor>
+void EntropyRegularizedBinaryPhraseStructure::forward(Functor&& weight_callback)
+{
+    const unsigned size = chart_forward->size;
+
+    chart_forward->init_forward();
+    for (unsigned i = 0; i < size; ++i)
+    {
+        for (unsigned j = i + 1; j < chart_forward->row_end(i); ++j)
+        {
+            chart_forward->weight(i, j) = weight_callback(chart_forward->cell_left(i, j), chart_forward->cell_right(i, j));
+        }
+    }
+
     EntropyRegularizedBinaryPhraseStructure::forward_maximize(chart_forward);
     EntropyRegularizedBinaryPhraseStructure::forward_backtracking(chart_forward);
 }
@@ -155,13 +300,13 @@ void EntropyRegularizedBinaryPhraseStructure::backward(Functor&& gradient_callba
 {
     const unsigned size = chart_forward->size;
 
-    chart_backward->zeros();
+    chart_backward->init_backward();
     // init gradient here
     for (unsigned i = 0; i < size; ++i)
     {
-        for (unsigned j = i + 1; j < size; ++j)
+        for (unsigned j = i + 1; j < chart_forward->row_end(i); ++j)
         {
-            chart_backward->soft_selection(i, j) = gradient_callback(i, j);
+            chart_backward->soft_selection(i, j) = gradient_callback(chart_forward->cell_left(i, j), chart_forward->cell_right(i, j));
         }
     }
 
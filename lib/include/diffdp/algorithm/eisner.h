@@ -3,38 +3,93 @@
 #include <cassert>
 #include <functional>
 #include <memory>
+#include <random>
+#include <vector>
 
 #include "diffdp/chart.h"
+#include "diffdp/algorithm/pruning.h"
 #include "diffdp/deduction_operations.h"
+#include "diffdp/parallel.h"
 
 namespace diffdp
 {
 
+/**
+ * Chart of the relaxed Eisner algorithms.
+ *
+ * Vine parsing: if vine_length > 0, an arc between two words cannot be longer than vine_length (root arcs are not bounded).
+ * The items (i, j) with i > 0 are then only built for spans of length at most vine_length,
+ * and the root collects the resulting subtrees on its right spine:
+ * every word is at most vine_length words away from the leftmost and the rightmost words of its subtree
+ * (this is slightly stronger than bounding the length of the arcs, e.g. a long chain of short arcs is excluded).
+ * Only the band of the chart is stored (see MirroredMatrix and SpanTensor3D),
+ * the time is O(n k^2) and the memory O(n k^2) for the split weights and O(n k) for the items, with k = vine_length.
+ * The output and the gradient of the arcs outside the band are exactly zero.
+ */
 struct EisnerChart
 {
-    const unsigned size;
-    const unsigned size_3d;
-    const unsigned size_2d;
+    unsigned size;
+    std::size_t size_3d;
+    std::size_t size_2d;
+    SplitWeightsMode split_weights_mode;
+    // maximum length of the arcs between words, 0 if unbounded
+    unsigned vine_length;
     float* _memory = nullptr;
     const bool _erase_memory;
-
-    Tensor3D<float>
-        a_cleft, a_cright, a_uleft, a_uright,
-        b_cleft, b_cright, b_uleft, b_uright;
-
-    Matrix<float>
+    // number of cells of the memory, bounds the size of the chart
+    std::size_t memory_cells;
+
+    // uleft(i, j) and uright(i, j) are built from the same antecedents,
+    // so they share a single split distribution (a_u, b_u).
+    // The split weights a_* are not allocated in the Recomputed mode
+    SpanTensor3D<float>
+        a_cleft, a_cright, a_u,
+        b_cleft, b_cright, b_u;
+
+    // cells are read by rows and by columns
+    MirroredMatrix<float>
         c_cleft, c_cright, c_uleft, c_uright,
         soft_c_cleft, soft_c_cright, soft_c_uleft, soft_c_uright
         ;
 
-    EisnerChart(unsigned size);
-    EisnerChart(unsigned size, float* mem);
+    EisnerChart(unsigned size, SplitWeightsMode mode = SplitWeightsMode::Stored, unsigned vine_length = 0u);
+    EisnerChart(unsigned size, float* mem, SplitWeightsMode mode = SplitWeightsMode::Stored, unsigned vine_length = 0u);
     ~EisnerChart();
 
+    // change the size of the chart, reusing its memory (it must be large enough)
+    void resize(unsigned size, SplitWeightsMode mode = SplitWeightsMode::Stored, unsigned vine_length = 0u);
+    // change the size and the memory of a chart that does not own its memory
+    void rebind(unsigned size, float* mem, SplitWeightsMode mode = SplitWeightsMode::Stored, unsigned vine_length = 0u);
+
     void zeros();
+    // set to zero the cells that are read before being written by the forward (resp. backward) pass,
+    // i.e. the base cases and the accumulators: the tensors are never initialized
+    void init_forward();
+    void init_backward();
 
-    static std::size_t required_memory(const unsigned size);
-    static unsigned required_cells(const unsigned size);
+    // number of items (i, i + length) that are built: with a vine, only the root has longer spans
+    inline unsigned n_spans(const unsigned length) const noexcept
+    {
+        return vine_length == 0u || length <= vine_length ? size - length : 1u;
+    }
+    // true if the items (i, j), i < j, are built, i.e. if the arcs between i and j are allowed
+    inline bool in_vine(const unsigned i, const unsigned j) const noexcept
+    {
+        return vine_length == 0u || i == 0u || j - i <= vine_length;
+    }
+    // first split k of the deduction of uleft(i, j) and uright(i, j), cleft(k + 1, j) must be built
+    inline unsigned u_first_split(const unsigned i, const unsigned j) const noexcept
+    {
+        return vine_length == 0u || j < i + vine_length + 1u ? i : j - vine_length - 1u;
+    }
+    // first split k of the deduction of cright(i, j), cright(k, j) must be built
+    inline unsigned cright_first_split(const unsigned i, const unsigned j) const noexcept
+    {
+        return vine_length == 0u || j < i + vine_length + 1u ? i + 1u : j - vine_length;
+    }
+
+    static std::size_t required_memory(const unsigned size, const SplitWeightsMode mode = SplitWeightsMode::Stored, const unsigned vine_length = 0u);
+    static std::size_t required_cells(const unsigned size, const SplitWeightsMode mode = SplitWeightsMode::Stored, const unsigned vine_length = 0u);
 };
 
 /*
@@ -44,11 +99,23 @@ struct AlgorithmicDifferentiableEisner
 {
     unsigned _size;
 
-    std::shared_ptr<EisnerChart> chart_forward;
-    std::shared_ptr<EisnerChart> chart_backward;
+    // charts allocated by the engine itself, if any
+    std::unique_ptr<EisnerChart> _owned_chart_forward;
+    std::unique_ptr<EisnerChart> _owned_chart_backward;
+
+    EisnerChart* chart_forward;
+    EisnerChart* chart_backward;
+
+    // arcs kept by a pruning stage, all arcs are used if it is a null pointer
+    const ArcPruning* pruning = nullptr;
+
+    // the backtracking skips the items whose contribution is below this threshold (0: nothing is skipped),
+    // the sum of the skipped contributions is reported in dropped_mass by the forward pass
+    float backtracking_threshold = 0.f;
+    float dropped_mass = 0.f;
 
-    explicit AlgorithmicDifferentiableEisner(const unsigned t_size);
-    AlgorithmicDifferentiableEisner(std::shared_ptr<EisnerChart> chart_forward, std::shared_ptr<EisnerChart> chart_backward);
+    explicit AlgorithmicDifferentiableEisner(const unsigned t_size, const SplitWeightsMode mode = SplitWeightsMode::Stored, const unsigned vine_length = 0u);
+    AlgorithmicDifferentiableEisner(EisnerChart* chart_forward, EisnerChart* chart_backward);
 
     template<class Functor>
     void forward(Functor&& weight_callback);
@@ -56,11 +123,13 @@ struct AlgorithmicDifferentiableEisner
     template<class Functor>
     void backward(Functor&& gradient_callback);
 
-    static void forward_maximize(std::shared_ptr<EisnerChart>& chart_forward);
-    static void forward_backtracking(std::shared_ptr<EisnerChart>& chart_forward);
+    static void forward_maximize(EisnerChart* chart_forward, const ArcPruning* pruning = nullptr);
+    // return the sum of the contributions of the skipped items
+    static float forward_backtracking(EisnerChart* chart_forward, const ArcPruning* pruning = nullptr, const float threshold = 0.f);
 
-    static void backward_maximize(std::shared_ptr<EisnerChart>& chart_forward, std::shared_ptr<EisnerChart>& chart_backward);
-    static void backward_backtracking(std::shared_ptr<EisnerChart>& chart_forward, std::shared_ptr<EisnerChart>& chart_backward);
+    static void backward_maximize(EisnerChart* chart_forward, EisnerChart* chart_backward, const ArcPruning* pruning = nullptr);
+    // the threshold must be the one of the forward pass: the same items are skipped
+    static void backward_backtracking(EisnerChart* chart_forward, EisnerChart* chart_backward, const ArcPruning* pruning = nullptr, const float threshold = 0.f);
 
     float output(const unsigned head, const unsigned mod) const;
     float gradient(const unsigned head, const unsigned mod) const;
@@ -79,12 +148,190 @@ struct EntropyRegularizedEisner
 {
     unsigned _size;
 
-    std::shared_ptr<EisnerChart> chart_forward;
-    std::shared_ptr<EisnerChart> chart_backward;
+    // charts allocated by the engine itself, if any
+    std::unique_ptr<EisnerChart> _owned_chart_forward;
+    std::unique_ptr<EisnerChart> _owned_chart_backward;
+
+    EisnerChart* chart_forward;
+    EisnerChart* chart_backward;
+
+    // arcs kept by a pruning stage, all arcs are used if it is a null pointer
+    const ArcPruning* pruning = nullptr;
+
+    explicit EntropyRegularizedEisner(const unsigned t_size, const SplitWeightsMode mode = SplitWeightsMode::Stored, const unsigned vine_length = 0u);
+    EntropyRegularizedEisner(EisnerChart* chart_forward, EisnerChart* chart_backward);
+
+
+    template<class Functor>
+    void forward(Functor&& weight_callback);
+
+    template<class Functor>
+    void backward(Functor&& gradient_callback);
+
+    static void forward_maximize(EisnerChart* chart_forward, const ArcPruning* pruning = nullptr);
+    static void forward_backtracking(EisnerChart* chart_forward, const ArcPruning* pruning = nullptr);
+
+    /*
+     * Exact samples of the distribution p(tree) ∝ exp(score(tree)) (forward-filtering, backward-sampling).
+     * The split distributions b_* of the forward chart are the distributions of the splits of each item
+     * conditionally on the item, so a tree is drawn by a stochastic backtracking from the root in O(n^2),
+     * without perturbation nor additional parse. forward must have been called.
+     */
+    // head of each word in heads[mod], heads[0] is set to 0
+    template<class Generator>
+    void sample(Generator& generator, unsigned* heads) const;
+    template<class Generator>
+    std::vector<std::vector<unsigned>> sample(Generator& generator, const unsigned n_samples) const;
+    // adjacency matrices stored one after the other, the arc (head, mod) of a sample is at head + mod * size
+    template<class Generator>
+    void sample_adjacency(Generator& generator, const unsigned n_samples, float* output) const;
+
+    // uniform() must return a value in [0, 1)
+    template<class Functor>
+    static void forward_sampling(EisnerChart* chart_forward, const ArcPruning* pruning, Functor&& uniform, unsigned* heads);
+
+    //static void backward_maximize(EisnerChart* chart_forward, EisnerChart* chart_backward);
+    //static void backward_backtracking(EisnerChart* chart_forward, EisnerChart* chart_backward);
+
+    float output(const unsigned head, const unsigned mod) const;
+    float gradient(const unsigned head, const unsigned mod) const;
+
+    /*
+     * The forward chart defines the distribution p(tree) ∝ exp(score(tree)) and output gives its arc marginals,
+     * so its entropy and the KL divergence to another arc-factored distribution q are closed forms:
+     *   H(p) = log Z_p - sum_a p(a) w_a
+     *   KL(p || q) = sum_a p(a) (w_a - v_a) - log Z_p + log Z_q
+     * Their gradients are backward passes of the same chart:
+     *   dH/dw = -backward(w), dKL/dw = backward(w - v) and dKL/dv = q(a) - p(a)
+     */
+    // log-partition of the trees, forward must have been called
+    float log_partition() const;
+    // sum_a p(a) w_a, weight_callback is called as in forward (but not for arcs with a null marginal)
+    template<class Functor>
+    float expected_score(Functor&& weight_callback) const;
+    // entropy of the distribution over trees, weight_callback must give the weights of the forward pass
+    template<class Functor>
+    float entropy(Functor&& weight_callback) const;
+
+    unsigned size() const;
+};
+
+
+/**
+ * Chart of the inside-outside algorithm: only the values and the contributions of the items are stored,
+ * so its memory is quadratic in the size of the sentence.
+ */
+struct InsideOutsideEisnerChart
+{
+    unsigned size;
+    std::size_t size_2d;
+    float* _memory = nullptr;
+    const bool _erase_memory;
+    // number of cells of the memory, bounds the size of the chart
+    std::size_t memory_cells;
+
+    // cells are read by rows and by columns
+    MirroredMatrix<float>
+        c_cleft, c_cright, c_uleft, c_uright,
+        soft_c_cleft, soft_c_cright, soft_c_uleft, soft_c_uright
+        ;
+    // log-partition of the shared split distribution of uleft(i, j) and uright(i, j), i.e. without the arc weight
+    MirroredMatrix<float> c_u;
+
+    explicit InsideOutsideEisnerChart(unsigned size);
+    InsideOutsideEisnerChart(unsigned size, float* mem);
+    ~InsideOutsideEisnerChart();
+
+    // change the size of the chart, reusing its memory (it must be large enough)
+    void resize(unsigned size);
+    // change the size and the memory of a chart that does not own its memory
+    void rebind(unsigned size, float* mem);
+
+    // set to zero the base cases and the accumulators, see EisnerChart
+    void init_forward();
+    void init_backward();
+
+    static std::size_t required_memory(const unsigned size);
+    static std::size_t required_cells(const unsigned size);
+};
+
+/*
+ * Same relaxation as EntropyRegularizedEisner, computed with the inside-outside algorithm:
+ * the arc marginals are computed by an outside pass over the inside values of the items,
+ * where the split distributions are recomputed instead of being stored.
+ * The backward pass is a second outside pass (the gradient of the marginals) followed by the backward of the inside pass.
+ * The memory is quadratic instead of cubic, at the cost of recomputing each split distribution three times.
+ */
+struct InsideOutsideEisner
+{
+    unsigned _size;
+
+    // charts allocated by the engine itself, if any
+    std::unique_ptr<InsideOutsideEisnerChart> _owned_chart_forward;
+    std::unique_ptr<InsideOutsideEisnerChart> _owned_chart_backward;
+
+    InsideOutsideEisnerChart* chart_forward;
+    InsideOutsideEisnerChart* chart_backward;
+
+    explicit InsideOutsideEisner(const unsigned t_size);
+    InsideOutsideEisner(InsideOutsideEisnerChart* chart_forward, InsideOutsideEisnerChart* chart_backward);
+
+    template<class Functor>
+    void forward(Functor&& weight_callback);
+
+    template<class Functor>
+    void backward(Functor&& gradient_callback);
+
+    // inside pass
+    static void forward_maximize(InsideOutsideEisnerChart* chart_forward);
+    // outside pass
+    static void forward_backtracking(InsideOutsideEisnerChart* chart_forward);
+
+    static void backward_maximize(InsideOutsideEisnerChart* chart_forward, InsideOutsideEisnerChart* chart_backward);
+    static void backward_backtracking(InsideOutsideEisnerChart* chart_forward, InsideOutsideEisnerChart* chart_backward);
+
+    float output(const unsigned head, const unsigned mod) const;
+    float gradient(const unsigned head, const unsigned mod) const;
+    // log-partition of the trees
+    float log_partition() const;
+
+    unsigned size() const;
+};
+
+
+// supports of the split distributions of a forward chart, see SparsemaxEisner
+struct EisnerSplitSupports
+{
+    SplitSupports cleft, cright, u;
+
+    void resize(const unsigned size);
+};
+
+/*
+ * Sparse variant of AlgorithmicDifferentiableEisner: the split distributions are computed with a sparsemax instead of a softmax.
+ * The backpointers are stored in the chart, and the positions of the non-zero ones in supports:
+ * the backtracking and the backward pass only visit these positions,
+ * so their cost is proportional to the active structure instead of cubic.
+ */
+struct SparsemaxEisner
+{
+    unsigned _size;
+
+    // charts allocated by the engine itself, if any
+    std::unique_ptr<EisnerChart> _owned_chart_forward;
+    std::unique_ptr<EisnerChart> _owned_chart_backward;
+
+    EisnerChart* chart_forward;
+    EisnerChart* chart_backward;
 
-    explicit EntropyRegularizedEisner(const unsigned t_size);
-    EntropyRegularizedEisner(std::shared_ptr<EisnerChart> chart_forward, std::shared_ptr<EisnerChart> chart_backward);
+    // non-zero backpointers of chart_forward, set by the forward pass
+    EisnerSplitSupports supports;
 
+    // arcs kept by a pruning stage, all arcs are used if it is a null pointer
+    const ArcPruning* pruning = nullptr;
+
+    explicit SparsemaxEisner(const unsigned t_size, const SplitWeightsMode mode = SplitWeightsMode::Stored);
+    SparsemaxEisner(EisnerChart* chart_forward, EisnerChart* chart_backward);
 
     template<class Functor>
     void forward(Functor&& weight_callback);
@@ -92,11 +339,11 @@ struct EntropyRegularizedEisner
     template<class Functor>
     void backward(Functor&& gradient_callback);
 
-    static void forward_maximize(std::shared_ptr<EisnerChart>& chart_forward);
-    static void forward_backtracking(std::shared_ptr<EisnerChart>& chart_forward);
+    static void forward_maximize(EisnerChart* chart_forward, EisnerSplitSupports* supports, const ArcPruning* pruning = nullptr);
+    static void forward_backtracking(EisnerChart* chart_forward, const EisnerSplitSupports* supports);
 
-    //static void backward_maximize(std::shared_ptr<EisnerChart>& chart_forward, std::shared_ptr<EisnerChart>& chart_backward);
-    //static void backward_backtracking(std::shared_ptr<EisnerChart>& chart_forward, std::shared_ptr<EisnerChart>& chart_backward);
+    static void backward_maximize(EisnerChart* chart_forward, EisnerChart* chart_backward, const EisnerSplitSupports* supports);
+    static void backward_backtracking(EisnerChart* chart_forward, EisnerChart* chart_backward, const EisnerSplitSupports* supports);
 
     float output(const unsigned head, const unsigned mod) const;
     float gradient(const unsigned head, const unsigned mod) const;
@@ -105,6 +352,67 @@ struct EntropyRegularizedEisner
 };
 
 
+/**
+ * Chart of the Viterbi algorithm: item scores and the position of their best split.
+ * Its memory is quadratic in the size of the sentence.
+ */
+struct ViterbiEisnerChart
+{
+    unsigned size;
+    // number of cells of each matrix, bounds the size of the chart
+    std::size_t memory_cells;
+    std::unique_ptr<float[]> _scores;
+    std::unique_ptr<unsigned[]> _splits;
+
+    // cells are read by rows and by columns
+    MirroredMatrix<float> c_cleft, c_cright, c_uleft, c_uright;
+    // uleft(i, j) and uright(i, j) share their best split
+    Matrix<unsigned> s_cleft, s_cright, s_u;
+
+    // head of each word in the best tree, the root has no head
+    std::vector<unsigned> heads;
+
+    explicit ViterbiEisnerChart(unsigned size);
+
+    // change the size of the chart, reusing its memory (it must be large enough)
+    void resize(unsigned size);
+
+    static std::size_t required_memory(const unsigned size);
+    static std::size_t required_cells(const unsigned size);
+};
+
+/*
+ * Discrete Eisner algorithm: returns the highest scoring projective tree.
+ * There is no backward pass, this is used for decoding.
+ */
+struct ViterbiEisner
+{
+    unsigned _size;
+
+    // chart allocated by the engine itself, if any
+    std::unique_ptr<ViterbiEisnerChart> _owned_chart;
+
+    ViterbiEisnerChart* chart;
+
+    explicit ViterbiEisner(const unsigned t_size);
+    explicit ViterbiEisner(ViterbiEisnerChart* chart);
+
+    template<class Functor>
+    void forward(Functor&& weight_callback);
+
+    static void forward_maximize(ViterbiEisnerChart* chart);
+    static void forward_backtracking(ViterbiEisnerChart* chart);
+
+    // 1 if the arc is in the best tree, 0 otherwise
+    float output(const unsigned head, const unsigned mod) const;
+    unsigned head(const unsigned mod) const;
+    // score of the best tree
+    float score() const;
+
+    unsigned size() const;
+};
+
+
 // templates implementations
 
 template<class Functor>
@@ -112,11 +420,15 @@ void AlgorithmicDifferentiableEisner::forward(Functor&& weight_callback)
 {
     const unsigned size = chart_forward->size;
 
-    chart_forward->zeros(); // we could skip some zeros here
+    chart_forward->init_forward();
     for (unsigned i = 0; i < size; ++i)
     {
         for (unsigned j = 1; j < size; ++j)
         {
+            // arcs outside the vine have no item
+            if (i != j && !chart_forward->in_vine(std::min(i, j), std::max(i, j)))
+                continue;
+
             if (i < j)
                 chart_forward->c_uright(i, j) = weight_callback(i, j);
             else if (j < i)
@@ -124,8 +436,8 @@ void AlgorithmicDifferentiableEisner::forward(Functor&& weight_callback)
         }
     }
 
-    AlgorithmicDifferentiableEisner::forward_maximize(chart_forward);
-    AlgorithmicDifferentiableEisner::forward_backtracking(chart_forward);
+    AlgorithmicDifferentiableEisner::forward_maximize(chart_forward, pruning);
+    dropped_mass = AlgorithmicDifferentiableEisner::forward_backtracking(chart_forward, pruning, backtracking_threshold);
 }
 
 template<class Functor>
@@ -133,11 +445,15 @@ void AlgorithmicDifferentiableEisner::backward(Functor&& gradient_callback)
 {
     const unsigned size = chart_forward->size;
 
-    chart_backward->zeros();
+    chart_backward->init_backward();
     for (unsigned i = 0; i < size; ++i)
     {
         for (unsigned j = 1; j < size; ++j)
         {
+            // arcs outside the vine have no item
+            if (i != j && !chart_forward->in_vine(std::min(i, j), std::max(i, j)))
+                continue;
+
             if (i < j)
                 chart_backward->soft_c_uright(i, j) = gradient_callback(i, j);
             else if (j < i)
@@ -145,8 +461,92 @@ void AlgorithmicDifferentiableEisner::backward(Functor&& gradient_callback)
         }
     }
 
-    AlgorithmicDifferentiableEisner::backward_backtracking(chart_forward, chart_backward);
-    AlgorithmicDifferentiableEisner::backward_maximize(chart_forward, chart_backward);
+    AlgorithmicDifferentiableEisner::backward_backtracking(chart_forward, chart_backward, pruning, backtracking_threshold);
+    AlgorithmicDifferentiableEisner::backward_maximize(chart_forward, chart_backward, pruning);
+}
+
+template<class Functor>
+void InsideOutsideEisner::forward(Functor&& weight_callback)
+{
+    const unsigned size = chart_forward->size;
+
+    chart_forward->init_forward();
+    for (unsigned i = 0; i < size; ++i)
+    {
+        for (unsigned j = 1; j < size; ++j)
+        {
+            if (i < j)
+                chart_forward->c_uright(i, j) = weight_callback(i, j);
+            else if (j < i)
+                chart_forward->c_uleft(j, i) = weight_callback(i, j);
+        }
+    }
+
+    InsideOutsideEisner::forward_maximize(chart_forward);
+    InsideOutsideEisner::forward_backtracking(chart_forward);
+}
+
+template<class Functor>
+void InsideOutsideEisner::backward(Functor&& gradient_callback)
+{
+    const unsigned size = chart_forward->size;
+
+    chart_backward->init_backward();
+    for (unsigned i = 0; i < size; ++i)
+    {
+        for (unsigned j = 1; j < size; ++j)
+        {
+            if (i < j)
+                chart_backward->soft_c_uright(i, j) = gradient_callback(i, j);
+            else if (j < i)
+                chart_backward->soft_c_uleft(j, i) = gradient_callback(i, j);
+        }
+    }
+
+    InsideOutsideEisner::backward_backtracking(chart_forward, chart_backward);
+    InsideOutsideEisner::backward_maximize(chart_forward, chart_backward);
+}
+
+template<class Functor>
+void SparsemaxEisner::forward(Functor&& weight_callback)
+{
+    const unsigned size = chart_forward->size;
+
+    chart_forward->init_forward();
+    for (unsigned i = 0; i < size; ++i)
+    {
+        for (unsigned j = 1; j < size; ++j)
+        {
+            if (i < j)
+                chart_forward->c_uright(i, j) = weight_callback(i, j);
+            else if (j < i)
+                chart_forward->c_uleft(j, i) = weight_callback(i, j);
+        }
+    }
+
+    SparsemaxEisner::forward_maximize(chart_forward, &supports, pruning);
+    SparsemaxEisner::forward_backtracking(chart_forward, &supports);
+}
+
+template<class Functor>
+void SparsemaxEisner::backward(Functor&& gradient_callback)
+{
+    const unsigned size = chart_forward->size;
+
+    chart_backward->init_backward();
+    for (unsigned i = 0; i < size; ++i)
+    {
+        for (unsigned j = 1; j < size; ++j)
+        {
+            if (i < j)
+                chart_backward->soft_c_uright(i, j) = gradient_callback(i, j);
+            else if (j < i)
+                chart_backward->soft_c_uleft(j, i) = gradient_callback(i, j);
+        }
+    }
+
+    SparsemaxEisner::backward_backtracking(chart_forward, chart_backward, &supports);
+    SparsemaxEisner::backward_maximize(chart_forward, chart_backward, &supports);
 }
 
 template<class Functor>
@@ -154,12 +554,15 @@ void EntropyRegularizedEisner::forward(Functor&& weight_callback)
 {
     const unsigned size = chart_forward->size;
 
-    // this initialization seems ok, but check why it works!
-    chart_forward->zeros(); // we could skip some zeros here
+    chart_forward->init_forward();
     for (unsigned i = 0; i < size; ++i)
     {
         for (unsigned j = 1; j < size; ++j)
         {
+            // arcs outside the vine have no item
+            if (i != j && !chart_forward->in_vine(std::min(i, j), std::max(i, j)))
+                continue;
+
             if (i < j)
                 chart_forward->c_uright(i, j) = weight_callback(i, j);
             else if (j < i)
@@ -167,8 +570,8 @@ void EntropyRegularizedEisner::forward(Functor&& weight_callback)
         }
     }
 
-    EntropyRegularizedEisner::forward_maximize(chart_forward);
-    EntropyRegularizedEisner::forward_backtracking(chart_forward);
+    EntropyRegularizedEisner::forward_maximize(chart_forward, pruning);
+    EntropyRegularizedEisner::forward_backtracking(chart_forward, pruning);
 }
 
 template<class Functor>
@@ -176,12 +579,15 @@ void EntropyRegularizedEisner::backward(Functor&& gradient_callback)
 {
     const unsigned size = chart_forward->size;
 
-    // check if this init is correct
-    chart_backward->zeros();
+    chart_backward->init_backward();
     for (unsigned i = 0; i < size; ++i)
     {
         for (unsigned j = 1; j < size; ++j)
         {
+            // arcs outside the vine have no item
+            if (i != j && !chart_forward->in_vine(std::min(i, j), std::max(i, j)))
+                continue;
+
             if (i < j)
                 chart_backward->soft_c_uright(i, j) = gradient_callback(i, j);
             else if (j < i)
@@ -189,39 +595,42 @@ void EntropyRegularizedEisner::backward(Functor&& gradient_callback)
         }
     }
 
-    // backpropagate throught backtracking
+    const unsigned n_threads = wavefront_num_threads(size);
+
+    // backpropagate throught backtracking,
+    // see AlgorithmicDifferentiableEisner for the use of the mirrored matrices
+    #pragma omp parallel num_threads(n_threads) if(n_threads > 1u)
     for (unsigned l = 1; l < size ; ++l)
     {
-        for (unsigned i = 0; i < size - l; ++i)
+        // spans of the same length only write their own gradients
+        #pragma omp for schedule(static)
+        for (unsigned i = 0; i < chart_forward->n_spans(l); ++i)
         {
             unsigned j = i + l;
+            const unsigned u_first = chart_forward->u_first_split(i, j);
+            const unsigned cright_first = chart_forward->cright_first_split(i, j);
 
-            if (i > 0u)
-            {
-                diffdp::backward_backtracking(
-                        chart_forward->soft_c_cright.iter2(i, i), chart_forward->soft_c_cleft.iter1(i + 1, j),
-                        chart_forward->soft_c_uleft(i, j),
-                        chart_forward->b_uleft.iter3(i, j, i),
-
-                        chart_backward->soft_c_cright.iter2(i, i), chart_backward->soft_c_cleft.iter1(i + 1, j),
-                        &chart_backward->soft_c_uleft(i, j),
-                        chart_backward->b_uleft.iter3(i, j, i),
-
-                        l
-                );
-            }
-
+            // shared split distribution of uleft(i, j) and uright(i, j):
+            // both items receive the same gradient
+            float gradient_u = 0.f;
             diffdp::backward_backtracking(
-                    chart_forward->soft_c_cright.iter2(i, i), chart_forward->soft_c_cleft.iter1(i + 1, j),
-                    chart_forward->soft_c_uright(i, j),
-                    chart_forward->b_uright.iter3(i, j, i),
+                    chart_forward->soft_c_cright.iter2(i, u_first), chart_forward->soft_c_cleft.iter1(u_first + 1, j),
+                    chart_forward->soft_c_uright(i, j) + (i > 0u ? chart_forward->soft_c_uleft(i, j) : 0.f),
+                    chart_forward->b_u.iter3(i, j, u_first),
 
-                    chart_backward->soft_c_cright.iter2(i, i), chart_backward->soft_c_cleft.iter1(i + 1, j),
-                    &chart_backward->soft_c_uright(i, j),
-                    chart_backward->b_uright.iter3(i, j, i),
+                    chart_backward->soft_c_cright.iter2(i, u_first), chart_backward->soft_c_cleft.iter1(u_first + 1, j),
+                    &gradient_u,
+                    chart_backward->b_u.iter3(i, j, u_first),
 
-                    l
+                    incomplete_splits(pruning, i, j, u_first)
             );
+            chart_backward->soft_c_uright(i, j) += gradient_u;
+            chart_backward->soft_c_uright.mirror(i, j);
+            if (i > 0u)
+            {
+                chart_backward->soft_c_uleft(i, j) += gradient_u;
+                chart_backward->soft_c_uleft.mirror(i, j);
+            }
 
             if (i > 0u)
             {
@@ -234,92 +643,214 @@ void EntropyRegularizedEisner::backward(Functor&& gradient_callback)
                         &chart_backward->soft_c_cleft(i, j),
                         chart_backward->b_cleft.iter3(i, j, i),
 
-                        l
+                        cleft_splits(pruning, i, j)
                 );
+                chart_backward->soft_c_cleft.mirror(i, j);
             }
 
             diffdp::backward_backtracking(
-                    chart_forward->soft_c_uright.iter2(i, i+1), chart_forward->soft_c_cright.iter1(i+1, j),
+                    chart_forward->soft_c_uright.iter2(i, cright_first), chart_forward->soft_c_cright.iter1(cright_first, j),
                     chart_forward->soft_c_cright(i, j),
-                    chart_forward->b_cright.iter3(i, j, i + 1),
+                    chart_forward->b_cright.iter3(i, j, cright_first),
 
-                    chart_backward->soft_c_uright.iter2(i, i+1), chart_backward->soft_c_cright.iter1(i+1, j),
+                    chart_backward->soft_c_uright.iter2(i, cright_first), chart_backward->soft_c_cright.iter1(cright_first, j),
                     &chart_backward->soft_c_cright(i, j),
-                    chart_backward->b_cright.iter3(i, j, i + 1),
+                    chart_backward->b_cright.iter3(i, j, cright_first),
 
-                    l
+                    cright_splits(pruning, i, j, cright_first)
             );
+            chart_backward->soft_c_cright.mirror(i, j);
         }
     }
-    for (unsigned l = size - 1; l >= 1; --l)
+    #pragma omp parallel num_threads(n_threads) if(n_threads > 1u)
     {
-        for (unsigned i = 0; i < size - l; ++i)
+        // gradient of the split weights of the current deduction, if they are not stored in the chart
+        std::vector<float> buffer(chart_backward->split_weights_mode == SplitWeightsMode::Stored ? 0u : size);
+        for (unsigned l = size - 1; l >= 1; --l)
         {
-            unsigned j = i + l;
-
-            if (i > 0u)
+            #pragma omp for schedule(static)
+            for (unsigned i = 0; i < chart_forward->n_spans(l); ++i)
             {
+                unsigned j = i + l;
+                const unsigned u_first = chart_forward->u_first_split(i, j);
+                const unsigned cright_first = chart_forward->cright_first_split(i, j);
+
+                if (i > 0u)
+                {
+                    backward_entropy_reg(
+                            chart_forward->c_cleft.iter2(i, i), chart_forward->c_uleft.iter1(i, j),
+                            chart_forward->a_cleft.iter3_or(i, j, i, nullptr),
+                            chart_forward->b_cleft.iter3(i, j, i),
+
+                            chart_backward->c_cleft.iter2(i, i), chart_backward->c_uleft.iter1(i, j),
+                            chart_backward->c_cleft.fold(i, j),
+                            chart_backward->a_cleft.iter3_or(i, j, i, buffer.data()),
+                            chart_backward->b_cleft.iter3(i, j, i),
+
+                            cleft_splits(pruning, i, j)
+                    );
+                }
+
                 backward_entropy_reg(
-                        chart_forward->c_cleft.iter2(i, i), chart_forward->c_uleft.iter1(i, j),
-                        chart_forward->a_cleft.iter3(i, j, i),
-                        chart_forward->b_cleft.iter3(i, j, i),
+                        chart_forward->c_uright.iter2(i, cright_first), chart_forward->c_cright.iter1(cright_first, j),
+                        chart_forward->a_cright.iter3_or(i, j, cright_first, nullptr),
+                        chart_forward->b_cright.iter3(i, j, cright_first),
 
-                        chart_backward->c_cleft.iter2(i, i), chart_backward->c_uleft.iter1(i, j),
-                        chart_backward->c_cleft(i, j),
-                        chart_backward->a_cleft.iter3(i, j, i),
-                        chart_backward->b_cleft.iter3(i, j, i),
+                        chart_backward->c_uright.iter2(i, cright_first), chart_backward->c_cright.iter1(cright_first, j),
+                        chart_backward->c_cright.fold(i, j),
+                        chart_backward->a_cright.iter3_or(i, j, cright_first, buffer.data()),
+                        chart_backward->b_cright.iter3(i, j, cright_first),
+
+                        cright_splits(pruning, i, j, cright_first)
+                );
+
+                // shared split distribution of uleft(i, j) and uright(i, j):
+                // the backward pass is linear in the incoming gradient so we can sum them
+                backward_entropy_reg(
+                        chart_forward->c_cright.iter2(i, u_first), chart_forward->c_cleft.iter1(u_first + 1, j),
+                        chart_forward->a_u.iter3_or(i, j, u_first, nullptr),
+                        chart_forward->b_u.iter3(i, j, u_first),
+
+                        chart_backward->c_cright.iter2(i, u_first), chart_backward->c_cleft.iter1(u_first + 1, j),
+                        chart_backward->c_uright.fold(i, j) + (i > 0u ? chart_backward->c_uleft.fold(i, j) : 0.f),
+                        chart_backward->a_u.iter3_or(i, j, u_first, buffer.data()),
+                        chart_backward->b_u.iter3(i, j, u_first),
 
-                        l
+                        incomplete_splits(pruning, i, j, u_first)
                 );
             }
+        }
+    }
+}
 
-            backward_entropy_reg(
-                    chart_forward->c_uright.iter2(i, i + 1), chart_forward->c_cright.iter1(i + 1, j),
-                    chart_forward->a_cright.iter3(i, j, i + 1),
-                    chart_forward->b_cright.iter3(i, j, i + 1),
+template<class Functor>
+float EntropyRegularizedEisner::expected_score(Functor&& weight_callback) const
+{
+    float score = 0.f;
+    for (unsigned head = 0u; head < _size; ++head)
+    {
+        for (unsigned mod = 1u; mod < _size; ++mod)
+        {
+            // masked arcs (-inf weight) have a null marginal and do not contribute
+            const float marginal = (head == mod ? 0.f : output(head, mod));
+            if (marginal > 0.f)
+                score += marginal * weight_callback(head, mod);
+        }
+    }
+    return score;
+}
 
-                    chart_backward->c_uright.iter2(i, i + 1), chart_backward->c_cright.iter1(i + 1, j),
-                    chart_backward->c_cright(i, j),
-                    chart_backward->a_cright.iter3(i, j, i + 1),
-                    chart_backward->b_cright.iter3(i, j, i + 1),
+template<class Functor>
+float EntropyRegularizedEisner::entropy(Functor&& weight_callback) const
+{
+    return log_partition() - expected_score(weight_callback);
+}
 
-                    l
-            );
+template<class Generator>
+void EntropyRegularizedEisner::sample(Generator& generator, unsigned* heads) const
+{
+    std::uniform_real_distribution<float> distribution(0.f, 1.f);
+    EntropyRegularizedEisner::forward_sampling(chart_forward, pruning, [&] () { return distribution(generator); }, heads);
+}
 
-            if (i > 0u)
-            {
-                backward_entropy_reg(
-                        chart_forward->c_cright.iter2(i, i), chart_forward->c_cleft.iter1(i + 1, j),
-                        chart_forward->a_uleft.iter3(i, j, i),
-                        chart_forward->b_uleft.iter3(i, j, i),
+template<class Generator>
+std::vector<std::vector<unsigned>> EntropyRegularizedEisner::sample(Generator& generator, const unsigned n_samples) const
+{
+    std::vector<std::vector<unsigned>> samples(n_samples, std::vector<unsigned>(_size));
+    for (auto& heads : samples)
+        sample(generator, heads.data());
+    return samples;
+}
 
-                        chart_backward->c_cright.iter2(i, i), chart_backward->c_cleft.iter1(i + 1, j),
-                        chart_backward->c_uleft(i, j),
-                        chart_backward->a_uleft.iter3(i, j, i),
-                        chart_backward->b_uleft.iter3(i, j, i),
+template<class Generator>
+void EntropyRegularizedEisner::sample_adjacency(Generator& generator, const unsigned n_samples, float* output) const
+{
+    std::vector<unsigned> heads(_size);
+    for (unsigned s = 0u; s < n_samples; ++s)
+    {
+        float* adjacency = output + s * _size * _size;
+        std::fill_n(adjacency, _size * _size, 0.f);
+        sample(generator, heads.data());
+        for (unsigned mod = 1u; mod < _size; ++mod)
+            adjacency[heads[mod] + mod * _size] = 1.f;
+    }
+}
 
-                        l
-                );
-            }
+template<class Functor>
+void EntropyRegularizedEisner::forward_sampling(EisnerChart* chart_forward, const ArcPruning* pruning, Functor&& uniform, unsigned* heads)
+{
+    const unsigned size = chart_forward->size;
 
-            backward_entropy_reg(
-                    chart_forward->c_cright.iter2(i, i), chart_forward->c_cleft.iter1(i + 1, j),
-                    chart_forward->a_uright.iter3(i, j, i),
-                    chart_forward->b_uright.iter3(i, j, i),
+    enum struct Item { CLeft, CRight, ULeft, URight };
+    struct Span { Item item; unsigned i, j; };
 
-                    chart_backward->c_cright.iter2(i, i), chart_backward->c_cleft.iter1(i + 1, j),
-                    chart_backward->c_uright(i, j),
-                    chart_backward->a_uright.iter3(i, j, i),
-                    chart_backward->b_uright.iter3(i, j, i),
+    std::fill_n(heads, size, 0u);
+    if (size <= 1u)
+        return;
 
-                    l
-            );
+    // same traversal as ViterbiEisner::forward_backtracking,
+    // with splits drawn from the split distributions instead of the best splits
+    std::vector<Span> stack{{Item::CRight, 0u, size - 1u}};
+    while (!stack.empty())
+    {
+        const Span span = stack.back();
+        stack.pop_back();
+        const unsigned i = span.i;
+        const unsigned j = span.j;
+        // complete items of length 0 have no antecedent
+        if (i == j)
+            continue;
+
+        if (span.item == Item::CRight)
+        {
+            const unsigned first = chart_forward->cright_first_split(i, j);
+            const unsigned k = first + sample_split(chart_forward->b_cright.iter3(i, j, first), uniform(), cright_splits(pruning, i, j, first));
+            stack.push_back({Item::URight, i, k});
+            stack.push_back({Item::CRight, k, j});
+        }
+        else if (span.item == Item::CLeft)
+        {
+            const unsigned k = i + sample_split(chart_forward->b_cleft.iter3(i, j, i), uniform(), cleft_splits(pruning, i, j));
+            stack.push_back({Item::CLeft, i, k});
+            stack.push_back({Item::ULeft, k, j});
+        }
+        else
+        {
+            if (span.item == Item::URight)
+                heads[j] = i;
+            else
+                heads[i] = j;
+
+            const unsigned first = chart_forward->u_first_split(i, j);
+            const unsigned k = first + sample_split(chart_forward->b_u.iter3(i, j, first), uniform(), incomplete_splits(pruning, i, j, first));
+            stack.push_back({Item::CRight, i, k});
+            stack.push_back({Item::CLeft, k + 1u, j});
         }
     }
 }
 
+template<class Functor>
+void ViterbiEisner::forward(Functor&& weight_callback)
+{
+    const unsigned size = chart->size;
 
+    // complete items of length 0
+    chart->c_cleft.zeros_diagonal();
+    chart->c_cright.zeros_diagonal();
+    for (unsigned i = 0; i < size; ++i)
+    {
+        for (unsigned j = 1; j < size; ++j)
+        {
+            if (i < j)
+                chart->c_uright(i, j) = weight_callback(i, j);
+            else if (j < i)
+                chart->c_uleft(j, i) = weight_callback(i, j);
+        }
+    }
 
-
+    ViterbiEisner::forward_maximize(chart);
+    ViterbiEisner::forward_backtracking(chart);
 }
 
+
+}
@@ -0,0 +1,111 @@
+#pragma once
+
+/**
+ * Pruning of the arcs of the Eisner algorithm.
+ *
+ * Arcs are pruned before running a relaxed Eisner algorithm:
+ * the deductions of the incomplete items of pruned arcs are skipped,
+ * and the deductions of complete items only use the splits whose incomplete antecedent is kept.
+ * With k heads per modifier, the cost of a sentence of size n is O(k n^2) instead of O(n^3).
+ * The output and the gradient of a pruned arc are exactly zero.
+ *
+ * The arcs between adjacent words are always kept:
+ * every complete item can then be built, so the chart always contains a tree.
+ */
+
+#include <algorithm>
+#include <limits>
+#include <utility>
+#include <vector>
+
+#include "diffdp/deduction_operations.h"
+
+namespace diffdp
+{
+
+struct PruningSettings
+{
+    // keep the top_k heads with the highest weights for each modifier (0: no limit)
+    unsigned top_k = 0u;
+    // keep the heads whose weight is at most margin below the best head of the modifier
+    float margin = std::numeric_limits<float>::infinity();
+    // keep all the arcs of the root: with a vine (see EisnerChart), the arcs between adjacent words
+    // are not enough to build a tree, but attaching every word to the root always is
+    bool keep_root_arcs = false;
+
+    bool enabled() const;
+};
+
+struct ArcPruning
+{
+    unsigned size = 0u;
+    // kept(head, mod), stored at head * size + mod
+    std::vector<char> _kept;
+    // kept modifiers of each head, on its left and on its right, in increasing order
+    std::vector<std::vector<unsigned>> left_modifiers, right_modifiers;
+
+    /**
+     * Select the arcs to keep, the memory of a previous call is reused.
+     *
+     * @param size Size of the sentence, including the root
+     * @param settings Pruning criteria
+     * @param weight_callback Weight of an arc, called as weight_callback(head, mod)
+     */
+    template<class Functor>
+    void build(const unsigned size, const PruningSettings& settings, Functor&& weight_callback);
+
+    bool kept(const unsigned head, const unsigned mod) const;
+
+    // build the lists of modifiers once _kept is set
+    void _update_modifiers();
+};
+
+/*
+ * Splits of the deductions of the chart, all of them if pruning is a null pointer
+ */
+Splits incomplete_splits(const ArcPruning* pruning, const unsigned i, const unsigned j);
+Splits cright_splits(const ArcPruning* pruning, const unsigned i, const unsigned j);
+Splits cleft_splits(const ArcPruning* pruning, const unsigned i, const unsigned j);
+// same, when the splits before first cannot be used (vine parsing, see EisnerChart)
+Splits incomplete_splits(const ArcPruning* pruning, const unsigned i, const unsigned j, const unsigned first);
+Splits cright_splits(const ArcPruning* pruning, const unsigned i, const unsigned j, const unsigned first);
+
+
+// templates implementations
+
+template<class Functor>
+void ArcPruning::build(const unsigned t_size, const PruningSettings& settings, Functor&& weight_callback)
+{
+    size = t_size;
+    _kept.assign(size * size, 0);
+
+    std::vector<std::pair<float, unsigned>> heads;
+    for (unsigned mod = 1u; mod < size; ++mod)
+    {
+        heads.clear();
+        for (unsigned head = 0u; head < size; ++head)
+            if (head != mod)
+                heads.emplace_back(weight_callback(head, mod), head);
+
+        // best heads first
+        unsigned n_kept = (settings.top_k == 0u ? heads.size() : std::min<unsigned>(settings.top_k, heads.size()));
+        std::partial_sort(
+                heads.begin(), heads.begin() + n_kept, heads.end(),
+                [] (const std::pair<float, unsigned>& a, const std::pair<float, unsigned>& b) { return a.first > b.first; }
+        );
+        while (n_kept > 1u && heads[n_kept - 1u].first < heads[0u].first - settings.margin)
+            --n_kept;
+
+        for (unsigned h = 0u; h < n_kept; ++h)
+            _kept[heads[h].second * size + mod] = 1;
+        _kept[(mod - 1u) * size + mod] = 1;
+        if (settings.keep_root_arcs)
+            _kept[mod] = 1;
+        if (mod + 1u < size)
+            _kept[(mod + 1u) * size + mod] = 1;
+    }
+
+    _update_modifiers();
+}
+
+}
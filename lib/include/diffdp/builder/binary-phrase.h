@@ -1,6 +1,8 @@
 #pragma once
 
 #include "dynet/expr.h"
+#include "diffdp/chart.h"
+#include "diffdp/random.h"
 
 namespace diffdp
 {
@@ -15,6 +17,11 @@ struct BinaryPhraseSettings
 {
     BinaryPhraseType type = BinaryPhraseType::AlgDiff;
     bool perturb = false;
+    // Recomputed saves memory
+    SplitWeightsMode split_weights_mode = SplitWeightsMode::Stored;
+    // maximum length of the constituents below the top-level right-branching spine, 0 if unbounded.
+    // The argmax is not bounded
+    unsigned max_span_length = 0u;
 };
 
 struct BinaryPhraseBuilder
@@ -27,6 +34,12 @@ struct BinaryPhraseBuilder
 
     void new_graph(dynet::ComputationGraph& cg, bool training);
     dynet::Expression relaxed(const dynet::Expression& weights);
+    /**
+     * Relaxed structures of n_samples perturbations of the weights, computed by a single node.
+     * The output is batched: element s * B + b is the sample s of the batch element b of weights.
+     * Samples only differ if the weights are perturbed (see BinaryPhraseSettings::perturb).
+     */
+    dynet::Expression relaxed_samples(const dynet::Expression& weights, unsigned n_samples);
     dynet::Expression argmax(const dynet::Expression& weights);
 
     dynet::Expression relaxed_alg_diff(const dynet::Expression& weights);
@@ -36,6 +49,11 @@ protected:
      * Perturb arc if training mode and setting.perturb == true
      */
     dynet::Expression perturb(const dynet::Expression& arc_weights);
+    /**
+     * Noise drawn by the parsing nodes when they read the weights, enabled in the same cases as perturb.
+     * The dynamic programs use it instead of perturb: the perturbed weights are never stored in the graph
+     */
+    GumbelPerturbation perturbation();
 };
 
 }
\ No newline at end of file
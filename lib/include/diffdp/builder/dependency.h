@@ -1,6 +1,12 @@
 #pragma once
 
+#include <memory>
+#include <vector>
+
 #include "dynet/expr.h"
+#include "diffdp/chart.h"
+#include "diffdp/random.h"
+#include "diffdp/algorithm/pruning.h"
 
 namespace diffdp
 {
@@ -17,6 +23,16 @@ struct DependencySettings
 {
     DependencyType type = DependencyType::Head;
     bool perturb = false;
+    // Recomputed saves memory in projective parsers
+    SplitWeightsMode split_weights_mode = SplitWeightsMode::Stored;
+    // arc pruning of projective parsers, disabled by default
+    PruningSettings pruning;
+    // maximum length of the arcs between words of projective relaxations (vine parsing), 0 if unbounded.
+    // The argmax is not bounded
+    unsigned vine_length = 0u;
+    // ProjectiveEntropyReg is computed with the inside-outside algorithm, whose memory is quadratic instead of cubic.
+    // The split weights mode is not used, pruning and vine parsing are not supported
+    bool inside_outside = false;
 };
 
 struct DependencyBuilder
@@ -24,11 +40,19 @@ struct DependencyBuilder
     const DependencySettings settings;
     dynet::ComputationGraph* _cg;
     bool _training = true;
+    // sizes of the repeated batches of relaxed_samples, they must live as long as the computation graph
+    std::vector<std::unique_ptr<std::vector<unsigned>>> _sample_sizes;
 
     DependencyBuilder(const DependencySettings& settings);
 
     void new_graph(dynet::ComputationGraph& cg, bool training);
     dynet::Expression relaxed(const dynet::Expression& arc_weights, std::vector<unsigned>* sizes = nullptr, dynet::Expression* e_mask = nullptr);
+    /**
+     * Relaxed structures of n_samples perturbations of the weights, computed by a single node.
+     * The output is batched: element s * B + b is the sample s of the batch element b of arc_weights.
+     * Samples only differ if the weights are perturbed (see DependencySettings::perturb).
+     */
+    dynet::Expression relaxed_samples(const dynet::Expression& arc_weights, unsigned n_samples, std::vector<unsigned>* sizes = nullptr, dynet::Expression* e_mask = nullptr);
 
     dynet::Expression relaxed_head(const dynet::Expression& arc_weights, dynet::Expression* e_mask = nullptr);
     dynet::Expression relaxed_nonprojective(const dynet::Expression& arc_weights, std::vector<unsigned>* sizes = nullptr);
@@ -46,6 +70,11 @@ protected:
      * Perturb arc if training mode and setting.perturb == true
      */
     dynet::Expression perturb(const dynet::Expression& arc_weights);
+    /**
+     * Noise drawn by the parsing nodes when they read the weights, enabled in the same cases as perturb.
+     * The dynamic programs use it instead of perturb: the perturbed weights are never stored in the graph
+     */
+    GumbelPerturbation perturbation();
 };
 
 }
\ No newline at end of file
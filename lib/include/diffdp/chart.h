@@ -1,10 +1,24 @@
 #pragma once
 
+#include <algorithm>
+#include <cstddef>
 #include <vector>
 
 namespace diffdp
 {
 
+/**
+ * Storage of the split weights of the deduction rules, i.e. the sums of the antecedents before the softmax.
+ * - Stored: they are kept in the chart for the backward pass
+ * - Recomputed: they are rebuilt from the item values in the backward pass (one extra sum per deduction),
+ *   the cubic tensors of split weights are not allocated, which halves the memory of a chart
+ */
+enum struct SplitWeightsMode
+{
+    Stored,
+    Recomputed
+};
+
 template<class T>
 struct Tensor3D
 {
@@ -26,6 +40,52 @@ struct Tensor3D
     T* iter3(const unsigned i, const unsigned j, const unsigned k) noexcept;
 };
 
+/**
+ * Packed storage of a chart indexed by spans.
+ *
+ * Only cells (i, j, k) with i < j and i <= k <= j are stored,
+ * which is the part of the cube used by the deduction rules.
+ * Spans are stored by increasing length, and for a given span
+ * the cells k = i, ..., j are contiguous.
+ * The required memory is roughly size^3 / 6 instead of size^3.
+ *
+ * With a band (vine parsing, see EisnerChart), only the spans of length at most band are stored,
+ * plus the spans (0, j) restricted to the band + 2 cells k = j - band - 1, ..., j:
+ * the required memory is then O(size * band^2).
+ */
+template<class T>
+struct SpanTensor3D
+{
+    unsigned _size;
+    bool _free_data;
+    T* _data;
+    // 0 if all spans are stored
+    unsigned _band = 0u;
+
+    SpanTensor3D(const unsigned size);
+    SpanTensor3D(const unsigned size, T* _data);
+    ~SpanTensor3D();
+
+    static std::size_t required_memory(const unsigned size, const unsigned band = 0u);
+    static std::size_t required_cells(const unsigned size, const unsigned band = 0u);
+    inline static std::size_t span_offset(const unsigned size, const unsigned length) noexcept;
+    // band actually used for a tensor of this size, 0 if the band covers all spans
+    inline static unsigned effective_band(const unsigned size, const unsigned band) noexcept;
+
+    // change the size and the memory of a tensor that does not own its memory
+    inline void rebind(const unsigned size, T* data, const unsigned band = 0u) noexcept;
+    inline std::size_t offset(const unsigned i, const unsigned j, const unsigned k) const noexcept;
+
+    inline T& operator()(const unsigned i, const unsigned j, const unsigned k) noexcept;
+    inline T operator()(const unsigned i, const unsigned j, const unsigned k) const noexcept;
+
+    inline
+    T* iter3(const unsigned i, const unsigned j, const unsigned k) noexcept;
+    // same as iter3, or buffer if the tensor has no memory
+    inline
+    T* iter3_or(const unsigned i, const unsigned j, const unsigned k, T* buffer) noexcept;
+};
+
 template<class T>
 struct Matrix;
 
@@ -62,6 +122,70 @@ struct Matrix
 
     inline MatrixRowIterator<T> iter1(const unsigned i, const unsigned j) noexcept;
     inline T* iter2(const unsigned i, const unsigned j) noexcept;
+
+    // change the size and the memory of a matrix that does not own its memory
+    inline void rebind(const unsigned size, T* data) noexcept;
+};
+
+/**
+ * Matrix stored twice: in row-major order and transposed.
+ *
+ * Deduction rules read (or update) a row and a column of the chart:
+ * a column of the matrix is a row of the transposed storage,
+ * so both antecedents are contiguous (iter1 and iter2 return pointers).
+ *
+ * Cells can be used in two ways:
+ * - values: a cell is written in the row-major storage,
+ *   then copied to the transposed storage with mirror(i, j) before being read by a column;
+ * - accumulators: contributions to a row (iter2) are added to the row-major storage
+ *   and contributions to a column (iter1) to the transposed storage,
+ *   the two parts of a cell are summed with fold(i, j) before it is read.
+ *   As a side effect, updates of rows and columns never write the same memory.
+ *
+ * With a band (vine parsing, see EisnerChart), row 0 is stored entirely
+ * but the other rows only contain the cells (i, j) with i <= j <= i + band,
+ * and the columns are only stored from row 1: they must not be read from row 0.
+ * The required memory is then O(size * band).
+ */
+template<class T>
+struct MirroredMatrix
+{
+    unsigned _size;
+    bool _free_data;
+    T* _data;
+    T* _transposed;
+    // 0 if the whole matrix is stored
+    unsigned _band = 0u;
+
+    MirroredMatrix(const unsigned size);
+    MirroredMatrix(const unsigned size, T* _data);
+    ~MirroredMatrix();
+
+    inline static std::size_t required_memory(const unsigned size, const unsigned band = 0u);
+    inline static std::size_t required_cells(const unsigned size, const unsigned band = 0u);
+    // band actually used for a matrix of this size, 0 if the band covers the upper triangle
+    inline static unsigned effective_band(const unsigned size, const unsigned band) noexcept;
+
+    inline T& operator()(const unsigned i, const unsigned j) noexcept;
+    inline T operator()(const unsigned i, const unsigned j) const noexcept;
+
+    // column j, starting at row i
+    inline T* iter1(const unsigned i, const unsigned j) noexcept;
+    // row i, starting at column j
+    inline T* iter2(const unsigned i, const unsigned j) noexcept;
+
+    // change the size and the memory of a matrix that does not own its memory
+    inline void rebind(const unsigned size, T* data, const unsigned band = 0u) noexcept;
+    inline std::size_t offset(const unsigned i, const unsigned j) const noexcept;
+    inline std::size_t transposed_offset(const unsigned i, const unsigned j) const noexcept;
+
+    inline void mirror(const unsigned i, const unsigned j) noexcept;
+    inline T& fold(const unsigned i, const unsigned j) noexcept;
+
+    // set cells (i, i) to zero in both storages
+    inline void zeros_diagonal() noexcept;
+    // set cells (i, j) with i <= j to zero in both storages
+    inline void zeros_upper_triangle() noexcept;
 };
 
 
@@ -122,6 +246,103 @@ T* Tensor3D<T>::iter3(const unsigned i, const unsigned j, const unsigned k) noex
 }
 
 
+template <class T>
+SpanTensor3D<T>::SpanTensor3D(const unsigned size) :
+    _size(size),
+    _free_data(true)
+{
+    _data = new T[required_cells(size)];
+}
+
+template <class T>
+SpanTensor3D<T>::SpanTensor3D(const unsigned size, T* _data) :
+    _size(size),
+    _free_data(false),
+    _data(_data)
+{}
+
+template <class T>
+SpanTensor3D<T>::~SpanTensor3D()
+{
+    if (_free_data)
+        delete[] _data;
+}
+
+template <class T>
+std::size_t SpanTensor3D<T>::required_memory(const unsigned size, const unsigned band)
+{
+    return required_cells(size, band) * sizeof(T);
+}
+
+template <class T>
+std::size_t SpanTensor3D<T>::required_cells(const unsigned size, const unsigned band)
+{
+    const unsigned b = effective_band(size, band);
+    // all spans of length 1, ..., size - 1
+    if (b == 0u)
+        return size <= 1u ? 0u : span_offset(size, size);
+    // spans of length 1, ..., band and the band + 2 last cells of the longer spans of the root
+    return span_offset(size, b + 1u) + (std::size_t) (size - b - 1u) * (b + 2u);
+}
+
+// number of cells used by spans strictly shorter than length,
+// i.e. sum_{l=1}^{length-1} (size - l) * (l + 1)
+template <class T>
+std::size_t SpanTensor3D<T>::span_offset(const unsigned size, const unsigned length) noexcept
+{
+    const std::size_t n = size;
+    const std::size_t m = length - 1u;
+    return (n - 1u) * m * (m + 1u) / 2u + n * m - m * (m + 1u) * (2u * m + 1u) / 6u;
+}
+
+template <class T>
+unsigned SpanTensor3D<T>::effective_band(const unsigned size, const unsigned band) noexcept
+{
+    return band + 1u < size ? band : 0u;
+}
+
+template <class T>
+void SpanTensor3D<T>::rebind(const unsigned size, T* data, const unsigned band) noexcept
+{
+    _size = size;
+    _data = data;
+    _band = effective_band(size, band);
+}
+
+template <class T>
+std::size_t SpanTensor3D<T>::offset(const unsigned i, const unsigned j, const unsigned k) const noexcept
+{
+    if (_band == 0u || j - i <= _band)
+        return span_offset(_size, j - i) + i * (j - i + 1u) + (k - i);
+    // span (0, j), whose first stored cell is k = j - band - 1
+    return span_offset(_size, _band + 1u) + (std::size_t) (j - _band - 1u) * (_band + 2u) + (k + _band + 1u - j);
+}
+
+template <class T>
+T& SpanTensor3D<T>::operator()(const unsigned i, const unsigned j, const unsigned k) noexcept
+{
+    return _data[offset(i, j, k)];
+}
+
+template <class T>
+T SpanTensor3D<T>::operator()(const unsigned i, const unsigned j, const unsigned k) const noexcept
+{
+    return _data[offset(i, j, k)];
+}
+
+template <class T>
+T* SpanTensor3D<T>::iter3(const unsigned i, const unsigned j, const unsigned k) noexcept
+{
+    return _data + offset(i, j, k);
+}
+
+template <class T>
+T* SpanTensor3D<T>::iter3_or(const unsigned i, const unsigned j, const unsigned k, T* buffer) noexcept
+{
+    return _data == nullptr ? buffer : iter3(i, j, k);
+}
+
+
 template <class T>
 MatrixRowIterator<T>::MatrixRowIterator(Matrix<T>* chart, T* current) :
         chart(chart),
@@ -212,5 +433,156 @@ T* Matrix<T>::iter2(const unsigned i, const unsigned j) noexcept
     return _data + i * _size + j;
 }
 
+template<class T>
+void Matrix<T>::rebind(const unsigned size, T* data) noexcept
+{
+    _size = size;
+    _data = data;
+}
+
+
+template<class T>
+MirroredMatrix<T>::MirroredMatrix(const unsigned size) :
+        _size(size),
+        _free_data(true),
+        _data(new T[required_cells(size)]),
+        _transposed(_data + size * size)
+{}
+
+template<class T>
+MirroredMatrix<T>::MirroredMatrix(const unsigned size, T* _data) :
+        _size(size),
+        _free_data(false),
+        _data(_data),
+        _transposed(_data + size * size)
+{}
+
+template<class T>
+std::size_t MirroredMatrix<T>::required_memory(const unsigned size, const unsigned band)
+{
+    return required_cells(size, band) * sizeof(T);
+}
+
+template<class T>
+std::size_t MirroredMatrix<T>::required_cells(const unsigned size, const unsigned band)
+{
+    const unsigned b = effective_band(size, band);
+    if (b == 0u)
+        return 2u * size * size;
+    // row 0, the band of the other rows and the band of the columns
+    return size + (std::size_t) (2u * size - 1u) * (b + 1u);
+}
+
+template<class T>
+unsigned MirroredMatrix<T>::effective_band(const unsigned size, const unsigned band) noexcept
+{
+    return band + 1u < size ? band : 0u;
+}
+
+template<class T>
+MirroredMatrix<T>::~MirroredMatrix()
+{
+    if (_free_data)
+        delete[] _data;
+}
+
+template<class T>
+std::size_t MirroredMatrix<T>::offset(const unsigned i, const unsigned j) const noexcept
+{
+    if (_band == 0u)
+        return i * _size + j;
+    return i == 0u ? j : _size + (i - 1u) * (_band + 1u) + (j - i);
+}
+
+// cells of a column are stored by increasing row, the last one being (j, j)
+template<class T>
+std::size_t MirroredMatrix<T>::transposed_offset(const unsigned i, const unsigned j) const noexcept
+{
+    if (_band == 0u)
+        return j * _size + i;
+    return j * (_band + 1u) + _band - (j - i);
+}
+
+template<class T>
+T& MirroredMatrix<T>::operator()(const unsigned i, const unsigned j) noexcept
+{
+    return _data[offset(i, j)];
+}
+
+template<class T>
+T MirroredMatrix<T>::operator()(const unsigned i, const unsigned j) const noexcept
+{
+    return _data[offset(i, j)];
+}
 
+template<class T>
+T* MirroredMatrix<T>::iter1(const unsigned i, const unsigned j) noexcept
+{
+    return _transposed + transposed_offset(i, j);
+}
+
+template<class T>
+T* MirroredMatrix<T>::iter2(const unsigned i, const unsigned j) noexcept
+{
+    return _data + offset(i, j);
 }
+
+template<class T>
+void MirroredMatrix<T>::rebind(const unsigned size, T* data, const unsigned band) noexcept
+{
+    _size = size;
+    _data = data;
+    _band = effective_band(size, band);
+    _transposed = data + (_band == 0u ? size * size : size + (size - 1u) * (_band + 1u));
+}
+
+template<class T>
+void MirroredMatrix<T>::mirror(const unsigned i, const unsigned j) noexcept
+{
+    // with a band, the columns are not read from row 0
+    if (_band > 0u && i == 0u)
+        return;
+    _transposed[transposed_offset(i, j)] = _data[offset(i, j)];
+}
+
+template<class T>
+T& MirroredMatrix<T>::fold(const unsigned i, const unsigned j) noexcept
+{
+    T& cell = _data[offset(i, j)];
+    if (_band > 0u && i == 0u)
+        return cell;
+    T& transposed = _transposed[transposed_offset(i, j)];
+    cell += transposed;
+    transposed = T{};
+    return cell;
+}
+
+template<class T>
+void MirroredMatrix<T>::zeros_diagonal() noexcept
+{
+    for (unsigned i = 0u; i < _size; ++i)
+    {
+        _data[offset(i, i)] = T{};
+        _transposed[transposed_offset(i, i)] = T{};
+    }
+}
+
+template<class T>
+void MirroredMatrix<T>::zeros_upper_triangle() noexcept
+{
+    // with a band, only the upper triangle is stored
+    if (_band > 0u)
+    {
+        std::fill(_data, _data + required_cells(_size, _band), T{});
+        return;
+    }
+
+    // row i and column i of the upper triangle are both contiguous
+    for (unsigned i = 0u; i < _size; ++i)
+    {
+        std::fill(_data + i * _size + i, _data + (i + 1u) * _size, T{});
+        std::fill(_transposed + i * _size, _transposed + i * _size + i + 1u, T{});
+    }
+}
+
+}
\ No newline at end of file
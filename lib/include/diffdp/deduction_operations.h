@@ -11,12 +11,20 @@
  * Author: Caio Corro
  */
 
+#include <algorithm>
 #include <iostream>
+#include <limits>
+#include <vector>
 #include "diffdp/math.h"
 
 namespace diffdp
 {
 
+/**
+ * The forward functions read the antecedents only once:
+ * 1. the split weights, their maximum and their partition are computed in a single pass (online softmax)
+ * 2. the backpointers and the value of the consequent are computed in a second pass over the split weights
+ */
 template<class T, class U, class V, class W>
 float forward_algorithmic_softmax(
         T left_antecedent, U right_antecedent,
@@ -25,9 +33,34 @@ float forward_algorithmic_softmax(
         unsigned size
 )
 {
-    cwise_add(split_weights, left_antecedent, right_antecedent, size);
-    softmax(backptr, split_weights, size);
-    return dot(split_weights, backptr, size);
+    float m;
+    const float z = cwise_add_partition(split_weights, left_antecedent, right_antecedent, size, &m);
+    return normalized_exp_dot(backptr, split_weights, m, z, size);
+}
+
+/**
+ * Max version of the forward functions, used by the Viterbi algorithm:
+ * return the value of the best split and write its position in argmax.
+ */
+template<class T, class U>
+float forward_viterbi(
+        T left_antecedent, U right_antecedent,
+        unsigned* argmax,
+        const unsigned size
+)
+{
+    float best = -std::numeric_limits<float>::infinity();
+    *argmax = 0u;
+    for (unsigned k = 0u; k < size; ++k, ++left_antecedent, ++right_antecedent)
+    {
+        const float v = *left_antecedent + *right_antecedent;
+        if (v > best)
+        {
+            best = v;
+            *argmax = k;
+        }
+    }
+    return best;
 }
 
 template<class T, class U, class V>
@@ -42,6 +75,10 @@ void forward_backtracking(
     add_cwise_mult(contrib_right_antecedent, backptr, contrib_consequent, size);
 }
 
+/**
+ * The gradient of the backpointers is initialized here,
+ * the backward functions of the split distribution below then accumulate into it.
+ */
 template<class T, class U, class V, class A, class B, class C>
 void backward_backtracking(
         T contrib_left_antecedent, U contrib_right_antecedent,
@@ -55,6 +92,7 @@ void backward_backtracking(
         const unsigned size
 )
 {
+    std::fill_n(gradient_backptr, size, 0.f);
     *gradient_contrib_consequent += dot(backptr, gradient_contrib_left_antecedent, size);
     *gradient_contrib_consequent += dot(backptr, gradient_contrib_right_antecedent, size);
     add_cwise_mult(gradient_backptr, gradient_contrib_left_antecedent, contrib_consequent, size);
@@ -62,6 +100,23 @@ void backward_backtracking(
 }
 
 
+/**
+ * Backward of a deduction whose backtracking has been skipped (its contribution was below a threshold):
+ * the backpointers have not been used, so their gradient is null.
+ */
+template<class C>
+void backward_skipped_backtracking(C gradient_backptr, const unsigned size)
+{
+    std::fill_n(gradient_backptr, size, 0.f);
+}
+
+/**
+ * The backward functions use gradient_split_weights as a temporary buffer: it does not need to be initialized.
+ *
+ * The split weights are only read by backward_algorithmic_softmax:
+ * if they have not been stored by the forward pass (split_weights is a null pointer),
+ * they are recomputed from the antecedents.
+ */
 template<class T, class U, class V, class W, class A, class B, class C, class D>
 void backward_algorithmic_softmax(
         T left_antecedent, U right_antecedent,
@@ -76,7 +131,15 @@ void backward_algorithmic_softmax(
         unsigned size
 )
 {
-    add_cwise_mult(gradient_backptr, split_weights, gradient_consequent, size);
+    if (split_weights == nullptr)
+    {
+        add_cwise_mult(gradient_backptr, left_antecedent, gradient_consequent, size);
+        add_cwise_mult(gradient_backptr, right_antecedent, gradient_consequent, size);
+    }
+    else
+        add_cwise_mult(gradient_backptr, split_weights, gradient_consequent, size);
+
+    std::fill_n(gradient_split_weights, size, 0.f);
     add_cwise_mult(gradient_split_weights, backptr, gradient_consequent, size);
 
     backprop_softmax(gradient_split_weights, gradient_backptr, split_weights, backptr, size);
@@ -94,13 +157,10 @@ float forward_entropy_reg(
         unsigned size
 )
 {
-    cwise_add(split_weights, left_antecedent, right_antecedent, size);
-    softmax(backptr, split_weights, size);
-    float m = max(split_weights, size);
-    float s = 0;
-    for (unsigned i = 0 ; i < size ; ++i, ++split_weights)
-        s += std::exp(*split_weights-m);
-    return m + std::log(s);
+    float m;
+    const float z = cwise_add_partition(split_weights, left_antecedent, right_antecedent, size, &m);
+    normalized_exp_dot(backptr, split_weights, m, z, size);
+    return m + std::log(z);
 }
 
 
@@ -118,6 +178,7 @@ void backward_entropy_reg(
         unsigned size
 )
 {
+    std::fill_n(gradient_split_weights, size, 0.f);
     add_cwise_mult(gradient_split_weights, backptr, gradient_consequent, size);
 
     backprop_softmax(gradient_split_weights, gradient_backptr, split_weights, backptr, size);
@@ -126,4 +187,438 @@ void backward_entropy_reg(
     add(gradient_right_antecedent, gradient_split_weights, size);
 }
 
-}
\ No newline at end of file
+
+/**
+ * Splits of a deduction that are used, when some of its antecedents cannot be built (see diffdp/algorithm/pruning.h).
+ * Either all the splits are used (dense), or only the listed ones:
+ * split *it is at position *it - first in the vectors of the deduction.
+ * The cells of the other splits are neither read nor written.
+ *
+ * The overloads below take a Splits instead of the size of the deduction,
+ * the sparse case requires random access iterators (e.g. pointers).
+ */
+struct Splits
+{
+    bool dense;
+    unsigned size;
+    const unsigned* begin;
+    const unsigned* end;
+    unsigned first;
+
+    explicit Splits(const unsigned size) :
+            dense(true), size(size), begin(nullptr), end(nullptr), first(0u)
+    {}
+
+    Splits(const unsigned* begin, const unsigned* end, const unsigned first) :
+            dense(false), size(0u), begin(begin), end(end), first(first)
+    {}
+};
+
+template<class T, class U, class V, class W>
+float forward_algorithmic_softmax(
+        T left_antecedent, U right_antecedent,
+        V split_weights,
+        W backptr,
+        const Splits& splits
+)
+{
+    if (splits.dense)
+        return forward_algorithmic_softmax(left_antecedent, right_antecedent, split_weights, backptr, splits.size);
+
+    float m = -std::numeric_limits<float>::max();
+    for (const unsigned* it = splits.begin; it != splits.end; ++it)
+    {
+        const unsigned k = *it - splits.first;
+        split_weights[k] = left_antecedent[k] + right_antecedent[k];
+        m = std::max(m, split_weights[k]);
+    }
+    float z = 0.f;
+    for (const unsigned* it = splits.begin; it != splits.end; ++it)
+    {
+        const unsigned k = *it - splits.first;
+        backptr[k] = std::exp(split_weights[k] - m);
+        z += backptr[k];
+    }
+    // all the splits are masked, see normalized_exp_dot
+    if (z == 0.f)
+        return -std::numeric_limits<float>::infinity();
+    float ret = 0.f;
+    for (const unsigned* it = splits.begin; it != splits.end; ++it)
+    {
+        const unsigned k = *it - splits.first;
+        backptr[k] /= z;
+        if (backptr[k] > 0.f)
+            ret += backptr[k] * split_weights[k];
+    }
+    return ret;
+}
+
+template<class T, class U, class V, class W>
+float forward_entropy_reg(
+        T left_antecedent, U right_antecedent,
+        V split_weights,
+        W backptr,
+        const Splits& splits
+)
+{
+    if (splits.dense)
+        return forward_entropy_reg(left_antecedent, right_antecedent, split_weights, backptr, splits.size);
+
+    float m = -std::numeric_limits<float>::max();
+    for (const unsigned* it = splits.begin; it != splits.end; ++it)
+    {
+        const unsigned k = *it - splits.first;
+        split_weights[k] = left_antecedent[k] + right_antecedent[k];
+        m = std::max(m, split_weights[k]);
+    }
+    float z = 0.f;
+    for (const unsigned* it = splits.begin; it != splits.end; ++it)
+    {
+        const unsigned k = *it - splits.first;
+        backptr[k] = std::exp(split_weights[k] - m);
+        z += backptr[k];
+    }
+    // all the splits are masked, see normalized_exp_dot
+    if (z == 0.f)
+        return -std::numeric_limits<float>::infinity();
+    for (const unsigned* it = splits.begin; it != splits.end; ++it)
+        backptr[*it - splits.first] /= z;
+    return m + std::log(z);
+}
+
+template<class T, class U, class V>
+void forward_backtracking(
+        T contrib_left_antecedent, U contrib_right_antecedent,
+        const float contrib_consequent,
+        V backptr,
+        const Splits& splits
+)
+{
+    if (splits.dense)
+        return forward_backtracking(contrib_left_antecedent, contrib_right_antecedent, contrib_consequent, backptr, splits.size);
+
+    for (const unsigned* it = splits.begin; it != splits.end; ++it)
+    {
+        const unsigned k = *it - splits.first;
+        contrib_left_antecedent[k] += backptr[k] * contrib_consequent;
+        contrib_right_antecedent[k] += backptr[k] * contrib_consequent;
+    }
+}
+
+/**
+ * Position of a split drawn from the distribution backptr, where u is uniform in [0, 1).
+ * Rounding errors are handled by returning the last split with a non-null probability.
+ */
+template<class V>
+unsigned sample_split(V backptr, float u, const unsigned size)
+{
+    unsigned last = 0u;
+    for (unsigned k = 0u; k < size; ++k)
+    {
+        if (backptr[k] <= 0.f)
+            continue;
+        u -= backptr[k];
+        if (u < 0.f)
+            return k;
+        last = k;
+    }
+    return last;
+}
+
+template<class V>
+unsigned sample_split(V backptr, float u, const Splits& splits)
+{
+    if (splits.dense)
+        return sample_split(backptr, u, splits.size);
+
+    unsigned last = 0u;
+    for (const unsigned* it = splits.begin; it != splits.end; ++it)
+    {
+        const unsigned k = *it - splits.first;
+        if (backptr[k] <= 0.f)
+            continue;
+        u -= backptr[k];
+        if (u < 0.f)
+            return k;
+        last = k;
+    }
+    return last;
+}
+
+template<class T, class U, class V, class A, class B, class C>
+void backward_backtracking(
+        T contrib_left_antecedent, U contrib_right_antecedent,
+        const float contrib_consequent,
+        V backptr,
+
+        A gradient_contrib_left_antecedent, B gradient_contrib_right_antecedent,
+        float *gradient_contrib_consequent,
+        C gradient_backptr,
+
+        const Splits& splits
+)
+{
+    if (splits.dense)
+        return backward_backtracking(
+                contrib_left_antecedent, contrib_right_antecedent, contrib_consequent, backptr,
+                gradient_contrib_left_antecedent, gradient_contrib_right_antecedent, gradient_contrib_consequent, gradient_backptr,
+                splits.size
+        );
+
+    for (const unsigned* it = splits.begin; it != splits.end; ++it)
+    {
+        const unsigned k = *it - splits.first;
+        const float g = gradient_contrib_left_antecedent[k] + gradient_contrib_right_antecedent[k];
+        *gradient_contrib_consequent += backptr[k] * g;
+        gradient_backptr[k] = g * contrib_consequent;
+    }
+}
+
+template<class C>
+void backward_skipped_backtracking(C gradient_backptr, const Splits& splits)
+{
+    if (splits.dense)
+        return backward_skipped_backtracking(gradient_backptr, splits.size);
+
+    for (const unsigned* it = splits.begin; it != splits.end; ++it)
+        gradient_backptr[*it - splits.first] = 0.f;
+}
+
+template<class T, class U, class V, class W, class A, class B, class C, class D>
+void backward_algorithmic_softmax(
+        T left_antecedent, U right_antecedent,
+        V split_weights,
+        W backptr,
+
+        A gradient_left_antecedent, B gradient_right_antecedent,
+        const float gradient_consequent,
+        C gradient_split_weights,
+        D gradient_backptr,
+
+        const Splits& splits
+)
+{
+    if (splits.dense)
+        return backward_algorithmic_softmax(
+                left_antecedent, right_antecedent, split_weights, backptr,
+                gradient_left_antecedent, gradient_right_antecedent, gradient_consequent, gradient_split_weights, gradient_backptr,
+                splits.size
+        );
+
+    float s = 0.f;
+    for (const unsigned* it = splits.begin; it != splits.end; ++it)
+    {
+        const unsigned k = *it - splits.first;
+        const float w = (split_weights == nullptr ? left_antecedent[k] + right_antecedent[k] : split_weights[k]);
+        gradient_backptr[k] += w * gradient_consequent;
+        s += gradient_backptr[k] * backptr[k];
+    }
+    for (const unsigned* it = splits.begin; it != splits.end; ++it)
+    {
+        const unsigned k = *it - splits.first;
+        gradient_split_weights[k] = backptr[k] * (gradient_consequent + gradient_backptr[k] - s);
+        gradient_left_antecedent[k] += gradient_split_weights[k];
+        gradient_right_antecedent[k] += gradient_split_weights[k];
+    }
+}
+
+template<class T, class U, class V, class W, class A, class B, class C, class D>
+void backward_entropy_reg(
+        T left_antecedent, U right_antecedent,
+        V split_weights,
+        W backptr,
+
+        A gradient_left_antecedent, B gradient_right_antecedent,
+        const float gradient_consequent,
+        C gradient_split_weights,
+        D gradient_backptr,
+
+        const Splits& splits
+)
+{
+    if (splits.dense)
+        return backward_entropy_reg(
+                left_antecedent, right_antecedent, split_weights, backptr,
+                gradient_left_antecedent, gradient_right_antecedent, gradient_consequent, gradient_split_weights, gradient_backptr,
+                splits.size
+        );
+
+    float s = 0.f;
+    for (const unsigned* it = splits.begin; it != splits.end; ++it)
+    {
+        const unsigned k = *it - splits.first;
+        s += gradient_backptr[k] * backptr[k];
+    }
+    for (const unsigned* it = splits.begin; it != splits.end; ++it)
+    {
+        const unsigned k = *it - splits.first;
+        gradient_split_weights[k] = backptr[k] * (gradient_consequent + gradient_backptr[k] - s);
+        gradient_left_antecedent[k] += gradient_split_weights[k];
+        gradient_right_antecedent[k] += gradient_split_weights[k];
+    }
+}
+
+
+/**
+ * When the split distributions of the entropy regularized relaxation are not stored (inside-outside algorithm),
+ * the backpointers of a deduction are recomputed in a buffer from the values of its antecedents
+ * and from the value of its consequent, i.e. the log-partition of its split weights.
+ */
+template<class T, class U>
+void recompute_entropy_reg_backptr(
+        T left_antecedent, U right_antecedent,
+        float* backptr,
+        const float log_partition,
+        const unsigned size
+)
+{
+    // all the splits are masked, see normalized_exp_dot
+    if (log_partition == -std::numeric_limits<float>::infinity())
+    {
+        std::fill_n(backptr, size, 0.f);
+        return;
+    }
+    cwise_add(backptr, left_antecedent, right_antecedent, size);
+    exp_minus_cst(backptr, backptr, log_partition, size);
+}
+
+/**
+ * Gradient of the backpointers written by backward_backtracking,
+ * recomputed from the gradients of the contributions of the antecedents.
+ */
+template<class A, class B>
+void recompute_gradient_backptr(
+        A gradient_contrib_left_antecedent, B gradient_contrib_right_antecedent,
+        const float contrib_consequent,
+        float* gradient_backptr,
+        const unsigned size
+)
+{
+    std::fill_n(gradient_backptr, size, 0.f);
+    add_cwise_mult(gradient_backptr, gradient_contrib_left_antecedent, contrib_consequent, size);
+    add_cwise_mult(gradient_backptr, gradient_contrib_right_antecedent, contrib_consequent, size);
+}
+
+/**
+ * Sparse relaxation of the deductions: the backpointers are the sparsemax of the split weights,
+ * i.e. their euclidean projection on the simplex (Martins & Astudillo, 2016), so most of them are exactly zero.
+ * The consequent is the expectation of the split weights, as in forward_algorithmic_softmax.
+ *
+ * The positions of the non-zero backpointers (the support) are written in increasing order in support,
+ * the other cells of backptr are not written.
+ * The backtracking and the backward pass then use Splits(support.data(), support.data() + support.size(), 0u),
+ * so their cost is proportional to the size of the support.
+ */
+template<class T, class U, class V, class W>
+float forward_algorithmic_sparsemax(
+        T left_antecedent, U right_antecedent,
+        V split_weights,
+        W backptr,
+        const Splits& splits,
+        std::vector<unsigned>& support
+)
+{
+    support.clear();
+    if (splits.dense)
+        for (unsigned k = 0u; k < splits.size; ++k)
+            support.push_back(k);
+    else
+        for (const unsigned* it = splits.begin; it != splits.end; ++it)
+            support.push_back(*it - splits.first);
+
+    for (const unsigned k : support)
+        split_weights[k] = left_antecedent[k] + right_antecedent[k];
+
+    // the support is the longest prefix of the sorted split weights above the threshold
+    std::sort(support.begin(), support.end(), [&] (const unsigned a, const unsigned b) { return split_weights[a] > split_weights[b]; });
+    float sum = 0.f;
+    float threshold = 0.f;
+    unsigned n = 0u;
+    for (; n < support.size(); ++n)
+    {
+        const float w = split_weights[support[n]];
+        if (1.f + (n + 1u) * w <= sum + w)
+            break;
+        sum += w;
+        threshold = (sum - 1.f) / (n + 1u);
+    }
+    support.resize(n);
+    std::sort(support.begin(), support.end());
+
+    float ret = 0.f;
+    for (const unsigned k : support)
+    {
+        backptr[k] = split_weights[k] - threshold;
+        ret += backptr[k] * split_weights[k];
+    }
+    return ret;
+}
+
+/**
+ * Backward of forward_algorithmic_sparsemax, where splits is the support of the forward pass.
+ * The jacobian of the sparsemax is (I - 1 1^T / |S|) on the support S and zero elsewhere.
+ */
+template<class T, class U, class V, class W, class A, class B, class C, class D>
+void backward_algorithmic_sparsemax(
+        T left_antecedent, U right_antecedent,
+        V split_weights,
+        W backptr,
+
+        A gradient_left_antecedent, B gradient_right_antecedent,
+        const float gradient_consequent,
+        C gradient_split_weights,
+        D gradient_backptr,
+
+        const Splits& support
+)
+{
+    if (support.begin == support.end)
+        return;
+
+    float mean = 0.f;
+    for (const unsigned* it = support.begin; it != support.end; ++it)
+    {
+        const unsigned k = *it - support.first;
+        const float w = (split_weights == nullptr ? left_antecedent[k] + right_antecedent[k] : split_weights[k]);
+        gradient_backptr[k] += w * gradient_consequent;
+        mean += gradient_backptr[k];
+    }
+    mean /= (support.end - support.begin);
+    for (const unsigned* it = support.begin; it != support.end; ++it)
+    {
+        const unsigned k = *it - support.first;
+        gradient_split_weights[k] = backptr[k] * gradient_consequent + gradient_backptr[k] - mean;
+        gradient_left_antecedent[k] += gradient_split_weights[k];
+        gradient_right_antecedent[k] += gradient_split_weights[k];
+    }
+}
+
+/**
+ * Supports of the deductions of a chart, indexed by the span (i, j) of their consequent.
+ * The memory of the supports is reused between calls.
+ */
+struct SplitSupports
+{
+    unsigned size = 0u;
+    std::vector<std::vector<unsigned>> _supports;
+
+    void resize(const unsigned t_size)
+    {
+        size = t_size;
+        if (_supports.size() < size * size)
+            _supports.resize(size * size);
+    }
+
+    std::vector<unsigned>& operator()(const unsigned i, const unsigned j)
+    {
+        return _supports[i * size + j];
+    }
+
+    Splits splits(const unsigned i, const unsigned j) const
+    {
+        const auto& support = _supports[i * size + j];
+        return Splits(support.data(), support.data() + support.size(), 0u);
+    }
+};
+
+}
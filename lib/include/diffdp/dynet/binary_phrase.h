@@ -13,20 +13,35 @@
 
 #include "diffdp/dynet/args.h"
 #include "diffdp/algorithm/binary_phrase.h"
+#include "diffdp/random.h"
+#include "diffdp/parallel.h"
+#include "diffdp/pool.h"
 
 namespace dynet
 {
 
+/**
+ * Relaxations of the CKY algorithm over binary bracketings, the output is the matrix of span marginals.
+ * If max_span_length > 0, the constituents (i, j) below the top-level right-branching spine
+ * have a length j - i of at most max_span_length (see diffdp::BinaryPhraseStructureChart),
+ * which only requires O(n w^2) time and memory.
+ */
 Expression algorithmic_differentiable_binary_phrase_structure(
         const Expression &x,
         diffdp::DiscreteMode mode,
-        std::vector<unsigned> *batch_sizes = nullptr
+        std::vector<unsigned> *batch_sizes = nullptr,
+        diffdp::SplitWeightsMode split_weights_mode = diffdp::SplitWeightsMode::Stored,
+        const diffdp::GumbelPerturbation& perturbation = diffdp::GumbelPerturbation(),
+        unsigned max_span_length = 0u
 );
 
 Expression entropy_regularized_binary_phrase_structure(
         const Expression &x,
         diffdp::DiscreteMode mode,
-        std::vector<unsigned> *batch_sizes = nullptr
+        std::vector<unsigned> *batch_sizes = nullptr,
+        diffdp::SplitWeightsMode split_weights_mode = diffdp::SplitWeightsMode::Stored,
+        const diffdp::GumbelPerturbation& perturbation = diffdp::GumbelPerturbation(),
+        unsigned max_span_length = 0u
 );
 
 struct AlgorithmicDifferentiableBinaryPhraseStructure :
@@ -34,13 +49,25 @@ struct AlgorithmicDifferentiableBinaryPhraseStructure :
 {
     const diffdp::DiscreteMode mode;
     std::vector<unsigned>* batch_sizes = nullptr;
-
-    std::vector<diffdp::AlgorithmicDifferentiableBinaryPhraseStructure*> _ce_ptr;
+    const diffdp::SplitWeightsMode split_weights_mode;
+    // Gumbel noise added to the weights when they are read, the gradient is unchanged
+    const diffdp::GumbelPerturbation perturbation;
+    // maximum length of the constituents below the spine, 0 if unbounded
+    const unsigned max_span_length;
+
+    // the forward charts are stored in the auxiliary memory of the node,
+    // the backward charts are taken from the chart pool on the first backward call
+    mutable std::vector<diffdp::AlgorithmicDifferentiableBinaryPhraseStructure> _ce;
+    mutable std::vector<std::unique_ptr<diffdp::BinaryPhraseStructureChart>> _forward_charts;
+    mutable std::vector<diffdp::PooledChart<diffdp::BinaryPhraseStructureChart>> _backward_charts;
 
     explicit AlgorithmicDifferentiableBinaryPhraseStructure(
             const std::initializer_list<VariableIndex>& a,
             diffdp::DiscreteMode mode,
-            std::vector<unsigned>* batch_sizes
+            std::vector<unsigned>* batch_sizes,
+            diffdp::SplitWeightsMode split_weights_mode,
+            const diffdp::GumbelPerturbation& perturbation,
+            unsigned max_span_length
     );
 
     DYNET_NODE_DEFINE_DEV_IMPL()
@@ -56,13 +83,25 @@ struct EntropyRegularizedBinaryPhraseStructure :
 {
     const diffdp::DiscreteMode mode;
     std::vector<unsigned>* batch_sizes = nullptr;
-
-    std::vector<diffdp::EntropyRegularizedBinaryPhraseStructure*> _ce_ptr;
+    const diffdp::SplitWeightsMode split_weights_mode;
+    // Gumbel noise added to the weights when they are read, the gradient is unchanged
+    const diffdp::GumbelPerturbation perturbation;
+    // maximum length of the constituents below the spine, 0 if unbounded
+    const unsigned max_span_length;
+
+    // the forward charts are stored in the auxiliary memory of the node,
+    // the backward charts are taken from the chart pool on the first backward call
+    mutable std::vector<diffdp::EntropyRegularizedBinaryPhraseStructure> _ce;
+    mutable std::vector<std::unique_ptr<diffdp::BinaryPhraseStructureChart>> _forward_charts;
+    mutable std::vector<diffdp::PooledChart<diffdp::BinaryPhraseStructureChart>> _backward_charts;
 
     explicit EntropyRegularizedBinaryPhraseStructure(
             const std::initializer_list<VariableIndex>& a,
             diffdp::DiscreteMode mode,
-            std::vector<unsigned>* batch_sizes
+            std::vector<unsigned>* batch_sizes,
+            diffdp::SplitWeightsMode split_weights_mode,
+            const diffdp::GumbelPerturbation& perturbation,
+            unsigned max_span_length
     );
 
     DYNET_NODE_DEFINE_DEV_IMPL()
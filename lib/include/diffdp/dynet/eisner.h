@@ -13,6 +13,10 @@
 
 #include "diffdp/dynet/args.h"
 #include "diffdp/algorithm/eisner.h"
+#include "diffdp/algorithm/pruning.h"
+#include "diffdp/random.h"
+#include "diffdp/parallel.h"
+#include "diffdp/pool.h"
 
 namespace diffdp
 {
@@ -31,13 +35,22 @@ std::pair<unsigned, unsigned> from_compact(const std::pair<unsigned, unsigned> d
 namespace dynet
 {
 
+/**
+ * Relaxations of the Eisner algorithm, see the README for the arguments.
+ * If vine_length > 0, arcs between words are bounded by vine_length (vine parsing, see diffdp::EisnerChart),
+ * which only requires O(n k^2) time and memory: this is only supported with diffdp::DiscreteMode::ForwardRegularized.
+ */
 Expression algorithmic_differentiable_eisner(
         const Expression &x,
         diffdp::DiscreteMode mode,
         diffdp::DependencyGraphMode input_graph = diffdp::DependencyGraphMode::Compact,
         diffdp::DependencyGraphMode output_graph = diffdp::DependencyGraphMode::Compact,
         bool with_root_arcs = true,
-        std::vector<unsigned> *batch_sizes = nullptr
+        std::vector<unsigned> *batch_sizes = nullptr,
+        diffdp::SplitWeightsMode split_weights_mode = diffdp::SplitWeightsMode::Stored,
+        const diffdp::PruningSettings& pruning_settings = diffdp::PruningSettings(),
+        const diffdp::GumbelPerturbation& perturbation = diffdp::GumbelPerturbation(),
+        unsigned vine_length = 0u
 );
 
 Expression entropy_regularized_eisner(
@@ -46,6 +59,78 @@ Expression entropy_regularized_eisner(
         diffdp::DependencyGraphMode input_graph = diffdp::DependencyGraphMode::Compact,
         diffdp::DependencyGraphMode output_graph = diffdp::DependencyGraphMode::Compact,
         bool with_root_arcs = true,
+        std::vector<unsigned> *batch_sizes = nullptr,
+        diffdp::SplitWeightsMode split_weights_mode = diffdp::SplitWeightsMode::Stored,
+        const diffdp::PruningSettings& pruning_settings = diffdp::PruningSettings(),
+        const diffdp::GumbelPerturbation& perturbation = diffdp::GumbelPerturbation(),
+        unsigned vine_length = 0u
+);
+
+/**
+ * Same relaxation as entropy_regularized_eisner, computed with the inside-outside algorithm (see diffdp::InsideOutsideEisner):
+ * the charts are quadratic in the size of the sentence instead of cubic, at the cost of recomputing the split distributions.
+ * Pruning and vine parsing are not supported.
+ */
+Expression inside_outside_eisner(
+        const Expression &x,
+        diffdp::DiscreteMode mode,
+        diffdp::DependencyGraphMode input_graph = diffdp::DependencyGraphMode::Compact,
+        diffdp::DependencyGraphMode output_graph = diffdp::DependencyGraphMode::Compact,
+        bool with_root_arcs = true,
+        std::vector<unsigned> *batch_sizes = nullptr,
+        const diffdp::GumbelPerturbation& perturbation = diffdp::GumbelPerturbation()
+);
+
+/**
+ * Highest scoring projective tree: the output is a discrete adjacency matrix and its gradient is null.
+ * It only requires quadratic memory, use it instead of the relaxations for decoding.
+ */
+Expression viterbi_eisner(
+        const Expression &x,
+        diffdp::DependencyGraphMode input_graph = diffdp::DependencyGraphMode::Compact,
+        diffdp::DependencyGraphMode output_graph = diffdp::DependencyGraphMode::Compact,
+        bool with_root_arcs = true,
+        std::vector<unsigned> *batch_sizes = nullptr,
+        const diffdp::GumbelPerturbation& perturbation = diffdp::GumbelPerturbation()
+);
+
+/**
+ * Entropy regularized relaxation of labeled dependencies.
+ * The input is a (n, n, L) tensor of (head, modifier, label) weights, where the first two dimensions follow input_graph.
+ * Labels are marginalized in a pre-pass: the weight of an arc is the log-sum-exp of its label weights,
+ * so the unlabeled chart is built once, in O(n^2 L + n^3) instead of O(n^3 L).
+ * The output is the (n, n, L) tensor of marginals of labeled arcs, i.e. the arc marginal times the softmax of its labels.
+ */
+Expression labeled_entropy_regularized_eisner(
+        const Expression &x,
+        diffdp::DependencyGraphMode input_graph = diffdp::DependencyGraphMode::Compact,
+        diffdp::DependencyGraphMode output_graph = diffdp::DependencyGraphMode::Compact,
+        bool with_root_arcs = true,
+        std::vector<unsigned> *batch_sizes = nullptr
+);
+
+/**
+ * Entropy of the distribution over projective trees p(tree) ∝ exp(score(tree)), one value per batch element.
+ * It is computed in closed form from the chart of the entropy regularized relaxation,
+ * and its gradient is a single backward pass of the same chart.
+ */
+Expression eisner_entropy(
+        const Expression &x,
+        diffdp::DependencyGraphMode input_graph = diffdp::DependencyGraphMode::Compact,
+        bool with_root_arcs = true,
+        std::vector<unsigned> *batch_sizes = nullptr
+);
+
+/**
+ * KL(p || q) between the distributions over projective trees with arc weights x (p) and y (q),
+ * one value per batch element. Both distributions are parsed once, the gradient of x is a backward pass of the chart of p
+ * and the gradient of y is the difference of the arc marginals.
+ */
+Expression eisner_kl_divergence(
+        const Expression &x,
+        const Expression &y,
+        diffdp::DependencyGraphMode input_graph = diffdp::DependencyGraphMode::Compact,
+        bool with_root_arcs = true,
         std::vector<unsigned> *batch_sizes = nullptr
 );
 
@@ -57,8 +142,22 @@ struct AlgorithmicDifferentiableEisner :
     const diffdp::DependencyGraphMode output_graph;
     bool with_root_arcs;
     std::vector<unsigned>* batch_sizes = nullptr;
+    const diffdp::SplitWeightsMode split_weights_mode;
+    const diffdp::PruningSettings pruning_settings;
+    // Gumbel noise added to the weights when they are read, the gradient is unchanged
+    const diffdp::GumbelPerturbation perturbation;
+    // maximum length of the arcs between words, 0 if unbounded
+    const unsigned vine_length;
 
-    std::vector<diffdp::AlgorithmicDifferentiableEisner*> _ce_ptr;
+    // the forward charts are stored in the auxiliary memory of the node,
+    // the backward charts are taken from the chart pool on the first backward call.
+    // With BackwardRegularized, the forward charts are also taken from the pool by the backward call
+    mutable std::vector<diffdp::AlgorithmicDifferentiableEisner> _ce;
+    // arcs kept by the pruning stage of each sentence, if pruning is enabled
+    mutable std::vector<diffdp::ArcPruning> _pruning;
+    mutable std::vector<std::unique_ptr<diffdp::EisnerChart>> _forward_charts;
+    mutable std::vector<diffdp::PooledChart<diffdp::EisnerChart>> _pooled_forward_charts;
+    mutable std::vector<diffdp::PooledChart<diffdp::EisnerChart>> _backward_charts;
 
     explicit AlgorithmicDifferentiableEisner(
             const std::initializer_list<VariableIndex>& a,
@@ -66,7 +165,11 @@ struct AlgorithmicDifferentiableEisner :
             diffdp::DependencyGraphMode input_graph,
             diffdp::DependencyGraphMode output_graph,
             bool with_root_arcs,
-            std::vector<unsigned>* batch_sizes
+            std::vector<unsigned>* batch_sizes,
+            diffdp::SplitWeightsMode split_weights_mode,
+            const diffdp::PruningSettings& pruning_settings,
+            const diffdp::GumbelPerturbation& perturbation,
+            unsigned vine_length
     );
 
     DYNET_NODE_DEFINE_DEV_IMPL()
@@ -85,8 +188,22 @@ struct EntropyRegularizedEisner :
     const diffdp::DependencyGraphMode output_graph;
     bool with_root_arcs;
     std::vector<unsigned>* batch_sizes = nullptr;
+    const diffdp::SplitWeightsMode split_weights_mode;
+    const diffdp::PruningSettings pruning_settings;
+    // Gumbel noise added to the weights when they are read, the gradient is unchanged
+    const diffdp::GumbelPerturbation perturbation;
+    // maximum length of the arcs between words, 0 if unbounded
+    const unsigned vine_length;
 
-    std::vector<diffdp::EntropyRegularizedEisner*> _ce_ptr;
+    // the forward charts are stored in the auxiliary memory of the node,
+    // the backward charts are taken from the chart pool on the first backward call.
+    // With BackwardRegularized, the forward charts are also taken from the pool by the backward call
+    mutable std::vector<diffdp::EntropyRegularizedEisner> _ce;
+    // arcs kept by the pruning stage of each sentence, if pruning is enabled
+    mutable std::vector<diffdp::ArcPruning> _pruning;
+    mutable std::vector<std::unique_ptr<diffdp::EisnerChart>> _forward_charts;
+    mutable std::vector<diffdp::PooledChart<diffdp::EisnerChart>> _pooled_forward_charts;
+    mutable std::vector<diffdp::PooledChart<diffdp::EisnerChart>> _backward_charts;
 
     explicit EntropyRegularizedEisner(
             const std::initializer_list<VariableIndex>& a,
@@ -94,7 +211,11 @@ struct EntropyRegularizedEisner :
             diffdp::DependencyGraphMode input_graph,
             diffdp::DependencyGraphMode output_graph,
             bool with_root_arcs,
-            std::vector<unsigned>* batch_sizes
+            std::vector<unsigned>* batch_sizes,
+            diffdp::SplitWeightsMode split_weights_mode,
+            const diffdp::PruningSettings& pruning_settings,
+            const diffdp::GumbelPerturbation& perturbation,
+            unsigned vine_length
     );
 
     DYNET_NODE_DEFINE_DEV_IMPL()
@@ -105,5 +226,150 @@ struct EntropyRegularizedEisner :
     virtual ~EntropyRegularizedEisner();
 };
 
+struct InsideOutsideEisner :
+        public dynet::Node
+{
+    const diffdp::DiscreteMode mode;
+    const diffdp::DependencyGraphMode input_graph;
+    const diffdp::DependencyGraphMode output_graph;
+    bool with_root_arcs;
+    std::vector<unsigned>* batch_sizes = nullptr;
+    // Gumbel noise added to the weights when they are read, the gradient is unchanged
+    const diffdp::GumbelPerturbation perturbation;
+
+    // the forward charts are stored in the auxiliary memory of the node,
+    // the backward charts are taken from the chart pool on the first backward call.
+    // With BackwardRegularized, the forward charts are also taken from the pool by the backward call
+    mutable std::vector<diffdp::InsideOutsideEisner> _ce;
+    mutable std::vector<std::unique_ptr<diffdp::InsideOutsideEisnerChart>> _forward_charts;
+    mutable std::vector<diffdp::PooledChart<diffdp::InsideOutsideEisnerChart>> _pooled_forward_charts;
+    mutable std::vector<diffdp::PooledChart<diffdp::InsideOutsideEisnerChart>> _backward_charts;
+
+    explicit InsideOutsideEisner(
+            const std::initializer_list<VariableIndex>& a,
+            diffdp::DiscreteMode mode,
+            diffdp::DependencyGraphMode input_graph,
+            diffdp::DependencyGraphMode output_graph,
+            bool with_root_arcs,
+            std::vector<unsigned>* batch_sizes,
+            const diffdp::GumbelPerturbation& perturbation
+    );
+
+    DYNET_NODE_DEFINE_DEV_IMPL()
+
+    virtual bool supports_multibatch() const override;
+    size_t aux_storage_size() const override;
+
+    virtual ~InsideOutsideEisner();
+};
+
+struct LabeledEntropyRegularizedEisner :
+        public dynet::Node
+{
+    const diffdp::DependencyGraphMode input_graph;
+    const diffdp::DependencyGraphMode output_graph;
+    bool with_root_arcs;
+    std::vector<unsigned>* batch_sizes = nullptr;
+
+    // all charts are taken from the chart pool, the backward charts on the first backward call
+    mutable std::vector<diffdp::EntropyRegularizedEisner> _ce;
+    mutable std::vector<diffdp::PooledChart<diffdp::EisnerChart>> _forward_charts;
+    mutable std::vector<diffdp::PooledChart<diffdp::EisnerChart>> _backward_charts;
+    // log-sum-exp of the label weights of each arc, in the input format (one matrix per batch element)
+    mutable std::vector<float> _arc_weights;
+
+    explicit LabeledEntropyRegularizedEisner(
+            const std::initializer_list<VariableIndex>& a,
+            diffdp::DependencyGraphMode input_graph,
+            diffdp::DependencyGraphMode output_graph,
+            bool with_root_arcs,
+            std::vector<unsigned>* batch_sizes
+    );
+
+    DYNET_NODE_DEFINE_DEV_IMPL()
+
+    virtual bool supports_multibatch() const override;
+
+    virtual ~LabeledEntropyRegularizedEisner();
+};
+
+struct EisnerEntropy :
+        public dynet::Node
+{
+    const diffdp::DependencyGraphMode input_graph;
+    bool with_root_arcs;
+    std::vector<unsigned>* batch_sizes = nullptr;
+
+    // all charts are taken from the chart pool, the backward charts on the first backward call
+    mutable std::vector<diffdp::EntropyRegularizedEisner> _ce;
+    mutable std::vector<diffdp::PooledChart<diffdp::EisnerChart>> _forward_charts;
+    mutable std::vector<diffdp::PooledChart<diffdp::EisnerChart>> _backward_charts;
+
+    explicit EisnerEntropy(
+            const std::initializer_list<VariableIndex>& a,
+            diffdp::DependencyGraphMode input_graph,
+            bool with_root_arcs,
+            std::vector<unsigned>* batch_sizes
+    );
+
+    DYNET_NODE_DEFINE_DEV_IMPL()
+
+    virtual bool supports_multibatch() const override;
+
+    virtual ~EisnerEntropy();
+};
+
+struct EisnerKLDivergence :
+        public dynet::Node
+{
+    const diffdp::DependencyGraphMode input_graph;
+    bool with_root_arcs;
+    std::vector<unsigned>* batch_sizes = nullptr;
+
+    // charts of p and q, taken from the chart pool.
+    // Only p needs a backward chart, it is taken on the first backward call
+    mutable std::vector<diffdp::EntropyRegularizedEisner> _ce_p, _ce_q;
+    mutable std::vector<diffdp::PooledChart<diffdp::EisnerChart>> _forward_charts;
+    mutable std::vector<diffdp::PooledChart<diffdp::EisnerChart>> _backward_charts;
+
+    explicit EisnerKLDivergence(
+            const std::initializer_list<VariableIndex>& a,
+            diffdp::DependencyGraphMode input_graph,
+            bool with_root_arcs,
+            std::vector<unsigned>* batch_sizes
+    );
+
+    DYNET_NODE_DEFINE_DEV_IMPL()
+
+    virtual bool supports_multibatch() const override;
+
+    virtual ~EisnerKLDivergence();
+};
+
+struct ViterbiEisner :
+        public dynet::Node
+{
+    const diffdp::DependencyGraphMode input_graph;
+    const diffdp::DependencyGraphMode output_graph;
+    bool with_root_arcs;
+    std::vector<unsigned>* batch_sizes = nullptr;
+    const diffdp::GumbelPerturbation perturbation;
+
+    explicit ViterbiEisner(
+            const std::initializer_list<VariableIndex>& a,
+            diffdp::DependencyGraphMode input_graph,
+            diffdp::DependencyGraphMode output_graph,
+            bool with_root_arcs,
+            std::vector<unsigned>* batch_sizes,
+            const diffdp::GumbelPerturbation& perturbation
+    );
+
+    DYNET_NODE_DEFINE_DEV_IMPL()
+
+    virtual bool supports_multibatch() const override;
+
+    virtual ~ViterbiEisner();
+};
+
 
 }
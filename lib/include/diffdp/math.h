@@ -9,15 +9,72 @@
  * - dereferenceable
  * - incrementable
  *
+ * When all inputs/outputs are float pointers (i.e. contiguous memory),
+ * the overloads below dispatch to the vectorized kernels of diffdp/simd.h.
+ * They must be declared before the generic implementations
+ * so that composite functions (e.g. softmax) also use them.
+ *
  * Author: Caio Corro
  */
 
 #include <cmath>
 #include <limits>
 
+#include "diffdp/simd.h"
+
 namespace diffdp
 {
 
+inline void cwise_add(float* output, float* input1, float* input2, const unsigned size)
+{
+    simd::cwise_add(output, input1, input2, size);
+}
+
+inline float max(float* input, const unsigned size)
+{
+    return simd::max(input, size);
+}
+
+inline void inplace_cwise_div(float* input, const float v, const unsigned size)
+{
+    simd::inplace_cwise_div(input, v, size);
+}
+
+inline void add(float* output, float* input, const unsigned size)
+{
+    simd::add(output, input, size);
+}
+
+inline void add_cwise_mult(float* output, float* input, const float v, const unsigned size)
+{
+    simd::add_cwise_mult(output, input, v, size);
+}
+
+inline float dot(float* input1, float* input2, const unsigned size)
+{
+    return simd::dot(input1, input2, size);
+}
+
+inline float exp_minus_cst(float* output, float* input, const float m, const unsigned size)
+{
+    return simd::exp_minus_cst(output, input, m, size);
+}
+
+inline void backprop_softmax(float* gradient_input, float* gradient_output, float*, float* output, const unsigned size)
+{
+    simd::backprop_softmax(gradient_input, gradient_output, output, size);
+}
+
+inline float cwise_add_partition(float* output, float* input1, float* input2, const unsigned size, float* m)
+{
+    return simd::cwise_add_partition(output, input1, input2, size, m);
+}
+
+inline float normalized_exp_dot(float* output, float* input, const float m, const float z, const unsigned size)
+{
+    return simd::normalized_exp_dot(output, input, m, z, size);
+}
+
 /**
  * Performs an element-wise sum of vectors input1 and output2.
  * The result is stored in output.
@@ -168,4 +225,74 @@ void backprop_softmax(A gradient_input, B gradient_output, T input, U output, co
         *gradient_input += (*output) * ((*gradient_output) - s);
 }
 
+/**
+ * Performs an element-wise sum of vectors input1 and input2
+ * and computes in the same pass the maximum and the partition of the result,
+ * i.e. the terms of its log-sum-exp, using the online softmax recurrence.
+ *
+ * @param output Vector where the sum will be stored
+ * @param input1 First input vector
+ * @param input2 Second intput vector
+ * @param size Size of the input vectors
+ * @param m Output argument: the maximum element of the sum
+ * @return The partition, i.e. the sum of exp(output_i - m), it is null if all the elements of the sum are -inf
+ */
+template<class T, class U, class V>
+float cwise_add_partition(T output, U input1, V input2, const unsigned size, float* m)
+{
+    // start from the lowest finite value so that -inf inputs never produce (-inf) - (-inf)
+    float value = -std::numeric_limits<float>::max();
+    float z = 0.f;
+    for (unsigned i = 0u; i < size; ++i, ++input1, ++input2, ++output)
+    {
+        const float v = *input1 + *input2;
+        *output = v;
+        if (v > value)
+        {
+            z = z * std::exp(value - v) + 1.f;
+            value = v;
+        }
+        else
+            z += std::exp(v - value);
+    }
+    *m = value;
+    return z;
+}
+
+/**
+ * Compute the normalized exponential of a vector, i.e. a softmax
+ * whose maximum and partition have already been computed (see cwise_add_partition),
+ * and return its dot product with the input.
+ *
+ * Masked (-inf) inputs have a null probability and are skipped by the dot product.
+ * If all the inputs are masked (i.e. the partition is null), the output is null and the dot product is -inf.
+ *
+ * @param output Output vector
+ * @param input Input vector
+ * @param m Maximum element of the input
+ * @param z Partition of the input
+ * @param size Size of the input vector
+ * @return The dot product between the output and the input
+ */
+template<class T, class U>
+float normalized_exp_dot(T output, U input, const float m, const float z, const unsigned size)
+{
+    if (z == 0.f)
+    {
+        for (unsigned i = 0u; i < size; ++i, ++output)
+            *output = 0.f;
+        return -std::numeric_limits<float>::infinity();
+    }
+
+    float ret = 0.f;
+    for (unsigned i = 0u; i < size; ++i, ++input, ++output)
+    {
+        const float v = std::exp(*input - m) / z;
+        *output = v;
+        if (v > 0.f)
+            ret += v * (*input);
+    }
+    return ret;
+}
+
 }
\ No newline at end of file
@@ -0,0 +1,115 @@
+#pragma once
+
+/**
+ * Parallel execution of dynamic programs.
+ *
+ * Two levels of parallelism are available:
+ * - the elements of a mini-batch are processed in parallel (see parallel_for_batch).
+ *   The cost of a dynamic program grows (at least) cubically with the length of the sentence,
+ *   so elements are dispatched longest first to idle threads (dynamic scheduling)
+ *   instead of static chunks: long sentences start early and short ones fill the gaps at the end.
+ * - the spans of the same length of a single sentence are processed in parallel (wavefront),
+ *   with a synchronization between lengths.
+ *   This is only useful for long sentences, so it is disabled below a length threshold.
+ *   It is also disabled inside parallel_for_batch, where all threads are already busy.
+ *
+ * If the library is built without OpenMP, everything is sequential.
+ */
+
+#include <algorithm>
+#include <exception>
+#include <numeric>
+#include <vector>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+namespace diffdp
+{
+
+/**
+ * Set the number of threads used by dynamic programs.
+ * 1 (the default) disables parallel execution, 0 uses all available threads.
+ * This function is not thread-safe: it must not be called while a computation graph is executed.
+ */
+void set_num_threads(unsigned n);
+
+/**
+ * Return the number of threads used by dynamic programs.
+ */
+unsigned num_threads();
+
+/**
+ * Set the minimum sentence length (including the root) for which the spans of a single sentence
+ * are processed in parallel. Default: 128.
+ * This function is not thread-safe: it must not be called while a computation graph is executed.
+ */
+void set_wavefront_threshold(unsigned size);
+
+/**
+ * Return the minimum sentence length for which the spans of a single sentence are processed in parallel.
+ */
+unsigned wavefront_threshold();
+
+/**
+ * Return the number of threads to use to process spans of a sentence in parallel.
+ *
+ * @param size Size of the sentence
+ * @return 1 if the sentence is shorter than the threshold or if we are already in a parallel region
+ */
+unsigned wavefront_num_threads(unsigned size);
+
+/**
+ * Call f(b) for each b in [0, batch_size), possibly in parallel.
+ * Each call must only write data specific to its element of the batch.
+ *
+ * If calls throw exceptions, the first one is rethrown once all elements have been processed.
+ *
+ * @param batch_size Number of elements in the batch
+ * @param length Function returning the length of an element, used to schedule longest elements first
+ * @param f Function to call on each element
+ */
+template<class L, class F>
+void parallel_for_batch(const unsigned batch_size, L length, F f)
+{
+    const unsigned n_threads = std::min(num_threads(), batch_size);
+    if (n_threads <= 1u)
+    {
+        for (unsigned batch = 0u ; batch < batch_size ; ++batch)
+            f(batch);
+        return;
+    }
+
+    std::vector<unsigned> lengths(batch_size);
+    for (unsigned batch = 0u ; batch < batch_size ; ++batch)
+        lengths[batch] = length(batch);
+
+    std::vector<unsigned> order(batch_size);
+    std::iota(order.begin(), order.end(), 0u);
+    std::stable_sort(
+            order.begin(), order.end(),
+            [&] (const unsigned a, const unsigned b) { return lengths[a] > lengths[b]; }
+    );
+
+    // exceptions must not escape a parallel region
+    std::exception_ptr error = nullptr;
+    #pragma omp parallel for schedule(dynamic, 1) num_threads(n_threads)
+    for (unsigned i = 0u ; i < batch_size ; ++i)
+    {
+        try
+        {
+            f(order[i]);
+        }
+        catch (...)
+        {
+            #pragma omp critical(diffdp_parallel_for_batch)
+            if (error == nullptr)
+                error = std::current_exception();
+        }
+    }
+    if (error != nullptr)
+        std::rethrow_exception(error);
+}
+
+}
@@ -0,0 +1,193 @@
+#pragma once
+
+/**
+ * Pool of charts shared by all computation graphs.
+ *
+ * Allocating a chart is costly (its memory grows cubically with the size of the sentence),
+ * so charts that are not used anymore are kept in the pool and reused by later computations
+ * instead of being freed. A request is served by the smallest free chart with enough memory,
+ * which is resized in place: in the steady state of a training loop, no memory is allocated.
+ *
+ * The memory of free charts is only returned to the system by clear().
+ * All functions are thread-safe.
+ */
+
+#include <map>
+#include <memory>
+#include <mutex>
+
+namespace diffdp
+{
+
+/**
+ * Chart must have a constructor Chart(unsigned size, args...) that allocates its memory,
+ * a resize(unsigned size, args...) method, a static required_cells(unsigned size, args...) method
+ * and a memory_cells attribute.
+ */
+template<class Chart>
+struct ChartPool
+{
+    /**
+     * Return a chart of the given size, its content is undefined.
+     * It must be given back with release().
+     *
+     * @param size Size of the chart
+     * @param args Other arguments of the chart constructor (e.g. the split weights mode)
+     */
+    template<class... Args>
+    static Chart* acquire(const unsigned size, Args... args);
+
+    /**
+     * Give back a chart obtained with acquire().
+     */
+    static void release(Chart* chart);
+
+    /**
+     * Free the memory of all charts that are not in use.
+     */
+    static void clear();
+
+    /**
+     * Return the number of free charts in the pool.
+     */
+    static std::size_t size();
+
+private:
+    struct Storage
+    {
+        std::mutex mutex;
+        // free charts, indexed by the number of cells of their memory
+        std::multimap<std::size_t, std::unique_ptr<Chart>> charts;
+    };
+
+    // never destroyed, so charts can be given back during static destruction
+    static Storage& storage();
+};
+
+/**
+ * Chart acquired from the pool, given back on destruction.
+ */
+template<class Chart>
+struct PooledChart
+{
+    Chart* chart = nullptr;
+
+    PooledChart() = default;
+    template<class... Args>
+    explicit PooledChart(const unsigned size, Args... args);
+    PooledChart(PooledChart&& o) noexcept;
+    PooledChart& operator=(PooledChart&& o) noexcept;
+    PooledChart(const PooledChart&) = delete;
+    PooledChart& operator=(const PooledChart&) = delete;
+    ~PooledChart();
+
+    void reset();
+    Chart* get() const noexcept;
+};
+
+
+// templates implementations
+
+template<class Chart>
+typename ChartPool<Chart>::Storage& ChartPool<Chart>::storage()
+{
+    static Storage* storage = new Storage();
+    return *storage;
+}
+
+template<class Chart>
+template<class... Args>
+Chart* ChartPool<Chart>::acquire(const unsigned size, Args... args)
+{
+    Storage& s = storage();
+    std::unique_ptr<Chart> chart;
+    {
+        std::lock_guard<std::mutex> lock(s.mutex);
+        auto it = s.charts.lower_bound(Chart::required_cells(size, args...));
+        if (it != s.charts.end())
+        {
+            chart = std::move(it->second);
+            s.charts.erase(it);
+        }
+    }
+
+    if (chart == nullptr)
+        return new Chart(size, args...);
+
+    chart->resize(size, args...);
+    return chart.release();
+}
+
+template<class Chart>
+void ChartPool<Chart>::release(Chart* chart)
+{
+    if (chart == nullptr)
+        return;
+
+    Storage& s = storage();
+    std::lock_guard<std::mutex> lock(s.mutex);
+    s.charts.emplace(chart->memory_cells, std::unique_ptr<Chart>(chart));
+}
+
+template<class Chart>
+void ChartPool<Chart>::clear()
+{
+    Storage& s = storage();
+    std::lock_guard<std::mutex> lock(s.mutex);
+    s.charts.clear();
+}
+
+template<class Chart>
+std::size_t ChartPool<Chart>::size()
+{
+    Storage& s = storage();
+    std::lock_guard<std::mutex> lock(s.mutex);
+    return s.charts.size();
+}
+
+
+template<class Chart>
+template<class... Args>
+PooledChart<Chart>::PooledChart(const unsigned size, Args... args) :
+        chart(ChartPool<Chart>::acquire(size, args...))
+{}
+
+template<class Chart>
+PooledChart<Chart>::PooledChart(PooledChart&& o) noexcept :
+        chart(o.chart)
+{
+    o.chart = nullptr;
+}
+
+template<class Chart>
+PooledChart<Chart>& PooledChart<Chart>::operator=(PooledChart&& o) noexcept
+{
+    if (this != &o)
+    {
+        reset();
+        chart = o.chart;
+        o.chart = nullptr;
+    }
+    return *this;
+}
+
+template<class Chart>
+PooledChart<Chart>::~PooledChart()
+{
+    reset();
+}
+
+template<class Chart>
+void PooledChart<Chart>::reset()
+{
+    ChartPool<Chart>::release(chart);
+    chart = nullptr;
+}
+
+template<class Chart>
+Chart* PooledChart<Chart>::get() const noexcept
+{
+    return chart;
+}
+
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+/**
+ * Gumbel noise drawn from a counter-based random number generator (Philox4x32-10, Salmon et al., 2011).
+ *
+ * The noise of a weight is a pure function of (seed, sentence, i, j):
+ * it can be drawn where the weight is read by a dynamic program instead of being stored in a tensor,
+ * it does not depend on the order in which threads read the weights,
+ * and the backward pass can draw it again instead of storing it.
+ */
+
+#include <cmath>
+#include <cstdint>
+
+namespace diffdp
+{
+
+/**
+ * Philox4x32 with 10 rounds: the four words of counter are replaced by four random words.
+ */
+inline void philox4x32(std::uint32_t counter[4], const std::uint32_t key[2])
+{
+    std::uint32_t k0 = key[0];
+    std::uint32_t k1 = key[1];
+    for (unsigned round = 0u ; round < 10u ; ++round)
+    {
+        const std::uint64_t p0 = (std::uint64_t) 0xD2511F53u * counter[0];
+        const std::uint64_t p1 = (std::uint64_t) 0xCD9E8D57u * counter[2];
+        const std::uint32_t c0 = (std::uint32_t) (p1 >> 32) ^ counter[1] ^ k0;
+        const std::uint32_t c2 = (std::uint32_t) (p0 >> 32) ^ counter[3] ^ k1;
+        counter[0] = c0;
+        counter[1] = (std::uint32_t) p1;
+        counter[2] = c2;
+        counter[3] = (std::uint32_t) p0;
+        k0 += 0x9E3779B9u;
+        k1 += 0xBB67AE85u;
+    }
+}
+
+/**
+ * Sample of the standard Gumbel distribution associated with weight (i, j) of a sentence.
+ */
+inline float gumbel_noise(const std::uint64_t seed, const unsigned sentence, const unsigned i, const unsigned j)
+{
+    std::uint32_t counter[4] = {i, j, sentence, 0u};
+    const std::uint32_t key[2] = {(std::uint32_t) seed, (std::uint32_t) (seed >> 32)};
+    philox4x32(counter, key);
+
+    // uniform in the open interval (0, 1), from the 24 high bits
+    const float u = ((float) (counter[0] >> 8) + 0.5f) * (1.f / 16777216.f);
+    return -std::log(-std::log(u));
+}
+
+/**
+ * Gumbel perturbation of the weights of a dynamic program, disabled by default.
+ * Nodes add the noise when they read the weights, so the perturbed weights are never stored.
+ */
+struct GumbelPerturbation
+{
+    bool enabled = false;
+    std::uint64_t seed = 0u;
+
+    GumbelPerturbation() = default;
+    explicit GumbelPerturbation(const std::uint64_t seed) :
+        enabled(true),
+        seed(seed)
+    {}
+
+    // noise of weight (i, j) of a sentence, zero if disabled
+    float operator()(const unsigned sentence, const unsigned i, const unsigned j) const
+    {
+        return enabled ? gumbel_noise(seed, sentence, i, j) : 0.f;
+    }
+};
+
+}
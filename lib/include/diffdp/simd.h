@@ -0,0 +1,62 @@
+#pragma once
+
+/**
+ * Vectorized kernels for contiguous float arrays.
+ *
+ * The kernels are implemented for several instruction sets (SSE2, AVX2+FMA, AVX-512)
+ * and the best one supported by the CPU is selected at runtime.
+ * On other architectures (or if the library is built without SIMD support),
+ * the scalar implementation is used.
+ *
+ * They should not be called directly:
+ * the functions in diffdp/math.h dispatch to them when all arguments are float pointers.
+ *
+ * Author: Caio Corro
+ */
+
+namespace diffdp
+{
+namespace simd
+{
+
+enum struct InstructionSet
+{
+    Scalar,
+    SSE,
+    AVX2,
+    AVX512
+};
+
+/**
+ * Return the best instruction set supported by the CPU (and by this build).
+ */
+InstructionSet best_instruction_set();
+
+/**
+ * Return the instruction set currently used by the kernels.
+ */
+InstructionSet instruction_set();
+
+/**
+ * Force the instruction set used by the kernels (e.g. for tests and benchmarks).
+ * This function is not thread-safe: it must not be called while kernels are running.
+ *
+ * @param set Instruction set to use, it must be supported by the CPU
+ */
+void set_instruction_set(InstructionSet set);
+
+bool is_supported(InstructionSet set);
+
+void cwise_add(float* output, const float* input1, const float* input2, unsigned size);
+float max(const float* input, unsigned size);
+void inplace_cwise_div(float* input, float v, unsigned size);
+void add(float* output, const float* input, unsigned size);
+void add_cwise_mult(float* output, const float* input, float v, unsigned size);
+float dot(const float* input1, const float* input2, unsigned size);
+float exp_minus_cst(float* output, const float* input, float m, unsigned size);
+void backprop_softmax(float* gradient_input, const float* gradient_output, const float* output, unsigned size);
+float cwise_add_partition(float* output, const float* input1, const float* input2, unsigned size, float* m);
+float normalized_exp_dot(float* output, const float* input, float m, float z, unsigned size);
+
+}
+}
@@ -1,31 +1,44 @@
+#include <stdexcept>
+#include <vector>
+
 #include "diffdp/algorithm/binary_phrase.h"
 
 namespace diffdp
 {
 
-BinaryPhraseStructureChart::BinaryPhraseStructureChart(unsigned size) :
+BinaryPhraseStructureChart::BinaryPhraseStructureChart(unsigned size, SplitWeightsMode mode, unsigned max_span_length) :
         size(size),
-        size_3d(size*size*size),
-        size_2d(size*size),
-        _memory(new float[size_3d * 2 + size_2d * 2]),
+        size_3d(SpanTensor3D<float>::required_cells(size, max_span_length)),
+        size_2d(MirroredMatrix<float>::required_cells(size, max_span_length)),
+        split_weights_mode(mode),
+        max_span_length(max_span_length),
+        _memory(new float[required_cells(size, mode, max_span_length)]),
         _erase_memory(true),
-        split_weights(size, _memory),
-        backptr(size, _memory + 1u*size_3d),
-        weight(size, _memory + 2u*size_3d),
-        soft_selection(size, _memory + 2u*size_3d + 1u*size_2d)
-{}
+        memory_cells(required_cells(size, mode, max_span_length)),
+        split_weights(size, nullptr),
+        backptr(size, nullptr),
+        weight(size, nullptr),
+        soft_selection(size, nullptr)
+{
+    resize(size, mode, max_span_length);
+}
 
-BinaryPhraseStructureChart::BinaryPhraseStructureChart(unsigned size, float* mem) :
+BinaryPhraseStructureChart::BinaryPhraseStructureChart(unsigned size, float* mem, SplitWeightsMode mode, unsigned max_span_length) :
         size(size),
-        size_3d(size*size*size),
-        size_2d(size*size),
+        size_3d(SpanTensor3D<float>::required_cells(size, max_span_length)),
+        size_2d(MirroredMatrix<float>::required_cells(size, max_span_length)),
+        split_weights_mode(mode),
+        max_span_length(max_span_length),
         _memory(mem),
         _erase_memory(false),
-        split_weights(size, _memory),
-        backptr(size, _memory + 1u*size_3d),
-        weight(size, _memory + 2u*size_3d),
-        soft_selection(size, _memory + 2u*size_3d + 1u*size_2d)
-{}
+        memory_cells(required_cells(size, mode, max_span_length)),
+        split_weights(size, nullptr),
+        backptr(size, nullptr),
+        weight(size, nullptr),
+        soft_selection(size, nullptr)
+{
+    resize(size, mode, max_span_length);
+}
 
 BinaryPhraseStructureChart::~BinaryPhraseStructureChart()
 {
@@ -33,61 +46,252 @@ BinaryPhraseStructureChart::~BinaryPhraseStructureChart()
         delete[] _memory;
 }
 
+void BinaryPhraseStructureChart::resize(const unsigned new_size, const SplitWeightsMode mode, const unsigned new_max_span_length)
+{
+    if (required_cells(new_size, mode, new_max_span_length) > memory_cells)
+        throw std::runtime_error("The chart is too small for this sentence");
+
+    size = new_size;
+    max_span_length = new_max_span_length;
+    size_3d = SpanTensor3D<float>::required_cells(size, max_span_length);
+    size_2d = MirroredMatrix<float>::required_cells(size, max_span_length);
+    split_weights_mode = mode;
+
+    // the split weights are stored last so that they can be dropped
+    const bool stored = (mode == SplitWeightsMode::Stored);
+    backptr.rebind(size, _memory, max_span_length);
+    split_weights.rebind(size, stored ? _memory + 1u*size_3d : nullptr, max_span_length);
+
+    float* mem = _memory + (stored ? 2u : 1u) * size_3d;
+    weight.rebind(size, mem, max_span_length);
+    soft_selection.rebind(size, mem + 1u*size_2d, max_span_length);
+}
+
+void BinaryPhraseStructureChart::rebind(const unsigned new_size, float* mem, const SplitWeightsMode mode, const unsigned new_max_span_length)
+{
+    if (_erase_memory)
+        throw std::runtime_error("Cannot rebind a chart that owns its memory");
+
+    _memory = mem;
+    memory_cells = required_cells(new_size, mode, new_max_span_length);
+    resize(new_size, mode, new_max_span_length);
+}
+
 void BinaryPhraseStructureChart::zeros()
 {
-    std::fill(_memory, _memory + required_cells(size), float{});
+    std::fill(_memory, _memory + required_cells(size, split_weights_mode, max_span_length), float{});
 }
 
-std::size_t BinaryPhraseStructureChart::required_memory(const unsigned size)
+void BinaryPhraseStructureChart::init_forward()
 {
-    return
-            2 * Tensor3D<float>::required_memory(size)
-            + 2 * Matrix<float>::required_memory(size)
-            ;
+    // spans of length 0
+    weight.zeros_diagonal();
+    soft_selection.zeros_upper_triangle();
 }
 
-unsigned BinaryPhraseStructureChart::required_cells(const unsigned size)
+void BinaryPhraseStructureChart::init_backward()
+{
+    // the gradients of the other spans are set by the gradient callback
+    soft_selection.zeros_diagonal();
+    weight.zeros_upper_triangle();
+}
+
+std::size_t BinaryPhraseStructureChart::required_memory(const unsigned size, const SplitWeightsMode mode, const unsigned max_span_length)
+{
+    return required_cells(size, mode, max_span_length) * sizeof(float);
+}
+
+std::size_t BinaryPhraseStructureChart::required_cells(const unsigned size, const SplitWeightsMode mode, const unsigned max_span_length)
 {
     return
-            2 * Tensor3D<float>::required_cells(size)
-            + 2 * Matrix<float>::required_cells(size)
+            (mode == SplitWeightsMode::Stored ? 2u : 1u) * SpanTensor3D<float>::required_cells(size, max_span_length)
+            + 2u * MirroredMatrix<float>::required_cells(size, max_span_length)
             ;
 }
 
 
-AlgorithmicDifferentiableBinaryPhraseStructure::AlgorithmicDifferentiableBinaryPhraseStructure(const unsigned t_size) :
+AlgorithmicDifferentiableBinaryPhraseStructure::AlgorithmicDifferentiableBinaryPhraseStructure(const unsigned t_size, const SplitWeightsMode mode, const unsigned max_span_length) :
         _size(t_size),
-        chart_forward(std::make_shared<BinaryPhraseStructureChart>(_size)),
-        chart_backward(std::make_shared<BinaryPhraseStructureChart>(_size))
+        _owned_chart_forward(new BinaryPhraseStructureChart(_size, mode, max_span_length)),
+        _owned_chart_backward(new BinaryPhraseStructureChart(_size, mode, max_span_length)),
+        chart_forward(_owned_chart_forward.get()),
+        chart_backward(_owned_chart_backward.get())
 {}
 
-AlgorithmicDifferentiableBinaryPhraseStructure::AlgorithmicDifferentiableBinaryPhraseStructure(std::shared_ptr<BinaryPhraseStructureChart> chart_forward, std::shared_ptr<BinaryPhraseStructureChart> chart_backward) :
+AlgorithmicDifferentiableBinaryPhraseStructure::AlgorithmicDifferentiableBinaryPhraseStructure(BinaryPhraseStructureChart* chart_forward, BinaryPhraseStructureChart* chart_backward) :
         _size(chart_forward->size),
         chart_forward(chart_forward),
         chart_backward(chart_backward)
 {}
 
-void AlgorithmicDifferentiableBinaryPhraseStructure::forward_maximize(std::shared_ptr<BinaryPhraseStructureChart>& chart_forward)
+void AlgorithmicDifferentiableBinaryPhraseStructure::forward_maximize(BinaryPhraseStructureChart* chart_forward)
 {
     const unsigned size = chart_forward->size;
+    // split weights of the current deduction, if they are not stored in the chart
+    std::vector<float> buffer(chart_forward->split_weights_mode == SplitWeightsMode::Stored ? 0u : size);
     for (unsigned l = 1u; l < size; ++l)
     {
-        for (unsigned i = 0u; i < size - l; ++i)
+        for (unsigned i = 0u; i < chart_forward->n_spans(l); ++i)
         {
             unsigned j = i + l;
+            const unsigned first = chart_forward->first_split(i, j);
 
             // use += because we initialized them with arc weights
             chart_forward->weight(i, j) += forward_algorithmic_softmax(
+                    chart_forward->weight.iter2(i, first), chart_forward->weight.iter1(first + 1, j),
+                    chart_forward->split_weights.iter3_or(i, j, first, buffer.data()),
+                    chart_forward->backptr.iter3(i, j, first),
+                    j - first
+            );
+            chart_forward->weight.mirror(i, j);
+        }
+    }
+}
+
+void AlgorithmicDifferentiableBinaryPhraseStructure::forward_backtracking(BinaryPhraseStructureChart* chart_forward)
+{
+    const unsigned size = chart_forward->size;
+    chart_forward->soft_selection(0, size - 1) = 1.0f;
+
+    for (unsigned l = size - 1; l >= 1; --l)
+    {
+        for (unsigned i = 0u; i < chart_forward->n_spans(l); ++i)
+        {
+            unsigned j = i + l;
+            const unsigned first = chart_forward->first_split(i, j);
+            diffdp::forward_backtracking(
+                    chart_forward->soft_selection.iter2(i, first), chart_forward->soft_selection.iter1(first + 1, j),
+                    chart_forward->soft_selection.fold(i, j),
+                    chart_forward->backptr.iter3(i, j, first),
+                    j - first
+            );
+        }
+    }
+}
+
+void AlgorithmicDifferentiableBinaryPhraseStructure::backward_backtracking(BinaryPhraseStructureChart* chart_forward, BinaryPhraseStructureChart* chart_backward)
+{
+    const unsigned size = chart_forward->size;
+
+    for (unsigned l = 1; l < size ; ++l)
+    {
+        for (unsigned i = 0; i < chart_forward->n_spans(l); ++i)
+        {
+            unsigned j = i + l;
+            const unsigned first = chart_forward->first_split(i, j);
+
+            diffdp::backward_backtracking(
+                    chart_forward->soft_selection.iter2(i, first), chart_forward->soft_selection.iter1(first + 1, j),
+                    chart_forward->soft_selection(i, j),
+                    chart_forward->backptr.iter3(i, j, first),
+
+                    chart_backward->soft_selection.iter2(i, first), chart_backward->soft_selection.iter1(first + 1, j),
+                    &chart_backward->soft_selection(i, j),
+                    chart_backward->backptr.iter3(i, j, first),
+
+                    j - first
+            );
+            chart_backward->soft_selection.mirror(i, j);
+        }
+    }
+
+}
+
+void AlgorithmicDifferentiableBinaryPhraseStructure::backward_maximize(BinaryPhraseStructureChart* chart_forward, BinaryPhraseStructureChart* chart_backward)
+{
+    const unsigned size = chart_forward->size;
+    // gradient of the split weights of the current deduction, if they are not stored in the chart
+    std::vector<float> buffer(chart_backward->split_weights_mode == SplitWeightsMode::Stored ? 0u : size);
+
+    for (unsigned l = size - 1; l >= 1; --l)
+    {
+        for (unsigned i = 0; i < chart_forward->n_spans(l); ++i)
+        {
+            unsigned j = i + l;
+            const unsigned first = chart_forward->first_split(i, j);
+
+            backward_algorithmic_softmax(
+                    chart_forward->weight.iter2(i, first), chart_forward->weight.iter1(first + 1, j),
+                    chart_forward->split_weights.iter3_or(i, j, first, nullptr),
+                    chart_forward->backptr.iter3(i, j, first),
+
+                    chart_backward->weight.iter2(i, first), chart_backward->weight.iter1(first + 1, j),
+                    chart_backward->weight.fold(i, j),
+                    chart_backward->split_weights.iter3_or(i, j, first, buffer.data()),
+                    chart_backward->backptr.iter3(i, j, first),
+
+                    j - first
+            );
+        }
+    }
+}
+
+unsigned AlgorithmicDifferentiableBinaryPhraseStructure::size() const
+{
+    return _size;
+}
+
+float AlgorithmicDifferentiableBinaryPhraseStructure::output(const unsigned left, const unsigned right) const
+{
+    // spans outside the band are never built
+    if (!chart_forward->in_band(left, right))
+        return 0.f;
+    return chart_forward->soft_selection(chart_forward->cell_left(left, right), chart_forward->cell_right(left, right));
+}
+
+float AlgorithmicDifferentiableBinaryPhraseStructure::gradient(const unsigned left, const unsigned right) const
+{
+    // spans outside the band are never built
+    if (!chart_forward->in_band(left, right))
+        return 0.f;
+    return chart_backward->weight(chart_forward->cell_left(left, right), chart_forward->cell_right(left, right));
+}
+
+
+
+SparsemaxBinaryPhraseStructure::SparsemaxBinaryPhraseStructure(const unsigned t_size, const SplitWeightsMode mode) :
+        _size(t_size),
+        _owned_chart_forward(new BinaryPhraseStructureChart(_size, mode)),
+        _owned_chart_backward(new BinaryPhraseStructureChart(_size, mode)),
+        chart_forward(_owned_chart_forward.get()),
+        chart_backward(_owned_chart_backward.get())
+{}
+
+SparsemaxBinaryPhraseStructure::SparsemaxBinaryPhraseStructure(BinaryPhraseStructureChart* chart_forward, BinaryPhraseStructureChart* chart_backward) :
+        _size(chart_forward->size),
+        chart_forward(chart_forward),
+        chart_backward(chart_backward)
+{
+    if (chart_forward->max_span_length > 0u)
+        throw std::runtime_error("The sparsemax relaxation does not support bounded span lengths");
+}
+
+void SparsemaxBinaryPhraseStructure::forward_maximize(BinaryPhraseStructureChart* chart_forward, SplitSupports* supports)
+{
+    const unsigned size = chart_forward->size;
+    supports->resize(size);
+    // split weights of the current deduction, if they are not stored in the chart
+    std::vector<float> buffer(chart_forward->split_weights_mode == SplitWeightsMode::Stored ? 0u : size);
+    for (unsigned l = 1u; l < size; ++l)
+    {
+        for (unsigned i = 0u; i < size - l; ++i)
+        {
+            unsigned j = i + l;
+
+            // use += because we initialized them with arc weights
+            chart_forward->weight(i, j) += forward_algorithmic_sparsemax(
                     chart_forward->weight.iter2(i, i), chart_forward->weight.iter1(i + 1, j),
-                    chart_forward->split_weights.iter3(i, j, i),
+                    chart_forward->split_weights.iter3_or(i, j, i, buffer.data()),
                     chart_forward->backptr.iter3(i, j, i),
-                    l
+                    Splits(l),
+                    (*supports)(i, j)
             );
+            chart_forward->weight.mirror(i, j);
         }
     }
 }
 
-void AlgorithmicDifferentiableBinaryPhraseStructure::forward_backtracking(std::shared_ptr<BinaryPhraseStructureChart>& chart_forward)
+void SparsemaxBinaryPhraseStructure::forward_backtracking(BinaryPhraseStructureChart* chart_forward, const SplitSupports* supports)
 {
     const unsigned size = chart_forward->size;
     chart_forward->soft_selection(0, size - 1) = 1.0f;
@@ -99,15 +303,15 @@ void AlgorithmicDifferentiableBinaryPhraseStructure::forward_backtracking(std::s
             unsigned j = i + l;
             diffdp::forward_backtracking(
                     chart_forward->soft_selection.iter2(i, i), chart_forward->soft_selection.iter1(i + 1, j),
-                    chart_forward->soft_selection(i, j),
+                    chart_forward->soft_selection.fold(i, j),
                     chart_forward->backptr.iter3(i, j, i),
-                    l
+                    supports->splits(i, j)
             );
         }
     }
 }
 
-void AlgorithmicDifferentiableBinaryPhraseStructure::backward_backtracking(std::shared_ptr<BinaryPhraseStructureChart>& chart_forward, std::shared_ptr<BinaryPhraseStructureChart>& chart_backward)
+void SparsemaxBinaryPhraseStructure::backward_backtracking(BinaryPhraseStructureChart* chart_forward, BinaryPhraseStructureChart* chart_backward, const SplitSupports* supports)
 {
     const unsigned size = chart_forward->size;
 
@@ -126,16 +330,19 @@ void AlgorithmicDifferentiableBinaryPhraseStructure::backward_backtracking(std::
                     &chart_backward->soft_selection(i, j),
                     chart_backward->backptr.iter3(i, j, i),
 
-                    l
+                    supports->splits(i, j)
             );
+            chart_backward->soft_selection.mirror(i, j);
         }
     }
 
 }
 
-void AlgorithmicDifferentiableBinaryPhraseStructure::backward_maximize(std::shared_ptr<BinaryPhraseStructureChart>& chart_forward, std::shared_ptr<BinaryPhraseStructureChart>& chart_backward)
+void SparsemaxBinaryPhraseStructure::backward_maximize(BinaryPhraseStructureChart* chart_forward, BinaryPhraseStructureChart* chart_backward, const SplitSupports* supports)
 {
     const unsigned size = chart_forward->size;
+    // gradient of the split weights of the current deduction, if they are not stored in the chart
+    std::vector<float> buffer(chart_backward->split_weights_mode == SplitWeightsMode::Stored ? 0u : size);
 
     for (unsigned l = size - 1; l >= 1; --l)
     {
@@ -143,87 +350,94 @@ void AlgorithmicDifferentiableBinaryPhraseStructure::backward_maximize(std::shar
         {
             unsigned j = i + l;
 
-            backward_algorithmic_softmax(
+            backward_algorithmic_sparsemax(
                     chart_forward->weight.iter2(i, i), chart_forward->weight.iter1(i + 1, j),
-                    chart_forward->split_weights.iter3(i, j, i),
+                    chart_forward->split_weights.iter3_or(i, j, i, nullptr),
                     chart_forward->backptr.iter3(i, j, i),
 
                     chart_backward->weight.iter2(i, i), chart_backward->weight.iter1(i + 1, j),
-                    chart_backward->weight(i, j),
-                    chart_backward->split_weights.iter3(i, j, i),
+                    chart_backward->weight.fold(i, j),
+                    chart_backward->split_weights.iter3_or(i, j, i, buffer.data()),
                     chart_backward->backptr.iter3(i, j, i),
 
-                    l
+                    supports->splits(i, j)
             );
         }
     }
 }
 
-unsigned AlgorithmicDifferentiableBinaryPhraseStructure::size() const
+unsigned SparsemaxBinaryPhraseStructure::size() const
 {
     return _size;
 }
 
-float AlgorithmicDifferentiableBinaryPhraseStructure::output(const unsigned left, const unsigned right) const
+float SparsemaxBinaryPhraseStructure::output(const unsigned left, const unsigned right) const
 {
     return chart_forward->soft_selection(left, right);
 }
 
-float AlgorithmicDifferentiableBinaryPhraseStructure::gradient(const unsigned left, const unsigned right) const
+float SparsemaxBinaryPhraseStructure::gradient(const unsigned left, const unsigned right) const
 {
     return chart_backward->weight(left, right);
 }
 
 
 
-EntropyRegularizedBinaryPhraseStructure::EntropyRegularizedBinaryPhraseStructure(const unsigned t_size) :
+EntropyRegularizedBinaryPhraseStructure::EntropyRegularizedBinaryPhraseStructure(const unsigned t_size, const SplitWeightsMode mode, const unsigned max_span_length) :
         _size(t_size),
-        chart_forward(std::make_shared<BinaryPhraseStructureChart>(_size)),
-        chart_backward(std::make_shared<BinaryPhraseStructureChart>(_size))
+        _owned_chart_forward(new BinaryPhraseStructureChart(_size, mode, max_span_length)),
+        _owned_chart_backward(new BinaryPhraseStructureChart(_size, mode, max_span_length)),
+        chart_forward(_owned_chart_forward.get()),
+        chart_backward(_owned_chart_backward.get())
 {}
 
-EntropyRegularizedBinaryPhraseStructure::EntropyRegularizedBinaryPhraseStructure(std::shared_ptr<BinaryPhraseStructureChart> chart_forward, std::shared_ptr<BinaryPhraseStructureChart> chart_backward) :
+EntropyRegularizedBinaryPhraseStructure::EntropyRegularizedBinaryPhraseStructure(BinaryPhraseStructureChart* chart_forward, BinaryPhraseStructureChart* chart_backward) :
         _size(chart_forward->size),
         chart_forward(chart_forward),
         chart_backward(chart_backward)
 {}
 
 
-void EntropyRegularizedBinaryPhraseStructure::forward_maximize(std::shared_ptr<BinaryPhraseStructureChart>& chart_forward)
+void EntropyRegularizedBinaryPhraseStructure::forward_maximize(BinaryPhraseStructureChart* chart_forward)
 {
     const unsigned size = chart_forward->size;
+    // split weights of the current deduction, if they are not stored in the chart
+    std::vector<float> buffer(chart_forward->split_weights_mode == SplitWeightsMode::Stored ? 0u : size);
     for (unsigned l = 1u; l < size; ++l)
     {
-        for (unsigned i = 0u; i < size - l; ++i)
+        for (unsigned i = 0u; i < chart_forward->n_spans(l); ++i)
         {
             unsigned j = i + l;
+            const unsigned first = chart_forward->first_split(i, j);
 
             // use += because we initialized them with arc weights
             chart_forward->weight(i, j) += forward_entropy_reg(
-                    chart_forward->weight.iter2(i, i), chart_forward->weight.iter1(i + 1, j),
-                    chart_forward->split_weights.iter3(i, j, i),
-                    chart_forward->backptr.iter3(i, j, i),
-                    l
+                    chart_forward->weight.iter2(i, first), chart_forward->weight.iter1(first + 1, j),
+                    chart_forward->split_weights.iter3_or(i, j, first, buffer.data()),
+                    chart_forward->backptr.iter3(i, j, first),
+                    j - first
             );
+            chart_forward->weight.mirror(i, j);
         }
     }
 }
 
-void EntropyRegularizedBinaryPhraseStructure::forward_backtracking(std::shared_ptr<BinaryPhraseStructureChart>& chart_forward)
+void EntropyRegularizedBinaryPhraseStructure::forward_backtracking(BinaryPhraseStructureChart* chart_forward)
 {
     const unsigned size = chart_forward->size;
     chart_forward->soft_selection(0, size - 1) = 1.0f;
 
     for (unsigned l = size - 1; l >= 1; --l)
     {
-        for (unsigned i = 0u; i < size - l; ++i)
+        for (unsigned i = 0u; i < chart_forward->n_spans(l); ++i)
         {
             unsigned j = i + l;
+            const unsigned first = chart_forward->first_split(i, j);
             diffdp::forward_backtracking(
-                    chart_forward->soft_selection.iter2(i, i), chart_forward->soft_selection.iter1(i + 1, j),
-                    chart_forward->soft_selection(i, j),
-                    chart_forward->backptr.iter3(i, j, i),
-                    l
+                    chart_forward->soft_selection.iter2(i, first), chart_forward->soft_selection.iter1(first + 1, j),
+                    chart_forward->soft_selection.fold(i, j),
+                    chart_forward->backptr.iter3(i, j, first),
+                    j - first
             );
         }
     }
@@ -237,59 +451,70 @@ unsigned EntropyRegularizedBinaryPhraseStructure::size() const
 
 float EntropyRegularizedBinaryPhraseStructure::output(const unsigned left, const unsigned right) const
 {
-    return chart_forward->soft_selection(left, right);
+    // spans outside the band are never built
+    if (!chart_forward->in_band(left, right))
+        return 0.f;
+    return chart_forward->soft_selection(chart_forward->cell_left(left, right), chart_forward->cell_right(left, right));
 }
 
 float EntropyRegularizedBinaryPhraseStructure::gradient(const unsigned left, const unsigned right) const
 {
-    return chart_backward->weight(left, right);
+    // spans outside the band are never built
+    if (!chart_forward->in_band(left, right))
+        return 0.f;
+    return chart_backward->weight(chart_forward->cell_left(left, right), chart_forward->cell_right(left, right));
 }
 
-void EntropyRegularizedBinaryPhraseStructure::backward_backtracking(std::shared_ptr<BinaryPhraseStructureChart>& chart_forward, std::shared_ptr<BinaryPhraseStructureChart>& chart_backward)
+void EntropyRegularizedBinaryPhraseStructure::backward_backtracking(BinaryPhraseStructureChart* chart_forward, BinaryPhraseStructureChart* chart_backward)
 {
     const unsigned size = chart_forward->size;
 
     for (unsigned l = 1; l < size ; ++l)
     {
-        for (unsigned i = 0; i < size - l; ++i)
+        for (unsigned i = 0; i < chart_forward->n_spans(l); ++i)
         {
             unsigned j = i + l;
+            const unsigned first = chart_forward->first_split(i, j);
 
             diffdp::backward_backtracking(
-                    chart_forward->soft_selection.iter2(i, i), chart_forward->soft_selection.iter1(i + 1, j),
+                    chart_forward->soft_selection.iter2(i, first), chart_forward->soft_selection.iter1(first + 1, j),
                     chart_forward->soft_selection(i, j),
-                    chart_forward->backptr.iter3(i, j, i),
+                    chart_forward->backptr.iter3(i, j, first),
 
-                    chart_backward->soft_selection.iter2(i, i), chart_backward->soft_selection.iter1(i + 1, j),
+                    chart_backward->soft_selection.iter2(i, first), chart_backward->soft_selection.iter1(first + 1, j),
                     &chart_backward->soft_selection(i, j),
-                    chart_backward->backptr.iter3(i, j, i),
+                    chart_backward->backptr.iter3(i, j, first),
 
-                    l
+                    j - first
             );
+            chart_backward->soft_selection.mirror(i, j);
         }
     }
 }
-void EntropyRegularizedBinaryPhraseStructure::backward_maximize(std::shared_ptr<BinaryPhraseStructureChart>& chart_forward, std::shared_ptr<BinaryPhraseStructureChart>& chart_backward)
+void EntropyRegularizedBinaryPhraseStructure::backward_maximize(BinaryPhraseStructureChart* chart_forward, BinaryPhraseStructureChart* chart_backward)
 {
     const unsigned size = chart_forward->size;
+    // gradient of the split weights of the current deduction, if they are not stored in the chart
+    std::vector<float> buffer(chart_backward->split_weights_mode == SplitWeightsMode::Stored ? 0u : size);
 
     for (unsigned l = size - 1; l >= 1; --l)
     {
-        for (unsigned i = 0; i < size - l; ++i)
+        for (unsigned i = 0; i < chart_forward->n_spans(l); ++i)
         {
             unsigned j = i + l;
+            const unsigned first = chart_forward->first_split(i, j);
 
             backward_entropy_reg(
-                    chart_forward->weight.iter2(i, i), chart_forward->weight.iter1(i + 1, j),
-                    chart_forward->split_weights.iter3(i, j, i),
-                    chart_forward->backptr.iter3(i, j, i),
+                    chart_forward->weight.iter2(i, first), chart_forward->weight.iter1(first + 1, j),
+                    chart_forward->split_weights.iter3_or(i, j, first, nullptr),
+                    chart_forward->backptr.iter3(i, j, first),
 
-                    chart_backward->weight.iter2(i, i), chart_backward->weight.iter1(i + 1, j),
-                    chart_backward->weight(i, j),
-                    chart_backward->split_weights.iter3(i, j, i),
-                    chart_backward->backptr.iter3(i, j, i),
+                    chart_backward->weight.iter2(i, first), chart_backward->weight.iter1(first + 1, j),
+                    chart_backward->weight.fold(i, j),
+                    chart_backward->split_weights.iter3_or(i, j, first, buffer.data()),
+                    chart_backward->backptr.iter3(i, j, first),
 
-                    l
+                    j - first
             );
         }
     }
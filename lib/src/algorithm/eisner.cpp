@@ -1,55 +1,46 @@
+#include <algorithm>
+#include <stdexcept>
+#include <vector>
+
 #include "diffdp/algorithm/eisner.h"
+#include "diffdp/parallel.h"
 
 namespace diffdp
 {
 
-EisnerChart::EisnerChart(unsigned size) :
+EisnerChart::EisnerChart(unsigned size, SplitWeightsMode mode, unsigned vine_length) :
     size(size),
-    size_3d(size*size*size),
-    size_2d(size*size),
-    _memory(new float[size_3d * 8 + size_2d * 8]),
+    size_3d(SpanTensor3D<float>::required_cells(size, vine_length)),
+    size_2d(MirroredMatrix<float>::required_cells(size, vine_length)),
+    split_weights_mode(mode),
+    vine_length(vine_length),
+    _memory(new float[required_cells(size, mode, vine_length)]),
     _erase_memory(true),
-    a_cleft(size, _memory),
-    a_cright(size, _memory + 1u*size_3d),
-    a_uleft(size, _memory + 2u*size_3d),
-    a_uright(size, _memory + 3u*size_3d),
-    b_cleft(size, _memory + 4u*size_3d),
-    b_cright(size, _memory + 5u*size_3d),
-    b_uleft(size, _memory + 6u*size_3d),
-    b_uright(size, _memory + 7u*size_3d),
-    c_cleft(size, _memory + 8u*size_3d),
-    c_cright(size, _memory + 8u*size_3d + 1u*size_2d),
-    c_uleft(size, _memory + 8u*size_3d + 2u*size_2d),
-    c_uright(size, _memory + 8u*size_3d + 3u*size_2d),
-    soft_c_cleft(size, _memory + 8u*size_3d + 4u*size_2d),
-    soft_c_cright(size, _memory + 8u*size_3d + 5u*size_2d),
-    soft_c_uleft(size, _memory + 8u*size_3d + 6u*size_2d),
-    soft_c_uright(size, _memory + 8u*size_3d + 7u*size_2d)
-{}
+    memory_cells(required_cells(size, mode, vine_length)),
+    a_cleft(size, nullptr), a_cright(size, nullptr), a_u(size, nullptr),
+    b_cleft(size, nullptr), b_cright(size, nullptr), b_u(size, nullptr),
+    c_cleft(size, nullptr), c_cright(size, nullptr), c_uleft(size, nullptr), c_uright(size, nullptr),
+    soft_c_cleft(size, nullptr), soft_c_cright(size, nullptr), soft_c_uleft(size, nullptr), soft_c_uright(size, nullptr)
+{
+    resize(size, mode, vine_length);
+}
 
-EisnerChart::EisnerChart(unsigned size, float* mem) :
+EisnerChart::EisnerChart(unsigned size, float* mem, SplitWeightsMode mode, unsigned vine_length) :
     size(size),
-    size_3d(size*size*size),
-    size_2d(size*size),
+    size_3d(SpanTensor3D<float>::required_cells(size, vine_length)),
+    size_2d(MirroredMatrix<float>::required_cells(size, vine_length)),
+    split_weights_mode(mode),
+    vine_length(vine_length),
     _memory(mem),
     _erase_memory(false),
-    a_cleft(size, mem),
-    a_cright(size, mem + 1u*size_3d),
-    a_uleft(size, mem + 2u*size_3d),
-    a_uright(size, mem + 3u*size_3d),
-    b_cleft(size, mem + 4u*size_3d),
-    b_cright(size, mem + 5u*size_3d),
-    b_uleft(size, mem + 6u*size_3d),
-    b_uright(size, mem + 7u*size_3d),
-    c_cleft(size, mem + 8u*size_3d),
-    c_cright(size, mem + 8u*size_3d + 1u*size_2d),
-    c_uleft(size, mem + 8u*size_3d + 2u*size_2d),
-    c_uright(size, mem + 8u*size_3d + 3u*size_2d),
-    soft_c_cleft(size, mem + 8u*size_3d + 4u*size_2d),
-    soft_c_cright(size, mem + 8u*size_3d + 5u*size_2d),
-    soft_c_uleft(size, mem + 8u*size_3d + 6u*size_2d),
-    soft_c_uright(size, mem + 8u*size_3d + 7u*size_2d)
-{}
+    memory_cells(required_cells(size, mode, vine_length)),
+    a_cleft(size, nullptr), a_cright(size, nullptr), a_u(size, nullptr),
+    b_cleft(size, nullptr), b_cright(size, nullptr), b_u(size, nullptr),
+    c_cleft(size, nullptr), c_cright(size, nullptr), c_uleft(size, nullptr), c_uright(size, nullptr),
+    soft_c_cleft(size, nullptr), soft_c_cright(size, nullptr), soft_c_uleft(size, nullptr), soft_c_uright(size, nullptr)
+{
+    resize(size, mode, vine_length);
+}
 
 EisnerChart::~EisnerChart()
 {
@@ -57,172 +48,1022 @@ EisnerChart::~EisnerChart()
         delete[] _memory;
 }
 
+void EisnerChart::resize(const unsigned new_size, const SplitWeightsMode mode, const unsigned new_vine_length)
+{
+    if (required_cells(new_size, mode, new_vine_length) > memory_cells)
+        throw std::runtime_error("The chart is too small for this sentence");
+
+    size = new_size;
+    vine_length = new_vine_length;
+    size_3d = SpanTensor3D<float>::required_cells(size, vine_length);
+    size_2d = MirroredMatrix<float>::required_cells(size, vine_length);
+    split_weights_mode = mode;
+
+    // the split weights are stored last so that they can be dropped
+    const bool stored = (mode == SplitWeightsMode::Stored);
+    b_cleft.rebind(size, _memory, vine_length);
+    b_cright.rebind(size, _memory + 1u*size_3d, vine_length);
+    b_u.rebind(size, _memory + 2u*size_3d, vine_length);
+    a_cleft.rebind(size, stored ? _memory + 3u*size_3d : nullptr, vine_length);
+    a_cright.rebind(size, stored ? _memory + 4u*size_3d : nullptr, vine_length);
+    a_u.rebind(size, stored ? _memory + 5u*size_3d : nullptr, vine_length);
+
+    float* mem = _memory + (stored ? 6u : 3u) * size_3d;
+    c_cleft.rebind(size, mem, vine_length);
+    c_cright.rebind(size, mem + 1u*size_2d, vine_length);
+    c_uleft.rebind(size, mem + 2u*size_2d, vine_length);
+    c_uright.rebind(size, mem + 3u*size_2d, vine_length);
+    soft_c_cleft.rebind(size, mem + 4u*size_2d, vine_length);
+    soft_c_cright.rebind(size, mem + 5u*size_2d, vine_length);
+    soft_c_uleft.rebind(size, mem + 6u*size_2d, vine_length);
+    soft_c_uright.rebind(size, mem + 7u*size_2d, vine_length);
+}
+
+void EisnerChart::rebind(const unsigned new_size, float* mem, const SplitWeightsMode mode, const unsigned new_vine_length)
+{
+    if (_erase_memory)
+        throw std::runtime_error("Cannot rebind a chart that owns its memory");
+
+    _memory = mem;
+    memory_cells = required_cells(new_size, mode, new_vine_length);
+    resize(new_size, mode, new_vine_length);
+}
+
 void EisnerChart::zeros()
 {
-    std::fill(_memory, _memory + size_3d * 8 + size_2d * 8, float{});
+    std::fill(_memory, _memory + required_cells(size, split_weights_mode, vine_length), float{});
 }
 
-std::size_t EisnerChart::required_memory(const unsigned size)
+void EisnerChart::init_forward()
 {
-    return
-            8 * Tensor3D<float>::required_memory(size)
-            + 8 * Matrix<float>::required_memory(size)
-            ;
+    // complete items of length 0
+    c_cleft.zeros_diagonal();
+    c_cright.zeros_diagonal();
+
+    soft_c_cleft.zeros_upper_triangle();
+    soft_c_cright.zeros_upper_triangle();
+    soft_c_uleft.zeros_upper_triangle();
+    soft_c_uright.zeros_upper_triangle();
+}
+
+void EisnerChart::init_backward()
+{
+    // the gradients of the incomplete items are set by the gradient callback
+    soft_c_cleft.zeros_upper_triangle();
+    soft_c_cright.zeros_upper_triangle();
+
+    c_cleft.zeros_upper_triangle();
+    c_cright.zeros_upper_triangle();
+    c_uleft.zeros_upper_triangle();
+    c_uright.zeros_upper_triangle();
 }
 
-unsigned EisnerChart::required_cells(const unsigned size)
+std::size_t EisnerChart::required_memory(const unsigned size, const SplitWeightsMode mode, const unsigned vine_length)
+{
+    return required_cells(size, mode, vine_length) * sizeof(float);
+}
+
+std::size_t EisnerChart::required_cells(const unsigned size, const SplitWeightsMode mode, const unsigned vine_length)
 {
     return
-            8 * Tensor3D<float>::required_cells(size)
-            + 8 * Matrix<float>::required_cells(size)
+            (mode == SplitWeightsMode::Stored ? 6u : 3u) * SpanTensor3D<float>::required_cells(size, vine_length)
+            + 8u * MirroredMatrix<float>::required_cells(size, vine_length)
             ;
 }
 
 
-AlgorithmicDifferentiableEisner::AlgorithmicDifferentiableEisner(const unsigned t_size) :
+AlgorithmicDifferentiableEisner::AlgorithmicDifferentiableEisner(const unsigned t_size, const SplitWeightsMode mode, const unsigned vine_length) :
     _size(t_size),
-    chart_forward(std::make_shared<EisnerChart>(_size)),
-    chart_backward(std::make_shared<EisnerChart>(_size))
+    _owned_chart_forward(new EisnerChart(_size, mode, vine_length)),
+    _owned_chart_backward(new EisnerChart(_size, mode, vine_length)),
+    chart_forward(_owned_chart_forward.get()),
+    chart_backward(_owned_chart_backward.get())
 {}
 
-AlgorithmicDifferentiableEisner::AlgorithmicDifferentiableEisner(std::shared_ptr<EisnerChart> chart_forward, std::shared_ptr<EisnerChart> chart_backward) :
+AlgorithmicDifferentiableEisner::AlgorithmicDifferentiableEisner(EisnerChart* chart_forward, EisnerChart* chart_backward) :
         _size(chart_forward->size),
         chart_forward(chart_forward),
         chart_backward(chart_backward)
 {}
 
-void AlgorithmicDifferentiableEisner::forward_maximize(std::shared_ptr<EisnerChart>& chart_forward)
+void AlgorithmicDifferentiableEisner::forward_maximize(EisnerChart* chart_forward, const ArcPruning* pruning)
 {
     const unsigned size = chart_forward->size;
-    for (unsigned l = 1u; l < size; ++l)
+    const unsigned n_threads = wavefront_num_threads(size);
+
+    // item values are mirrored as soon as they are computed,
+    // so that longer spans can read them by column
+    #pragma omp parallel num_threads(n_threads) if(n_threads > 1u)
     {
-        for (unsigned i = 0u; i < size - l; ++i)
+        // split weights of the current deduction, if they are not stored in the chart
+        std::vector<float> buffer(chart_forward->split_weights_mode == SplitWeightsMode::Stored ? 0u : size);
+        for (unsigned l = 1u; l < size; ++l)
+        {
+            // spans of the same length only read shorter spans
+            #pragma omp for schedule(static)
+            for (unsigned i = 0u; i < chart_forward->n_spans(l); ++i)
+            {
+                unsigned j = i + l;
+                const unsigned u_first = chart_forward->u_first_split(i, j);
+                const unsigned cright_first = chart_forward->cright_first_split(i, j);
+
+                // uleft(i, j) and uright(i, j) have the same antecedents,
+                // so the split distribution is computed once for both
+                const float u = forward_algorithmic_softmax(
+                        chart_forward->c_cright.iter2(i, u_first), chart_forward->c_cleft.iter1(u_first + 1, j),
+                        chart_forward->a_u.iter3_or(i, j, u_first, buffer.data()),
+                        chart_forward->b_u.iter3(i, j, u_first),
+                        incomplete_splits(pruning, i, j, u_first)
+                );
+
+                // use += because we initialized them with arc weights
+                chart_forward->c_uright(i, j) += u;
+                chart_forward->c_uright.mirror(i, j);
+                if (i > 0u) // because the root cannot be the modifier
+                {
+                    chart_forward->c_uleft(i, j) += u;
+                    chart_forward->c_uleft.mirror(i, j);
+                }
+
+                chart_forward->c_cright(i, j) = forward_algorithmic_softmax(
+                        chart_forward->c_uright.iter2(i, cright_first), chart_forward->c_cright.iter1(cright_first, j),
+                        chart_forward->a_cright.iter3_or(i, j, cright_first, buffer.data()),
+                        chart_forward->b_cright.iter3(i, j, cright_first),
+                        cright_splits(pruning, i, j, cright_first)
+                );
+                chart_forward->c_cright.mirror(i, j);
+
+                if (i > 0u)
+                {
+                    chart_forward->c_cleft(i, j) = forward_algorithmic_softmax(
+                            chart_forward->c_cleft.iter2(i, i), chart_forward->c_uleft.iter1(i, j),
+                            chart_forward->a_cleft.iter3_or(i, j, i, buffer.data()),
+                            chart_forward->b_cleft.iter3(i, j, i),
+                            cleft_splits(pruning, i, j)
+                    );
+                    chart_forward->c_cleft.mirror(i, j);
+                }
+            }
+        }
+    }
+}
+
+float AlgorithmicDifferentiableEisner::forward_backtracking(EisnerChart* chart_forward, const ArcPruning* pruning, const float threshold)
+{
+    const unsigned size = chart_forward->size;
+    const unsigned n_threads = wavefront_num_threads(size);
+
+    chart_forward->soft_c_cright(0, size - 1) = 1.0f;
+
+    // contributions are pushed to a row and a column of shorter spans:
+    // the column part is accumulated in the transposed storage and folded when the item is reached,
+    // so spans of the same length never write to the same memory.
+    // The contribution of an item is complete when it is reached, so it can be compared to the threshold
+    float dropped_mass = 0.f;
+    #pragma omp parallel num_threads(n_threads) if(n_threads > 1u) reduction(+:dropped_mass)
+    for (unsigned l = size - 1; l >= 1; --l)
+    {
+        #pragma omp for schedule(static)
+        for (unsigned i = 0u; i < chart_forward->n_spans(l); ++i)
         {
             unsigned j = i + l;
+            const unsigned u_first = chart_forward->u_first_split(i, j);
+            const unsigned cright_first = chart_forward->cright_first_split(i, j);
 
-            // use += because we initialized them with arc weights
-            chart_forward->c_uright(i, j) += forward_algorithmic_softmax(
-                    chart_forward->c_cright.iter2(i, i), chart_forward->c_cleft.iter1(i + 1, j),
-                    chart_forward->a_uright.iter3(i, j, i),
-                    chart_forward->b_uright.iter3(i, j, i),
-                    l
-            );
+            const float contrib_cright = chart_forward->soft_c_cright.fold(i, j);
+            if (contrib_cright < threshold)
+                dropped_mass += contrib_cright;
+            else
+                diffdp::forward_backtracking(
+                        chart_forward->soft_c_uright.iter2(i, cright_first), chart_forward->soft_c_cright.iter1(cright_first, j),
+                        contrib_cright,
+                        chart_forward->b_cright.iter3(i, j, cright_first),
+                        cright_splits(pruning, i, j, cright_first)
+                );
 
-            if (i > 0u) // because the root cannot be the modifier
+            if (i > 0u)
             {
-                chart_forward->c_uleft(i, j) += forward_algorithmic_softmax(
+                const float contrib_cleft = chart_forward->soft_c_cleft.fold(i, j);
+                if (contrib_cleft < threshold)
+                    dropped_mass += contrib_cleft;
+                else
+                    diffdp::forward_backtracking(
+                            chart_forward->soft_c_cleft.iter2(i, i), chart_forward->soft_c_uleft.iter1(i, j),
+                            contrib_cleft,
+                            chart_forward->b_cleft.iter3(i, j, i),
+                            cleft_splits(pruning, i, j)
+                    );
+            }
+
+            // shared split distribution of uleft(i, j) and uright(i, j)
+            const float contrib_u = chart_forward->soft_c_uright.fold(i, j) + (i > 0u ? chart_forward->soft_c_uleft.fold(i, j) : 0.f);
+            if (contrib_u < threshold)
+                dropped_mass += contrib_u;
+            else
+                diffdp::forward_backtracking(
+                        chart_forward->soft_c_cright.iter2(i, u_first), chart_forward->soft_c_cleft.iter1(u_first + 1, j),
+                        contrib_u,
+                        chart_forward->b_u.iter3(i, j, u_first),
+                        incomplete_splits(pruning, i, j, u_first)
+                );
+        }
+    }
+    return dropped_mass;
+}
+
+void AlgorithmicDifferentiableEisner::backward_backtracking(EisnerChart* chart_forward, EisnerChart* chart_backward, const ArcPruning* pruning, const float threshold)
+{
+    const unsigned size = chart_forward->size;
+    const unsigned n_threads = wavefront_num_threads(size);
+
+    // the gradients of the backtracking contributions are values (see forward_maximize).
+    // Skipped items do not depend on their contribution (the threshold is piecewise constant)
+    #pragma omp parallel num_threads(n_threads) if(n_threads > 1u)
+    for (unsigned l = 1; l < size ; ++l)
+    {
+        // spans of the same length only write their own gradients
+        #pragma omp for schedule(static)
+        for (unsigned i = 0; i < chart_forward->n_spans(l); ++i)
+        {
+            unsigned j = i + l;
+            const unsigned u_first = chart_forward->u_first_split(i, j);
+            const unsigned cright_first = chart_forward->cright_first_split(i, j);
+
+            // shared split distribution of uleft(i, j) and uright(i, j):
+            // both items receive the same gradient
+            float gradient_u = 0.f;
+            const float contrib_u = chart_forward->soft_c_uright(i, j) + (i > 0u ? chart_forward->soft_c_uleft(i, j) : 0.f);
+            if (contrib_u < threshold)
+                backward_skipped_backtracking(chart_backward->b_u.iter3(i, j, u_first), incomplete_splits(pruning, i, j, u_first));
+            else
+                diffdp::backward_backtracking(
+                        chart_forward->soft_c_cright.iter2(i, u_first), chart_forward->soft_c_cleft.iter1(u_first + 1, j),
+                        contrib_u,
+                        chart_forward->b_u.iter3(i, j, u_first),
+
+                        chart_backward->soft_c_cright.iter2(i, u_first), chart_backward->soft_c_cleft.iter1(u_first + 1, j),
+                        &gradient_u,
+                        chart_backward->b_u.iter3(i, j, u_first),
+
+                        incomplete_splits(pruning, i, j, u_first)
+                );
+            chart_backward->soft_c_uright(i, j) += gradient_u;
+            chart_backward->soft_c_uright.mirror(i, j);
+            if (i > 0u)
+            {
+                chart_backward->soft_c_uleft(i, j) += gradient_u;
+                chart_backward->soft_c_uleft.mirror(i, j);
+            }
+
+            if (i > 0u)
+            {
+                if (chart_forward->soft_c_cleft(i, j) < threshold)
+                    backward_skipped_backtracking(chart_backward->b_cleft.iter3(i, j, i), cleft_splits(pruning, i, j));
+                else
+                    diffdp::backward_backtracking(
+                            chart_forward->soft_c_cleft.iter2(i, i), chart_forward->soft_c_uleft.iter1(i, j),
+                            chart_forward->soft_c_cleft(i, j),
+                            chart_forward->b_cleft.iter3(i, j, i),
+
+                            chart_backward->soft_c_cleft.iter2(i, i), chart_backward->soft_c_uleft.iter1(i, j),
+                            &chart_backward->soft_c_cleft(i, j),
+                            chart_backward->b_cleft.iter3(i, j, i),
+
+                            cleft_splits(pruning, i, j)
+                    );
+                chart_backward->soft_c_cleft.mirror(i, j);
+            }
+
+            if (chart_forward->soft_c_cright(i, j) < threshold)
+                backward_skipped_backtracking(chart_backward->b_cright.iter3(i, j, cright_first), cright_splits(pruning, i, j, cright_first));
+            else
+                diffdp::backward_backtracking(
+                        chart_forward->soft_c_uright.iter2(i, cright_first), chart_forward->soft_c_cright.iter1(cright_first, j),
+                        chart_forward->soft_c_cright(i, j),
+                        chart_forward->b_cright.iter3(i, j, cright_first),
+
+                        chart_backward->soft_c_uright.iter2(i, cright_first), chart_backward->soft_c_cright.iter1(cright_first, j),
+                        &chart_backward->soft_c_cright(i, j),
+                        chart_backward->b_cright.iter3(i, j, cright_first),
+
+                        cright_splits(pruning, i, j, cright_first)
+                );
+            chart_backward->soft_c_cright.mirror(i, j);
+        }
+    }
+
+}
+
+void AlgorithmicDifferentiableEisner::backward_maximize(EisnerChart* chart_forward, EisnerChart* chart_backward, const ArcPruning* pruning)
+{
+    const unsigned size = chart_forward->size;
+    const unsigned n_threads = wavefront_num_threads(size);
+
+    // the gradients of the items are accumulators (see forward_backtracking)
+    #pragma omp parallel num_threads(n_threads) if(n_threads > 1u)
+    {
+        // gradient of the split weights of the current deduction, if they are not stored in the chart
+        std::vector<float> buffer(chart_backward->split_weights_mode == SplitWeightsMode::Stored ? 0u : size);
+        for (unsigned l = size - 1; l >= 1; --l)
+        {
+            #pragma omp for schedule(static)
+            for (unsigned i = 0; i < chart_forward->n_spans(l); ++i)
+            {
+                unsigned j = i + l;
+                const unsigned u_first = chart_forward->u_first_split(i, j);
+                const unsigned cright_first = chart_forward->cright_first_split(i, j);
+
+                if (i > 0u)
+                {
+                    backward_algorithmic_softmax(
+                            chart_forward->c_cleft.iter2(i, i), chart_forward->c_uleft.iter1(i, j),
+                            chart_forward->a_cleft.iter3_or(i, j, i, nullptr),
+                            chart_forward->b_cleft.iter3(i, j, i),
+
+                            chart_backward->c_cleft.iter2(i, i), chart_backward->c_uleft.iter1(i, j),
+                            chart_backward->c_cleft.fold(i, j),
+                            chart_backward->a_cleft.iter3_or(i, j, i, buffer.data()),
+                            chart_backward->b_cleft.iter3(i, j, i),
+
+                            cleft_splits(pruning, i, j)
+                    );
+                }
+
+                backward_algorithmic_softmax(
+                        chart_forward->c_uright.iter2(i, cright_first), chart_forward->c_cright.iter1(cright_first, j),
+                        chart_forward->a_cright.iter3_or(i, j, cright_first, nullptr),
+                        chart_forward->b_cright.iter3(i, j, cright_first),
+
+                        chart_backward->c_uright.iter2(i, cright_first), chart_backward->c_cright.iter1(cright_first, j),
+                        chart_backward->c_cright.fold(i, j),
+                        chart_backward->a_cright.iter3_or(i, j, cright_first, buffer.data()),
+                        chart_backward->b_cright.iter3(i, j, cright_first),
+
+                        cright_splits(pruning, i, j, cright_first)
+                );
+
+                // shared split distribution of uleft(i, j) and uright(i, j):
+                // the backward pass is linear in the incoming gradient so we can sum them
+                backward_algorithmic_softmax(
+                        chart_forward->c_cright.iter2(i, u_first), chart_forward->c_cleft.iter1(u_first + 1, j),
+                        chart_forward->a_u.iter3_or(i, j, u_first, nullptr),
+                        chart_forward->b_u.iter3(i, j, u_first),
+
+                        chart_backward->c_cright.iter2(i, u_first), chart_backward->c_cleft.iter1(u_first + 1, j),
+                        chart_backward->c_uright.fold(i, j) + (i > 0u ? chart_backward->c_uleft.fold(i, j) : 0.f),
+                        chart_backward->a_u.iter3_or(i, j, u_first, buffer.data()),
+                        chart_backward->b_u.iter3(i, j, u_first),
+
+                        incomplete_splits(pruning, i, j, u_first)
+                );
+            }
+        }
+    }
+}
+
+unsigned AlgorithmicDifferentiableEisner::size() const
+{
+    return _size;
+}
+
+float AlgorithmicDifferentiableEisner::output(const unsigned head, const unsigned mod) const
+{
+    if (head != mod && !chart_forward->in_vine(std::min(head, mod), std::max(head, mod)))
+        return 0.f;
+    if (head < mod)
+        return chart_forward->soft_c_uright(head, mod);
+    else if (mod < head)
+        return chart_forward->soft_c_uleft(mod, head);
+    else
+        return std::nanf("");
+}
+
+float AlgorithmicDifferentiableEisner::gradient(const unsigned head, const unsigned mod) const
+{
+    if (head != mod && !chart_forward->in_vine(std::min(head, mod), std::max(head, mod)))
+        return 0.f;
+    if (head < mod)
+        return chart_backward->c_uright(head, mod);
+    else if (mod < head)
+        return chart_backward->c_uleft(mod, head);
+    else
+        return std::nanf("");
+}
+
+
+
+
+InsideOutsideEisnerChart::InsideOutsideEisnerChart(unsigned size) :
+    size(size),
+    size_2d(MirroredMatrix<float>::required_cells(size)),
+    _memory(new float[required_cells(size)]),
+    _erase_memory(true),
+    memory_cells(required_cells(size)),
+    c_cleft(size, nullptr), c_cright(size, nullptr), c_uleft(size, nullptr), c_uright(size, nullptr),
+    soft_c_cleft(size, nullptr), soft_c_cright(size, nullptr), soft_c_uleft(size, nullptr), soft_c_uright(size, nullptr),
+    c_u(size, nullptr)
+{
+    resize(size);
+}
+
+InsideOutsideEisnerChart::InsideOutsideEisnerChart(unsigned size, float* mem) :
+    size(size),
+    size_2d(MirroredMatrix<float>::required_cells(size)),
+    _memory(mem),
+    _erase_memory(false),
+    memory_cells(required_cells(size)),
+    c_cleft(size, nullptr), c_cright(size, nullptr), c_uleft(size, nullptr), c_uright(size, nullptr),
+    soft_c_cleft(size, nullptr), soft_c_cright(size, nullptr), soft_c_uleft(size, nullptr), soft_c_uright(size, nullptr),
+    c_u(size, nullptr)
+{
+    resize(size);
+}
+
+InsideOutsideEisnerChart::~InsideOutsideEisnerChart()
+{
+    if (_erase_memory)
+        delete[] _memory;
+}
+
+void InsideOutsideEisnerChart::resize(const unsigned new_size)
+{
+    if (required_cells(new_size) > memory_cells)
+        throw std::runtime_error("The chart is too small for this sentence");
+
+    size = new_size;
+    size_2d = MirroredMatrix<float>::required_cells(size);
+
+    c_cleft.rebind(size, _memory);
+    c_cright.rebind(size, _memory + 1u*size_2d);
+    c_uleft.rebind(size, _memory + 2u*size_2d);
+    c_uright.rebind(size, _memory + 3u*size_2d);
+    soft_c_cleft.rebind(size, _memory + 4u*size_2d);
+    soft_c_cright.rebind(size, _memory + 5u*size_2d);
+    soft_c_uleft.rebind(size, _memory + 6u*size_2d);
+    soft_c_uright.rebind(size, _memory + 7u*size_2d);
+    c_u.rebind(size, _memory + 8u*size_2d);
+}
+
+void InsideOutsideEisnerChart::rebind(const unsigned new_size, float* mem)
+{
+    if (_erase_memory)
+        throw std::runtime_error("Cannot rebind a chart that owns its memory");
+
+    _memory = mem;
+    memory_cells = required_cells(new_size);
+    resize(new_size);
+}
+
+void InsideOutsideEisnerChart::init_forward()
+{
+    // complete items of length 0
+    c_cleft.zeros_diagonal();
+    c_cright.zeros_diagonal();
+
+    soft_c_cleft.zeros_upper_triangle();
+    soft_c_cright.zeros_upper_triangle();
+    soft_c_uleft.zeros_upper_triangle();
+    soft_c_uright.zeros_upper_triangle();
+}
+
+void InsideOutsideEisnerChart::init_backward()
+{
+    // the gradients of the incomplete items are set by the gradient callback
+    soft_c_cleft.zeros_upper_triangle();
+    soft_c_cright.zeros_upper_triangle();
+
+    c_cleft.zeros_upper_triangle();
+    c_cright.zeros_upper_triangle();
+    c_uleft.zeros_upper_triangle();
+    c_uright.zeros_upper_triangle();
+}
+
+std::size_t InsideOutsideEisnerChart::required_memory(const unsigned size)
+{
+    return required_cells(size) * sizeof(float);
+}
+
+std::size_t InsideOutsideEisnerChart::required_cells(const unsigned size)
+{
+    return 9u * MirroredMatrix<float>::required_cells(size);
+}
+
+
+InsideOutsideEisner::InsideOutsideEisner(const unsigned t_size) :
+    _size(t_size),
+    _owned_chart_forward(new InsideOutsideEisnerChart(_size)),
+    _owned_chart_backward(new InsideOutsideEisnerChart(_size)),
+    chart_forward(_owned_chart_forward.get()),
+    chart_backward(_owned_chart_backward.get())
+{}
+
+InsideOutsideEisner::InsideOutsideEisner(InsideOutsideEisnerChart* chart_forward, InsideOutsideEisnerChart* chart_backward) :
+        _size(chart_forward->size),
+        chart_forward(chart_forward),
+        chart_backward(chart_backward)
+{}
+
+void InsideOutsideEisner::forward_maximize(InsideOutsideEisnerChart* chart_forward)
+{
+    const unsigned size = chart_forward->size;
+    const unsigned n_threads = wavefront_num_threads(size);
+
+    // item values are mirrored as soon as they are computed,
+    // so that longer spans can read them by column
+    #pragma omp parallel num_threads(n_threads) if(n_threads > 1u)
+    {
+        // split weights and backpointers of the current deduction, they are not stored
+        std::vector<float> split_weights(size), backptr(size);
+        for (unsigned l = 1u; l < size; ++l)
+        {
+            // spans of the same length only read shorter spans
+            #pragma omp for schedule(static)
+            for (unsigned i = 0u; i < size - l; ++i)
+            {
+                unsigned j = i + l;
+
+                // uleft(i, j) and uright(i, j) have the same antecedents,
+                // so the split distribution is computed once for both
+                const float u = forward_entropy_reg(
+                        chart_forward->c_cright.iter2(i, i), chart_forward->c_cleft.iter1(i + 1, j),
+                        split_weights.data(),
+                        backptr.data(),
+                        l
+                );
+                chart_forward->c_u(i, j) = u;
+
+                // use += because we initialized them with arc weights
+                chart_forward->c_uright(i, j) += u;
+                chart_forward->c_uright.mirror(i, j);
+                if (i > 0u) // because the root cannot be the modifier
+                {
+                    chart_forward->c_uleft(i, j) += u;
+                    chart_forward->c_uleft.mirror(i, j);
+                }
+
+                chart_forward->c_cright(i, j) = forward_entropy_reg(
+                        chart_forward->c_uright.iter2(i, i + 1), chart_forward->c_cright.iter1(i + 1, j),
+                        split_weights.data(),
+                        backptr.data(),
+                        l
+                );
+                chart_forward->c_cright.mirror(i, j);
+
+                if (i > 0u)
+                {
+                    chart_forward->c_cleft(i, j) = forward_entropy_reg(
+                            chart_forward->c_cleft.iter2(i, i), chart_forward->c_uleft.iter1(i, j),
+                            split_weights.data(),
+                            backptr.data(),
+                            l
+                    );
+                    chart_forward->c_cleft.mirror(i, j);
+                }
+            }
+        }
+    }
+}
+
+void InsideOutsideEisner::forward_backtracking(InsideOutsideEisnerChart* chart_forward)
+{
+    const unsigned size = chart_forward->size;
+    const unsigned n_threads = wavefront_num_threads(size);
+
+    chart_forward->soft_c_cright(0, size - 1) = 1.0f;
+
+    // see AlgorithmicDifferentiableEisner for the use of the mirrored matrices
+    #pragma omp parallel num_threads(n_threads) if(n_threads > 1u)
+    {
+        std::vector<float> backptr(size);
+        for (unsigned l = size - 1; l >= 1; --l)
+        {
+            #pragma omp for schedule(static)
+            for (unsigned i = 0u; i < size - l; ++i)
+            {
+                unsigned j = i + l;
+
+                recompute_entropy_reg_backptr(
+                        chart_forward->c_uright.iter2(i, i + 1), chart_forward->c_cright.iter1(i + 1, j),
+                        backptr.data(), chart_forward->c_cright(i, j), l
+                );
+                diffdp::forward_backtracking(
+                        chart_forward->soft_c_uright.iter2(i, i + 1), chart_forward->soft_c_cright.iter1(i + 1, j),
+                        chart_forward->soft_c_cright.fold(i, j),
+                        backptr.data(),
+                        l
+                );
+
+                if (i > 0u)
+                {
+                    recompute_entropy_reg_backptr(
+                            chart_forward->c_cleft.iter2(i, i), chart_forward->c_uleft.iter1(i, j),
+                            backptr.data(), chart_forward->c_cleft(i, j), l
+                    );
+                    diffdp::forward_backtracking(
+                            chart_forward->soft_c_cleft.iter2(i, i), chart_forward->soft_c_uleft.iter1(i, j),
+                            chart_forward->soft_c_cleft.fold(i, j),
+                            backptr.data(),
+                            l
+                    );
+                }
+
+                // shared split distribution of uleft(i, j) and uright(i, j)
+                recompute_entropy_reg_backptr(
                         chart_forward->c_cright.iter2(i, i), chart_forward->c_cleft.iter1(i + 1, j),
-                        chart_forward->a_uleft.iter3(i, j, i),
-                        chart_forward->b_uleft.iter3(i, j, i),
+                        backptr.data(), chart_forward->c_u(i, j), l
+                );
+                diffdp::forward_backtracking(
+                        chart_forward->soft_c_cright.iter2(i, i), chart_forward->soft_c_cleft.iter1(i + 1, j),
+                        chart_forward->soft_c_uright.fold(i, j) + (i > 0u ? chart_forward->soft_c_uleft.fold(i, j) : 0.f),
+                        backptr.data(),
                         l
                 );
             }
+        }
+    }
+}
 
-            chart_forward->c_cright(i, j) = forward_algorithmic_softmax(
-                    chart_forward->c_uright.iter2(i, i + 1), chart_forward->c_cright.iter1(i + 1, j),
-                    chart_forward->a_cright.iter3(i, j, i + 1),
-                    chart_forward->b_cright.iter3(i, j, i + 1),
-                    l
-            );
+void InsideOutsideEisner::backward_backtracking(InsideOutsideEisnerChart* chart_forward, InsideOutsideEisnerChart* chart_backward)
+{
+    const unsigned size = chart_forward->size;
+    const unsigned n_threads = wavefront_num_threads(size);
 
-            if (i > 0u)
+    // gradient of the contributions of the items, the gradient of the backpointers is recomputed by backward_maximize
+    #pragma omp parallel num_threads(n_threads) if(n_threads > 1u)
+    {
+        std::vector<float> backptr(size), gradient_backptr(size);
+        for (unsigned l = 1; l < size ; ++l)
+        {
+            // spans of the same length only write their own gradients
+            #pragma omp for schedule(static)
+            for (unsigned i = 0; i < size - l; ++i)
             {
-                chart_forward->c_cleft(i, j) = forward_algorithmic_softmax(
-                        chart_forward->c_cleft.iter2(i, i), chart_forward->c_uleft.iter1(i, j),
-                        chart_forward->a_cleft.iter3(i, j, i),
-                        chart_forward->b_cleft.iter3(i, j, i),
+                unsigned j = i + l;
+
+                // shared split distribution of uleft(i, j) and uright(i, j):
+                // both items receive the same gradient
+                float gradient_u = 0.f;
+                recompute_entropy_reg_backptr(
+                        chart_forward->c_cright.iter2(i, i), chart_forward->c_cleft.iter1(i + 1, j),
+                        backptr.data(), chart_forward->c_u(i, j), l
+                );
+                diffdp::backward_backtracking(
+                        chart_forward->soft_c_cright.iter2(i, i), chart_forward->soft_c_cleft.iter1(i + 1, j),
+                        chart_forward->soft_c_uright(i, j) + (i > 0u ? chart_forward->soft_c_uleft(i, j) : 0.f),
+                        backptr.data(),
+
+                        chart_backward->soft_c_cright.iter2(i, i), chart_backward->soft_c_cleft.iter1(i + 1, j),
+                        &gradient_u,
+                        gradient_backptr.data(),
+
                         l
                 );
+                chart_backward->soft_c_uright(i, j) += gradient_u;
+                chart_backward->soft_c_uright.mirror(i, j);
+                if (i > 0u)
+                {
+                    chart_backward->soft_c_uleft(i, j) += gradient_u;
+                    chart_backward->soft_c_uleft.mirror(i, j);
+                }
+
+                if (i > 0u)
+                {
+                    recompute_entropy_reg_backptr(
+                            chart_forward->c_cleft.iter2(i, i), chart_forward->c_uleft.iter1(i, j),
+                            backptr.data(), chart_forward->c_cleft(i, j), l
+                    );
+                    diffdp::backward_backtracking(
+                            chart_forward->soft_c_cleft.iter2(i, i), chart_forward->soft_c_uleft.iter1(i, j),
+                            chart_forward->soft_c_cleft(i, j),
+                            backptr.data(),
+
+                            chart_backward->soft_c_cleft.iter2(i, i), chart_backward->soft_c_uleft.iter1(i, j),
+                            &chart_backward->soft_c_cleft(i, j),
+                            gradient_backptr.data(),
+
+                            l
+                    );
+                    chart_backward->soft_c_cleft.mirror(i, j);
+                }
+
+                recompute_entropy_reg_backptr(
+                        chart_forward->c_uright.iter2(i, i + 1), chart_forward->c_cright.iter1(i + 1, j),
+                        backptr.data(), chart_forward->c_cright(i, j), l
+                );
+                diffdp::backward_backtracking(
+                        chart_forward->soft_c_uright.iter2(i, i+1), chart_forward->soft_c_cright.iter1(i+1, j),
+                        chart_forward->soft_c_cright(i, j),
+                        backptr.data(),
+
+                        chart_backward->soft_c_uright.iter2(i, i+1), chart_backward->soft_c_cright.iter1(i+1, j),
+                        &chart_backward->soft_c_cright(i, j),
+                        gradient_backptr.data(),
+
+                        l
+                );
+                chart_backward->soft_c_cright.mirror(i, j);
             }
         }
     }
 }
 
-void AlgorithmicDifferentiableEisner::forward_backtracking(std::shared_ptr<EisnerChart>& chart_forward)
+void InsideOutsideEisner::backward_maximize(InsideOutsideEisnerChart* chart_forward, InsideOutsideEisnerChart* chart_backward)
 {
     const unsigned size = chart_forward->size;
+    const unsigned n_threads = wavefront_num_threads(size);
+
+    // the gradients of the items are accumulators (see forward_backtracking)
+    #pragma omp parallel num_threads(n_threads) if(n_threads > 1u)
+    {
+        // the backpointers and their gradient are recomputed from the forward and backward outside passes,
+        // the split weights are not read by backward_entropy_reg
+        std::vector<float> backptr(size), gradient_backptr(size), gradient_split_weights(size);
+        float* const split_weights = nullptr;
+        for (unsigned l = size - 1; l >= 1; --l)
+        {
+            #pragma omp for schedule(static)
+            for (unsigned i = 0; i < size - l; ++i)
+            {
+                unsigned j = i + l;
+
+                if (i > 0u)
+                {
+                    recompute_entropy_reg_backptr(
+                            chart_forward->c_cleft.iter2(i, i), chart_forward->c_uleft.iter1(i, j),
+                            backptr.data(), chart_forward->c_cleft(i, j), l
+                    );
+                    recompute_gradient_backptr(
+                            chart_backward->soft_c_cleft.iter2(i, i), chart_backward->soft_c_uleft.iter1(i, j),
+                            chart_forward->soft_c_cleft(i, j),
+                            gradient_backptr.data(), l
+                    );
+                    backward_entropy_reg(
+                            chart_forward->c_cleft.iter2(i, i), chart_forward->c_uleft.iter1(i, j),
+                            split_weights,
+                            backptr.data(),
+
+                            chart_backward->c_cleft.iter2(i, i), chart_backward->c_uleft.iter1(i, j),
+                            chart_backward->c_cleft.fold(i, j),
+                            gradient_split_weights.data(),
+                            gradient_backptr.data(),
+
+                            l
+                    );
+                }
+
+                recompute_entropy_reg_backptr(
+                        chart_forward->c_uright.iter2(i, i + 1), chart_forward->c_cright.iter1(i + 1, j),
+                        backptr.data(), chart_forward->c_cright(i, j), l
+                );
+                recompute_gradient_backptr(
+                        chart_backward->soft_c_uright.iter2(i, i + 1), chart_backward->soft_c_cright.iter1(i + 1, j),
+                        chart_forward->soft_c_cright(i, j),
+                        gradient_backptr.data(), l
+                );
+                backward_entropy_reg(
+                        chart_forward->c_uright.iter2(i, i + 1), chart_forward->c_cright.iter1(i + 1, j),
+                        split_weights,
+                        backptr.data(),
+
+                        chart_backward->c_uright.iter2(i, i + 1), chart_backward->c_cright.iter1(i + 1, j),
+                        chart_backward->c_cright.fold(i, j),
+                        gradient_split_weights.data(),
+                        gradient_backptr.data(),
+
+                        l
+                );
+
+                // shared split distribution of uleft(i, j) and uright(i, j):
+                // the backward pass is linear in the incoming gradient so we can sum them
+                recompute_entropy_reg_backptr(
+                        chart_forward->c_cright.iter2(i, i), chart_forward->c_cleft.iter1(i + 1, j),
+                        backptr.data(), chart_forward->c_u(i, j), l
+                );
+                recompute_gradient_backptr(
+                        chart_backward->soft_c_cright.iter2(i, i), chart_backward->soft_c_cleft.iter1(i + 1, j),
+                        chart_forward->soft_c_uright(i, j) + (i > 0u ? chart_forward->soft_c_uleft(i, j) : 0.f),
+                        gradient_backptr.data(), l
+                );
+                backward_entropy_reg(
+                        chart_forward->c_cright.iter2(i, i), chart_forward->c_cleft.iter1(i + 1, j),
+                        split_weights,
+                        backptr.data(),
+
+                        chart_backward->c_cright.iter2(i, i), chart_backward->c_cleft.iter1(i + 1, j),
+                        chart_backward->c_uright.fold(i, j) + (i > 0u ? chart_backward->c_uleft.fold(i, j) : 0.f),
+                        gradient_split_weights.data(),
+                        gradient_backptr.data(),
+
+                        l
+                );
+            }
+        }
+    }
+}
+
+unsigned InsideOutsideEisner::size() const
+{
+    return _size;
+}
+
+float InsideOutsideEisner::output(const unsigned head, const unsigned mod) const
+{
+    if (head < mod)
+        return chart_forward->soft_c_uright(head, mod);
+    else if (mod < head)
+        return chart_forward->soft_c_uleft(mod, head);
+    else
+        return std::nanf("");
+}
+
+float InsideOutsideEisner::gradient(const unsigned head, const unsigned mod) const
+{
+    if (head < mod)
+        return chart_backward->c_uright(head, mod);
+    else if (mod < head)
+        return chart_backward->c_uleft(mod, head);
+    else
+        return std::nanf("");
+}
+
+float InsideOutsideEisner::log_partition() const
+{
+    return chart_forward->c_cright(0, _size - 1);
+}
+
+
+
+
+void EisnerSplitSupports::resize(const unsigned size)
+{
+    cleft.resize(size);
+    cright.resize(size);
+    u.resize(size);
+}
+
+SparsemaxEisner::SparsemaxEisner(const unsigned t_size, const SplitWeightsMode mode) :
+    _size(t_size),
+    _owned_chart_forward(new EisnerChart(_size, mode)),
+    _owned_chart_backward(new EisnerChart(_size, mode)),
+    chart_forward(_owned_chart_forward.get()),
+    chart_backward(_owned_chart_backward.get())
+{}
+
+SparsemaxEisner::SparsemaxEisner(EisnerChart* chart_forward, EisnerChart* chart_backward) :
+        _size(chart_forward->size),
+        chart_forward(chart_forward),
+        chart_backward(chart_backward)
+{
+    if (chart_forward->vine_length > 0u)
+        throw std::runtime_error("The sparsemax relaxation does not support vine charts");
+}
+
+void SparsemaxEisner::forward_maximize(EisnerChart* chart_forward, EisnerSplitSupports* supports, const ArcPruning* pruning)
+{
+    const unsigned size = chart_forward->size;
+    const unsigned n_threads = wavefront_num_threads(size);
+    supports->resize(size);
+
+    // item values are mirrored as soon as they are computed,
+    // so that longer spans can read them by column
+    #pragma omp parallel num_threads(n_threads) if(n_threads > 1u)
+    {
+        // split weights of the current deduction, if they are not stored in the chart
+        std::vector<float> buffer(chart_forward->split_weights_mode == SplitWeightsMode::Stored ? 0u : size);
+        for (unsigned l = 1u; l < size; ++l)
+        {
+            // spans of the same length only read shorter spans
+            #pragma omp for schedule(static)
+            for (unsigned i = 0u; i < size - l; ++i)
+            {
+                unsigned j = i + l;
+
+                // uleft(i, j) and uright(i, j) have the same antecedents,
+                // so the split distribution is computed once for both
+                const float u = forward_algorithmic_sparsemax(
+                        chart_forward->c_cright.iter2(i, i), chart_forward->c_cleft.iter1(i + 1, j),
+                        chart_forward->a_u.iter3_or(i, j, i, buffer.data()),
+                        chart_forward->b_u.iter3(i, j, i),
+                        incomplete_splits(pruning, i, j),
+                        supports->u(i, j)
+                );
+
+                // use += because we initialized them with arc weights
+                chart_forward->c_uright(i, j) += u;
+                chart_forward->c_uright.mirror(i, j);
+                if (i > 0u) // because the root cannot be the modifier
+                {
+                    chart_forward->c_uleft(i, j) += u;
+                    chart_forward->c_uleft.mirror(i, j);
+                }
+
+                chart_forward->c_cright(i, j) = forward_algorithmic_sparsemax(
+                        chart_forward->c_uright.iter2(i, i + 1), chart_forward->c_cright.iter1(i + 1, j),
+                        chart_forward->a_cright.iter3_or(i, j, i + 1, buffer.data()),
+                        chart_forward->b_cright.iter3(i, j, i + 1),
+                        cright_splits(pruning, i, j),
+                        supports->cright(i, j)
+                );
+                chart_forward->c_cright.mirror(i, j);
+
+                if (i > 0u)
+                {
+                    chart_forward->c_cleft(i, j) = forward_algorithmic_sparsemax(
+                            chart_forward->c_cleft.iter2(i, i), chart_forward->c_uleft.iter1(i, j),
+                            chart_forward->a_cleft.iter3_or(i, j, i, buffer.data()),
+                            chart_forward->b_cleft.iter3(i, j, i),
+                            cleft_splits(pruning, i, j),
+                            supports->cleft(i, j)
+                    );
+                    chart_forward->c_cleft.mirror(i, j);
+                }
+            }
+        }
+    }
+}
+
+void SparsemaxEisner::forward_backtracking(EisnerChart* chart_forward, const EisnerSplitSupports* supports)
+{
+    const unsigned size = chart_forward->size;
+    const unsigned n_threads = wavefront_num_threads(size);
+
     chart_forward->soft_c_cright(0, size - 1) = 1.0f;
 
+    // contributions are pushed to a row and a column of shorter spans:
+    // the column part is accumulated in the transposed storage and folded when the item is reached,
+    // so spans of the same length never write to the same memory
+    #pragma omp parallel num_threads(n_threads) if(n_threads > 1u)
     for (unsigned l = size - 1; l >= 1; --l)
     {
+        #pragma omp for schedule(static)
         for (unsigned i = 0u; i < size - l; ++i)
         {
             unsigned j = i + l;
 
             diffdp::forward_backtracking(
                     chart_forward->soft_c_uright.iter2(i, i + 1), chart_forward->soft_c_cright.iter1(i + 1, j),
-                    chart_forward->soft_c_cright(i, j),
+                    chart_forward->soft_c_cright.fold(i, j),
                     chart_forward->b_cright.iter3(i, j, i + 1),
-                    l
+                    supports->cright.splits(i, j)
             );
 
             if (i > 0u)
             {
                 diffdp::forward_backtracking(
                         chart_forward->soft_c_cleft.iter2(i, i), chart_forward->soft_c_uleft.iter1(i, j),
-                        chart_forward->soft_c_cleft(i, j),
+                        chart_forward->soft_c_cleft.fold(i, j),
                         chart_forward->b_cleft.iter3(i, j, i),
-                        l
+                        supports->cleft.splits(i, j)
                 );
             }
 
+            // shared split distribution of uleft(i, j) and uright(i, j)
             diffdp::forward_backtracking(
                     chart_forward->soft_c_cright.iter2(i, i), chart_forward->soft_c_cleft.iter1(i + 1, j),
-                    chart_forward->soft_c_uright(i, j),
-                    chart_forward->b_uright.iter3(i, j, i),
-                    l
+                    chart_forward->soft_c_uright.fold(i, j) + (i > 0u ? chart_forward->soft_c_uleft.fold(i, j) : 0.f),
+                    chart_forward->b_u.iter3(i, j, i),
+                    supports->u.splits(i, j)
             );
-
-
-            if (i > 0u)
-            {
-                diffdp::forward_backtracking(
-                        chart_forward->soft_c_cright.iter2(i, i), chart_forward->soft_c_cleft.iter1(i + 1, j),
-                        chart_forward->soft_c_uleft(i, j),
-                        chart_forward->b_uleft.iter3(i, j, i),
-                        l
-                );
-            }
         }
     }
 }
 
-void AlgorithmicDifferentiableEisner::backward_backtracking(std::shared_ptr<EisnerChart>& chart_forward, std::shared_ptr<EisnerChart>& chart_backward)
+void SparsemaxEisner::backward_backtracking(EisnerChart* chart_forward, EisnerChart* chart_backward, const EisnerSplitSupports* supports)
 {
     const unsigned size = chart_forward->size;
+    const unsigned n_threads = wavefront_num_threads(size);
 
+    // the gradients of the backtracking contributions are values (see forward_maximize)
+    #pragma omp parallel num_threads(n_threads) if(n_threads > 1u)
     for (unsigned l = 1; l < size ; ++l)
     {
+        // spans of the same length only write their own gradients
+        #pragma omp for schedule(static)
         for (unsigned i = 0; i < size - l; ++i)
         {
             unsigned j = i + l;
 
-            if (i > 0u)
-            {
-                diffdp::backward_backtracking(
-                        chart_forward->soft_c_cright.iter2(i, i), chart_forward->soft_c_cleft.iter1(i + 1, j),
-                        chart_forward->soft_c_uleft(i, j),
-                        chart_forward->b_uleft.iter3(i, j, i),
-
-                        chart_backward->soft_c_cright.iter2(i, i), chart_backward->soft_c_cleft.iter1(i + 1, j),
-                        &chart_backward->soft_c_uleft(i, j),
-                        chart_backward->b_uleft.iter3(i, j, i),
-
-                        l
-                );
-            }
-
+            // shared split distribution of uleft(i, j) and uright(i, j):
+            // both items receive the same gradient
+            float gradient_u = 0.f;
             diffdp::backward_backtracking(
                     chart_forward->soft_c_cright.iter2(i, i), chart_forward->soft_c_cleft.iter1(i + 1, j),
-                    chart_forward->soft_c_uright(i, j),
-                    chart_forward->b_uright.iter3(i, j, i),
+                    chart_forward->soft_c_uright(i, j) + (i > 0u ? chart_forward->soft_c_uleft(i, j) : 0.f),
+                    chart_forward->b_u.iter3(i, j, i),
 
                     chart_backward->soft_c_cright.iter2(i, i), chart_backward->soft_c_cleft.iter1(i + 1, j),
-                    &chart_backward->soft_c_uright(i, j),
-                    chart_backward->b_uright.iter3(i, j, i),
+                    &gradient_u,
+                    chart_backward->b_u.iter3(i, j, i),
 
-                    l
+                    supports->u.splits(i, j)
             );
+            chart_backward->soft_c_uright(i, j) += gradient_u;
+            chart_backward->soft_c_uright.mirror(i, j);
+            if (i > 0u)
+            {
+                chart_backward->soft_c_uleft(i, j) += gradient_u;
+                chart_backward->soft_c_uleft.mirror(i, j);
+            }
 
             if (i > 0u)
             {
@@ -235,8 +1076,9 @@ void AlgorithmicDifferentiableEisner::backward_backtracking(std::shared_ptr<Eisn
                         &chart_backward->soft_c_cleft(i, j),
                         chart_backward->b_cleft.iter3(i, j, i),
 
-                        l
+                        supports->cleft.splits(i, j)
                 );
+                chart_backward->soft_c_cleft.mirror(i, j);
             }
 
             diffdp::backward_backtracking(
@@ -248,90 +1090,85 @@ void AlgorithmicDifferentiableEisner::backward_backtracking(std::shared_ptr<Eisn
                     &chart_backward->soft_c_cright(i, j),
                     chart_backward->b_cright.iter3(i, j, i + 1),
 
-                    l
+                    supports->cright.splits(i, j)
             );
+            chart_backward->soft_c_cright.mirror(i, j);
         }
     }
 
 }
 
-void AlgorithmicDifferentiableEisner::backward_maximize(std::shared_ptr<EisnerChart>& chart_forward, std::shared_ptr<EisnerChart>& chart_backward)
+void SparsemaxEisner::backward_maximize(EisnerChart* chart_forward, EisnerChart* chart_backward, const EisnerSplitSupports* supports)
 {
     const unsigned size = chart_forward->size;
+    const unsigned n_threads = wavefront_num_threads(size);
 
-    for (unsigned l = size - 1; l >= 1; --l)
+    // the gradients of the items are accumulators (see forward_backtracking)
+    #pragma omp parallel num_threads(n_threads) if(n_threads > 1u)
     {
-        for (unsigned i = 0; i < size - l; ++i)
+        // gradient of the split weights of the current deduction, if they are not stored in the chart
+        std::vector<float> buffer(chart_backward->split_weights_mode == SplitWeightsMode::Stored ? 0u : size);
+        for (unsigned l = size - 1; l >= 1; --l)
         {
-            unsigned j = i + l;
-
-            if (i > 0u)
+            #pragma omp for schedule(static)
+            for (unsigned i = 0; i < size - l; ++i)
             {
-                backward_algorithmic_softmax(
-                        chart_forward->c_cleft.iter2(i, i), chart_forward->c_uleft.iter1(i, j),
-                        chart_forward->a_cleft.iter3(i, j, i),
-                        chart_forward->b_cleft.iter3(i, j, i),
-
-                        chart_backward->c_cleft.iter2(i, i), chart_backward->c_uleft.iter1(i, j),
-                        chart_backward->c_cleft(i, j),
-                        chart_backward->a_cleft.iter3(i, j, i),
-                        chart_backward->b_cleft.iter3(i, j, i),
-
-                        l
+                unsigned j = i + l;
+
+                if (i > 0u)
+                {
+                    backward_algorithmic_sparsemax(
+                            chart_forward->c_cleft.iter2(i, i), chart_forward->c_uleft.iter1(i, j),
+                            chart_forward->a_cleft.iter3_or(i, j, i, nullptr),
+                            chart_forward->b_cleft.iter3(i, j, i),
+
+                            chart_backward->c_cleft.iter2(i, i), chart_backward->c_uleft.iter1(i, j),
+                            chart_backward->c_cleft.fold(i, j),
+                            chart_backward->a_cleft.iter3_or(i, j, i, buffer.data()),
+                            chart_backward->b_cleft.iter3(i, j, i),
+
+                            supports->cleft.splits(i, j)
+                    );
+                }
+
+                backward_algorithmic_sparsemax(
+                        chart_forward->c_uright.iter2(i, i + 1), chart_forward->c_cright.iter1(i + 1, j),
+                        chart_forward->a_cright.iter3_or(i, j, i + 1, nullptr),
+                        chart_forward->b_cright.iter3(i, j, i + 1),
+
+                        chart_backward->c_uright.iter2(i, i + 1), chart_backward->c_cright.iter1(i + 1, j),
+                        chart_backward->c_cright.fold(i, j),
+                        chart_backward->a_cright.iter3_or(i, j, i + 1, buffer.data()),
+                        chart_backward->b_cright.iter3(i, j, i + 1),
+
+                        supports->cright.splits(i, j)
                 );
-            }
-
-            backward_algorithmic_softmax(
-                    chart_forward->c_uright.iter2(i, i + 1), chart_forward->c_cright.iter1(i + 1, j),
-                    chart_forward->a_cright.iter3(i, j, i + 1),
-                    chart_forward->b_cright.iter3(i, j, i + 1),
-
-                    chart_backward->c_uright.iter2(i, i + 1), chart_backward->c_cright.iter1(i + 1, j),
-                    chart_backward->c_cright(i, j),
-                    chart_backward->a_cright.iter3(i, j, i + 1),
-                    chart_backward->b_cright.iter3(i, j, i + 1),
 
-                    l
-            );
-
-            if (i > 0u)
-            {
-                backward_algorithmic_softmax(
+                // shared split distribution of uleft(i, j) and uright(i, j):
+                // the backward pass is linear in the incoming gradient so we can sum them
+                backward_algorithmic_sparsemax(
                         chart_forward->c_cright.iter2(i, i), chart_forward->c_cleft.iter1(i + 1, j),
-                        chart_forward->a_uleft.iter3(i, j, i),
-                        chart_forward->b_uleft.iter3(i, j, i),
+                        chart_forward->a_u.iter3_or(i, j, i, nullptr),
+                        chart_forward->b_u.iter3(i, j, i),
 
                         chart_backward->c_cright.iter2(i, i), chart_backward->c_cleft.iter1(i + 1, j),
-                        chart_backward->c_uleft(i, j),
-                        chart_backward->a_uleft.iter3(i, j, i),
-                        chart_backward->b_uleft.iter3(i, j, i),
+                        chart_backward->c_uright.fold(i, j) + (i > 0u ? chart_backward->c_uleft.fold(i, j) : 0.f),
+                        chart_backward->a_u.iter3_or(i, j, i, buffer.data()),
+                        chart_backward->b_u.iter3(i, j, i),
 
-                        l
+                        supports->u.splits(i, j)
                 );
             }
-
-            backward_algorithmic_softmax(
-                    chart_forward->c_cright.iter2(i, i), chart_forward->c_cleft.iter1(i + 1, j),
-                    chart_forward->a_uright.iter3(i, j, i),
-                    chart_forward->b_uright.iter3(i, j, i),
-
-                    chart_backward->c_cright.iter2(i, i), chart_backward->c_cleft.iter1(i + 1, j),
-                    chart_backward->c_uright(i, j),
-                    chart_backward->a_uright.iter3(i, j, i),
-                    chart_backward->b_uright.iter3(i, j, i),
-
-                    l
-            );
         }
     }
 }
 
-unsigned AlgorithmicDifferentiableEisner::size() const
+unsigned SparsemaxEisner::size() const
 {
     return _size;
 }
 
-float AlgorithmicDifferentiableEisner::output(const unsigned head, const unsigned mod) const
+float SparsemaxEisner::output(const unsigned head, const unsigned mod) const
 {
     if (head < mod)
         return chart_forward->soft_c_uright(head, mod);
@@ -341,7 +1178,7 @@ float AlgorithmicDifferentiableEisner::output(const unsigned head, const unsigne
         return std::nanf("");
 }
 
-float AlgorithmicDifferentiableEisner::gradient(const unsigned head, const unsigned mod) const
+float SparsemaxEisner::gradient(const unsigned head, const unsigned mod) const
 {
     if (head < mod)
         return chart_backward->c_uright(head, mod);
@@ -354,112 +1191,127 @@ float AlgorithmicDifferentiableEisner::gradient(const unsigned head, const unsig
 
 
 
-EntropyRegularizedEisner::EntropyRegularizedEisner(const unsigned t_size) :
+EntropyRegularizedEisner::EntropyRegularizedEisner(const unsigned t_size, const SplitWeightsMode mode, const unsigned vine_length) :
         _size(t_size),
-        chart_forward(std::make_shared<EisnerChart>(_size)),
-        chart_backward(std::make_shared<EisnerChart>(_size))
+        _owned_chart_forward(new EisnerChart(_size, mode, vine_length)),
+        _owned_chart_backward(new EisnerChart(_size, mode, vine_length)),
+        chart_forward(_owned_chart_forward.get()),
+        chart_backward(_owned_chart_backward.get())
 {}
 
-EntropyRegularizedEisner::EntropyRegularizedEisner(std::shared_ptr<EisnerChart> chart_forward, std::shared_ptr<EisnerChart> chart_backward) :
+EntropyRegularizedEisner::EntropyRegularizedEisner(EisnerChart* chart_forward, EisnerChart* chart_backward) :
         _size(chart_forward->size),
         chart_forward(chart_forward),
         chart_backward(chart_backward)
 {}
 
 
-void EntropyRegularizedEisner::forward_maximize(std::shared_ptr<EisnerChart>& chart_forward)
+void EntropyRegularizedEisner::forward_maximize(EisnerChart* chart_forward, const ArcPruning* pruning)
 {
     const unsigned size = chart_forward->size;
+    const unsigned n_threads = wavefront_num_threads(size);
 
-    for (unsigned l = 1u; l < size; ++l)
+    // item values are mirrored as soon as they are computed,
+    // so that longer spans can read them by column
+    #pragma omp parallel num_threads(n_threads) if(n_threads > 1u)
     {
-        for (unsigned i = 0u; i < size - l; ++i)
+        // split weights of the current deduction, if they are not stored in the chart
+        std::vector<float> buffer(chart_forward->split_weights_mode == SplitWeightsMode::Stored ? 0u : size);
+        for (unsigned l = 1u; l < size; ++l)
         {
-            unsigned j = i + l;
-
-            chart_forward->c_uright(i, j) += forward_entropy_reg(
-                    chart_forward->c_cright.iter2(i, i), chart_forward->c_cleft.iter1(i + 1, j),
-                    chart_forward->a_uright.iter3(i, j, i),
-                    chart_forward->b_uright.iter3(i, j, i),
-                    l
-            );
-
-            if (i > 0u) // because the root cannot be the modifier
+            // spans of the same length only read shorter spans
+            #pragma omp for schedule(static)
+            for (unsigned i = 0u; i < chart_forward->n_spans(l); ++i)
             {
-                chart_forward->c_uleft(i, j) += forward_entropy_reg(
-                        chart_forward->c_cright.iter2(i, i), chart_forward->c_cleft.iter1(i + 1, j),
-                        chart_forward->a_uleft.iter3(i, j, i),
-                        chart_forward->b_uleft.iter3(i, j, i),
-                        l
+                unsigned j = i + l;
+                const unsigned u_first = chart_forward->u_first_split(i, j);
+                const unsigned cright_first = chart_forward->cright_first_split(i, j);
+
+                // uleft(i, j) and uright(i, j) have the same antecedents,
+                // so the split distribution is computed once for both
+                const float u = forward_entropy_reg(
+                        chart_forward->c_cright.iter2(i, u_first), chart_forward->c_cleft.iter1(u_first + 1, j),
+                        chart_forward->a_u.iter3_or(i, j, u_first, buffer.data()),
+                        chart_forward->b_u.iter3(i, j, u_first),
+                        incomplete_splits(pruning, i, j, u_first)
                 );
-            }
-
-            chart_forward->c_cright(i, j) = forward_entropy_reg(
-                    chart_forward->c_uright.iter2(i, i + 1), chart_forward->c_cright.iter1(i + 1, j),
-                    chart_forward->a_cright.iter3(i, j, i + 1),
-                    chart_forward->b_cright.iter3(i, j, i + 1),
-                    l
-            );
 
-            if (i > 0u)
-            {
-                chart_forward->c_cleft(i, j) = forward_entropy_reg(
-                        chart_forward->c_cleft.iter2(i, i), chart_forward->c_uleft.iter1(i, j),
-                        chart_forward->a_cleft.iter3(i, j, i),
-                        chart_forward->b_cleft.iter3(i, j, i),
-                        l
+                // use += because we initialized them with arc weights
+                chart_forward->c_uright(i, j) += u;
+                chart_forward->c_uright.mirror(i, j);
+                if (i > 0u) // because the root cannot be the modifier
+                {
+                    chart_forward->c_uleft(i, j) += u;
+                    chart_forward->c_uleft.mirror(i, j);
+                }
+
+                chart_forward->c_cright(i, j) = forward_entropy_reg(
+                        chart_forward->c_uright.iter2(i, cright_first), chart_forward->c_cright.iter1(cright_first, j),
+                        chart_forward->a_cright.iter3_or(i, j, cright_first, buffer.data()),
+                        chart_forward->b_cright.iter3(i, j, cright_first),
+                        cright_splits(pruning, i, j, cright_first)
                 );
+                chart_forward->c_cright.mirror(i, j);
+
+                if (i > 0u)
+                {
+                    chart_forward->c_cleft(i, j) = forward_entropy_reg(
+                            chart_forward->c_cleft.iter2(i, i), chart_forward->c_uleft.iter1(i, j),
+                            chart_forward->a_cleft.iter3_or(i, j, i, buffer.data()),
+                            chart_forward->b_cleft.iter3(i, j, i),
+                            cleft_splits(pruning, i, j)
+                    );
+                    chart_forward->c_cleft.mirror(i, j);
+                }
             }
         }
     }
 }
 
-void EntropyRegularizedEisner::forward_backtracking(std::shared_ptr<EisnerChart>& chart_forward)
+void EntropyRegularizedEisner::forward_backtracking(EisnerChart* chart_forward, const ArcPruning* pruning)
 {
     const unsigned size = chart_forward->size;
+    const unsigned n_threads = wavefront_num_threads(size);
 
     chart_forward->soft_c_cright(0, size - 1) = 1.0f;
 
+    // contributions are pushed to a row and a column of shorter spans:
+    // the column part is accumulated in the transposed storage and folded when the item is reached,
+    // so spans of the same length never write to the same memory
+    #pragma omp parallel num_threads(n_threads) if(n_threads > 1u)
     for (unsigned l = size - 1; l >= 1; --l)
     {
-        for (unsigned i = 0u; i < size - l; ++i)
+        #pragma omp for schedule(static)
+        for (unsigned i = 0u; i < chart_forward->n_spans(l); ++i)
         {
             unsigned j = i + l;
+            const unsigned u_first = chart_forward->u_first_split(i, j);
+            const unsigned cright_first = chart_forward->cright_first_split(i, j);
 
             diffdp::forward_backtracking(
-                    chart_forward->soft_c_uright.iter2(i, i + 1), chart_forward->soft_c_cright.iter1(i + 1, j),
-                    chart_forward->soft_c_cright(i, j),
-                    chart_forward->b_cright.iter3(i, j, i + 1),
-                    l
+                    chart_forward->soft_c_uright.iter2(i, cright_first), chart_forward->soft_c_cright.iter1(cright_first, j),
+                    chart_forward->soft_c_cright.fold(i, j),
+                    chart_forward->b_cright.iter3(i, j, cright_first),
+                    cright_splits(pruning, i, j, cright_first)
             );
 
             if (i > 0u)
             {
                 diffdp::forward_backtracking(
                         chart_forward->soft_c_cleft.iter2(i, i), chart_forward->soft_c_uleft.iter1(i, j),
-                        chart_forward->soft_c_cleft(i, j),
+                        chart_forward->soft_c_cleft.fold(i, j),
                         chart_forward->b_cleft.iter3(i, j, i),
-                        l
+                        cleft_splits(pruning, i, j)
                 );
             }
 
+            // shared split distribution of uleft(i, j) and uright(i, j)
             diffdp::forward_backtracking(
-                    chart_forward->soft_c_cright.iter2(i, i), chart_forward->soft_c_cleft.iter1(i + 1, j),
-                    chart_forward->soft_c_uright(i, j),
-                    chart_forward->b_uright.iter3(i, j, i),
-                    l
+                    chart_forward->soft_c_cright.iter2(i, u_first), chart_forward->soft_c_cleft.iter1(u_first + 1, j),
+                    chart_forward->soft_c_uright.fold(i, j) + (i > 0u ? chart_forward->soft_c_uleft.fold(i, j) : 0.f),
+                    chart_forward->b_u.iter3(i, j, u_first),
+                    incomplete_splits(pruning, i, j, u_first)
             );
-
-
-            if (i > 0u)
-            {
-                diffdp::forward_backtracking(
-                        chart_forward->soft_c_cright.iter2(i, i), chart_forward->soft_c_cleft.iter1(i + 1, j),
-                        chart_forward->soft_c_uleft(i, j),
-                        chart_forward->b_uleft.iter3(i, j, i),
-                        l
-                );
-            }
         }
     }
 }
@@ -472,6 +1324,8 @@ unsigned EntropyRegularizedEisner::size() const
 
 float EntropyRegularizedEisner::output(const unsigned head, const unsigned mod) const
 {
+    if (head != mod && !chart_forward->in_vine(std::min(head, mod), std::max(head, mod)))
+        return 0.f;
     if (head < mod)
         return chart_forward->soft_c_uright(head, mod);
     else if (mod < head)
@@ -482,6 +1336,8 @@ float EntropyRegularizedEisner::output(const unsigned head, const unsigned mod)
 
 float EntropyRegularizedEisner::gradient(const unsigned head, const unsigned mod) const
 {
+    if (head != mod && !chart_forward->in_vine(std::min(head, mod), std::max(head, mod)))
+        return 0.f;
     if (head < mod)
         return chart_backward->c_uright(head, mod);
     else if (mod < head)
@@ -490,4 +1346,189 @@ float EntropyRegularizedEisner::gradient(const unsigned head, const unsigned mod
         return std::nanf("");
 }
 
-}
\ No newline at end of file
+float EntropyRegularizedEisner::log_partition() const
+{
+    return chart_forward->c_cright(0, _size - 1);
+}
+
+
+
+ViterbiEisnerChart::ViterbiEisnerChart(unsigned size) :
+    size(size),
+    memory_cells(required_cells(size)),
+    _scores(new float[8u * memory_cells]),
+    _splits(new unsigned[3u * memory_cells]),
+    c_cleft(size, nullptr), c_cright(size, nullptr), c_uleft(size, nullptr), c_uright(size, nullptr),
+    s_cleft(size, nullptr), s_cright(size, nullptr), s_u(size, nullptr)
+{
+    resize(size);
+}
+
+void ViterbiEisnerChart::resize(const unsigned new_size)
+{
+    if (required_cells(new_size) > memory_cells)
+        throw std::runtime_error("The chart is too small for this sentence");
+
+    size = new_size;
+    const std::size_t size_2d = MirroredMatrix<float>::required_cells(size);
+    c_cleft.rebind(size, _scores.get());
+    c_cright.rebind(size, _scores.get() + 1u*size_2d);
+    c_uleft.rebind(size, _scores.get() + 2u*size_2d);
+    c_uright.rebind(size, _scores.get() + 3u*size_2d);
+
+    const std::size_t splits_2d = Matrix<unsigned>::required_cells(size);
+    s_cleft.rebind(size, _splits.get());
+    s_cright.rebind(size, _splits.get() + 1u*splits_2d);
+    s_u.rebind(size, _splits.get() + 2u*splits_2d);
+
+    heads.resize(size);
+}
+
+std::size_t ViterbiEisnerChart::required_memory(const unsigned size)
+{
+    return required_cells(size) * (8u * sizeof(float) + 3u * sizeof(unsigned));
+}
+
+std::size_t ViterbiEisnerChart::required_cells(const unsigned size)
+{
+    return Matrix<float>::required_cells(size);
+}
+
+
+ViterbiEisner::ViterbiEisner(const unsigned t_size) :
+        _size(t_size),
+        _owned_chart(new ViterbiEisnerChart(_size)),
+        chart(_owned_chart.get())
+{}
+
+ViterbiEisner::ViterbiEisner(ViterbiEisnerChart* chart) :
+        _size(chart->size),
+        chart(chart)
+{}
+
+void ViterbiEisner::forward_maximize(ViterbiEisnerChart* chart)
+{
+    const unsigned size = chart->size;
+    const unsigned n_threads = wavefront_num_threads(size);
+
+    // same deductions as AlgorithmicDifferentiableEisner::forward_maximize,
+    // with a max instead of a softmax
+    #pragma omp parallel num_threads(n_threads) if(n_threads > 1u)
+    for (unsigned l = 1u; l < size; ++l)
+    {
+        // spans of the same length only read shorter spans
+        #pragma omp for schedule(static)
+        for (unsigned i = 0u; i < size - l; ++i)
+        {
+            unsigned j = i + l;
+            unsigned k;
+
+            const float u = forward_viterbi(
+                    chart->c_cright.iter2(i, i), chart->c_cleft.iter1(i + 1, j),
+                    &k,
+                    l
+            );
+            chart->s_u(i, j) = i + k;
+
+            // use += because we initialized them with arc weights
+            chart->c_uright(i, j) += u;
+            chart->c_uright.mirror(i, j);
+            if (i > 0u) // because the root cannot be the modifier
+            {
+                chart->c_uleft(i, j) += u;
+                chart->c_uleft.mirror(i, j);
+            }
+
+            chart->c_cright(i, j) = forward_viterbi(
+                    chart->c_uright.iter2(i, i + 1), chart->c_cright.iter1(i + 1, j),
+                    &k,
+                    l
+            );
+            chart->s_cright(i, j) = i + 1u + k;
+            chart->c_cright.mirror(i, j);
+
+            if (i > 0u)
+            {
+                chart->c_cleft(i, j) = forward_viterbi(
+                        chart->c_cleft.iter2(i, i), chart->c_uleft.iter1(i, j),
+                        &k,
+                        l
+                );
+                chart->s_cleft(i, j) = i + k;
+                chart->c_cleft.mirror(i, j);
+            }
+        }
+    }
+}
+
+void ViterbiEisner::forward_backtracking(ViterbiEisnerChart* chart)
+{
+    const unsigned size = chart->size;
+
+    enum struct Item { CLeft, CRight, ULeft, URight };
+    struct Span { Item item; unsigned i, j; };
+
+    std::fill(chart->heads.begin(), chart->heads.end(), 0u);
+    if (size <= 1u)
+        return;
+
+    std::vector<Span> stack{{Item::CRight, 0u, size - 1u}};
+    while (!stack.empty())
+    {
+        const Span span = stack.back();
+        stack.pop_back();
+        const unsigned i = span.i;
+        const unsigned j = span.j;
+        // complete items of length 0 have no antecedent
+        if (i == j)
+            continue;
+
+        if (span.item == Item::CRight)
+        {
+            const unsigned k = chart->s_cright(i, j);
+            stack.push_back({Item::URight, i, k});
+            stack.push_back({Item::CRight, k, j});
+        }
+        else if (span.item == Item::CLeft)
+        {
+            const unsigned k = chart->s_cleft(i, j);
+            stack.push_back({Item::CLeft, i, k});
+            stack.push_back({Item::ULeft, k, j});
+        }
+        else
+        {
+            if (span.item == Item::URight)
+                chart->heads[j] = i;
+            else
+                chart->heads[i] = j;
+
+            const unsigned k = chart->s_u(i, j);
+            stack.push_back({Item::CRight, i, k});
+            stack.push_back({Item::CLeft, k + 1u, j});
+        }
+    }
+}
+
+unsigned ViterbiEisner::size() const
+{
+    return _size;
+}
+
+float ViterbiEisner::output(const unsigned head, const unsigned mod) const
+{
+    if (head == mod)
+        return std::nanf("");
+    return mod > 0u && chart->heads[mod] == head ? 1.f : 0.f;
+}
+
+unsigned ViterbiEisner::head(const unsigned mod) const
+{
+    return chart->heads[mod];
+}
+
+float ViterbiEisner::score() const
+{
+    return chart->c_cright(0, _size - 1);
+}
+
+}
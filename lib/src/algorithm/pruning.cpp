@@ -0,0 +1,76 @@
+#include "diffdp/algorithm/pruning.h"
+
+namespace diffdp
+{
+
+bool PruningSettings::enabled() const
+{
+    return top_k > 0u || margin < std::numeric_limits<float>::infinity();
+}
+
+bool ArcPruning::kept(const unsigned head, const unsigned mod) const
+{
+    return _kept[head * size + mod] != 0;
+}
+
+void ArcPruning::_update_modifiers()
+{
+    left_modifiers.resize(size);
+    right_modifiers.resize(size);
+    for (unsigned head = 0u; head < size; ++head)
+    {
+        left_modifiers[head].clear();
+        right_modifiers[head].clear();
+        for (unsigned mod = 1u; mod < size; ++mod)
+        {
+            if (mod < head && kept(head, mod))
+                left_modifiers[head].push_back(mod);
+            else if (head < mod && kept(head, mod))
+                right_modifiers[head].push_back(mod);
+        }
+    }
+}
+
+// uleft(i, j) and uright(i, j) share their deduction, it is skipped if both arcs are pruned
+Splits incomplete_splits(const ArcPruning* pruning, const unsigned i, const unsigned j)
+{
+    return incomplete_splits(pruning, i, j, i);
+}
+
+Splits incomplete_splits(const ArcPruning* pruning, const unsigned i, const unsigned j, const unsigned first)
+{
+    if (pruning == nullptr || pruning->kept(i, j) || (i > 0u && pruning->kept(j, i)))
+        return Splits(j - first);
+    else
+        return Splits(nullptr, nullptr, 0u);
+}
+
+// cright(i, j) = uright(i, k) + cright(k, j) with i < k <= j: k must be a kept right modifier of i
+Splits cright_splits(const ArcPruning* pruning, const unsigned i, const unsigned j)
+{
+    return cright_splits(pruning, i, j, i + 1u);
+}
+
+Splits cright_splits(const ArcPruning* pruning, const unsigned i, const unsigned j, const unsigned first)
+{
+    if (pruning == nullptr)
+        return Splits(j - first + 1u);
+
+    const auto& modifiers = pruning->right_modifiers[i];
+    const auto begin = std::lower_bound(modifiers.begin(), modifiers.end(), first);
+    const auto end = std::upper_bound(begin, modifiers.end(), j);
+    return Splits(modifiers.data() + (begin - modifiers.begin()), modifiers.data() + (end - modifiers.begin()), first);
+}
+
+// cleft(i, j) = cleft(i, k) + uleft(k, j) with i <= k < j: k must be a kept left modifier of j
+Splits cleft_splits(const ArcPruning* pruning, const unsigned i, const unsigned j)
+{
+    if (pruning == nullptr)
+        return Splits(j - i);
+
+    const auto& modifiers = pruning->left_modifiers[j];
+    const auto begin = std::lower_bound(modifiers.begin(), modifiers.end(), i);
+    return Splits(modifiers.data() + (begin - modifiers.begin()), modifiers.data() + modifiers.size(), i);
+}
+
+}
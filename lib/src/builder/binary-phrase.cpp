@@ -1,5 +1,11 @@
 #include "diffdp/builder/binary-phrase.h"
 
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+
+#include "dynet/globals.h"
+
 #include "diffdp/dynet/binary_phrase.h"
 #include "dytools/algorithms/span-parser.h"
 #include "dytools/utils.h"
@@ -25,6 +31,15 @@ dynet::Expression BinaryPhraseBuilder::relaxed(const dynet::Expression& weights)
         return relaxed_entropy_Reg(weights);
 }
 
+dynet::Expression BinaryPhraseBuilder::relaxed_samples(const dynet::Expression& weights, unsigned n_samples)
+{
+    if (n_samples == 0u)
+        throw std::runtime_error("The number of samples must be positive");
+
+    // the copies are perturbed independently by the relaxation, which runs all of them in a single node
+    return relaxed(dynet::concatenate_to_batch(std::vector<dynet::Expression>(n_samples, weights)));
+}
+
 dynet::Expression BinaryPhraseBuilder::argmax(const dynet::Expression& weights)
 {
     const auto size = weights.dim().rows();
@@ -46,14 +61,12 @@ dynet::Expression BinaryPhraseBuilder::argmax(const dynet::Expression& weights)
 
 dynet::Expression BinaryPhraseBuilder::relaxed_alg_diff(const dynet::Expression& weights)
 {
-    const auto p_weights = perturb(weights);
-    return dytools::force_cpu(dynet::algorithmic_differentiable_binary_phrase_structure, p_weights, DiscreteMode::ForwardRegularized, nullptr);
+    return dytools::force_cpu(dynet::algorithmic_differentiable_binary_phrase_structure, weights, DiscreteMode::ForwardRegularized, nullptr, settings.split_weights_mode, perturbation(), settings.max_span_length);
 }
 
 dynet::Expression BinaryPhraseBuilder::relaxed_entropy_Reg(const dynet::Expression& weights)
 {
-    const auto p_weights = perturb(weights);
-    return dytools::force_cpu(dynet::entropy_regularized_binary_phrase_structure, p_weights, DiscreteMode::ForwardRegularized, nullptr);
+    return dytools::force_cpu(dynet::entropy_regularized_binary_phrase_structure, weights, DiscreteMode::ForwardRegularized, nullptr, settings.split_weights_mode, perturbation(), settings.max_span_length);
 }
 
 
@@ -65,5 +78,16 @@ dynet::Expression BinaryPhraseBuilder::perturb(const dynet::Expression& arc_weig
         return arc_weights;
 }
 
+GumbelPerturbation BinaryPhraseBuilder::perturbation()
+{
+    if (!(settings.perturb and _training))
+        return GumbelPerturbation();
+
+    // the seed is drawn from the random engine of DyNet, so the noise is reproducible with a fixed DyNet seed
+    const std::uint64_t high = (*dynet::rndeng)();
+    const std::uint64_t low = (*dynet::rndeng)();
+    return GumbelPerturbation((high << 32) | low);
+}
+
 
 }
\ No newline at end of file
@@ -1,8 +1,11 @@
 #include "diffdp/builder/dependency.h"
 
+#include <cstdint>
 #include <vector>
 #include <limits>
 
+#include "dynet/globals.h"
+
 #include "dytools/functions/rooted_arborescence_marginals.h"
 #include "dytools/functions/masking.h"
 #include "diffdp/dynet/eisner.h"
@@ -19,6 +22,7 @@ void DependencyBuilder::new_graph(dynet::ComputationGraph& cg, bool training)
 {
     _cg = &cg;
     _training = training;
+    _sample_sizes.clear();
 }
 
 dynet::Expression DependencyBuilder::relaxed(const dynet::Expression& arc_weights, std::vector<unsigned>* sizes, dynet::Expression* e_mask)
@@ -33,6 +37,31 @@ dynet::Expression DependencyBuilder::relaxed(const dynet::Expression& arc_weight
         return relaxed_projective_entropy_reg(arc_weights, sizes);
 }
 
+dynet::Expression DependencyBuilder::relaxed_samples(const dynet::Expression& arc_weights, unsigned n_samples, std::vector<unsigned>* sizes, dynet::Expression* e_mask)
+{
+    if (n_samples == 0u)
+        throw std::runtime_error("The number of samples must be positive");
+
+    // the copies are perturbed independently by the relaxation, which runs all of them in a single node
+    const auto repeated_weights = dynet::concatenate_to_batch(std::vector<dynet::Expression>(n_samples, arc_weights));
+
+    std::vector<unsigned>* repeated_sizes = nullptr;
+    if (sizes != nullptr)
+    {
+        _sample_sizes.emplace_back(new std::vector<unsigned>());
+        repeated_sizes = _sample_sizes.back().get();
+        for (unsigned sample = 0u ; sample < n_samples ; ++sample)
+            repeated_sizes->insert(repeated_sizes->end(), sizes->begin(), sizes->end());
+    }
+
+    if (e_mask != nullptr && e_mask->dim().batch_elems() > 1u)
+    {
+        auto repeated_mask = dynet::concatenate_to_batch(std::vector<dynet::Expression>(n_samples, *e_mask));
+        return relaxed(repeated_weights, repeated_sizes, &repeated_mask);
+    }
+    return relaxed(repeated_weights, repeated_sizes, e_mask);
+}
+
 dynet::Expression DependencyBuilder::relaxed_head(const dynet::Expression& arc_weights, dynet::Expression* e_mask)
 {
     if (e_mask != nullptr)
@@ -66,27 +95,48 @@ dynet::Expression DependencyBuilder::relaxed_nonprojective(const dynet::Expressi
 
 dynet::Expression DependencyBuilder::relaxed_projective_alg_diff(const dynet::Expression& arc_weights, std::vector<unsigned>* sizes)
 {
-    const auto p_arc_weights = perturb(arc_weights);
     return dytools::force_cpu(dynet::algorithmic_differentiable_eisner,
-            p_arc_weights,
+            arc_weights,
             DiscreteMode::ForwardRegularized,
             DependencyGraphMode::Adjacency,
             DependencyGraphMode::Adjacency,
             true,
-            sizes
+            sizes,
+            settings.split_weights_mode,
+            settings.pruning,
+            perturbation(),
+            settings.vine_length
     );
 }
 
 dynet::Expression DependencyBuilder::relaxed_projective_entropy_reg(const dynet::Expression& arc_weights, std::vector<unsigned>* sizes)
 {
-    const auto p_arc_weights = perturb(arc_weights);
+    if (settings.inside_outside)
+    {
+        if (settings.pruning.enabled() || settings.vine_length > 0u)
+            throw std::runtime_error("The inside-outside relaxation does not support pruning and vine parsing");
+        return dytools::force_cpu(dynet::inside_outside_eisner,
+                arc_weights,
+                DiscreteMode::ForwardRegularized,
+                DependencyGraphMode::Adjacency,
+                DependencyGraphMode::Adjacency,
+                true,
+                sizes,
+                perturbation()
+        );
+    }
+
     return dytools::force_cpu(dynet::entropy_regularized_eisner,
-            p_arc_weights,
+            arc_weights,
             DiscreteMode::ForwardRegularized,
             DependencyGraphMode::Adjacency,
             DependencyGraphMode::Adjacency,
             true,
-            sizes
+            sizes,
+            settings.split_weights_mode,
+            settings.pruning,
+            perturbation(),
+            settings.vine_length
     );
 }
 
@@ -112,14 +162,22 @@ dynet::Expression DependencyBuilder::argmax_nonprojective(const dynet::Expressio
     throw std::runtime_error("Not implemented yet.");
 }
 
-dynet::Expression DependencyBuilder::argmax_projective_alg_diff(const dynet::Expression&, std::vector<unsigned>*)
+dynet::Expression DependencyBuilder::argmax_projective_alg_diff(const dynet::Expression& arc_weights, std::vector<unsigned>* sizes)
 {
-    throw std::runtime_error("Not implemented yet.");
+    return dytools::force_cpu(dynet::viterbi_eisner,
+            arc_weights,
+            DependencyGraphMode::Adjacency,
+            DependencyGraphMode::Adjacency,
+            true,
+            sizes,
+            perturbation()
+    );
 }
 
-dynet::Expression DependencyBuilder::argmax_projective_entropy_reg(const dynet::Expression&, std::vector<unsigned>*)
+// both relaxations have the same argmax
+dynet::Expression DependencyBuilder::argmax_projective_entropy_reg(const dynet::Expression& arc_weights, std::vector<unsigned>* sizes)
 {
-    throw std::runtime_error("Not implemented yet.");
+    return argmax_projective_alg_diff(arc_weights, sizes);
 }
 
 
@@ -131,5 +189,16 @@ dynet::Expression DependencyBuilder::perturb(const dynet::Expression& arc_weight
         return arc_weights;
 }
 
+GumbelPerturbation DependencyBuilder::perturbation()
+{
+    if (!(settings.perturb and _training))
+        return GumbelPerturbation();
+
+    // the seed is drawn from the random engine of DyNet, so the noise is reproducible with a fixed DyNet seed
+    const std::uint64_t high = (*dynet::rndeng)();
+    const std::uint64_t low = (*dynet::rndeng)();
+    return GumbelPerturbation((high << 32) | low);
+}
+
 
 }
\ No newline at end of file
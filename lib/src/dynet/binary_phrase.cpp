@@ -4,24 +4,30 @@
 namespace dynet
 {
 
-Expression algorithmic_differentiable_binary_phrase_structure(const Expression& x, diffdp::DiscreteMode mode, std::vector<unsigned>* batch_sizes)
+Expression algorithmic_differentiable_binary_phrase_structure(const Expression& x, diffdp::DiscreteMode mode, std::vector<unsigned>* batch_sizes, diffdp::SplitWeightsMode split_weights_mode, const diffdp::GumbelPerturbation& perturbation, unsigned max_span_length)
 {
-    return Expression(x.pg, x.pg->add_function<AlgorithmicDifferentiableBinaryPhraseStructure>({x.i}, mode, batch_sizes));
+    return Expression(x.pg, x.pg->add_function<AlgorithmicDifferentiableBinaryPhraseStructure>({x.i}, mode, batch_sizes, split_weights_mode, perturbation, max_span_length));
 }
 
-Expression entropy_regularized_binary_phrase_structure(const Expression& x, diffdp::DiscreteMode mode, std::vector<unsigned>* batch_sizes)
+Expression entropy_regularized_binary_phrase_structure(const Expression& x, diffdp::DiscreteMode mode, std::vector<unsigned>* batch_sizes, diffdp::SplitWeightsMode split_weights_mode, const diffdp::GumbelPerturbation& perturbation, unsigned max_span_length)
 {
-    return Expression(x.pg, x.pg->add_function<EntropyRegularizedBinaryPhraseStructure>({x.i}, mode, batch_sizes));
+    return Expression(x.pg, x.pg->add_function<EntropyRegularizedBinaryPhraseStructure>({x.i}, mode, batch_sizes, split_weights_mode, perturbation, max_span_length));
 }
 
 AlgorithmicDifferentiableBinaryPhraseStructure::AlgorithmicDifferentiableBinaryPhraseStructure(
         const std::initializer_list<VariableIndex>& a,
         diffdp::DiscreteMode mode,
-        std::vector<unsigned>* batch_sizes
+        std::vector<unsigned>* batch_sizes,
+        diffdp::SplitWeightsMode split_weights_mode,
+        const diffdp::GumbelPerturbation& perturbation,
+        unsigned max_span_length
 ) :
         Node(a),
         mode(mode),
-        batch_sizes(batch_sizes)
+        batch_sizes(batch_sizes),
+        split_weights_mode(split_weights_mode),
+        perturbation(perturbation),
+        max_span_length(max_span_length)
 {
     this->has_cuda_implemented = false;
 }
@@ -32,14 +38,7 @@ bool AlgorithmicDifferentiableBinaryPhraseStructure::supports_multibatch() const
 }
 
 AlgorithmicDifferentiableBinaryPhraseStructure::~AlgorithmicDifferentiableBinaryPhraseStructure()
-{
-    for (auto*& ptr : _ce_ptr)
-        if (ptr != nullptr)
-        {
-            delete ptr;
-            ptr = nullptr;
-        }
-}
+{}
 
 std::string AlgorithmicDifferentiableBinaryPhraseStructure::as_string(const std::vector<std::string>& arg_names) const {
     std::ostringstream s;
@@ -57,9 +56,12 @@ Dim AlgorithmicDifferentiableBinaryPhraseStructure::dim_forward(const std::vecto
 }
 
 size_t AlgorithmicDifferentiableBinaryPhraseStructure::aux_storage_size() const {
-    // 2 times because we have a forward and a backward chart
-    const size_t dp_mem = 2 * diffdp::BinaryPhraseStructureChart::required_memory(dim.rows());
-    return dim.batch_elems() * dp_mem;
+    // only the forward charts, the backward charts are taken from the pool if backward is called.
+    // Charts are packed one after the other, so each one only uses the memory required by its sentence
+    size_t dp_mem = 0u;
+    for (unsigned batch = 0u ; batch < dim.batch_elems() ; ++batch)
+        dp_mem += diffdp::BinaryPhraseStructureChart::required_memory(batch_sizes == nullptr ? dim.rows() : batch_sizes->at(batch), split_weights_mode, max_span_length);
+    return dp_mem;
 }
 
 template<class MyDevice>
@@ -74,48 +76,47 @@ void AlgorithmicDifferentiableBinaryPhraseStructure::forward_dev_impl(
     // TODO call zero only when necessary
     TensorTools::zero(fx);
 
-    std::vector<diffdp::AlgorithmicDifferentiableBinaryPhraseStructure*>& _ce_ptr2 =
-            const_cast<std::vector<diffdp::AlgorithmicDifferentiableBinaryPhraseStructure*>&>(_ce_ptr);
-
-    for (auto*& ptr : _ce_ptr2)
-        if (ptr != nullptr)
-        {
-            delete ptr;
-            ptr = nullptr;
-        }
-
-    if (_ce_ptr2.size() != xs[0]->d.batch_elems())
-        _ce_ptr2.resize(xs[0]->d.batch_elems(), nullptr);
-
+    const unsigned batch_elems = xs[0]->d.batch_elems();
     const unsigned max_input_dim = xs[0]->d.rows();
     float* aux_fmem = static_cast<float*>(aux_mem);
 
-    //#pragma omp parallel for
-    for (unsigned batch = 0u ; batch < xs[0]->d.batch_elems() ; ++batch)
+    const auto batch_input_dim = [&] (const unsigned batch) -> unsigned
     {
-        const unsigned eisner_dim = (
-                batch_sizes == nullptr
-                ? max_input_dim
-                : batch_sizes->at(batch)
-        );
+        return batch_sizes == nullptr ? max_input_dim : batch_sizes->at(batch);
+    };
+
+    // the forward charts are views on the auxiliary memory,
+    // the backward charts of a previous call are given back to the pool:
+    // they are only needed if backward is called
+    _ce.clear();
+    _backward_charts.clear();
+    _forward_charts.resize(batch_elems);
+    float* fmem = aux_fmem;
+    for (unsigned batch = 0u ; batch < batch_elems ; ++batch)
+    {
+        const unsigned input_dim = batch_input_dim(batch);
+        if (input_dim > max_input_dim)
+            throw std::runtime_error("Sentence size is larger than the input matrix");
+        if (_forward_charts[batch] == nullptr)
+            _forward_charts[batch].reset(new diffdp::BinaryPhraseStructureChart(input_dim, fmem, split_weights_mode, max_span_length));
+        else
+            _forward_charts[batch]->rebind(input_dim, fmem, split_weights_mode, max_span_length);
+        _ce.emplace_back(_forward_charts[batch].get(), nullptr);
+        fmem += diffdp::BinaryPhraseStructureChart::required_cells(input_dim, split_weights_mode, max_span_length);
+    }
+
+    diffdp::parallel_for_batch(batch_elems, batch_input_dim, [&] (const unsigned batch)
+    {
+        const unsigned eisner_dim = batch_input_dim(batch);
 
         auto input = batch_matrix(*(xs[0]), batch);
 
         if (mode == diffdp::DiscreteMode::ForwardRegularized)
         {
-            float* fmem = aux_fmem + batch * 2 * diffdp::BinaryPhraseStructureChart::required_cells(max_input_dim);
-            //auto forward_chart = std::make_shared<diffdp::EisnerChart>(eisner_dim, fmem);
-            //auto backward_chart = std::make_shared<diffdp::EisnerChart>(eisner_dim, fmem + diffdp::EisnerChart::required_cells(max_eisner_dim));
-            auto forward_chart = std::make_shared<diffdp::BinaryPhraseStructureChart>(eisner_dim, fmem);
-            auto backward_chart = std::make_shared<diffdp::BinaryPhraseStructureChart>(eisner_dim);
-
-            _ce_ptr2.at(batch) = new diffdp::AlgorithmicDifferentiableBinaryPhraseStructure(forward_chart, backward_chart);
-
-
-            _ce_ptr2.at(batch)->forward(
+            _ce.at(batch).forward(
                     [&] (const unsigned left, const unsigned right)
                     {
-                        return input(left, right);
+                        return input(left, right) + perturbation(batch, left, right);
                     }
             );
 
@@ -125,7 +126,7 @@ void AlgorithmicDifferentiableBinaryPhraseStructure::forward_dev_impl(
             {
                 for (unsigned right = left+1; right < eisner_dim ; ++right)
                 {
-                    const float a = _ce_ptr2[batch]->output(left, right);
+                    const float a = _ce[batch].output(left, right);
                     output(left, right) = a;
                 }
             }
@@ -134,7 +135,7 @@ void AlgorithmicDifferentiableBinaryPhraseStructure::forward_dev_impl(
         {
             throw std::runtime_error("Not implemented: only ForwardRegularized can be used at the moment");
         }
-    }
+    });
 #endif
 }
 
@@ -150,13 +151,25 @@ void AlgorithmicDifferentiableBinaryPhraseStructure::backward_dev_impl(
 #ifdef __CUDACC__
     DYNET_NO_CUDA_IMPL_ERROR("AlgorithmicDifferentiableEisner::backward");
 #else
-    //#pragma omp parallel for
-    for (unsigned batch = 0u ; batch < xs[0]->d.batch_elems() ; ++batch)
+    // the backward charts are taken from the pool on the first call only
+    if (_backward_charts.empty())
+    {
+        for (auto& dp : _ce)
+        {
+            _backward_charts.emplace_back(dp.size(), split_weights_mode, max_span_length);
+            dp.chart_backward = _backward_charts.back().get();
+        }
+    }
+
+    diffdp::parallel_for_batch(
+            xs[0]->d.batch_elems(),
+            [&] (const unsigned batch) { return _ce.at(batch).size(); },
+            [&] (const unsigned batch)
     {
         auto output_grad = batch_matrix(dEdxi, batch);
         auto input_grad = batch_matrix(dEdf, batch);
 
-        auto& dp = *(_ce_ptr.at(batch));
+        auto& dp = _ce.at(batch);
 
         dp.backward(
                 [&] (unsigned left, unsigned right) -> float
@@ -168,7 +181,7 @@ void AlgorithmicDifferentiableBinaryPhraseStructure::backward_dev_impl(
         for (unsigned left = 0u ; left < dp.size() ; ++left)
             for (unsigned right = left + 1u; right < dp.size(); ++right)
                 output_grad(left, right) += dp.gradient(left, right);
-    }
+    });
 #endif
 }
 
@@ -182,11 +195,17 @@ DYNET_NODE_INST_DEV_IMPL(AlgorithmicDifferentiableBinaryPhraseStructure)
 EntropyRegularizedBinaryPhraseStructure::EntropyRegularizedBinaryPhraseStructure(
         const std::initializer_list<VariableIndex>& a,
         diffdp::DiscreteMode mode,
-        std::vector<unsigned>* batch_sizes
+        std::vector<unsigned>* batch_sizes,
+        diffdp::SplitWeightsMode split_weights_mode,
+        const diffdp::GumbelPerturbation& perturbation,
+        unsigned max_span_length
 ) :
         Node(a),
         mode(mode),
-        batch_sizes(batch_sizes)
+        batch_sizes(batch_sizes),
+        split_weights_mode(split_weights_mode),
+        perturbation(perturbation),
+        max_span_length(max_span_length)
 {
     this->has_cuda_implemented = false;
 }
@@ -197,14 +216,7 @@ bool EntropyRegularizedBinaryPhraseStructure::supports_multibatch() const
 }
 
 EntropyRegularizedBinaryPhraseStructure::~EntropyRegularizedBinaryPhraseStructure()
-{
-    for (auto*& ptr : _ce_ptr)
-        if (ptr != nullptr)
-        {
-            delete ptr;
-            ptr = nullptr;
-        }
-}
+{}
 
 std::string EntropyRegularizedBinaryPhraseStructure::as_string(const std::vector<std::string>& arg_names) const {
     std::ostringstream s;
@@ -222,9 +234,12 @@ Dim EntropyRegularizedBinaryPhraseStructure::dim_forward(const std::vector<Dim>&
 }
 
 size_t EntropyRegularizedBinaryPhraseStructure::aux_storage_size() const {
-    // 2 times because we have a forward and a backward chart
-    const size_t dp_mem = 2 * diffdp::BinaryPhraseStructureChart::required_memory(dim.rows());
-    return dim.batch_elems() * dp_mem;
+    // only the forward charts, the backward charts are taken from the pool if backward is called.
+    // Charts are packed one after the other, so each one only uses the memory required by its sentence
+    size_t dp_mem = 0u;
+    for (unsigned batch = 0u ; batch < dim.batch_elems() ; ++batch)
+        dp_mem += diffdp::BinaryPhraseStructureChart::required_memory(batch_sizes == nullptr ? dim.rows() : batch_sizes->at(batch), split_weights_mode, max_span_length);
+    return dp_mem;
 }
 
 template<class MyDevice>
@@ -239,48 +254,47 @@ void EntropyRegularizedBinaryPhraseStructure::forward_dev_impl(
     // TODO call zero only when necessary
     TensorTools::zero(fx);
 
-    std::vector<diffdp::EntropyRegularizedBinaryPhraseStructure*>& _ce_ptr2 =
-            const_cast<std::vector<diffdp::EntropyRegularizedBinaryPhraseStructure*>&>(_ce_ptr);
-
-    for (auto*& ptr : _ce_ptr2)
-        if (ptr != nullptr)
-        {
-            delete ptr;
-            ptr = nullptr;
-        }
-
-    if (_ce_ptr2.size() != xs[0]->d.batch_elems())
-        _ce_ptr2.resize(xs[0]->d.batch_elems(), nullptr);
-
+    const unsigned batch_elems = xs[0]->d.batch_elems();
     const unsigned max_input_dim = xs[0]->d.rows();
     float* aux_fmem = static_cast<float*>(aux_mem);
 
-    //#pragma omp parallel for
-    for (unsigned batch = 0u ; batch < xs[0]->d.batch_elems() ; ++batch)
+    const auto batch_input_dim = [&] (const unsigned batch) -> unsigned
     {
-        const unsigned eisner_dim = (
-                batch_sizes == nullptr
-                ? max_input_dim
-                : batch_sizes->at(batch)
-        );
+        return batch_sizes == nullptr ? max_input_dim : batch_sizes->at(batch);
+    };
+
+    // the forward charts are views on the auxiliary memory,
+    // the backward charts of a previous call are given back to the pool:
+    // they are only needed if backward is called
+    _ce.clear();
+    _backward_charts.clear();
+    _forward_charts.resize(batch_elems);
+    float* fmem = aux_fmem;
+    for (unsigned batch = 0u ; batch < batch_elems ; ++batch)
+    {
+        const unsigned input_dim = batch_input_dim(batch);
+        if (input_dim > max_input_dim)
+            throw std::runtime_error("Sentence size is larger than the input matrix");
+        if (_forward_charts[batch] == nullptr)
+            _forward_charts[batch].reset(new diffdp::BinaryPhraseStructureChart(input_dim, fmem, split_weights_mode, max_span_length));
+        else
+            _forward_charts[batch]->rebind(input_dim, fmem, split_weights_mode, max_span_length);
+        _ce.emplace_back(_forward_charts[batch].get(), nullptr);
+        fmem += diffdp::BinaryPhraseStructureChart::required_cells(input_dim, split_weights_mode, max_span_length);
+    }
+
+    diffdp::parallel_for_batch(batch_elems, batch_input_dim, [&] (const unsigned batch)
+    {
+        const unsigned eisner_dim = batch_input_dim(batch);
 
         auto input = batch_matrix(*(xs[0]), batch);
 
         if (mode == diffdp::DiscreteMode::ForwardRegularized)
         {
-            float* fmem = aux_fmem + batch * 2 * diffdp::BinaryPhraseStructureChart::required_cells(max_input_dim);
-            //auto forward_chart = std::make_shared<diffdp::EisnerChart>(eisner_dim, fmem);
-            //auto backward_chart = std::make_shared<diffdp::EisnerChart>(eisner_dim, fmem + diffdp::EisnerChart::required_cells(max_eisner_dim));
-            auto forward_chart = std::make_shared<diffdp::BinaryPhraseStructureChart>(eisner_dim, fmem);
-            auto backward_chart = std::make_shared<diffdp::BinaryPhraseStructureChart>(eisner_dim, fmem + diffdp::BinaryPhraseStructureChart::required_cells(max_input_dim));
-
-            _ce_ptr2.at(batch) = new diffdp::EntropyRegularizedBinaryPhraseStructure(forward_chart, backward_chart);
-
-
-            _ce_ptr2.at(batch)->forward(
+            _ce.at(batch).forward(
                     [&] (const unsigned left, const unsigned right)
                     {
-                        return input(left, right);
+                        return input(left, right) + perturbation(batch, left, right);
                     }
             );
 
@@ -290,7 +304,7 @@ void EntropyRegularizedBinaryPhraseStructure::forward_dev_impl(
             {
                 for (unsigned right = left+1; right < eisner_dim ; ++right)
                 {
-                    const float a = _ce_ptr2[batch]->output(left, right);
+                    const float a = _ce[batch].output(left, right);
                     output(left, right) = a;
                 }
             }
@@ -299,7 +313,7 @@ void EntropyRegularizedBinaryPhraseStructure::forward_dev_impl(
         {
             throw std::runtime_error("Not implemented: only ForwardRegularized can be used at the moment");
         }
-    }
+    });
 #endif
 }
 
@@ -315,13 +329,25 @@ void EntropyRegularizedBinaryPhraseStructure::backward_dev_impl(
 #ifdef __CUDACC__
     DYNET_NO_CUDA_IMPL_ERROR("AlgorithmicDifferentiableEisner::backward");
 #else
-    //#pragma omp parallel for
-    for (unsigned batch = 0u ; batch < xs[0]->d.batch_elems() ; ++batch)
+    // the backward charts are taken from the pool on the first call only
+    if (_backward_charts.empty())
+    {
+        for (auto& dp : _ce)
+        {
+            _backward_charts.emplace_back(dp.size(), split_weights_mode, max_span_length);
+            dp.chart_backward = _backward_charts.back().get();
+        }
+    }
+
+    diffdp::parallel_for_batch(
+            xs[0]->d.batch_elems(),
+            [&] (const unsigned batch) { return _ce.at(batch).size(); },
+            [&] (const unsigned batch)
     {
         auto output_grad = batch_matrix(dEdxi, batch);
         auto input_grad = batch_matrix(dEdf, batch);
 
-        auto& dp = *(_ce_ptr.at(batch));
+        auto& dp = _ce.at(batch);
 
         dp.backward(
                 [&] (unsigned left, unsigned right) -> float
@@ -335,7 +361,7 @@ void EntropyRegularizedBinaryPhraseStructure::backward_dev_impl(
             {
                 output_grad(left, right) += dp.gradient(left, right);
             }
-    }
+    });
 #endif
 }
 
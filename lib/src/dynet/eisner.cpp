@@ -1,9 +1,8 @@
-/**
- * TODO: there is a lot a duplicate code between the two nodes (almost identical)
- */
 #include "diffdp/dynet/eisner.h"
 #include "dynet/tensor-eigen.h"
 
+#include <limits>
+
 namespace diffdp
 {
 
@@ -43,70 +42,229 @@ std::pair<unsigned, unsigned> from_compact(const std::pair<unsigned, unsigned> d
 namespace dynet
 {
 
-Expression algorithmic_differentiable_eisner(const Expression& x, diffdp::DiscreteMode mode, diffdp::DependencyGraphMode input_graph, diffdp::DependencyGraphMode output_graph, bool with_root_arcs, std::vector<unsigned>* batch_sizes)
+namespace
+{
+
+// weight of an arc of the chart, read from the input matrix and perturbed if the perturbation is enabled.
+// The noise only depends on the sentence and on the input cell, so the backward pass draws the same noise
+template<class Matrix>
+float arc_weight(const Matrix& input, const unsigned head, const unsigned mod, const diffdp::DependencyGraphMode input_graph, const bool with_root_arcs, const diffdp::GumbelPerturbation& perturbation, const unsigned batch)
 {
-    return Expression(x.pg, x.pg->add_function<AlgorithmicDifferentiableEisner>({x.i}, mode, input_graph, output_graph, with_root_arcs, batch_sizes));
+    if (mod == 0u)
+        throw std::runtime_error("Illegal arc");
+    if (head == 0u && !with_root_arcs)
+        return 0.f;
+
+    const auto arc = diffdp::from_adjacency({head, mod}, input_graph);
+    return input(arc.first, arc.second) + perturbation(batch, arc.first, arc.second);
 }
 
-Expression entropy_regularized_eisner(const Expression& x, diffdp::DiscreteMode mode, diffdp::DependencyGraphMode input_graph, diffdp::DependencyGraphMode output_graph, bool with_root_arcs, std::vector<unsigned>* batch_sizes)
+// with a vine, the root arcs are never pruned so that the chart always contains a tree
+diffdp::PruningSettings vine_pruning_settings(diffdp::PruningSettings settings, const unsigned vine_length)
 {
-    return Expression(x.pg, x.pg->add_function<EntropyRegularizedEisner>({x.i}, mode, input_graph, output_graph, with_root_arcs, batch_sizes));
+    if (vine_length > 0u)
+        settings.keep_root_arcs = true;
+    return settings;
 }
 
-AlgorithmicDifferentiableEisner::AlgorithmicDifferentiableEisner(
-        const std::initializer_list<VariableIndex>& a,
-        diffdp::DiscreteMode mode,
-        diffdp::DependencyGraphMode input_graph,
-        diffdp::DependencyGraphMode output_graph,
-        bool with_root_arcs,
-        std::vector<unsigned>* batch_sizes
-) :
-        Node(a),
-        mode(mode),
-        input_graph(input_graph),
-        output_graph(output_graph),
-        with_root_arcs(with_root_arcs),
-        batch_sizes(batch_sizes)
+// write the adjacency matrix of the best tree in fx, fx must be zero.
+// With pruning, the tree only contains kept arcs, as the relaxation computed by the backward pass
+template<class L>
+void viterbi_forward(
+        const Tensor& x,
+        Tensor& fx,
+        const diffdp::DependencyGraphMode input_graph,
+        const diffdp::DependencyGraphMode output_graph,
+        const bool with_root_arcs,
+        const diffdp::GumbelPerturbation& perturbation,
+        const diffdp::PruningSettings& pruning_settings,
+        const unsigned max_eisner_dim,
+        L batch_eisner_dim
+)
 {
-    this->has_cuda_implemented = false;
+    const unsigned batch_elems = x.d.batch_elems();
+    for (unsigned batch = 0u ; batch < batch_elems ; ++batch)
+        if (batch_eisner_dim(batch) > max_eisner_dim)
+            throw std::runtime_error("Sentence size is larger than the input matrix");
+
+    diffdp::parallel_for_batch(batch_elems, batch_eisner_dim, [&] (const unsigned batch)
+    {
+        const unsigned eisner_dim = batch_eisner_dim(batch);
+
+        // the chart is only needed during the forward pass
+        diffdp::PooledChart<diffdp::ViterbiEisnerChart> chart(eisner_dim);
+        diffdp::ViterbiEisner eisner(chart.get());
+
+        auto input = batch_matrix(x, batch);
+        const auto weight = [&] (const unsigned head, const unsigned mod)
+        {
+            return arc_weight(input, head, mod, input_graph, with_root_arcs, perturbation, batch);
+        };
+
+        diffdp::ArcPruning pruning;
+        if (pruning_settings.enabled())
+            pruning.build(eisner_dim, pruning_settings, weight);
+        eisner.forward(
+                [&] (const unsigned head, const unsigned mod)
+                {
+                    if (pruning_settings.enabled() && !pruning.kept(head, mod))
+                        return -std::numeric_limits<float>::infinity();
+                    return weight(head, mod);
+                }
+        );
+
+        auto output = batch_matrix(fx, batch);
+        for (unsigned mod = 1u; mod < eisner_dim ; ++mod)
+        {
+            const unsigned head = eisner.head(mod);
+            if (head == 0u && !with_root_arcs)
+                continue;
+
+            const auto arc = diffdp::from_adjacency({head, mod}, output_graph);
+            output(arc.first, arc.second) = 1.f;
+        }
+    });
 }
 
-bool AlgorithmicDifferentiableEisner::supports_multibatch() const
+// probability of a label given its arc, i.e. exp(label - arc) where arc is the log-sum-exp of the labels.
+// An arc whose labels are all -inf (masked) has a weight of -inf and all its labels have a probability of 0
+inline float label_probability(const float label, const float arc)
 {
-    return true;
+    return arc == -std::numeric_limits<float>::infinity() ? 0.f : std::exp(label - arc);
 }
 
-AlgorithmicDifferentiableEisner::~AlgorithmicDifferentiableEisner()
+// log-sum-exp over labels of the top-left (dim, dim) block of a (rows, rows, n_labels) tensor.
+// Labels are the outer loop, so the inner loops read contiguous memory and are vectorized
+void label_log_sum_exp(const float* labels, float* arcs, float* buffer, const unsigned rows, const unsigned n_labels, const unsigned dim)
+{
+    const std::size_t label_stride = (std::size_t) rows * rows;
+
+    for (unsigned c = 0u ; c < dim ; ++c)
+        std::copy_n(labels + c * rows, dim, arcs + c * rows);
+    for (unsigned l = 1u ; l < n_labels ; ++l)
+        for (unsigned c = 0u ; c < dim ; ++c)
+            for (unsigned r = 0u ; r < dim ; ++r)
+                arcs[r + c * rows] = std::max(arcs[r + c * rows], labels[l * label_stride + r + c * rows]);
+
+    for (unsigned c = 0u ; c < dim ; ++c)
+        std::fill_n(buffer + c * rows, dim, 0.f);
+    for (unsigned l = 0u ; l < n_labels ; ++l)
+        for (unsigned c = 0u ; c < dim ; ++c)
+            for (unsigned r = 0u ; r < dim ; ++r)
+                buffer[r + c * rows] += label_probability(labels[l * label_stride + r + c * rows], arcs[r + c * rows]);
+
+    for (unsigned c = 0u ; c < dim ; ++c)
+        for (unsigned r = 0u ; r < dim ; ++r)
+            arcs[r + c * rows] += std::log(buffer[r + c * rows]);
+}
+
+// the output of the divergence nodes is a scalar for each sentence
+Dim divergence_dim_forward(const std::vector<Dim>& xs, const unsigned n_args, const diffdp::DependencyGraphMode input_graph, const char* name)
+{
+    DYNET_ARG_CHECK(
+            xs.size() == n_args && xs[0].nd == 2 && xs[0].rows() == xs[0].cols(),
+            "Bad input dimensions in " << name << ": " << xs
+    );
+    DYNET_ARG_CHECK(
+            xs[0].rows() >= (input_graph == diffdp::DependencyGraphMode::Compact ? 1u : 2u),
+            "Bad input dimensions in " << name << ": " << xs
+    );
+    for (unsigned i = 1u ; i < n_args ; ++i)
+        DYNET_ARG_CHECK(
+                xs[i].nd == 2 && xs[i].rows() == xs[0].rows() && xs[i].cols() == xs[0].cols() && xs[i].batch_elems() == xs[0].batch_elems(),
+                "Bad input dimensions in " << name << ": " << xs
+        );
+
+    return dynet::Dim({1u}, xs[0].batch_elems());
+}
+
+// add scale * value(head, mod) to the input cell of each arc
+template<class Matrix, class F>
+void add_arc_gradient(Matrix& input_grad, const unsigned eisner_dim, const diffdp::DependencyGraphMode input_graph, const bool with_root_arcs, const float scale, F value)
 {
-    for (auto*& ptr : _ce_ptr)
-        if (ptr != nullptr)
+    for (unsigned head = 0u ; head < eisner_dim ; ++head)
+    {
+        for (unsigned mod = 1u; mod < eisner_dim ; ++mod)
         {
-            delete ptr;
-            ptr = nullptr;
+            if (head == mod)
+                continue;
+
+            if (head == 0u && !with_root_arcs)
+                continue;
+
+            const float v = value(head, mod);
+            if (!std::isfinite(v))
+                throw std::runtime_error("BAD eisner output grad");
+
+            const auto arc = diffdp::from_adjacency({head, mod}, input_graph);
+            input_grad(arc.first, arc.second) += scale * v;
         }
+    }
 }
 
-std::string AlgorithmicDifferentiableEisner::as_string(const std::vector<std::string>& arg_names) const {
-    std::ostringstream s;
-    s << "algorithmic_differentiable_eisner(" << arg_names[0] << ")";
-    return s.str();
+// straight-through estimator: the gradient of each output arc is copied to the input arc
+template<class L>
+void straight_through_backward(
+        const Tensor& dEdf,
+        Tensor& dEdxi,
+        const diffdp::DependencyGraphMode input_graph,
+        const diffdp::DependencyGraphMode output_graph,
+        const bool with_root_arcs,
+        L batch_eisner_dim
+)
+{
+    const unsigned batch_elems = dEdf.d.batch_elems();
+    diffdp::parallel_for_batch(batch_elems, batch_eisner_dim, [&] (const unsigned batch)
+    {
+        const unsigned eisner_dim = batch_eisner_dim(batch);
+        auto output_grad = batch_matrix(dEdxi, batch);
+        auto input_grad = batch_matrix(dEdf, batch);
+
+        for (unsigned head = 0u ; head < eisner_dim ; ++head)
+        {
+            for (unsigned mod = 1u; mod < eisner_dim ; ++mod)
+            {
+                if (head == mod)
+                    continue;
+
+                if (head == 0u && !with_root_arcs)
+                    continue;
+
+                const auto input_arc = diffdp::from_adjacency({head, mod}, input_graph);
+                const auto output_arc = diffdp::from_adjacency({head, mod}, output_graph);
+                output_grad(input_arc.first, input_arc.second) += input_grad(output_arc.first, output_arc.second);
+            }
+        }
+    });
 }
 
-Dim AlgorithmicDifferentiableEisner::dim_forward(const std::vector<Dim>& xs) const {
+// the inside-outside algorithm does not support pruning, its nodes never enable it
+template<class Engine>
+void set_pruning(Engine& eisner, const diffdp::ArcPruning* pruning)
+{
+    eisner.pruning = pruning;
+}
+
+void set_pruning(diffdp::InsideOutsideEisner&, const diffdp::ArcPruning*)
+{
+    throw std::runtime_error("Pruning is not supported by the inside-outside algorithm");
+}
+
+// The relaxed nodes (AlgorithmicDifferentiableEisner, EntropyRegularizedEisner and InsideOutsideEisner)
+// only differ by their dynamic program (Engine) and its chart (Chart).
+// chart_args are the arguments of the chart after its size and memory, e.g. the split weights mode,
+// and pruning is only used (and must not be null) if pruning_settings is enabled.
+
+Dim relaxed_dim_forward(const std::vector<Dim>& xs, const diffdp::DependencyGraphMode input_graph, const diffdp::DependencyGraphMode output_graph, const char* name)
+{
     DYNET_ARG_CHECK(
             xs.size() == 1 && xs[0].nd == 2 && xs[0].rows() == xs[0].cols(),
-            "Bad input dimensions in AlgorithmicDifferentiableEisner: " << xs
+            "Bad input dimensions in " << name << ": " << xs
+    );
+    DYNET_ARG_CHECK(
+            xs[0].rows() >= (input_graph == diffdp::DependencyGraphMode::Compact ? 1u : 2u),
+            "Bad input dimensions in " << name << ": " << xs
     );
-    if (input_graph == diffdp::DependencyGraphMode::Compact)
-        DYNET_ARG_CHECK(
-                xs[0].rows() >= 1,
-                "Bad input dimensions in AlgorithmicDifferentiableEisner: " << xs
-        )
-    else
-        DYNET_ARG_CHECK(
-                xs[0].rows() >= 2,
-                "Bad input dimensions in AlgorithmicDifferentiableEisner: " << xs
-        )
 
     unsigned dim;
     if (input_graph == output_graph)
@@ -119,146 +277,209 @@ Dim AlgorithmicDifferentiableEisner::dim_forward(const std::vector<Dim>& xs) con
     return dynet::Dim({dim, dim}, xs[0].batch_elems());
 }
 
-size_t AlgorithmicDifferentiableEisner::aux_storage_size() const {
-    const unsigned eisner_dim = dim.rows() + (output_graph == diffdp::DependencyGraphMode::Compact ? 1 : 0);
-    // 2 times because we have a forward and a backward chart
-    const size_t eisner_mem = 2 * diffdp::EisnerChart::required_memory(eisner_dim);
-    return dim.batch_elems() * eisner_mem;
+template<class Chart, class N, class... ChartArgs>
+size_t relaxed_aux_storage_size(const N& node, ChartArgs... chart_args)
+{
+    // the discrete modes do not build the relaxation in the forward pass
+    if (node.mode != diffdp::DiscreteMode::ForwardRegularized)
+        return 0u;
+
+    const unsigned max_eisner_dim = node.dim.rows() + (node.output_graph == diffdp::DependencyGraphMode::Compact ? 1 : 0);
+    // only the forward charts, the backward charts are taken from the pool if backward is called.
+    // Charts are packed one after the other, so each one only uses the memory required by its sentence
+    size_t eisner_mem = 0u;
+    for (unsigned batch = 0u ; batch < node.dim.batch_elems() ; ++batch)
+        eisner_mem += Chart::required_memory(node.batch_sizes == nullptr ? max_eisner_dim : node.batch_sizes->at(batch) + 1, chart_args...);
+    return eisner_mem;
 }
 
+// forward pass of the relaxation of a sentence, after the pruning stage if it is enabled
+template<class Engine, class N>
+void relaxed_sentence_forward(
+        const N& node,
+        Engine& eisner,
+        const Tensor& x,
+        const unsigned batch,
+        const diffdp::PruningSettings& pruning_settings,
+        std::vector<diffdp::ArcPruning>* pruning
+)
+{
+    auto input = batch_matrix(x, batch);
+    const auto weight = [&] (const unsigned head, const unsigned mod)
+    {
+        return arc_weight(input, head, mod, node.input_graph, node.with_root_arcs, node.perturbation, batch);
+    };
 
+    if (pruning_settings.enabled())
+    {
+        pruning->at(batch).build(eisner.size(), pruning_settings, weight);
+        set_pruning(eisner, &pruning->at(batch));
+    }
+    eisner.forward(weight);
+}
 
-
-template<class MyDevice>
-void AlgorithmicDifferentiableEisner::forward_dev_impl(
-        const MyDevice&,
+template<class Engine, class Chart, class N, class... ChartArgs>
+void relaxed_forward(
+        const N& node,
         const std::vector<const Tensor*>& xs,
-        Tensor& fx
-) const {
-#ifdef __CUDACC__
-    DYNET_NO_CUDA_IMPL_ERROR("AlgorithmicDifferentiableEisner::forward");
-#else
-    // TODO call zero only when necessary
+        Tensor& fx,
+        const diffdp::PruningSettings& pruning_settings,
+        std::vector<diffdp::ArcPruning>* pruning,
+        ChartArgs... chart_args
+)
+{
+    std::vector<Engine>& ce = node._ce;
+    std::vector<std::unique_ptr<Chart>>& forward_charts = node._forward_charts;
+
+    // the cells after the end of the sentences, and the arcs outside of the tree in the discrete modes, are null
     TensorTools::zero(fx);
 
-    std::vector<diffdp::AlgorithmicDifferentiableEisner*>& _ce_ptr2 =
-            const_cast<std::vector<diffdp::AlgorithmicDifferentiableEisner*>&>(_ce_ptr);
+    const unsigned batch_elems = xs[0]->d.batch_elems();
+    const unsigned max_eisner_dim = xs[0]->d.rows() + (node.input_graph == diffdp::DependencyGraphMode::Compact ? 1 : 0);
 
-    for (auto*& ptr : _ce_ptr2)
-        if (ptr != nullptr)
-        {
-            delete ptr;
-            ptr = nullptr;
-        }
+    const auto batch_eisner_dim = [&] (const unsigned batch) -> unsigned
+    {
+        return node.batch_sizes == nullptr ? max_eisner_dim : node.batch_sizes->at(batch) + 1;
+    };
 
-    if (_ce_ptr2.size() != xs[0]->d.batch_elems())
-        _ce_ptr2.resize(xs[0]->d.batch_elems(), nullptr);
+    // the charts of a previous call are given back to the pool
+    ce.clear();
+    node._backward_charts.clear();
+    node._pooled_forward_charts.clear();
 
-    const unsigned max_eisner_dim = xs[0]->d.rows() + (input_graph == diffdp::DependencyGraphMode::Compact ? 1 : 0);
-    float* aux_fmem = static_cast<float*>(aux_mem);
+    // the output of the other modes is discrete:
+    // the relaxation is only computed by backward_dev_impl, if it needs it
+    if (node.mode != diffdp::DiscreteMode::ForwardRegularized)
+    {
+        viterbi_forward(*(xs[0]), fx, node.input_graph, node.output_graph, node.with_root_arcs, node.perturbation, pruning_settings, max_eisner_dim, batch_eisner_dim);
+        return;
+    }
 
-    //#pragma omp parallel for
-    for (unsigned batch = 0u ; batch < xs[0]->d.batch_elems() ; ++batch)
+    // the forward charts are views on the auxiliary memory,
+    // the backward charts are only needed if backward is called
+    forward_charts.resize(batch_elems);
+    if (pruning_settings.enabled())
+        pruning->resize(batch_elems);
+    float* fmem = static_cast<float*>(node.aux_mem);
+    for (unsigned batch = 0u ; batch < batch_elems ; ++batch)
     {
-        const unsigned eisner_dim = (
-                batch_sizes == nullptr
-                ? max_eisner_dim
-                : batch_sizes->at(batch) + 1
-        );
+        const unsigned eisner_dim = batch_eisner_dim(batch);
+        if (eisner_dim > max_eisner_dim)
+            throw std::runtime_error("Sentence size is larger than the input matrix");
+        if (forward_charts[batch] == nullptr)
+            forward_charts[batch].reset(new Chart(eisner_dim, fmem, chart_args...));
+        else
+            forward_charts[batch]->rebind(eisner_dim, fmem, chart_args...);
+        ce.emplace_back(forward_charts[batch].get(), nullptr);
+        fmem += Chart::required_cells(eisner_dim, chart_args...);
+    }
 
-        auto input = batch_matrix(*(xs[0]), batch);
+    diffdp::parallel_for_batch(batch_elems, batch_eisner_dim, [&] (const unsigned batch)
+    {
+        const unsigned eisner_dim = batch_eisner_dim(batch);
+        relaxed_sentence_forward(node, ce.at(batch), *(xs[0]), batch, pruning_settings, pruning);
 
-        if (mode == diffdp::DiscreteMode::ForwardRegularized)
+        auto output = batch_matrix(fx, batch);
+
+        for (unsigned head = 0u ; head < eisner_dim ; ++head)
         {
-            float* fmem = aux_fmem + batch * 2 * diffdp::EisnerChart::required_cells(max_eisner_dim);
-            //auto forward_chart = std::make_shared<diffdp::EisnerChart>(eisner_dim, fmem);
-            //auto backward_chart = std::make_shared<diffdp::EisnerChart>(eisner_dim, fmem + diffdp::EisnerChart::required_cells(max_eisner_dim));
-            auto forward_chart = std::make_shared<diffdp::EisnerChart>(eisner_dim, fmem);
-            auto backward_chart = std::make_shared<diffdp::EisnerChart>(eisner_dim);
+            for (unsigned mod = 1u; mod < eisner_dim ; ++mod)
+            {
+                const auto arc = diffdp::from_adjacency({head, mod}, node.output_graph);
+                if (head == mod)
+                {
+                    output(arc.first, arc.second) = 0.f;
+                    continue;
+                }
 
-            _ce_ptr2.at(batch) = new diffdp::AlgorithmicDifferentiableEisner(forward_chart, backward_chart);
+                if (head == 0u && !node.with_root_arcs)
+                {
+                    output(arc.first, arc.second) = 0.f;
+                    continue;
+                }
 
+                const float a = ce[batch].output(head, mod);
 
-            _ce_ptr2.at(batch)->forward(
-                    [&] (const unsigned head, const unsigned mod)
-                    {
-                        if (mod == 0u)
-                            throw std::runtime_error("Illegal arc");
-                        if (head == 0u && !with_root_arcs)
-                        {
-                            return 0.f;
-                        }
-                        else
-                        {
-                            const auto arc = diffdp::from_adjacency({head, mod}, input_graph);
-                            const float v = input(arc.first, arc.second);
-                            return v;
-                        }
-                    }
-            );
+                if (!std::isfinite(a))
+                    throw std::runtime_error("BAD eisner output");
 
-            auto output = batch_matrix(fx, batch);
+                output(arc.first, arc.second) = a;
+            }
+        }
+    });
+}
 
-            for (unsigned head = 0u ; head < eisner_dim ; ++head)
-            {
-                for (unsigned mod = 1u; mod < eisner_dim ; ++mod)
-                {
-                    const auto arc = diffdp::from_adjacency({head, mod}, output_graph);
-                    if (head == mod)
-                    {
-                        output(arc.first, arc.second) = 0.f;
-                        continue;
-                    }
+template<class Engine, class Chart, class N, class... ChartArgs>
+void relaxed_backward(
+        const N& node,
+        const std::vector<const Tensor*>& xs,
+        const Tensor& dEdf,
+        Tensor& dEdxi,
+        const diffdp::PruningSettings& pruning_settings,
+        std::vector<diffdp::ArcPruning>* pruning,
+        ChartArgs... chart_args
+)
+{
+    std::vector<Engine>& ce = node._ce;
+    std::vector<diffdp::PooledChart<Chart>>& pooled_forward_charts = node._pooled_forward_charts;
+    std::vector<diffdp::PooledChart<Chart>>& backward_charts = node._backward_charts;
 
-                    if (head == 0u && !with_root_arcs)
-                    {
-                        output(arc.first, arc.second) = 0.f;
-                        continue;
-                    }
+    const unsigned batch_elems = xs[0]->d.batch_elems();
+    const unsigned max_eisner_dim = xs[0]->d.rows() + (node.input_graph == diffdp::DependencyGraphMode::Compact ? 1 : 0);
 
-                    const float a = _ce_ptr2[batch]->output(head, mod);
+    const auto batch_eisner_dim = [&] (const unsigned batch) -> unsigned
+    {
+        return node.batch_sizes == nullptr ? max_eisner_dim : node.batch_sizes->at(batch) + 1;
+    };
 
-                    if (!std::isfinite(a))
-                        throw std::runtime_error("BAD eisner output");
+    if (node.mode == diffdp::DiscreteMode::Null)
+        return;
+    if (node.mode == diffdp::DiscreteMode::StraightThrough)
+    {
+        straight_through_backward(dEdf, dEdxi, node.input_graph, node.output_graph, node.with_root_arcs, batch_eisner_dim);
+        return;
+    }
 
-                    output(arc.first, arc.second) = a;
-                }
+    // the charts are taken from the pool on the first call only
+    if (backward_charts.empty())
+    {
+        // the relaxation has not been computed by the forward pass
+        if (node.mode == diffdp::DiscreteMode::BackwardRegularized)
+        {
+            if (pruning_settings.enabled())
+                pruning->resize(batch_elems);
+            for (unsigned batch = 0u ; batch < batch_elems ; ++batch)
+            {
+                pooled_forward_charts.emplace_back(batch_eisner_dim(batch), chart_args...);
+                ce.emplace_back(pooled_forward_charts.back().get(), nullptr);
             }
+
+            diffdp::parallel_for_batch(batch_elems, batch_eisner_dim, [&] (const unsigned batch)
+            {
+                relaxed_sentence_forward(node, ce.at(batch), *(xs[0]), batch, pruning_settings, pruning);
+            });
         }
-        else
+
+        for (auto& dp : ce)
         {
-            throw std::runtime_error("Not implemented: only ForwardRegularized can be used at the moment");
+            backward_charts.emplace_back(dp.size(), chart_args...);
+            dp.chart_backward = backward_charts.back().get();
         }
     }
-#endif
-}
 
-template<class MyDevice>
-void AlgorithmicDifferentiableEisner::backward_dev_impl(
-        const MyDevice &,
-        const std::vector<const Tensor*>& xs,
-        const Tensor&,
-        const Tensor& dEdf,
-        unsigned,
-        Tensor& dEdxi
-) const {
-#ifdef __CUDACC__
-    DYNET_NO_CUDA_IMPL_ERROR("AlgorithmicDifferentiableEisner::backward");
-#else
-    //#pragma omp parallel for
-    for (unsigned batch = 0u ; batch < xs[0]->d.batch_elems() ; ++batch)
+    diffdp::parallel_for_batch(batch_elems, batch_eisner_dim, [&] (const unsigned batch)
     {
         auto output_grad = batch_matrix(dEdxi, batch);
         auto input_grad = batch_matrix(dEdf, batch);
 
-        auto& eisner = *(_ce_ptr.at(batch));
+        auto& eisner = ce.at(batch);
 
         eisner.backward(
                 [&] (unsigned head, unsigned mod) -> float
                 {
-                    if (head == 0u && !with_root_arcs)
+                    if (head == 0u && !node.with_root_arcs)
                         return 0.f;
-                    auto arc = diffdp::from_adjacency({head, mod}, output_graph);
+                    auto arc = diffdp::from_adjacency({head, mod}, node.output_graph);
                     const float v = input_grad(arc.first, arc.second);
                     if (!std::isfinite(v))
                         throw std::runtime_error("BAD eisner input grad");
@@ -273,209 +494,562 @@ void AlgorithmicDifferentiableEisner::backward_dev_impl(
                 if (head == mod)
                     continue;
 
-                if (head == 0u && !with_root_arcs)
-                    return;
+                if (head == 0u && !node.with_root_arcs)
+                    continue;
 
                 auto const v = eisner.gradient(head, mod);
                 if (!std::isfinite(v))
                     throw std::runtime_error("BAD eisner output grad");
 
-                auto arc = diffdp::from_adjacency({head, mod}, input_graph);
+                auto arc = diffdp::from_adjacency({head, mod}, node.input_graph);
                 output_grad(arc.first, arc.second) += v;
             }
         }
-    }
-#endif
+    });
 }
 
+}
 
-DYNET_NODE_INST_DEV_IMPL(AlgorithmicDifferentiableEisner)
+Expression algorithmic_differentiable_eisner(const Expression& x, diffdp::DiscreteMode mode, diffdp::DependencyGraphMode input_graph, diffdp::DependencyGraphMode output_graph, bool with_root_arcs, std::vector<unsigned>* batch_sizes, diffdp::SplitWeightsMode split_weights_mode, const diffdp::PruningSettings& pruning_settings, const diffdp::GumbelPerturbation& perturbation, unsigned vine_length)
+{
+    return Expression(x.pg, x.pg->add_function<AlgorithmicDifferentiableEisner>({x.i}, mode, input_graph, output_graph, with_root_arcs, batch_sizes, split_weights_mode, pruning_settings, perturbation, vine_length));
+}
+
+Expression entropy_regularized_eisner(const Expression& x, diffdp::DiscreteMode mode, diffdp::DependencyGraphMode input_graph, diffdp::DependencyGraphMode output_graph, bool with_root_arcs, std::vector<unsigned>* batch_sizes, diffdp::SplitWeightsMode split_weights_mode, const diffdp::PruningSettings& pruning_settings, const diffdp::GumbelPerturbation& perturbation, unsigned vine_length)
+{
+    return Expression(x.pg, x.pg->add_function<EntropyRegularizedEisner>({x.i}, mode, input_graph, output_graph, with_root_arcs, batch_sizes, split_weights_mode, pruning_settings, perturbation, vine_length));
+}
 
+Expression inside_outside_eisner(const Expression& x, diffdp::DiscreteMode mode, diffdp::DependencyGraphMode input_graph, diffdp::DependencyGraphMode output_graph, bool with_root_arcs, std::vector<unsigned>* batch_sizes, const diffdp::GumbelPerturbation& perturbation)
+{
+    return Expression(x.pg, x.pg->add_function<InsideOutsideEisner>({x.i}, mode, input_graph, output_graph, with_root_arcs, batch_sizes, perturbation));
+}
 
+Expression viterbi_eisner(const Expression& x, diffdp::DependencyGraphMode input_graph, diffdp::DependencyGraphMode output_graph, bool with_root_arcs, std::vector<unsigned>* batch_sizes, const diffdp::GumbelPerturbation& perturbation)
+{
+    return Expression(x.pg, x.pg->add_function<ViterbiEisner>({x.i}, input_graph, output_graph, with_root_arcs, batch_sizes, perturbation));
+}
 
+Expression labeled_entropy_regularized_eisner(const Expression& x, diffdp::DependencyGraphMode input_graph, diffdp::DependencyGraphMode output_graph, bool with_root_arcs, std::vector<unsigned>* batch_sizes)
+{
+    return Expression(x.pg, x.pg->add_function<LabeledEntropyRegularizedEisner>({x.i}, input_graph, output_graph, with_root_arcs, batch_sizes));
+}
 
-// ENTROPY Regularized
+Expression eisner_entropy(const Expression& x, diffdp::DependencyGraphMode input_graph, bool with_root_arcs, std::vector<unsigned>* batch_sizes)
+{
+    return Expression(x.pg, x.pg->add_function<EisnerEntropy>({x.i}, input_graph, with_root_arcs, batch_sizes));
+}
 
+Expression eisner_kl_divergence(const Expression& x, const Expression& y, diffdp::DependencyGraphMode input_graph, bool with_root_arcs, std::vector<unsigned>* batch_sizes)
+{
+    return Expression(x.pg, x.pg->add_function<EisnerKLDivergence>({x.i, y.i}, input_graph, with_root_arcs, batch_sizes));
+}
 
-EntropyRegularizedEisner::EntropyRegularizedEisner(
+AlgorithmicDifferentiableEisner::AlgorithmicDifferentiableEisner(
         const std::initializer_list<VariableIndex>& a,
         diffdp::DiscreteMode mode,
         diffdp::DependencyGraphMode input_graph,
         diffdp::DependencyGraphMode output_graph,
         bool with_root_arcs,
-        std::vector<unsigned>* batch_sizes
+        std::vector<unsigned>* batch_sizes,
+        diffdp::SplitWeightsMode split_weights_mode,
+        const diffdp::PruningSettings& pruning_settings,
+        const diffdp::GumbelPerturbation& perturbation,
+        unsigned vine_length
 ) :
         Node(a),
         mode(mode),
         input_graph(input_graph),
         output_graph(output_graph),
         with_root_arcs(with_root_arcs),
-        batch_sizes(batch_sizes)
+        batch_sizes(batch_sizes),
+        split_weights_mode(split_weights_mode),
+        pruning_settings(vine_pruning_settings(pruning_settings, vine_length)),
+        perturbation(perturbation),
+        vine_length(vine_length)
 {
     this->has_cuda_implemented = false;
+    // the discrete modes decode with the Viterbi algorithm, whose chart is not bounded
+    if (vine_length > 0u && mode != diffdp::DiscreteMode::ForwardRegularized)
+        throw std::runtime_error("Vine parsing is only supported with DiscreteMode::ForwardRegularized");
 }
 
-bool EntropyRegularizedEisner::supports_multibatch() const
+bool AlgorithmicDifferentiableEisner::supports_multibatch() const
 {
     return true;
 }
 
-EntropyRegularizedEisner::~EntropyRegularizedEisner()
-{
-    for (auto*& ptr : _ce_ptr)
-        if (ptr != nullptr)
-        {
-            delete ptr;
-            ptr = nullptr;
-        }
-}
+AlgorithmicDifferentiableEisner::~AlgorithmicDifferentiableEisner()
+{}
 
-std::string EntropyRegularizedEisner::as_string(const std::vector<std::string>& arg_names) const {
+std::string AlgorithmicDifferentiableEisner::as_string(const std::vector<std::string>& arg_names) const {
     std::ostringstream s;
-    s << "entropy_regularized_eisner(" << arg_names[0] << ")";
+    s << "algorithmic_differentiable_eisner(" << arg_names[0] << ")";
     return s.str();
 }
 
-Dim EntropyRegularizedEisner::dim_forward(const std::vector<Dim>& xs) const {
-    DYNET_ARG_CHECK(
-            xs.size() == 1 && xs[0].nd == 2 && xs[0].rows() == xs[0].cols(),
-            "Bad input dimensions in EntropyRegularizedEisner: " << xs
-    );
-    if (input_graph == diffdp::DependencyGraphMode::Compact)
-        DYNET_ARG_CHECK(
-                xs[0].rows() >= 1,
-                "Bad input dimensions in EntropyRegularizedEisner: " << xs
-        )
-    else
-        DYNET_ARG_CHECK(
-                xs[0].rows() >= 2,
-                "Bad input dimensions in EntropyRegularizedEisner: " << xs
-        )
-
-    unsigned dim;
-    if (input_graph == output_graph)
-        dim = xs[0].rows();
-    else if (input_graph == diffdp::DependencyGraphMode::Compact)
-        dim = xs[0].rows() + 1; // from compact to adj
-    else
-        dim = xs[0].rows() - 1; // from adj to compact
-
-    return dynet::Dim({dim, dim}, xs[0].batch_elems());
+Dim AlgorithmicDifferentiableEisner::dim_forward(const std::vector<Dim>& xs) const {
+    return relaxed_dim_forward(xs, input_graph, output_graph, "AlgorithmicDifferentiableEisner");
 }
 
-size_t EntropyRegularizedEisner::aux_storage_size() const {
-    const unsigned eisner_dim = dim.rows() + (output_graph == diffdp::DependencyGraphMode::Compact ? 1 : 0);
-    // 2 times because we have a forward and a backward chart
-    const size_t eisner_mem = 2 * diffdp::EisnerChart::required_memory(eisner_dim);
-    return dim.batch_elems() * eisner_mem;
+size_t AlgorithmicDifferentiableEisner::aux_storage_size() const {
+    return relaxed_aux_storage_size<diffdp::EisnerChart>(*this, split_weights_mode, vine_length);
 }
 
+
+
+
 template<class MyDevice>
-void EntropyRegularizedEisner::forward_dev_impl(
+void AlgorithmicDifferentiableEisner::forward_dev_impl(
         const MyDevice&,
         const std::vector<const Tensor*>& xs,
         Tensor& fx
 ) const {
 #ifdef __CUDACC__
-    DYNET_NO_CUDA_IMPL_ERROR("EntropyRegularizedEisner::forward");
+    DYNET_NO_CUDA_IMPL_ERROR("AlgorithmicDifferentiableEisner::forward");
 #else
-    // TODO call zero only when necessary
-    TensorTools::zero(fx);
-
-    std::vector<diffdp::EntropyRegularizedEisner*>& _ce_ptr2 =
-            const_cast<std::vector<diffdp::EntropyRegularizedEisner*>&>(_ce_ptr);
-
-    for (auto*& ptr : _ce_ptr2)
-        if (ptr != nullptr)
-        {
-            delete ptr;
-            ptr = nullptr;
-        }
-
-    if (_ce_ptr2.size() != xs[0]->d.batch_elems())
-        _ce_ptr2.resize(xs[0]->d.batch_elems(), nullptr);
-
-    const unsigned max_eisner_dim = xs[0]->d.rows() + (input_graph == diffdp::DependencyGraphMode::Compact ? 1 : 0);
-    float* aux_fmem = static_cast<float*>(aux_mem);
+    relaxed_forward<diffdp::AlgorithmicDifferentiableEisner, diffdp::EisnerChart>(*this, xs, fx, pruning_settings, &_pruning, split_weights_mode, vine_length);
+#endif
+}
 
-    //#pragma omp parallel for
-    for (unsigned batch = 0u ; batch < xs[0]->d.batch_elems() ; ++batch)
-    {
-        const unsigned eisner_dim = (
-                batch_sizes == nullptr
-                ? max_eisner_dim
-                : batch_sizes->at(batch) + 1
-        );
+template<class MyDevice>
+void AlgorithmicDifferentiableEisner::backward_dev_impl(
+        const MyDevice &,
+        const std::vector<const Tensor*>& xs,
+        const Tensor&,
+        const Tensor& dEdf,
+        unsigned,
+        Tensor& dEdxi
+) const {
+#ifdef __CUDACC__
+    DYNET_NO_CUDA_IMPL_ERROR("AlgorithmicDifferentiableEisner::backward");
+#else
+    relaxed_backward<diffdp::AlgorithmicDifferentiableEisner, diffdp::EisnerChart>(*this, xs, dEdf, dEdxi, pruning_settings, &_pruning, split_weights_mode, vine_length);
+#endif
+}
 
-        auto input = batch_matrix(*(xs[0]), batch);
 
-        if (mode == diffdp::DiscreteMode::ForwardRegularized)
-        {
-            float* fmem = aux_fmem + batch * 2 * diffdp::EisnerChart::required_cells(max_eisner_dim);
-            //auto forward_chart = std::make_shared<diffdp::EisnerChart>(eisner_dim, fmem);
-            //auto backward_chart = std::make_shared<diffdp::EisnerChart>(eisner_dim, fmem + diffdp::EisnerChart::required_cells(max_eisner_dim));
-            auto forward_chart = std::make_shared<diffdp::EisnerChart>(eisner_dim, fmem);
-            auto backward_chart = std::make_shared<diffdp::EisnerChart>(eisner_dim);
+DYNET_NODE_INST_DEV_IMPL(AlgorithmicDifferentiableEisner)
 
-            _ce_ptr2.at(batch) = new diffdp::EntropyRegularizedEisner(forward_chart, backward_chart);
 
 
-            _ce_ptr2.at(batch)->forward(
-                    [&] (const unsigned head, const unsigned mod)
-                    {
-                        if (mod == 0u)
-                            throw std::runtime_error("Illegal arc");
-                        if (head == 0u && !with_root_arcs)
-                        {
-                            return 0.f;
-                        }
-                        else
-                        {
-                            const auto arc = diffdp::from_adjacency({head, mod}, input_graph);
-                            const float v = input(arc.first, arc.second);
-                            return v;
-                        }
-                    }
-            );
 
-            auto output = batch_matrix(fx, batch);
+// ENTROPY Regularized
+
+
+EntropyRegularizedEisner::EntropyRegularizedEisner(
+        const std::initializer_list<VariableIndex>& a,
+        diffdp::DiscreteMode mode,
+        diffdp::DependencyGraphMode input_graph,
+        diffdp::DependencyGraphMode output_graph,
+        bool with_root_arcs,
+        std::vector<unsigned>* batch_sizes,
+        diffdp::SplitWeightsMode split_weights_mode,
+        const diffdp::PruningSettings& pruning_settings,
+        const diffdp::GumbelPerturbation& perturbation,
+        unsigned vine_length
+) :
+        Node(a),
+        mode(mode),
+        input_graph(input_graph),
+        output_graph(output_graph),
+        with_root_arcs(with_root_arcs),
+        batch_sizes(batch_sizes),
+        split_weights_mode(split_weights_mode),
+        pruning_settings(vine_pruning_settings(pruning_settings, vine_length)),
+        perturbation(perturbation),
+        vine_length(vine_length)
+{
+    this->has_cuda_implemented = false;
+    // the discrete modes decode with the Viterbi algorithm, whose chart is not bounded
+    if (vine_length > 0u && mode != diffdp::DiscreteMode::ForwardRegularized)
+        throw std::runtime_error("Vine parsing is only supported with DiscreteMode::ForwardRegularized");
+}
+
+bool EntropyRegularizedEisner::supports_multibatch() const
+{
+    return true;
+}
+
+EntropyRegularizedEisner::~EntropyRegularizedEisner()
+{}
+
+std::string EntropyRegularizedEisner::as_string(const std::vector<std::string>& arg_names) const {
+    std::ostringstream s;
+    s << "entropy_regularized_eisner(" << arg_names[0] << ")";
+    return s.str();
+}
+
+Dim EntropyRegularizedEisner::dim_forward(const std::vector<Dim>& xs) const {
+    return relaxed_dim_forward(xs, input_graph, output_graph, "EntropyRegularizedEisner");
+}
+
+size_t EntropyRegularizedEisner::aux_storage_size() const {
+    return relaxed_aux_storage_size<diffdp::EisnerChart>(*this, split_weights_mode, vine_length);
+}
+
+template<class MyDevice>
+void EntropyRegularizedEisner::forward_dev_impl(
+        const MyDevice&,
+        const std::vector<const Tensor*>& xs,
+        Tensor& fx
+) const {
+#ifdef __CUDACC__
+    DYNET_NO_CUDA_IMPL_ERROR("EntropyRegularizedEisner::forward");
+#else
+    relaxed_forward<diffdp::EntropyRegularizedEisner, diffdp::EisnerChart>(*this, xs, fx, pruning_settings, &_pruning, split_weights_mode, vine_length);
+#endif
+}
+
+template<class MyDevice>
+void EntropyRegularizedEisner::backward_dev_impl(
+        const MyDevice &,
+        const std::vector<const Tensor*>& xs,
+        const Tensor&,
+        const Tensor& dEdf,
+        unsigned,
+        Tensor& dEdxi
+) const {
+#ifdef __CUDACC__
+    DYNET_NO_CUDA_IMPL_ERROR("EntropyRegularizedEisner::backward");
+#else
+    relaxed_backward<diffdp::EntropyRegularizedEisner, diffdp::EisnerChart>(*this, xs, dEdf, dEdxi, pruning_settings, &_pruning, split_weights_mode, vine_length);
+#endif
+}
+
+DYNET_NODE_INST_DEV_IMPL(EntropyRegularizedEisner)
+
+
+
+// INSIDE-OUTSIDE (entropy regularized relaxation in quadratic memory)
+
+
+InsideOutsideEisner::InsideOutsideEisner(
+        const std::initializer_list<VariableIndex>& a,
+        diffdp::DiscreteMode mode,
+        diffdp::DependencyGraphMode input_graph,
+        diffdp::DependencyGraphMode output_graph,
+        bool with_root_arcs,
+        std::vector<unsigned>* batch_sizes,
+        const diffdp::GumbelPerturbation& perturbation
+) :
+        Node(a),
+        mode(mode),
+        input_graph(input_graph),
+        output_graph(output_graph),
+        with_root_arcs(with_root_arcs),
+        batch_sizes(batch_sizes),
+        perturbation(perturbation)
+{
+    this->has_cuda_implemented = false;
+}
+
+bool InsideOutsideEisner::supports_multibatch() const
+{
+    return true;
+}
+
+InsideOutsideEisner::~InsideOutsideEisner()
+{}
+
+std::string InsideOutsideEisner::as_string(const std::vector<std::string>& arg_names) const {
+    std::ostringstream s;
+    s << "inside_outside_eisner(" << arg_names[0] << ")";
+    return s.str();
+}
+
+Dim InsideOutsideEisner::dim_forward(const std::vector<Dim>& xs) const {
+    return relaxed_dim_forward(xs, input_graph, output_graph, "InsideOutsideEisner");
+}
+
+size_t InsideOutsideEisner::aux_storage_size() const {
+    return relaxed_aux_storage_size<diffdp::InsideOutsideEisnerChart>(*this);
+}
+
+template<class MyDevice>
+void InsideOutsideEisner::forward_dev_impl(
+        const MyDevice&,
+        const std::vector<const Tensor*>& xs,
+        Tensor& fx
+) const {
+#ifdef __CUDACC__
+    DYNET_NO_CUDA_IMPL_ERROR("InsideOutsideEisner::forward");
+#else
+    relaxed_forward<diffdp::InsideOutsideEisner, diffdp::InsideOutsideEisnerChart>(*this, xs, fx, diffdp::PruningSettings(), nullptr);
+#endif
+}
+
+template<class MyDevice>
+void InsideOutsideEisner::backward_dev_impl(
+        const MyDevice &,
+        const std::vector<const Tensor*>& xs,
+        const Tensor&,
+        const Tensor& dEdf,
+        unsigned,
+        Tensor& dEdxi
+) const {
+#ifdef __CUDACC__
+    DYNET_NO_CUDA_IMPL_ERROR("InsideOutsideEisner::backward");
+#else
+    relaxed_backward<diffdp::InsideOutsideEisner, diffdp::InsideOutsideEisnerChart>(*this, xs, dEdf, dEdxi, diffdp::PruningSettings(), nullptr);
+#endif
+}
+
+DYNET_NODE_INST_DEV_IMPL(InsideOutsideEisner)
+
+
+
+
+// VITERBI
+
+
+ViterbiEisner::ViterbiEisner(
+        const std::initializer_list<VariableIndex>& a,
+        diffdp::DependencyGraphMode input_graph,
+        diffdp::DependencyGraphMode output_graph,
+        bool with_root_arcs,
+        std::vector<unsigned>* batch_sizes,
+        const diffdp::GumbelPerturbation& perturbation
+) :
+        Node(a),
+        input_graph(input_graph),
+        output_graph(output_graph),
+        with_root_arcs(with_root_arcs),
+        batch_sizes(batch_sizes),
+        perturbation(perturbation)
+{
+    this->has_cuda_implemented = false;
+}
+
+bool ViterbiEisner::supports_multibatch() const
+{
+    return true;
+}
+
+ViterbiEisner::~ViterbiEisner()
+{}
+
+std::string ViterbiEisner::as_string(const std::vector<std::string>& arg_names) const {
+    std::ostringstream s;
+    s << "viterbi_eisner(" << arg_names[0] << ")";
+    return s.str();
+}
+
+Dim ViterbiEisner::dim_forward(const std::vector<Dim>& xs) const {
+    DYNET_ARG_CHECK(
+            xs.size() == 1 && xs[0].nd == 2 && xs[0].rows() == xs[0].cols(),
+            "Bad input dimensions in ViterbiEisner: " << xs
+    );
+    if (input_graph == diffdp::DependencyGraphMode::Compact)
+        DYNET_ARG_CHECK(
+                xs[0].rows() >= 1,
+                "Bad input dimensions in ViterbiEisner: " << xs
+        )
+    else
+        DYNET_ARG_CHECK(
+                xs[0].rows() >= 2,
+                "Bad input dimensions in ViterbiEisner: " << xs
+        )
+
+    unsigned dim;
+    if (input_graph == output_graph)
+        dim = xs[0].rows();
+    else if (input_graph == diffdp::DependencyGraphMode::Compact)
+        dim = xs[0].rows() + 1; // from compact to adj
+    else
+        dim = xs[0].rows() - 1; // from adj to compact
 
-            for (unsigned head = 0u ; head < eisner_dim ; ++head)
+    return dynet::Dim({dim, dim}, xs[0].batch_elems());
+}
+
+template<class MyDevice>
+void ViterbiEisner::forward_dev_impl(
+        const MyDevice&,
+        const std::vector<const Tensor*>& xs,
+        Tensor& fx
+) const {
+#ifdef __CUDACC__
+    DYNET_NO_CUDA_IMPL_ERROR("ViterbiEisner::forward");
+#else
+    TensorTools::zero(fx);
+
+    const unsigned max_eisner_dim = xs[0]->d.rows() + (input_graph == diffdp::DependencyGraphMode::Compact ? 1 : 0);
+    viterbi_forward(
+            *(xs[0]), fx,
+            input_graph, output_graph, with_root_arcs, perturbation, diffdp::PruningSettings(),
+            max_eisner_dim,
+            [&] (const unsigned batch) -> unsigned
             {
-                for (unsigned mod = 1u; mod < eisner_dim ; ++mod)
-                {
-                    const auto arc = diffdp::from_adjacency({head, mod}, output_graph);
-                    if (head == mod)
-                    {
-                        output(arc.first, arc.second) = 0.f;
-                        continue;
-                    }
+                return batch_sizes == nullptr ? max_eisner_dim : batch_sizes->at(batch) + 1;
+            }
+    );
+#endif
+}
 
-                    if (head == 0u && !with_root_arcs)
-                    {
-                        output(arc.first, arc.second) = 0.f;
-                        continue;
-                    }
+template<class MyDevice>
+void ViterbiEisner::backward_dev_impl(
+        const MyDevice &,
+        const std::vector<const Tensor*>&,
+        const Tensor&,
+        const Tensor&,
+        unsigned,
+        Tensor&
+) const {
+#ifdef __CUDACC__
+    DYNET_NO_CUDA_IMPL_ERROR("ViterbiEisner::backward");
+#else
+    // the output is piecewise constant: the gradient is null
+#endif
+}
+
+DYNET_NODE_INST_DEV_IMPL(ViterbiEisner)
+
+
+
+// LABELED
+
+
+LabeledEntropyRegularizedEisner::LabeledEntropyRegularizedEisner(
+        const std::initializer_list<VariableIndex>& a,
+        diffdp::DependencyGraphMode input_graph,
+        diffdp::DependencyGraphMode output_graph,
+        bool with_root_arcs,
+        std::vector<unsigned>* batch_sizes
+) :
+        Node(a),
+        input_graph(input_graph),
+        output_graph(output_graph),
+        with_root_arcs(with_root_arcs),
+        batch_sizes(batch_sizes)
+{
+    this->has_cuda_implemented = false;
+}
 
-                    const float a = _ce_ptr2[batch]->output(head, mod);
+bool LabeledEntropyRegularizedEisner::supports_multibatch() const
+{
+    return true;
+}
+
+LabeledEntropyRegularizedEisner::~LabeledEntropyRegularizedEisner()
+{}
+
+std::string LabeledEntropyRegularizedEisner::as_string(const std::vector<std::string>& arg_names) const {
+    std::ostringstream s;
+    s << "labeled_entropy_regularized_eisner(" << arg_names[0] << ")";
+    return s.str();
+}
 
-                    if (!std::isfinite(a))
-                        throw std::runtime_error("BAD eisner output");
+Dim LabeledEntropyRegularizedEisner::dim_forward(const std::vector<Dim>& xs) const {
+    DYNET_ARG_CHECK(
+            xs.size() == 1 && (xs[0].nd == 2 || xs[0].nd == 3) && xs[0].rows() == xs[0].cols(),
+            "Bad input dimensions in LabeledEntropyRegularizedEisner: " << xs
+    );
+    if (input_graph == diffdp::DependencyGraphMode::Compact)
+        DYNET_ARG_CHECK(
+                xs[0].rows() >= 1,
+                "Bad input dimensions in LabeledEntropyRegularizedEisner: " << xs
+        )
+    else
+        DYNET_ARG_CHECK(
+                xs[0].rows() >= 2,
+                "Bad input dimensions in LabeledEntropyRegularizedEisner: " << xs
+        )
 
-                    output(arc.first, arc.second) = a;
+    unsigned dim;
+    if (input_graph == output_graph)
+        dim = xs[0].rows();
+    else if (input_graph == diffdp::DependencyGraphMode::Compact)
+        dim = xs[0].rows() + 1; // from compact to adj
+    else
+        dim = xs[0].rows() - 1; // from adj to compact
+
+    return dynet::Dim({dim, dim, xs[0][2]}, xs[0].batch_elems());
+}
+
+template<class MyDevice>
+void LabeledEntropyRegularizedEisner::forward_dev_impl(
+        const MyDevice&,
+        const std::vector<const Tensor*>& xs,
+        Tensor& fx
+) const {
+#ifdef __CUDACC__
+    DYNET_NO_CUDA_IMPL_ERROR("LabeledEntropyRegularizedEisner::forward");
+#else
+    TensorTools::zero(fx);
+
+    const unsigned batch_elems = xs[0]->d.batch_elems();
+    const unsigned input_rows = xs[0]->d.rows();
+    const unsigned output_rows = fx.d.rows();
+    const unsigned n_labels = xs[0]->d[2];
+    const unsigned max_eisner_dim = input_rows + (input_graph == diffdp::DependencyGraphMode::Compact ? 1 : 0);
+
+    const auto batch_eisner_dim = [&] (const unsigned batch) -> unsigned
+    {
+        return batch_sizes == nullptr ? max_eisner_dim : batch_sizes->at(batch) + 1;
+    };
+
+    // the charts of a previous call are given back to the pool
+    _ce.clear();
+    _backward_charts.clear();
+    _forward_charts.clear();
+    for (unsigned batch = 0u ; batch < batch_elems ; ++batch)
+    {
+        if (batch_eisner_dim(batch) > max_eisner_dim)
+            throw std::runtime_error("Sentence size is larger than the input matrix");
+        _forward_charts.emplace_back(batch_eisner_dim(batch));
+        _ce.emplace_back(_forward_charts.back().get(), nullptr);
+    }
+    _arc_weights.resize((std::size_t) batch_elems * input_rows * input_rows);
+
+    diffdp::parallel_for_batch(batch_elems, batch_eisner_dim, [&] (const unsigned batch)
+    {
+        const unsigned eisner_dim = batch_eisner_dim(batch);
+        const std::size_t input_size = (std::size_t) input_rows * input_rows;
+        const std::size_t output_size = (std::size_t) output_rows * output_rows;
+        const float* labels = xs[0]->v + batch * input_size * n_labels;
+        float* output = fx.v + batch * output_size * n_labels;
+        float* arcs = _arc_weights.data() + batch * input_size;
+
+        // cells of the input matrix read by the chart
+        const unsigned input_dim = eisner_dim - (input_graph == diffdp::DependencyGraphMode::Compact ? 1 : 0);
+        std::vector<float> buffer(input_size);
+        label_log_sum_exp(labels, arcs, buffer.data(), input_rows, n_labels, input_dim);
+
+        const Eigen::Map<Eigen::MatrixXf> input(arcs, input_rows, input_rows);
+        auto& eisner = _ce.at(batch);
+        eisner.forward(
+                [&] (const unsigned head, const unsigned mod)
+                {
+                    return arc_weight(input, head, mod, input_graph, with_root_arcs, diffdp::GumbelPerturbation(), batch);
                 }
-            }
-        }
-        else
+        );
+
+        // marginal of a labeled arc: marginal of the arc times the softmax of its labels
+        for (unsigned head = 0u ; head < eisner_dim ; ++head)
         {
-            throw std::runtime_error("Not implemented: only ForwardRegularized can be used at the moment");
+            for (unsigned mod = 1u; mod < eisner_dim ; ++mod)
+            {
+                if (head == mod || (head == 0u && !with_root_arcs))
+                    continue;
+
+                const float a = eisner.output(head, mod);
+                if (!std::isfinite(a))
+                    throw std::runtime_error("BAD eisner output");
+
+                const auto input_arc = diffdp::from_adjacency({head, mod}, input_graph);
+                const auto output_arc = diffdp::from_adjacency({head, mod}, output_graph);
+                const std::size_t input_cell = input_arc.first + (std::size_t) input_arc.second * input_rows;
+                const std::size_t output_cell = output_arc.first + (std::size_t) output_arc.second * output_rows;
+                for (unsigned l = 0u ; l < n_labels ; ++l)
+                    output[output_cell + l * output_size] = a * label_probability(labels[input_cell + l * input_size], arcs[input_cell]);
+            }
         }
-    }
+    });
 #endif
 }
 
 template<class MyDevice>
-void EntropyRegularizedEisner::backward_dev_impl(
+void LabeledEntropyRegularizedEisner::backward_dev_impl(
         const MyDevice &,
         const std::vector<const Tensor*>& xs,
         const Tensor&,
@@ -484,51 +1058,382 @@ void EntropyRegularizedEisner::backward_dev_impl(
         Tensor& dEdxi
 ) const {
 #ifdef __CUDACC__
-    DYNET_NO_CUDA_IMPL_ERROR("EntropyRegularizedEisner::backward");
+    DYNET_NO_CUDA_IMPL_ERROR("LabeledEntropyRegularizedEisner::backward");
 #else
-    //#pragma omp parallel for
-    for (unsigned batch = 0u ; batch < xs[0]->d.batch_elems() ; ++batch)
-    {
-        auto output_grad = batch_matrix(dEdxi, batch);
-        auto input_grad = batch_matrix(dEdf, batch);
+    const unsigned input_rows = xs[0]->d.rows();
+    const unsigned output_rows = dEdf.d.rows();
+    const unsigned n_labels = xs[0]->d[2];
 
-        auto& eisner = *(_ce_ptr.at(batch));
+    if (_backward_charts.empty())
+    {
+        for (auto& dp : _ce)
+        {
+            _backward_charts.emplace_back(dp.size());
+            dp.chart_backward = _backward_charts.back().get();
+        }
+    }
 
-        eisner.backward(
-                [&] (unsigned head, unsigned mod) -> float
+    diffdp::parallel_for_batch(
+            xs[0]->d.batch_elems(),
+            [&] (const unsigned batch) { return _ce.at(batch).size(); },
+            [&] (const unsigned batch)
+            {
+                const std::size_t input_size = (std::size_t) input_rows * input_rows;
+                const std::size_t output_size = (std::size_t) output_rows * output_rows;
+                const float* labels = xs[0]->v + batch * input_size * n_labels;
+                const float* arcs = _arc_weights.data() + batch * input_size;
+                const float* output_grad = dEdf.v + batch * output_size * n_labels;
+                float* input_grad = dEdxi.v + batch * input_size * n_labels;
+                auto& eisner = _ce.at(batch);
+
+                // expectation of the label gradients under the label softmax of an arc
+                const auto arc_gradient = [&] (const unsigned head, const unsigned mod) -> float
                 {
                     if (head == 0u && !with_root_arcs)
                         return 0.f;
-                    auto arc = diffdp::from_adjacency({head, mod}, output_graph);
-                    const float v = input_grad(arc.first, arc.second);
+
+                    const auto input_arc = diffdp::from_adjacency({head, mod}, input_graph);
+                    const auto output_arc = diffdp::from_adjacency({head, mod}, output_graph);
+                    const std::size_t input_cell = input_arc.first + (std::size_t) input_arc.second * input_rows;
+                    const std::size_t output_cell = output_arc.first + (std::size_t) output_arc.second * output_rows;
+                    float v = 0.f;
+                    for (unsigned l = 0u ; l < n_labels ; ++l)
+                        v += output_grad[output_cell + l * output_size] * label_probability(labels[input_cell + l * input_size], arcs[input_cell]);
                     if (!std::isfinite(v))
                         throw std::runtime_error("BAD eisner input grad");
                     return v;
+                };
+
+                eisner.backward(arc_gradient);
+
+                // d output(a, l) / d x(a, k) = p(a) p(l|a) (1[l = k] - p(k|a)) through the label softmax,
+                // and the arc weight is the log-sum-exp of the labels so d w(a) / d x(a, k) = p(k|a)
+                for (unsigned head = 0u ; head < eisner.size() ; ++head)
+                {
+                    for (unsigned mod = 1u; mod < eisner.size(); ++mod)
+                    {
+                        if (head == mod || (head == 0u && !with_root_arcs))
+                            continue;
+
+                        const float a = eisner.output(head, mod);
+                        const float g = eisner.gradient(head, mod);
+                        const float mean = arc_gradient(head, mod);
+                        if (!std::isfinite(g))
+                            throw std::runtime_error("BAD eisner output grad");
+
+                        const auto input_arc = diffdp::from_adjacency({head, mod}, input_graph);
+                        const auto output_arc = diffdp::from_adjacency({head, mod}, output_graph);
+                        const std::size_t input_cell = input_arc.first + (std::size_t) input_arc.second * input_rows;
+                        const std::size_t output_cell = output_arc.first + (std::size_t) output_arc.second * output_rows;
+                        for (unsigned l = 0u ; l < n_labels ; ++l)
+                        {
+                            const float p = label_probability(labels[input_cell + l * input_size], arcs[input_cell]);
+                            input_grad[input_cell + l * input_size] += p * (a * (output_grad[output_cell + l * output_size] - mean) + g);
+                        }
+                    }
                 }
-        );
+            }
+    );
+#endif
+}
 
-        for (unsigned head = 0u ; head < eisner.size() ; ++head)
+DYNET_NODE_INST_DEV_IMPL(LabeledEntropyRegularizedEisner)
+
+
+
+// DIVERGENCES
+
+
+EisnerEntropy::EisnerEntropy(
+        const std::initializer_list<VariableIndex>& a,
+        diffdp::DependencyGraphMode input_graph,
+        bool with_root_arcs,
+        std::vector<unsigned>* batch_sizes
+) :
+        Node(a),
+        input_graph(input_graph),
+        with_root_arcs(with_root_arcs),
+        batch_sizes(batch_sizes)
+{
+    this->has_cuda_implemented = false;
+}
+
+bool EisnerEntropy::supports_multibatch() const
+{
+    return true;
+}
+
+EisnerEntropy::~EisnerEntropy()
+{}
+
+std::string EisnerEntropy::as_string(const std::vector<std::string>& arg_names) const {
+    std::ostringstream s;
+    s << "eisner_entropy(" << arg_names[0] << ")";
+    return s.str();
+}
+
+Dim EisnerEntropy::dim_forward(const std::vector<Dim>& xs) const {
+    return divergence_dim_forward(xs, 1u, input_graph, "EisnerEntropy");
+}
+
+template<class MyDevice>
+void EisnerEntropy::forward_dev_impl(
+        const MyDevice&,
+        const std::vector<const Tensor*>& xs,
+        Tensor& fx
+) const {
+#ifdef __CUDACC__
+    DYNET_NO_CUDA_IMPL_ERROR("EisnerEntropy::forward");
+#else
+    const unsigned batch_elems = xs[0]->d.batch_elems();
+    const unsigned max_eisner_dim = xs[0]->d.rows() + (input_graph == diffdp::DependencyGraphMode::Compact ? 1 : 0);
+
+    const auto batch_eisner_dim = [&] (const unsigned batch) -> unsigned
+    {
+        return batch_sizes == nullptr ? max_eisner_dim : batch_sizes->at(batch) + 1;
+    };
+
+    // the charts of a previous call are given back to the pool
+    _ce.clear();
+    _backward_charts.clear();
+    _forward_charts.clear();
+    for (unsigned batch = 0u ; batch < batch_elems ; ++batch)
+    {
+        if (batch_eisner_dim(batch) > max_eisner_dim)
+            throw std::runtime_error("Sentence size is larger than the input matrix");
+        _forward_charts.emplace_back(batch_eisner_dim(batch));
+        _ce.emplace_back(_forward_charts.back().get(), nullptr);
+    }
+
+    diffdp::parallel_for_batch(batch_elems, batch_eisner_dim, [&] (const unsigned batch)
+    {
+        auto input = batch_matrix(*(xs[0]), batch);
+        const auto weight = [&] (const unsigned head, const unsigned mod)
         {
-            for (unsigned mod = 1u; mod < eisner.size(); ++mod)
+            return arc_weight(input, head, mod, input_graph, with_root_arcs, diffdp::GumbelPerturbation(), batch);
+        };
+
+        _ce.at(batch).forward(weight);
+        const float entropy = _ce.at(batch).entropy(weight);
+        if (!std::isfinite(entropy))
+            throw std::runtime_error("BAD eisner entropy");
+        fx.v[batch] = entropy;
+    });
+#endif
+}
+
+template<class MyDevice>
+void EisnerEntropy::backward_dev_impl(
+        const MyDevice &,
+        const std::vector<const Tensor*>& xs,
+        const Tensor&,
+        const Tensor& dEdf,
+        unsigned,
+        Tensor& dEdxi
+) const {
+#ifdef __CUDACC__
+    DYNET_NO_CUDA_IMPL_ERROR("EisnerEntropy::backward");
+#else
+    if (_backward_charts.empty())
+    {
+        for (auto& dp : _ce)
+        {
+            _backward_charts.emplace_back(dp.size());
+            dp.chart_backward = _backward_charts.back().get();
+        }
+    }
+
+    diffdp::parallel_for_batch(
+            xs[0]->d.batch_elems(),
+            [&] (const unsigned batch) { return _ce.at(batch).size(); },
+            [&] (const unsigned batch)
             {
-                if (head == mod)
-                    continue;
+                auto input = batch_matrix(*(xs[0]), batch);
+                auto input_grad = batch_matrix(dEdxi, batch);
+                auto& eisner = _ce.at(batch);
+
+                // dH/dw = - J^T w where J is the jacobian of the arc marginals,
+                // the rows of arcs with a null marginal are null (this skips the -inf weights of masked arcs)
+                eisner.backward(
+                        [&] (const unsigned head, const unsigned mod)
+                        {
+                            if (!(eisner.output(head, mod) > 0.f))
+                                return 0.f;
+                            return arc_weight(input, head, mod, input_graph, with_root_arcs, diffdp::GumbelPerturbation(), batch);
+                        }
+                );
+                add_arc_gradient(input_grad, eisner.size(), input_graph, with_root_arcs, -dEdf.v[batch],
+                        [&] (const unsigned head, const unsigned mod) { return eisner.gradient(head, mod); }
+                );
+            }
+    );
+#endif
+}
 
-                if (head == 0u && !with_root_arcs)
-                    return;
+DYNET_NODE_INST_DEV_IMPL(EisnerEntropy)
 
-                auto const v = eisner.gradient(head, mod);
-                if (!std::isfinite(v))
-                    throw std::runtime_error("BAD eisner output grad");
 
-                auto arc = diffdp::from_adjacency({head, mod}, input_graph);
-                output_grad(arc.first, arc.second) += v;
-            }
+EisnerKLDivergence::EisnerKLDivergence(
+        const std::initializer_list<VariableIndex>& a,
+        diffdp::DependencyGraphMode input_graph,
+        bool with_root_arcs,
+        std::vector<unsigned>* batch_sizes
+) :
+        Node(a),
+        input_graph(input_graph),
+        with_root_arcs(with_root_arcs),
+        batch_sizes(batch_sizes)
+{
+    this->has_cuda_implemented = false;
+}
+
+bool EisnerKLDivergence::supports_multibatch() const
+{
+    return true;
+}
+
+EisnerKLDivergence::~EisnerKLDivergence()
+{}
+
+std::string EisnerKLDivergence::as_string(const std::vector<std::string>& arg_names) const {
+    std::ostringstream s;
+    s << "eisner_kl_divergence(" << arg_names[0] << ", " << arg_names[1] << ")";
+    return s.str();
+}
+
+Dim EisnerKLDivergence::dim_forward(const std::vector<Dim>& xs) const {
+    return divergence_dim_forward(xs, 2u, input_graph, "EisnerKLDivergence");
+}
+
+template<class MyDevice>
+void EisnerKLDivergence::forward_dev_impl(
+        const MyDevice&,
+        const std::vector<const Tensor*>& xs,
+        Tensor& fx
+) const {
+#ifdef __CUDACC__
+    DYNET_NO_CUDA_IMPL_ERROR("EisnerKLDivergence::forward");
+#else
+    const unsigned batch_elems = xs[0]->d.batch_elems();
+    const unsigned max_eisner_dim = xs[0]->d.rows() + (input_graph == diffdp::DependencyGraphMode::Compact ? 1 : 0);
+
+    const auto batch_eisner_dim = [&] (const unsigned batch) -> unsigned
+    {
+        return batch_sizes == nullptr ? max_eisner_dim : batch_sizes->at(batch) + 1;
+    };
+
+    // the charts of a previous call are given back to the pool
+    _ce_p.clear();
+    _ce_q.clear();
+    _backward_charts.clear();
+    _forward_charts.clear();
+    for (unsigned batch = 0u ; batch < batch_elems ; ++batch)
+    {
+        if (batch_eisner_dim(batch) > max_eisner_dim)
+            throw std::runtime_error("Sentence size is larger than the input matrix");
+        _forward_charts.emplace_back(batch_eisner_dim(batch));
+        _ce_p.emplace_back(_forward_charts.back().get(), nullptr);
+        _forward_charts.emplace_back(batch_eisner_dim(batch));
+        _ce_q.emplace_back(_forward_charts.back().get(), nullptr);
+    }
+
+    diffdp::parallel_for_batch(batch_elems, batch_eisner_dim, [&] (const unsigned batch)
+    {
+        auto input_p = batch_matrix(*(xs[0]), batch);
+        auto input_q = batch_matrix(*(xs[1]), batch);
+        const auto weight_p = [&] (const unsigned head, const unsigned mod)
+        {
+            return arc_weight(input_p, head, mod, input_graph, with_root_arcs, diffdp::GumbelPerturbation(), batch);
+        };
+        const auto weight_q = [&] (const unsigned head, const unsigned mod)
+        {
+            return arc_weight(input_q, head, mod, input_graph, with_root_arcs, diffdp::GumbelPerturbation(), batch);
+        };
+
+        auto& p = _ce_p.at(batch);
+        auto& q = _ce_q.at(batch);
+        p.forward(weight_p);
+        q.forward(weight_q);
+
+        const float kl =
+                p.expected_score([&] (const unsigned head, const unsigned mod) { return weight_p(head, mod) - weight_q(head, mod); })
+                - p.log_partition() + q.log_partition();
+        if (!std::isfinite(kl))
+            throw std::runtime_error("BAD eisner kl divergence");
+        fx.v[batch] = kl;
+    });
+#endif
+}
+
+template<class MyDevice>
+void EisnerKLDivergence::backward_dev_impl(
+        const MyDevice &,
+        const std::vector<const Tensor*>& xs,
+        const Tensor&,
+        const Tensor& dEdf,
+        unsigned i,
+        Tensor& dEdxi
+) const {
+#ifdef __CUDACC__
+    DYNET_NO_CUDA_IMPL_ERROR("EisnerKLDivergence::backward");
+#else
+    // dKL/dv = q(a) - p(a): no backward pass
+    if (i == 1u)
+    {
+        diffdp::parallel_for_batch(
+                xs[0]->d.batch_elems(),
+                [&] (const unsigned batch) { return _ce_p.at(batch).size(); },
+                [&] (const unsigned batch)
+                {
+                    auto input_grad = batch_matrix(dEdxi, batch);
+                    const auto& p = _ce_p.at(batch);
+                    const auto& q = _ce_q.at(batch);
+                    add_arc_gradient(input_grad, p.size(), input_graph, with_root_arcs, dEdf.v[batch],
+                            [&] (const unsigned head, const unsigned mod) { return q.output(head, mod) - p.output(head, mod); }
+                    );
+                }
+        );
+        return;
+    }
+
+    if (_backward_charts.empty())
+    {
+        for (auto& dp : _ce_p)
+        {
+            _backward_charts.emplace_back(dp.size());
+            dp.chart_backward = _backward_charts.back().get();
         }
     }
+
+    diffdp::parallel_for_batch(
+            xs[0]->d.batch_elems(),
+            [&] (const unsigned batch) { return _ce_p.at(batch).size(); },
+            [&] (const unsigned batch)
+            {
+                auto input_p = batch_matrix(*(xs[0]), batch);
+                auto input_q = batch_matrix(*(xs[1]), batch);
+                auto input_grad = batch_matrix(dEdxi, batch);
+                auto& p = _ce_p.at(batch);
+
+                // dKL/dw = J^T (w - v) where J is the jacobian of the arc marginals of p,
+                // the rows of arcs with a null marginal are null (see EisnerEntropy)
+                p.backward(
+                        [&] (const unsigned head, const unsigned mod)
+                        {
+                            if (!(p.output(head, mod) > 0.f))
+                                return 0.f;
+                            return arc_weight(input_p, head, mod, input_graph, with_root_arcs, diffdp::GumbelPerturbation(), batch)
+                                    - arc_weight(input_q, head, mod, input_graph, with_root_arcs, diffdp::GumbelPerturbation(), batch);
+                        }
+                );
+                add_arc_gradient(input_grad, p.size(), input_graph, with_root_arcs, dEdf.v[batch],
+                        [&] (const unsigned head, const unsigned mod) { return p.gradient(head, mod); }
+                );
+            }
+    );
 #endif
 }
 
-DYNET_NODE_INST_DEV_IMPL(EntropyRegularizedEisner)
+DYNET_NODE_INST_DEV_IMPL(EisnerKLDivergence)
 
-}
\ No newline at end of file
+}
@@ -0,0 +1,61 @@
+#include "diffdp/parallel.h"
+
+namespace diffdp
+{
+
+namespace
+{
+
+unsigned& current_num_threads()
+{
+    static unsigned n = 1u;
+    return n;
+}
+
+unsigned& current_wavefront_threshold()
+{
+    static unsigned size = 128u;
+    return size;
+}
+
+}
+
+void set_num_threads(const unsigned n)
+{
+    current_num_threads() = n;
+}
+
+unsigned num_threads()
+{
+#ifdef _OPENMP
+    if (current_num_threads() == 0u)
+        return (unsigned) omp_get_max_threads();
+    return current_num_threads();
+#else
+    return 1u;
+#endif
+}
+
+void set_wavefront_threshold(const unsigned size)
+{
+    current_wavefront_threshold() = size;
+}
+
+unsigned wavefront_threshold()
+{
+    return current_wavefront_threshold();
+}
+
+unsigned wavefront_num_threads(const unsigned size)
+{
+#ifdef _OPENMP
+    if (size < current_wavefront_threshold() || omp_in_parallel())
+        return 1u;
+    return num_threads();
+#else
+    (void) size;
+    return 1u;
+#endif
+}
+
+}
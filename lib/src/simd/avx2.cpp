@@ -0,0 +1,82 @@
+/**
+ * AVX2 kernels, this file must be compiled with -mavx2 -mfma
+ */
+#include <immintrin.h>
+
+#include "simd/kernels.h"
+
+namespace diffdp
+{
+namespace simd
+{
+
+namespace
+{
+
+struct AVX2Traits
+{
+    typedef __m256 type;
+    static const unsigned width = 8u;
+
+    static type load(const float* p) { return _mm256_loadu_ps(p); }
+    static void store(float* p, const type v) { _mm256_storeu_ps(p, v); }
+    static type set1(const float v) { return _mm256_set1_ps(v); }
+    static type add(const type a, const type b) { return _mm256_add_ps(a, b); }
+    static type sub(const type a, const type b) { return _mm256_sub_ps(a, b); }
+    static type mul(const type a, const type b) { return _mm256_mul_ps(a, b); }
+    static type div(const type a, const type b) { return _mm256_div_ps(a, b); }
+    static type fmadd(const type a, const type b, const type c) { return _mm256_fmadd_ps(a, b, c); }
+    static type max(const type a, const type b) { return _mm256_max_ps(a, b); }
+
+    static type exp(type x)
+    {
+        using namespace detail::exp_constants;
+        const type zero_mask = _mm256_cmp_ps(x, _mm256_set1_ps(zero_threshold), _CMP_LT_OQ);
+        x = _mm256_min_ps(x, _mm256_set1_ps(max_input));
+        x = _mm256_max_ps(x, _mm256_set1_ps(min_input));
+
+        // n = floor(x * log2(e) + 0.5)
+        const type fx = _mm256_floor_ps(_mm256_fmadd_ps(x, _mm256_set1_ps(log2e), _mm256_set1_ps(0.5f)));
+
+        x = _mm256_fnmadd_ps(fx, _mm256_set1_ps(c1), x);
+        x = _mm256_fnmadd_ps(fx, _mm256_set1_ps(c2), x);
+        const type x2 = _mm256_mul_ps(x, x);
+
+        type y = _mm256_set1_ps(p0);
+        y = _mm256_fmadd_ps(y, x, _mm256_set1_ps(p1));
+        y = _mm256_fmadd_ps(y, x, _mm256_set1_ps(p2));
+        y = _mm256_fmadd_ps(y, x, _mm256_set1_ps(p3));
+        y = _mm256_fmadd_ps(y, x, _mm256_set1_ps(p4));
+        y = _mm256_fmadd_ps(y, x, _mm256_set1_ps(p5));
+        y = _mm256_fmadd_ps(y, x2, _mm256_add_ps(x, _mm256_set1_ps(1.f)));
+
+        // 2^n
+        const __m256i n = _mm256_cvttps_epi32(fx);
+        const type pow2n = _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_add_epi32(n, _mm256_set1_epi32(127)), 23));
+        return _mm256_andnot_ps(zero_mask, _mm256_mul_ps(y, pow2n));
+    }
+
+    static float reduce_add(const type a)
+    {
+        __m128 b = _mm_add_ps(_mm256_castps256_ps128(a), _mm256_extractf128_ps(a, 1));
+        b = _mm_add_ps(b, _mm_movehl_ps(b, b));
+        return _mm_cvtss_f32(_mm_add_ss(b, _mm_shuffle_ps(b, b, 1)));
+    }
+
+    static float reduce_max(const type a)
+    {
+        __m128 b = _mm_max_ps(_mm256_castps256_ps128(a), _mm256_extractf128_ps(a, 1));
+        b = _mm_max_ps(b, _mm_movehl_ps(b, b));
+        return _mm_cvtss_f32(_mm_max_ss(b, _mm_shuffle_ps(b, b, 1)));
+    }
+};
+
+}
+
+namespace detail
+{
+const Kernels avx2_kernels = make_kernels<AVX2Traits>();
+}
+
+}
+}
@@ -0,0 +1,81 @@
+/**
+ * AVX-512 kernels, this file must be compiled with -mavx512f
+ */
+#include <immintrin.h>
+
+#include "simd/kernels.h"
+
+namespace diffdp
+{
+namespace simd
+{
+
+namespace
+{
+
+struct AVX512Traits
+{
+    typedef __m512 type;
+    static const unsigned width = 16u;
+
+    static type load(const float* p) { return _mm512_loadu_ps(p); }
+    static void store(float* p, const type v) { _mm512_storeu_ps(p, v); }
+    static type set1(const float v) { return _mm512_set1_ps(v); }
+    static type add(const type a, const type b) { return _mm512_add_ps(a, b); }
+    static type sub(const type a, const type b) { return _mm512_sub_ps(a, b); }
+    static type mul(const type a, const type b) { return _mm512_mul_ps(a, b); }
+    static type div(const type a, const type b) { return _mm512_div_ps(a, b); }
+    static type fmadd(const type a, const type b, const type c) { return _mm512_fmadd_ps(a, b, c); }
+    static type max(const type a, const type b) { return _mm512_max_ps(a, b); }
+
+    static type exp(type x)
+    {
+        using namespace detail::exp_constants;
+        const __mmask16 zero_mask = _mm512_cmp_ps_mask(x, _mm512_set1_ps(zero_threshold), _CMP_LT_OQ);
+        x = _mm512_min_ps(x, _mm512_set1_ps(max_input));
+        x = _mm512_max_ps(x, _mm512_set1_ps(min_input));
+
+        // n = floor(x * log2(e) + 0.5)
+        const type fx = _mm512_roundscale_ps(
+                _mm512_fmadd_ps(x, _mm512_set1_ps(log2e), _mm512_set1_ps(0.5f)),
+                _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC
+        );
+
+        x = _mm512_fnmadd_ps(fx, _mm512_set1_ps(c1), x);
+        x = _mm512_fnmadd_ps(fx, _mm512_set1_ps(c2), x);
+        const type x2 = _mm512_mul_ps(x, x);
+
+        type y = _mm512_set1_ps(p0);
+        y = _mm512_fmadd_ps(y, x, _mm512_set1_ps(p1));
+        y = _mm512_fmadd_ps(y, x, _mm512_set1_ps(p2));
+        y = _mm512_fmadd_ps(y, x, _mm512_set1_ps(p3));
+        y = _mm512_fmadd_ps(y, x, _mm512_set1_ps(p4));
+        y = _mm512_fmadd_ps(y, x, _mm512_set1_ps(p5));
+        y = _mm512_fmadd_ps(y, x2, _mm512_add_ps(x, _mm512_set1_ps(1.f)));
+
+        // 2^n
+        const __m512i n = _mm512_cvttps_epi32(fx);
+        const type pow2n = _mm512_castsi512_ps(_mm512_slli_epi32(_mm512_add_epi32(n, _mm512_set1_epi32(127)), 23));
+        return _mm512_maskz_mul_ps(_mm512_knot(zero_mask), y, pow2n);
+    }
+
+    static float reduce_add(const type a)
+    {
+        return _mm512_reduce_add_ps(a);
+    }
+
+    static float reduce_max(const type a)
+    {
+        return _mm512_reduce_max_ps(a);
+    }
+};
+
+}
+
+namespace detail
+{
+const Kernels avx512_kernels = make_kernels<AVX512Traits>();
+}
+
+}
+}
@@ -0,0 +1,287 @@
+#pragma once
+
+/**
+ * Generic implementation of the kernels of diffdp/simd.h.
+ *
+ * Each instruction set is implemented in its own translation unit (compiled with the corresponding flags)
+ * by defining a traits type with the following static members:
+ * - width: number of floats in a register
+ * - load, store, set1, add, sub, mul, div, fmadd (a * b + c), max
+ * - exp: vectorized exponential
+ * - reduce_add, reduce_max: horizontal reductions
+ *
+ * Traits types must be defined in an anonymous namespace so that instantiations
+ * compiled with instruction set specific flags are never shared between translation units.
+ */
+
+#include <cmath>
+#include <cfloat>
+
+namespace diffdp
+{
+namespace simd
+{
+namespace detail
+{
+
+struct Kernels
+{
+    void (*cwise_add)(float*, const float*, const float*, unsigned);
+    float (*max)(const float*, unsigned);
+    void (*inplace_cwise_div)(float*, float, unsigned);
+    void (*add)(float*, const float*, unsigned);
+    void (*add_cwise_mult)(float*, const float*, float, unsigned);
+    float (*dot)(const float*, const float*, unsigned);
+    float (*exp_minus_cst)(float*, const float*, float, unsigned);
+    void (*backprop_softmax)(float*, const float*, const float*, unsigned);
+    float (*cwise_add_partition)(float*, const float*, const float*, unsigned, float*);
+    float (*normalized_exp_dot)(float*, const float*, float, float, unsigned);
+};
+
+extern const Kernels scalar_kernels;
+extern const Kernels sse_kernels;
+extern const Kernels avx2_kernels;
+extern const Kernels avx512_kernels;
+
+// Constants of the Cephes single precision exponential,
+// shared by all vectorized implementations.
+namespace exp_constants
+{
+const float max_input = 88.3762626647949f;
+const float min_input = -88.3762626647949f;
+// below this value, the result is flushed to zero
+const float zero_threshold = -87.33654475f;
+const float log2e = 1.44269504088896341f;
+const float c1 = 0.693359375f;
+const float c2 = -2.12194440e-4f;
+const float p0 = 1.9875691500e-4f;
+const float p1 = 1.3981999507e-3f;
+const float p2 = 8.3334519073e-3f;
+const float p3 = 4.1665795894e-2f;
+const float p4 = 1.6666665459e-1f;
+const float p5 = 5.0000001201e-1f;
+}
+
+static inline float scalar_exp(const float x)
+{
+    // the C function, not the inline std::exp overload: an inline function compiled with the flags of this
+    // translation unit could be merged by the linker with the copies of the other ones (hence the anonymous traits types)
+    return x < exp_constants::zero_threshold ? 0.f : ::expf(x);
+}
+
+template<class S>
+void cwise_add(float* output, const float* input1, const float* input2, const unsigned size)
+{
+    unsigned i = 0u;
+    for (; i + S::width <= size; i += S::width)
+        S::store(output + i, S::add(S::load(input1 + i), S::load(input2 + i)));
+    for (; i < size; ++i)
+        output[i] = input1[i] + input2[i];
+}
+
+template<class S>
+float max(const float* input, const unsigned size)
+{
+    float value = -INFINITY;
+    unsigned i = 0u;
+    if (size >= S::width)
+    {
+        auto acc = S::set1(-INFINITY);
+        for (; i + S::width <= size; i += S::width)
+            acc = S::max(acc, S::load(input + i));
+        value = S::reduce_max(acc);
+    }
+    for (; i < size; ++i)
+        value = value < input[i] ? input[i] : value;
+    return value;
+}
+
+template<class S>
+void inplace_cwise_div(float* input, const float v, const unsigned size)
+{
+    const auto vv = S::set1(v);
+    unsigned i = 0u;
+    for (; i + S::width <= size; i += S::width)
+        S::store(input + i, S::div(S::load(input + i), vv));
+    for (; i < size; ++i)
+        input[i] = input[i] / v;
+}
+
+template<class S>
+void add(float* output, const float* input, const unsigned size)
+{
+    unsigned i = 0u;
+    for (; i + S::width <= size; i += S::width)
+        S::store(output + i, S::add(S::load(output + i), S::load(input + i)));
+    for (; i < size; ++i)
+        output[i] += input[i];
+}
+
+template<class S>
+void add_cwise_mult(float* output, const float* input, const float v, const unsigned size)
+{
+    const auto vv = S::set1(v);
+    unsigned i = 0u;
+    for (; i + S::width <= size; i += S::width)
+        S::store(output + i, S::fmadd(S::load(input + i), vv, S::load(output + i)));
+    for (; i < size; ++i)
+        output[i] += input[i] * v;
+}
+
+template<class S>
+float dot(const float* input1, const float* input2, const unsigned size)
+{
+    float ret = 0.f;
+    unsigned i = 0u;
+    if (size >= S::width)
+    {
+        auto acc = S::set1(0.f);
+        for (; i + S::width <= size; i += S::width)
+            acc = S::fmadd(S::load(input1 + i), S::load(input2 + i), acc);
+        ret = S::reduce_add(acc);
+    }
+    for (; i < size; ++i)
+        ret += input1[i] * input2[i];
+    return ret;
+}
+
+template<class S>
+float exp_minus_cst(float* output, const float* input, const float m, const unsigned size)
+{
+    float ret = 0.f;
+    unsigned i = 0u;
+    if (size >= S::width)
+    {
+        const auto vm = S::set1(m);
+        auto acc = S::set1(0.f);
+        for (; i + S::width <= size; i += S::width)
+        {
+            const auto v = S::exp(S::sub(S::load(input + i), vm));
+            S::store(output + i, v);
+            acc = S::add(acc, v);
+        }
+        ret = S::reduce_add(acc);
+    }
+    for (; i < size; ++i)
+    {
+        const float v = scalar_exp(input[i] - m);
+        output[i] = v;
+        ret += v;
+    }
+    return ret;
+}
+
+template<class S>
+void backprop_softmax(float* gradient_input, const float* gradient_output, const float* output, const unsigned size)
+{
+    const float s = dot<S>(gradient_output, output, size);
+    const auto vs = S::set1(s);
+    unsigned i = 0u;
+    for (; i + S::width <= size; i += S::width)
+        S::store(
+                gradient_input + i,
+                S::fmadd(S::load(output + i), S::sub(S::load(gradient_output + i), vs), S::load(gradient_input + i))
+        );
+    for (; i < size; ++i)
+        gradient_input[i] += output[i] * (gradient_output[i] - s);
+}
+
+template<class S>
+float cwise_add_partition(float* output, const float* input1, const float* input2, const unsigned size, float* m)
+{
+    // the running maximum starts at the lowest finite value
+    // so that -inf inputs never produce (-inf) - (-inf)
+    float value = -FLT_MAX;
+    float z = 0.f;
+    unsigned i = 0u;
+    if (size >= S::width)
+    {
+        // one online recurrence per lane, merged at the end
+        auto vm = S::set1(-FLT_MAX);
+        auto vz = S::set1(0.f);
+        for (; i + S::width <= size; i += S::width)
+        {
+            const auto x = S::add(S::load(input1 + i), S::load(input2 + i));
+            S::store(output + i, x);
+            const auto new_vm = S::max(vm, x);
+            vz = S::fmadd(vz, S::exp(S::sub(vm, new_vm)), S::exp(S::sub(x, new_vm)));
+            vm = new_vm;
+        }
+        value = S::reduce_max(vm);
+        z = S::reduce_add(S::mul(vz, S::exp(S::sub(vm, S::set1(value)))));
+    }
+    for (; i < size; ++i)
+    {
+        const float x = input1[i] + input2[i];
+        output[i] = x;
+        if (x > value)
+        {
+            z = z * scalar_exp(value - x) + 1.f;
+            value = x;
+        }
+        else
+            z += scalar_exp(x - value);
+    }
+    *m = value;
+    return z;
+}
+
+template<class S>
+float normalized_exp_dot(float* output, const float* input, const float m, const float z, const unsigned size)
+{
+    // all inputs are masked
+    if (z == 0.f)
+    {
+        for (unsigned i = 0u; i < size; ++i)
+            output[i] = 0.f;
+        return -INFINITY;
+    }
+
+    float ret = 0.f;
+    unsigned i = 0u;
+    if (size >= S::width)
+    {
+        const auto vm = S::set1(m);
+        const auto vz = S::set1(z);
+        const auto lowest = S::set1(-FLT_MAX);
+        auto acc = S::set1(0.f);
+        for (; i + S::width <= size; i += S::width)
+        {
+            const auto x = S::load(input + i);
+            const auto v = S::div(S::exp(S::sub(x, vm)), vz);
+            S::store(output + i, v);
+            // masked inputs have a null probability, clamping them avoids 0 * -inf
+            acc = S::fmadd(v, S::max(x, lowest), acc);
+        }
+        ret = S::reduce_add(acc);
+    }
+    for (; i < size; ++i)
+    {
+        const float v = scalar_exp(input[i] - m) / z;
+        output[i] = v;
+        if (v > 0.f)
+            ret += v * input[i];
+    }
+    return ret;
+}
+
+template<class S>
+constexpr Kernels make_kernels()
+{
+    return {
+            &cwise_add<S>,
+            &max<S>,
+            &inplace_cwise_div<S>,
+            &add<S>,
+            &add_cwise_mult<S>,
+            &dot<S>,
+            &exp_minus_cst<S>,
+            &backprop_softmax<S>,
+            &cwise_add_partition<S>,
+            &normalized_exp_dot<S>
+    };
+}
+
+}
+}
+}
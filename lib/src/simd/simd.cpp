@@ -0,0 +1,161 @@
+#include "diffdp/simd.h"
+
+#include <stdexcept>
+
+#include "simd/kernels.h"
+
+namespace diffdp
+{
+namespace simd
+{
+
+namespace
+{
+
+struct ScalarTraits
+{
+    typedef float type;
+    static const unsigned width = 1u;
+
+    static type load(const float* p) { return *p; }
+    static void store(float* p, const type v) { *p = v; }
+    static type set1(const float v) { return v; }
+    static type add(const type a, const type b) { return a + b; }
+    static type sub(const type a, const type b) { return a - b; }
+    static type mul(const type a, const type b) { return a * b; }
+    static type div(const type a, const type b) { return a / b; }
+    static type fmadd(const type a, const type b, const type c) { return a * b + c; }
+    static type max(const type a, const type b) { return a < b ? b : a; }
+    static type exp(const type a) { return detail::scalar_exp(a); }
+    static float reduce_add(const type a) { return a; }
+    static float reduce_max(const type a) { return a; }
+};
+
+const detail::Kernels& kernels_for(const InstructionSet set)
+{
+    switch (set)
+    {
+#ifdef DIFFDP_SIMD_X86
+        case InstructionSet::AVX512:
+            return detail::avx512_kernels;
+        case InstructionSet::AVX2:
+            return detail::avx2_kernels;
+        case InstructionSet::SSE:
+            return detail::sse_kernels;
+#endif
+        default:
+            return detail::scalar_kernels;
+    }
+}
+
+InstructionSet& current_instruction_set()
+{
+    static InstructionSet set = best_instruction_set();
+    return set;
+}
+
+const detail::Kernels*& current_kernels()
+{
+    static const detail::Kernels* kernels = &kernels_for(current_instruction_set());
+    return kernels;
+}
+
+}
+
+namespace detail
+{
+const Kernels scalar_kernels = make_kernels<ScalarTraits>();
+}
+
+bool is_supported(const InstructionSet set)
+{
+    switch (set)
+    {
+        case InstructionSet::Scalar:
+            return true;
+#ifdef DIFFDP_SIMD_X86
+        case InstructionSet::SSE:
+            return __builtin_cpu_supports("sse2");
+        case InstructionSet::AVX2:
+            return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+        case InstructionSet::AVX512:
+            return __builtin_cpu_supports("avx512f");
+#endif
+        default:
+            return false;
+    }
+}
+
+InstructionSet best_instruction_set()
+{
+    for (const auto set : {InstructionSet::AVX512, InstructionSet::AVX2, InstructionSet::SSE})
+        if (is_supported(set))
+            return set;
+    return InstructionSet::Scalar;
+}
+
+InstructionSet instruction_set()
+{
+    return current_instruction_set();
+}
+
+void set_instruction_set(const InstructionSet set)
+{
+    if (!is_supported(set))
+        throw std::runtime_error("Instruction set not supported by the CPU");
+    current_instruction_set() = set;
+    current_kernels() = &kernels_for(set);
+}
+
+void cwise_add(float* output, const float* input1, const float* input2, const unsigned size)
+{
+    current_kernels()->cwise_add(output, input1, input2, size);
+}
+
+float max(const float* input, const unsigned size)
+{
+    return current_kernels()->max(input, size);
+}
+
+void inplace_cwise_div(float* input, const float v, const unsigned size)
+{
+    current_kernels()->inplace_cwise_div(input, v, size);
+}
+
+void add(float* output, const float* input, const unsigned size)
+{
+    current_kernels()->add(output, input, size);
+}
+
+void add_cwise_mult(float* output, const float* input, const float v, const unsigned size)
+{
+    current_kernels()->add_cwise_mult(output, input, v, size);
+}
+
+float dot(const float* input1, const float* input2, const unsigned size)
+{
+    return current_kernels()->dot(input1, input2, size);
+}
+
+float exp_minus_cst(float* output, const float* input, const float m, const unsigned size)
+{
+    return current_kernels()->exp_minus_cst(output, input, m, size);
+}
+
+void backprop_softmax(float* gradient_input, const float* gradient_output, const float* output, const unsigned size)
+{
+    current_kernels()->backprop_softmax(gradient_input, gradient_output, output, size);
+}
+
+float cwise_add_partition(float* output, const float* input1, const float* input2, const unsigned size, float* m)
+{
+    return current_kernels()->cwise_add_partition(output, input1, input2, size, m);
+}
+
+float normalized_exp_dot(float* output, const float* input, const float m, const float z, const unsigned size)
+{
+    return current_kernels()->normalized_exp_dot(output, input, m, z, size);
+}
+
+}
+}
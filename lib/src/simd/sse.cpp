@@ -0,0 +1,84 @@
+/**
+ * SSE2 kernels, this file must be compiled with -msse2
+ */
+#include <emmintrin.h>
+
+#include "simd/kernels.h"
+
+namespace diffdp
+{
+namespace simd
+{
+
+namespace
+{
+
+struct SSETraits
+{
+    typedef __m128 type;
+    static const unsigned width = 4u;
+
+    static type load(const float* p) { return _mm_loadu_ps(p); }
+    static void store(float* p, const type v) { _mm_storeu_ps(p, v); }
+    static type set1(const float v) { return _mm_set1_ps(v); }
+    static type add(const type a, const type b) { return _mm_add_ps(a, b); }
+    static type sub(const type a, const type b) { return _mm_sub_ps(a, b); }
+    static type mul(const type a, const type b) { return _mm_mul_ps(a, b); }
+    static type div(const type a, const type b) { return _mm_div_ps(a, b); }
+    static type fmadd(const type a, const type b, const type c) { return _mm_add_ps(_mm_mul_ps(a, b), c); }
+    static type max(const type a, const type b) { return _mm_max_ps(a, b); }
+
+    static type exp(type x)
+    {
+        using namespace detail::exp_constants;
+        const type zero_mask = _mm_cmplt_ps(x, _mm_set1_ps(zero_threshold));
+        x = _mm_min_ps(x, _mm_set1_ps(max_input));
+        x = _mm_max_ps(x, _mm_set1_ps(min_input));
+
+        // n = floor(x * log2(e) + 0.5), SSE2 has no floor instruction
+        type fx = _mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(log2e)), _mm_set1_ps(0.5f));
+        __m128i n = _mm_cvttps_epi32(fx);
+        type tmp = _mm_cvtepi32_ps(n);
+        const type correction = _mm_and_ps(_mm_cmpgt_ps(tmp, fx), _mm_set1_ps(1.f));
+        fx = _mm_sub_ps(tmp, correction);
+        n = _mm_cvttps_epi32(fx);
+
+        x = _mm_sub_ps(x, _mm_mul_ps(fx, _mm_set1_ps(c1)));
+        x = _mm_sub_ps(x, _mm_mul_ps(fx, _mm_set1_ps(c2)));
+        const type x2 = _mm_mul_ps(x, x);
+
+        type y = _mm_set1_ps(p0);
+        y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(p1));
+        y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(p2));
+        y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(p3));
+        y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(p4));
+        y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(p5));
+        y = _mm_add_ps(_mm_mul_ps(y, x2), _mm_add_ps(x, _mm_set1_ps(1.f)));
+
+        // 2^n
+        const type pow2n = _mm_castsi128_ps(_mm_slli_epi32(_mm_add_epi32(n, _mm_set1_epi32(127)), 23));
+        return _mm_andnot_ps(zero_mask, _mm_mul_ps(y, pow2n));
+    }
+
+    static float reduce_add(const type a)
+    {
+        const type b = _mm_add_ps(a, _mm_movehl_ps(a, a));
+        return _mm_cvtss_f32(_mm_add_ss(b, _mm_shuffle_ps(b, b, 1)));
+    }
+
+    static float reduce_max(const type a)
+    {
+        const type b = _mm_max_ps(a, _mm_movehl_ps(a, a));
+        return _mm_cvtss_f32(_mm_max_ss(b, _mm_shuffle_ps(b, b, 1)));
+    }
+};
+
+}
+
+namespace detail
+{
+const Kernels sse_kernels = make_kernels<SSETraits>();
+}
+
+}
+}
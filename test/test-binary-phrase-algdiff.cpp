@@ -90,4 +90,41 @@ BOOST_AUTO_TEST_CASE(gradient)
                         }
                     }
                 }
-        }
\ No newline at end of file
+        }
+
+
+// dropping the split weights must not change the result
+template<class Parser>
+void check_recomputed_split_weights()
+{
+    const unsigned size = 10;
+    std::vector<float> weights(size * size), gradients(size * size);
+    for (unsigned i = 0 ; i < size * size ; ++i)
+    {
+        weights[i] = std::sin(1.7f * i);
+        gradients[i] = std::cos(0.3f * i);
+    }
+
+    Parser stored(size);
+    Parser recomputed(size, diffdp::SplitWeightsMode::Recomputed);
+    for (Parser* parser : {&stored, &recomputed})
+    {
+        parser->forward([&] (const unsigned left, const unsigned right) { return weights.at(left + right * size); });
+        parser->backward([&] (const unsigned left, const unsigned right) { return gradients.at(left + right * size); });
+    }
+
+    for (unsigned left = 0 ; left < size ; ++left)
+    {
+        for (unsigned right = left + 1 ; right < size ; ++right)
+        {
+            BOOST_CHECK_EQUAL(stored.output(left, right), recomputed.output(left, right));
+            BOOST_CHECK(check_grad(stored.gradient(left, right), recomputed.gradient(left, right)));
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(recomputed_split_weights)
+{
+    check_recomputed_split_weights<diffdp::AlgorithmicDifferentiableBinaryPhraseStructure>();
+    check_recomputed_split_weights<diffdp::EntropyRegularizedBinaryPhraseStructure>();
+}
@@ -0,0 +1,106 @@
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE "SparsemaxBinaryPhraseStructure"
+
+#include <boost/test/unit_test.hpp>
+namespace utf = boost::unit_test;
+
+#include <vector>
+#include <random>
+#include <cmath>
+
+#include "diffdp/algorithm/binary_phrase.h"
+
+// using boost test with intolerance fails (too precise),
+// so let's just use the same test as in Dynet.
+bool check_grad(float g, float g_act)
+{
+    float f = std::fabs(g - g_act);
+    float m = std::max(std::fabs(g), std::fabs(g_act));
+    if (f > 0.01 && m > 0.f)
+        f /= m;
+
+    if (f > 0.01 || std::isnan(f))
+        return false;
+    else
+        return true;
+}
+
+// the relaxation is piecewise linear:
+// the gradient of a random projection of the output is compared to finite differences
+BOOST_AUTO_TEST_CASE(gradient)
+{
+    const unsigned size = 8;
+    const float sensitivity = 1e-3;
+
+    std::default_random_engine generator;
+    std::uniform_real_distribution<float> distribution(-1.f, 1.f);
+    std::vector<float> weights(size * size), gradients(size * size);
+    for (unsigned i = 0 ; i < size * size ; ++i)
+    {
+        weights[i] = distribution(generator);
+        gradients[i] = distribution(generator);
+    }
+
+    diffdp::SparsemaxBinaryPhraseStructure sparsemax(size);
+    const auto projection = [&] () -> double
+    {
+        sparsemax.forward([&] (const unsigned left, const unsigned right) { return weights.at(left + right * size); });
+        double ret = 0.;
+        for (unsigned left = 0 ; left < size ; ++left)
+            for (unsigned right = left + 1 ; right < size ; ++right)
+                ret += gradients.at(left + right * size) * sparsemax.output(left, right);
+        return ret;
+    };
+
+    projection();
+    sparsemax.backward([&] (const unsigned left, const unsigned right) { return gradients.at(left + right * size); });
+    std::vector<float> computed_gradients(size * size);
+    for (unsigned left = 0 ; left < size ; ++left)
+        for (unsigned right = left + 1 ; right < size ; ++right)
+            computed_gradients.at(left + right * size) = sparsemax.gradient(left, right);
+
+    for (unsigned left = 0 ; left < size ; ++left)
+    {
+        for (unsigned right = left + 1 ; right < size ; ++right)
+        {
+            const float original_weight = weights.at(left + right * size);
+            weights.at(left + right * size) = original_weight + sensitivity;
+            const double output_a = projection();
+            weights.at(left + right * size) = original_weight - sensitivity;
+            const double output_b = projection();
+            weights.at(left + right * size) = original_weight;
+
+            const double estimated_gradient = (output_a - output_b) / (2.f * sensitivity);
+            BOOST_CHECK(check_grad(computed_gradients.at(left + right * size), estimated_gradient));
+        }
+    }
+}
+
+// with spread weights, the selection of most spans is exactly zero
+BOOST_AUTO_TEST_CASE(sparse_output)
+{
+    const unsigned size = 12;
+
+    std::default_random_engine generator;
+    std::uniform_real_distribution<float> distribution(-10.f, 10.f);
+    std::vector<float> weights(size * size);
+    for (auto& w : weights)
+        w = distribution(generator);
+
+    diffdp::SparsemaxBinaryPhraseStructure sparsemax(size);
+    sparsemax.forward([&] (const unsigned left, const unsigned right) { return weights.at(left + right * size); });
+
+    unsigned n_zeros = 0u;
+    for (unsigned left = 0 ; left < size ; ++left)
+    {
+        for (unsigned right = left + 1 ; right < size ; ++right)
+        {
+            const float v = sparsemax.output(left, right);
+            BOOST_CHECK(v >= 0.f && v <= 1.f + 1e-5f);
+            if (v == 0.f)
+                ++n_zeros;
+        }
+    }
+    BOOST_CHECK_EQUAL(sparsemax.output(0, size - 1), 1.f);
+    BOOST_CHECK(n_zeros > size * (size - 1) / 4);
+}
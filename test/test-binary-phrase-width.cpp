@@ -0,0 +1,195 @@
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE "BinaryPhraseWidth"
+
+#include <boost/test/unit_test.hpp>
+namespace utf = boost::unit_test;
+
+#include <vector>
+#include <random>
+#include <cmath>
+#include <utility>
+
+#include "diffdp/algorithm/binary_phrase.h"
+
+const unsigned size = 7u;
+const unsigned max_span_length = 2u;
+
+typedef std::vector<std::pair<unsigned, unsigned>> Tree;
+
+// all binary bracketings of the words left, ..., right (spans of a single word are omitted)
+std::vector<Tree> bracketings(const unsigned left, const unsigned right)
+{
+    if (left == right)
+        return {Tree()};
+
+    std::vector<Tree> trees;
+    for (unsigned k = left ; k < right ; ++k)
+    {
+        for (const auto& left_tree : bracketings(left, k))
+        {
+            for (const auto& right_tree : bracketings(k + 1u, right))
+            {
+                Tree tree(left_tree);
+                tree.insert(tree.end(), right_tree.begin(), right_tree.end());
+                tree.emplace_back(left, right);
+                trees.push_back(tree);
+            }
+        }
+    }
+    return trees;
+}
+
+// the trees built by the bounded chart: the long constituents are on the right spine
+bool is_bounded_tree(const Tree& tree)
+{
+    for (const auto& span : tree)
+        if (span.second - span.first > max_span_length && span.second != size - 1u)
+            return false;
+    return true;
+}
+
+// log-partition and span marginals of the bounded trees, by enumeration
+double bounded_marginals(const std::vector<float>& weights, std::vector<double>& marginals)
+{
+    std::vector<double> scores;
+    std::vector<Tree> trees;
+    for (const auto& tree : bracketings(0u, size - 1u))
+    {
+        if (!is_bounded_tree(tree))
+            continue;
+        double score = 0.;
+        for (const auto& span : tree)
+            score += weights.at(span.first + span.second * size);
+        scores.push_back(score);
+        trees.push_back(tree);
+    }
+
+    double m = -std::numeric_limits<double>::infinity();
+    for (double s : scores)
+        m = std::max(m, s);
+    double z = 0.;
+    for (double s : scores)
+        z += std::exp(s - m);
+    const double log_z = m + std::log(z);
+
+    marginals.assign(size * size, 0.);
+    for (unsigned t = 0u ; t < trees.size() ; ++t)
+        for (const auto& span : trees.at(t))
+            marginals.at(span.first + span.second * size) += std::exp(scores.at(t) - log_z);
+    return log_z;
+}
+
+std::vector<float> random_weights(std::default_random_engine& generator)
+{
+    std::uniform_real_distribution<float> distribution(-2.f, 2.f);
+    std::vector<float> weights(size * size);
+    for (auto& w : weights)
+        w = distribution(generator);
+    return weights;
+}
+
+// the relaxation of the bounded chart is the distribution over bounded trees
+void check_marginals(diffdp::SplitWeightsMode mode)
+{
+    std::default_random_engine generator;
+    const auto weights = random_weights(generator);
+
+    std::vector<double> marginals;
+    const double log_z = bounded_marginals(weights, marginals);
+
+    diffdp::EntropyRegularizedBinaryPhraseStructure parser(size, mode, max_span_length);
+    parser.forward([&] (unsigned left, unsigned right) { return weights.at(left + right * size); });
+    BOOST_CHECK_SMALL(parser.chart_forward->weight(0u, size - 1u) - (float) log_z, 1e-4f);
+
+    for (unsigned left = 0u ; left < size ; ++left)
+    {
+        for (unsigned right = left + 1u ; right < size ; ++right)
+        {
+            BOOST_CHECK_SMALL(parser.output(left, right) - (float) marginals.at(left + right * size), 1e-4f);
+            if (right - left > max_span_length && right != size - 1u)
+                BOOST_CHECK_EQUAL(parser.output(left, right), 0.f);
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(bounded_marginals_stored)
+{
+    check_marginals(diffdp::SplitWeightsMode::Stored);
+}
+
+BOOST_AUTO_TEST_CASE(bounded_marginals_recomputed)
+{
+    check_marginals(diffdp::SplitWeightsMode::Recomputed);
+}
+
+// with a bound larger than the sentence, all spans are built
+BOOST_AUTO_TEST_CASE(unbounded)
+{
+    std::default_random_engine generator;
+    const auto weights = random_weights(generator);
+    const auto weight = [&] (unsigned left, unsigned right) { return weights.at(left + right * size); };
+
+    diffdp::AlgorithmicDifferentiableBinaryPhraseStructure dense(size), bounded(size, diffdp::SplitWeightsMode::Stored, size);
+    dense.forward(weight);
+    bounded.forward(weight);
+    dense.backward(weight);
+    bounded.backward(weight);
+    for (unsigned left = 0u ; left < size ; ++left)
+    {
+        for (unsigned right = left + 1u ; right < size ; ++right)
+        {
+            BOOST_CHECK_SMALL(bounded.output(left, right) - dense.output(left, right), 1e-5f);
+            BOOST_CHECK_SMALL(bounded.gradient(left, right) - dense.gradient(left, right), 1e-5f);
+        }
+    }
+}
+
+// the memory of the band is linear in the size of the sentence
+BOOST_AUTO_TEST_CASE(bounded_memory)
+{
+    const std::size_t cells_100 = diffdp::BinaryPhraseStructureChart::required_cells(100u, diffdp::SplitWeightsMode::Stored, 5u);
+    const std::size_t cells_200 = diffdp::BinaryPhraseStructureChart::required_cells(200u, diffdp::SplitWeightsMode::Stored, 5u);
+    BOOST_CHECK(cells_200 < 2u * cells_100 + 1000u);
+    BOOST_CHECK(cells_200 < diffdp::BinaryPhraseStructureChart::required_cells(200u) / 100u);
+}
+
+// gradients of both relaxations compared with finite differences
+template<class Parser>
+void check_gradient(const float tolerance)
+{
+    std::default_random_engine generator;
+    const auto weights = random_weights(generator);
+    const auto output_weights = random_weights(generator);
+    const auto loss = [&] (const std::vector<float>& w)
+    {
+        Parser parser(size, diffdp::SplitWeightsMode::Stored, max_span_length);
+        parser.forward([&] (unsigned left, unsigned right) { return w.at(left + right * size); });
+        float value = 0.f;
+        for (unsigned left = 0u ; left < size ; ++left)
+            for (unsigned right = left + 1u ; right < size ; ++right)
+                value += parser.output(left, right) * output_weights.at(left + right * size);
+        return value;
+    };
+
+    Parser parser(size, diffdp::SplitWeightsMode::Stored, max_span_length);
+    parser.forward([&] (unsigned left, unsigned right) { return weights.at(left + right * size); });
+    parser.backward([&] (unsigned left, unsigned right) { return output_weights.at(left + right * size); });
+
+    const float eps = 1e-2f;
+    const float value = loss(weights);
+    for (unsigned left = 0u ; left < size ; ++left)
+    {
+        for (unsigned right = left + 1u ; right < size ; ++right)
+        {
+            auto perturbed_weights = weights;
+            perturbed_weights.at(left + right * size) += eps;
+            BOOST_CHECK_SMALL(parser.gradient(left, right) - (loss(perturbed_weights) - value) / eps, tolerance);
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(bounded_gradient)
+{
+    check_gradient<diffdp::EntropyRegularizedBinaryPhraseStructure>(2e-2f);
+    check_gradient<diffdp::AlgorithmicDifferentiableBinaryPhraseStructure>(2e-2f);
+}
@@ -0,0 +1,215 @@
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE "DynetBuilder"
+
+#include <boost/test/unit_test.hpp>
+namespace utf = boost::unit_test;
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "dynet/expr.h"
+#include "dynet/param-init.h"
+#include "dynet/grad-check.h"
+
+#include "diffdp/builder/dependency.h"
+#include "diffdp/builder/binary-phrase.h"
+
+const unsigned size = 7u;
+const unsigned n_batch = 2u;
+const unsigned n_samples = 3u;
+
+// one parameter per batch element, so that the gradient check covers all of them
+std::vector<dynet::Parameter> batch_parameters(dynet::ParameterCollection& pc)
+{
+    std::vector<dynet::Parameter> parameters;
+    for (unsigned b = 0u ; b < n_batch ; ++b)
+    {
+        std::vector<float> weights(size * size);
+        for (unsigned i = 0 ; i < weights.size() ; ++i)
+            weights.at(i) = std::sin((float) (i + b * weights.size()));
+        parameters.push_back(pc.add_parameters(dynet::Dim({size, size}), dynet::ParameterInitFromVector(weights)));
+    }
+    return parameters;
+}
+
+dynet::Expression batched_weights(dynet::ComputationGraph& cg, std::vector<dynet::Parameter>& parameters)
+{
+    std::vector<dynet::Expression> weights;
+    for (auto& p : parameters)
+        weights.push_back(dynet::parameter(cg, p));
+    return dynet::concatenate_to_batch(weights);
+}
+
+std::vector<float> batch_element(const std::vector<float>& values, const unsigned elem)
+{
+    return std::vector<float>(values.begin() + elem * size * size, values.begin() + (elem + 1u) * size * size);
+}
+
+float max_difference(const std::vector<float>& a, const std::vector<float>& b)
+{
+    float diff = 0.f;
+    for (unsigned i = 0u ; i < a.size() ; ++i)
+        diff = std::max(diff, std::fabs(a.at(i) - b.at(i)));
+    return diff;
+}
+
+// loss covering all the cells of the samples
+dynet::Expression samples_loss(dynet::ComputationGraph& cg, const dynet::Expression& e_samples)
+{
+    std::vector<float> output_weights(size * size * n_samples * n_batch);
+    for (unsigned i = 0 ; i < output_weights.size() ; ++i)
+        output_weights.at(i) = std::cos((float) i);
+    const auto e_output_weights = dynet::input(cg, dynet::Dim({size, size}, n_samples * n_batch), output_weights);
+    return dynet::sum_batches(dynet::sum_elems(dynet::cmult(e_samples, e_output_weights)));
+}
+
+// without perturbation, sample s * B + b is the relaxation of the batch element b
+BOOST_AUTO_TEST_CASE(dependency_samples_order)
+{
+    int argc = 1;
+    char **argv;
+    dynet::initialize(argc, argv);
+
+    dynet::ParameterCollection pc;
+    auto parameters = batch_parameters(pc);
+
+    diffdp::DependencySettings settings;
+    settings.type = diffdp::DependencyType::ProjectiveEntropyReg;
+    diffdp::DependencyBuilder builder(settings);
+
+    dynet::ComputationGraph cg;
+    builder.new_graph(cg, true);
+
+    // the second sentence is shorter than the input matrix
+    std::vector<unsigned> sizes = {size - 1u, size - 3u};
+    auto e_samples = builder.relaxed_samples(batched_weights(cg, parameters), n_samples, &sizes);
+    BOOST_CHECK_EQUAL(e_samples.dim().batch_elems(), n_samples * n_batch);
+    const auto samples = dynet::as_vector(cg.forward(e_samples));
+
+    for (unsigned b = 0u ; b < n_batch ; ++b)
+    {
+        std::vector<unsigned> single_size = {sizes.at(b)};
+        const auto expected = dynet::as_vector(cg.forward(builder.relaxed(dynet::parameter(cg, parameters.at(b)), &single_size)));
+        for (unsigned s = 0u ; s < n_samples ; ++s)
+            BOOST_CHECK_SMALL(max_difference(batch_element(samples, s * n_batch + b), expected), 1e-6f);
+    }
+
+    // words after the end of the second sentence have no head
+    for (unsigned s = 0u ; s < n_samples ; ++s)
+        for (unsigned head = 0u ; head < size ; ++head)
+            BOOST_CHECK_EQUAL(batch_element(samples, s * n_batch + 1u).at(head + (size - 1u) * size), 0.f);
+}
+
+// the batched mask is repeated as the weights
+BOOST_AUTO_TEST_CASE(dependency_samples_mask)
+{
+    int argc = 1;
+    char **argv;
+    dynet::initialize(argc, argv);
+
+    dynet::ParameterCollection pc;
+    auto parameters = batch_parameters(pc);
+
+    diffdp::DependencySettings settings;
+    settings.type = diffdp::DependencyType::Head;
+    diffdp::DependencyBuilder builder(settings);
+
+    dynet::ComputationGraph cg;
+    builder.new_graph(cg, true);
+
+    // a different word is masked in each batch element
+    const std::vector<unsigned> masked_words = {2u, 4u};
+    std::vector<float> mask(size * n_batch, 1.f);
+    for (unsigned b = 0u ; b < n_batch ; ++b)
+        mask.at(masked_words.at(b) + b * size) = 0.f;
+    auto e_mask = dynet::input(cg, dynet::Dim({1u, size}, n_batch), mask);
+
+    auto e_samples = builder.relaxed_samples(batched_weights(cg, parameters), n_samples, nullptr, &e_mask);
+    BOOST_CHECK_EQUAL(e_samples.dim().batch_elems(), n_samples * n_batch);
+    const auto samples = dynet::as_vector(cg.forward(e_samples));
+
+    for (unsigned b = 0u ; b < n_batch ; ++b)
+    {
+        auto e_single_mask = dynet::pick_batch_elem(e_mask, b);
+        const auto expected = dynet::as_vector(cg.forward(builder.relaxed(dynet::parameter(cg, parameters.at(b)), nullptr, &e_single_mask)));
+        for (unsigned s = 0u ; s < n_samples ; ++s)
+        {
+            const auto sample = batch_element(samples, s * n_batch + b);
+            BOOST_CHECK_SMALL(max_difference(sample, expected), 1e-6f);
+            for (unsigned head = 0u ; head < size ; ++head)
+                BOOST_CHECK_EQUAL(sample.at(head + masked_words.at(b) * size), 0.f);
+        }
+    }
+}
+
+// with perturbation, the samples of a batch element differ, and the noise is fixed in the graph
+BOOST_AUTO_TEST_CASE(dependency_samples_perturbation)
+{
+    int argc = 1;
+    char **argv;
+    dynet::initialize(argc, argv);
+
+    dynet::ParameterCollection pc;
+    auto parameters = batch_parameters(pc);
+
+    diffdp::DependencySettings settings;
+    settings.type = diffdp::DependencyType::ProjectiveEntropyReg;
+    settings.perturb = true;
+    diffdp::DependencyBuilder builder(settings);
+
+    dynet::ComputationGraph cg;
+    builder.new_graph(cg, true);
+
+    std::vector<unsigned> sizes = {size - 1u, size - 3u};
+    auto e_samples = builder.relaxed_samples(batched_weights(cg, parameters), n_samples, &sizes);
+    const auto samples = dynet::as_vector(cg.forward(e_samples));
+    for (unsigned b = 0u ; b < n_batch ; ++b)
+        for (unsigned s1 = 0u ; s1 < n_samples ; ++s1)
+            for (unsigned s2 = s1 + 1u ; s2 < n_samples ; ++s2)
+                BOOST_CHECK(max_difference(batch_element(samples, s1 * n_batch + b), batch_element(samples, s2 * n_batch + b)) > 1e-3f);
+
+    BOOST_CHECK(check_grad(pc, samples_loss(cg, e_samples), 0));
+}
+
+BOOST_AUTO_TEST_CASE(phrase_samples)
+{
+    int argc = 1;
+    char **argv;
+    dynet::initialize(argc, argv);
+
+    dynet::ParameterCollection pc;
+    auto parameters = batch_parameters(pc);
+
+    for (const bool perturb : {false, true})
+    {
+        diffdp::BinaryPhraseSettings settings;
+        settings.perturb = perturb;
+        diffdp::BinaryPhraseBuilder builder(settings);
+
+        dynet::ComputationGraph cg;
+        builder.new_graph(cg, true);
+
+        auto e_samples = builder.relaxed_samples(batched_weights(cg, parameters), n_samples);
+        BOOST_CHECK_EQUAL(e_samples.dim().batch_elems(), n_samples * n_batch);
+        const auto samples = dynet::as_vector(cg.forward(e_samples));
+
+        for (unsigned b = 0u ; b < n_batch ; ++b)
+        {
+            if (perturb)
+            {
+                for (unsigned s1 = 0u ; s1 < n_samples ; ++s1)
+                    for (unsigned s2 = s1 + 1u ; s2 < n_samples ; ++s2)
+                        BOOST_CHECK(max_difference(batch_element(samples, s1 * n_batch + b), batch_element(samples, s2 * n_batch + b)) > 1e-3f);
+            }
+            else
+            {
+                const auto expected = dynet::as_vector(cg.forward(builder.relaxed(dynet::parameter(cg, parameters.at(b)))));
+                for (unsigned s = 0u ; s < n_samples ; ++s)
+                    BOOST_CHECK_SMALL(max_difference(batch_element(samples, s * n_batch + b), expected), 1e-6f);
+            }
+        }
+
+        BOOST_CHECK(check_grad(pc, samples_loss(cg, e_samples), 0));
+    }
+}
@@ -8,6 +8,9 @@
 namespace utf = boost::unit_test;
 
 #include <vector>
+#include <cmath>
+#include <limits>
+#include <utility>
 
 #include "dynet/expr.h"
 #include "dynet/param-init.h"
@@ -81,4 +84,503 @@ BOOST_AUTO_TEST_CASE(test_dynet_eisner_algdiff)
             }
         }
     }
-}
\ No newline at end of file
+}
+BOOST_AUTO_TEST_CASE(test_dynet_eisner_viterbi)
+{
+    const unsigned size = 10u;
+
+    int argc = 1;
+    char **argv;
+    dynet::initialize(argc, argv);
+
+    std::vector<float> weights(size * size);
+    for (unsigned i = 0 ; i < weights.size() ; ++i)
+        weights.at(i) = std::sin((float) i);
+
+    dynet::ComputationGraph cg;
+    auto e_weights = dynet::input(cg, dynet::Dim({size, size}), weights);
+    auto e_arcs = dynet::viterbi_eisner(
+            e_weights,
+            diffdp::DependencyGraphMode::Adjacency,
+            diffdp::DependencyGraphMode::Adjacency
+    );
+    const auto arcs = dynet::as_vector(cg.forward(e_arcs));
+
+    // each word has exactly one head (column-major, as the input)
+    for (unsigned mod = 0u; mod < size; ++mod)
+    {
+        float n_heads = 0.f;
+        for (unsigned head = 0u; head < size; ++head)
+        {
+            const float v = arcs.at(head + mod * size);
+            BOOST_CHECK(v == 0.f || v == 1.f);
+            n_heads += v;
+        }
+        BOOST_CHECK_EQUAL(n_heads, mod == 0u ? 0.f : 1.f);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(test_dynet_eisner_discrete_modes)
+{
+    const unsigned size = 10u;
+
+    int argc = 1;
+    char **argv;
+    dynet::initialize(argc, argv);
+
+    dynet::ParameterCollection pc;
+
+    std::vector<float> weights(size * size);
+    for (unsigned i = 0 ; i < weights.size() ; ++i)
+        weights.at(i) = std::sin((float) i);
+    auto p_weights = pc.add_parameters(dynet::Dim({size, size}), dynet::ParameterInitFromVector(weights));
+
+    for (const auto mode : {diffdp::DiscreteMode::StraightThrough, diffdp::DiscreteMode::BackwardRegularized})
+    {
+        dynet::ComputationGraph cg;
+        auto e_weights = dynet::parameter(cg, p_weights);
+
+        const auto best = dynet::as_vector(cg.forward(dynet::viterbi_eisner(
+                e_weights,
+                diffdp::DependencyGraphMode::Adjacency,
+                diffdp::DependencyGraphMode::Adjacency
+        )));
+
+        // the output is the best tree
+        auto e_arcs = dynet::algorithmic_differentiable_eisner(
+                e_weights,
+                mode,
+                diffdp::DependencyGraphMode::Adjacency,
+                diffdp::DependencyGraphMode::Adjacency
+        );
+        const auto arcs = dynet::as_vector(cg.forward(e_arcs));
+        for (unsigned i = 0u ; i < size * size ; ++i)
+            BOOST_CHECK_EQUAL(arcs.at(i), best.at(i));
+
+        auto e_loss = dynet::sum_elems(dynet::cmult(e_arcs, e_weights));
+        cg.forward(e_loss);
+        cg.backward(e_loss);
+
+        const auto gradient = dynet::as_vector(p_weights.get_storage().g);
+        for (unsigned head = 0u ; head < size ; ++head)
+        {
+            for (unsigned mod = 1u ; mod < size ; ++mod)
+            {
+                if (head == mod)
+                    continue;
+
+                const float g = gradient.at(head + mod * size);
+                BOOST_CHECK(std::isfinite(g));
+                // straight-through: the gradient of the output is copied
+                if (mode == diffdp::DiscreteMode::StraightThrough)
+                    BOOST_CHECK_CLOSE(g, best.at(head + mod * size) + weights.at(head + mod * size), 1e-3f);
+            }
+        }
+        pc.reset_gradient();
+    }
+}
+
+BOOST_AUTO_TEST_CASE(test_dynet_eisner_pruning)
+{
+    const unsigned size = 10u;
+
+    int argc = 1;
+    char **argv;
+    dynet::initialize(argc, argv);
+
+    dynet::ParameterCollection pc;
+
+    std::vector<float> weights(size * size);
+    for (unsigned i = 0 ; i < weights.size() ; ++i)
+        weights.at(i) = std::sin((float) i);
+    auto p_weights = pc.add_parameters(dynet::Dim({size, size}), dynet::ParameterInitFromVector(weights));
+
+    diffdp::PruningSettings settings;
+    settings.top_k = 2u;
+    diffdp::ArcPruning pruning;
+    pruning.build(size, settings, [&] (unsigned head, unsigned mod) { return weights.at(head + mod * size); });
+
+    dynet::ComputationGraph cg;
+    auto e_weights = dynet::parameter(cg, p_weights);
+    auto e_arcs = dynet::entropy_regularized_eisner(
+            e_weights,
+            diffdp::DiscreteMode::ForwardRegularized,
+            diffdp::DependencyGraphMode::Adjacency,
+            diffdp::DependencyGraphMode::Adjacency,
+            true,
+            nullptr,
+            diffdp::SplitWeightsMode::Stored,
+            settings
+    );
+    auto e_loss = dynet::sum_elems(dynet::cmult(e_arcs, e_weights));
+    cg.forward(e_loss);
+    cg.backward(e_loss);
+
+    const auto arcs = dynet::as_vector(e_arcs.value());
+    const auto gradient = dynet::as_vector(p_weights.get_storage().g);
+    for (unsigned mod = 1u ; mod < size ; ++mod)
+    {
+        float sum = 0.f;
+        for (unsigned head = 0u ; head < size ; ++head)
+        {
+            if (head == mod)
+                continue;
+
+            sum += arcs.at(head + mod * size);
+            BOOST_CHECK(std::isfinite(gradient.at(head + mod * size)));
+            // pruned arcs are neither in the output nor in the gradient
+            if (!pruning.kept(head, mod))
+            {
+                BOOST_CHECK_EQUAL(arcs.at(head + mod * size), 0.f);
+                BOOST_CHECK_EQUAL(gradient.at(head + mod * size), 0.f);
+            }
+        }
+        BOOST_CHECK_CLOSE(sum, 1.f, 1e-2f);
+    }
+}
+
+// the discrete modes decode the best tree of the pruned chart
+BOOST_AUTO_TEST_CASE(test_dynet_eisner_pruning_discrete_modes)
+{
+    const unsigned size = 10u;
+
+    int argc = 1;
+    char **argv;
+    dynet::initialize(argc, argv);
+
+    dynet::ParameterCollection pc;
+
+    std::vector<float> weights(size * size);
+    for (unsigned i = 0 ; i < weights.size() ; ++i)
+        weights.at(i) = std::sin((float) i);
+    auto p_weights = pc.add_parameters(dynet::Dim({size, size}), dynet::ParameterInitFromVector(weights));
+
+    diffdp::PruningSettings settings;
+    settings.top_k = 1u;
+    diffdp::ArcPruning pruning;
+    pruning.build(size, settings, [&] (unsigned head, unsigned mod) { return weights.at(head + mod * size); });
+
+    for (const auto mode : {diffdp::DiscreteMode::StraightThrough, diffdp::DiscreteMode::BackwardRegularized})
+    {
+        dynet::ComputationGraph cg;
+        auto e_weights = dynet::parameter(cg, p_weights);
+        auto e_arcs = dynet::algorithmic_differentiable_eisner(
+                e_weights,
+                mode,
+                diffdp::DependencyGraphMode::Adjacency,
+                diffdp::DependencyGraphMode::Adjacency,
+                true,
+                nullptr,
+                diffdp::SplitWeightsMode::Stored,
+                settings
+        );
+        auto e_loss = dynet::sum_elems(dynet::cmult(e_arcs, e_weights));
+        cg.forward(e_loss);
+        cg.backward(e_loss);
+
+        const auto arcs = dynet::as_vector(e_arcs.value());
+        const auto gradient = dynet::as_vector(p_weights.get_storage().g);
+        for (unsigned mod = 1u ; mod < size ; ++mod)
+        {
+            float n_heads = 0.f;
+            for (unsigned head = 0u ; head < size ; ++head)
+            {
+                if (head == mod)
+                    continue;
+
+                n_heads += arcs.at(head + mod * size);
+                BOOST_CHECK(std::isfinite(gradient.at(head + mod * size)));
+                if (!pruning.kept(head, mod))
+                {
+                    BOOST_CHECK_EQUAL(arcs.at(head + mod * size), 0.f);
+                    if (mode == diffdp::DiscreteMode::BackwardRegularized)
+                        BOOST_CHECK_EQUAL(gradient.at(head + mod * size), 0.f);
+                }
+            }
+            BOOST_CHECK_EQUAL(n_heads, 1.f);
+        }
+        pc.reset_gradient();
+    }
+}
+
+// the noise drawn by the node is the same as adding the noise to the input
+BOOST_AUTO_TEST_CASE(test_dynet_eisner_perturbation)
+{
+    const unsigned size = 10u;
+
+    int argc = 1;
+    char **argv;
+    dynet::initialize(argc, argv);
+
+    const diffdp::GumbelPerturbation perturbation(42u);
+    std::vector<float> weights(size * size), perturbed_weights(size * size);
+    for (unsigned i = 0 ; i < weights.size() ; ++i)
+    {
+        weights.at(i) = std::sin((float) i);
+        perturbed_weights.at(i) = weights.at(i) + perturbation(0u, i % size, i / size);
+    }
+
+    dynet::ComputationGraph cg;
+    auto e_weights = dynet::input(cg, dynet::Dim({size, size}), weights);
+    auto e_perturbed_weights = dynet::input(cg, dynet::Dim({size, size}), perturbed_weights);
+    auto e_arcs = dynet::entropy_regularized_eisner(
+            e_weights,
+            diffdp::DiscreteMode::ForwardRegularized,
+            diffdp::DependencyGraphMode::Adjacency,
+            diffdp::DependencyGraphMode::Adjacency,
+            true,
+            nullptr,
+            diffdp::SplitWeightsMode::Stored,
+            diffdp::PruningSettings(),
+            perturbation
+    );
+    auto e_expected_arcs = dynet::entropy_regularized_eisner(
+            e_perturbed_weights,
+            diffdp::DiscreteMode::ForwardRegularized,
+            diffdp::DependencyGraphMode::Adjacency,
+            diffdp::DependencyGraphMode::Adjacency
+    );
+
+    const auto arcs = dynet::as_vector(cg.forward(e_arcs));
+    const auto expected_arcs = dynet::as_vector(cg.forward(e_expected_arcs));
+    for (unsigned i = 0 ; i < arcs.size() ; ++i)
+        BOOST_CHECK_SMALL(arcs.at(i) - expected_arcs.at(i), 1e-5f);
+}
+
+// arcs between words longer than the vine are neither in the output nor in the gradient
+BOOST_AUTO_TEST_CASE(test_dynet_eisner_vine)
+{
+    const unsigned n_words = 12u;
+    const unsigned size = n_words + 1u;
+    const unsigned vine_length = 3u;
+
+    int argc = 1;
+    char **argv;
+    dynet::initialize(argc, argv);
+
+    dynet::ParameterCollection pc;
+
+    // compact input: the root arcs are on the main diagonal
+    std::vector<float> weights(n_words * n_words);
+    for (unsigned i = 0 ; i < weights.size() ; ++i)
+        weights.at(i) = std::sin((float) i);
+    auto p_weights = pc.add_parameters(dynet::Dim({n_words, n_words}), dynet::ParameterInitFromVector(weights));
+
+    dynet::ComputationGraph cg;
+    auto e_weights = dynet::parameter(cg, p_weights);
+    auto e_arcs = dynet::algorithmic_differentiable_eisner(
+            e_weights,
+            diffdp::DiscreteMode::ForwardRegularized,
+            diffdp::DependencyGraphMode::Compact,
+            diffdp::DependencyGraphMode::Adjacency,
+            true,
+            nullptr,
+            diffdp::SplitWeightsMode::Recomputed,
+            diffdp::PruningSettings(),
+            diffdp::GumbelPerturbation(),
+            vine_length
+    );
+    std::vector<float> output_weights(size * size);
+    for (unsigned i = 0 ; i < output_weights.size() ; ++i)
+        output_weights.at(i) = std::cos((float) i);
+    auto e_loss = dynet::sum_elems(dynet::cmult(e_arcs, dynet::input(cg, dynet::Dim({size, size}), output_weights)));
+    cg.forward(e_loss);
+    cg.backward(e_loss);
+
+    const auto arcs = dynet::as_vector(e_arcs.value());
+    const auto gradient = dynet::as_vector(p_weights.get_storage().g);
+    for (unsigned mod = 1u ; mod < size ; ++mod)
+    {
+        float sum = 0.f;
+        for (unsigned head = 0u ; head < size ; ++head)
+        {
+            if (head == mod)
+                continue;
+
+            sum += arcs.at(head + mod * size);
+            const unsigned input_head = (head == 0u ? mod : head) - 1u;
+            BOOST_CHECK(std::isfinite(gradient.at(input_head + (mod - 1u) * n_words)));
+            if (head > 0u && std::max(head, mod) - std::min(head, mod) > vine_length)
+            {
+                BOOST_CHECK_EQUAL(arcs.at(head + mod * size), 0.f);
+                BOOST_CHECK_EQUAL(gradient.at(input_head + (mod - 1u) * n_words), 0.f);
+            }
+        }
+        BOOST_CHECK_CLOSE(sum, 1.f, 1e-2f);
+    }
+}
+
+// the inside-outside node computes the entropy regularized relaxation with quadratic charts
+BOOST_AUTO_TEST_CASE(test_dynet_eisner_inside_outside)
+{
+    const unsigned size = 10u;
+
+    int argc = 1;
+    char **argv;
+    dynet::initialize(argc, argv);
+
+    dynet::ParameterCollection pc;
+
+    std::vector<float> weights(size * size);
+    for (unsigned i = 0 ; i < weights.size() ; ++i)
+        weights.at(i) = std::sin((float) i);
+    auto p_weights = pc.add_parameters(dynet::Dim({size, size}), dynet::ParameterInitFromVector(weights));
+
+    dynet::ComputationGraph cg;
+    auto e_weights = dynet::parameter(cg, p_weights);
+    auto e_arcs = dynet::inside_outside_eisner(
+            e_weights,
+            diffdp::DiscreteMode::ForwardRegularized,
+            diffdp::DependencyGraphMode::Adjacency,
+            diffdp::DependencyGraphMode::Adjacency
+    );
+    const auto arcs = dynet::as_vector(cg.forward(e_arcs));
+    const auto expected_arcs = dynet::as_vector(cg.forward(dynet::entropy_regularized_eisner(
+            e_weights,
+            diffdp::DiscreteMode::ForwardRegularized,
+            diffdp::DependencyGraphMode::Adjacency,
+            diffdp::DependencyGraphMode::Adjacency
+    )));
+    for (unsigned i = 0u ; i < size * size ; ++i)
+        BOOST_CHECK_SMALL(arcs.at(i) - expected_arcs.at(i), 1e-5f);
+
+    std::vector<float> output_weights(size * size);
+    for (unsigned i = 0 ; i < output_weights.size() ; ++i)
+        output_weights.at(i) = std::cos((float) i);
+    auto e_loss = dynet::sum_elems(dynet::cmult(e_arcs, dynet::input(cg, dynet::Dim({size, size}), output_weights)));
+    BOOST_CHECK(check_grad(pc, e_loss, 0));
+}
+
+BOOST_AUTO_TEST_CASE(test_dynet_eisner_divergences)
+{
+    const unsigned size = 6u;
+
+    int argc = 1;
+    char **argv;
+    dynet::initialize(argc, argv);
+
+    dynet::ParameterCollection pc;
+
+    std::vector<float> p_weights(size * size), q_weights(size * size);
+    for (unsigned i = 0 ; i < p_weights.size() ; ++i)
+    {
+        p_weights.at(i) = std::sin((float) i);
+        q_weights.at(i) = std::cos((float) i);
+    }
+    auto p_p_weights = pc.add_parameters(dynet::Dim({size, size}), dynet::ParameterInitFromVector(p_weights));
+    auto p_q_weights = pc.add_parameters(dynet::Dim({size, size}), dynet::ParameterInitFromVector(q_weights));
+
+    dynet::ComputationGraph cg;
+    cg.set_immediate_compute(true);
+    cg.set_check_validity(true);
+
+    auto e_p_weights = dynet::parameter(cg, p_p_weights);
+    auto e_q_weights = dynet::parameter(cg, p_q_weights);
+
+    auto e_entropy = dynet::eisner_entropy(e_p_weights, diffdp::DependencyGraphMode::Adjacency);
+    BOOST_CHECK(dynet::as_scalar(cg.forward(e_entropy)) > 0.f);
+    BOOST_CHECK(check_grad(pc, e_entropy, 0));
+
+    auto e_kl = dynet::eisner_kl_divergence(e_p_weights, e_q_weights, diffdp::DependencyGraphMode::Adjacency);
+    BOOST_CHECK(dynet::as_scalar(cg.forward(e_kl)) > 0.f);
+    BOOST_CHECK(check_grad(pc, e_kl, 0));
+
+    // the divergence of a distribution with itself is null
+    auto e_self_kl = dynet::eisner_kl_divergence(e_p_weights, e_p_weights, diffdp::DependencyGraphMode::Adjacency);
+    BOOST_CHECK_SMALL(dynet::as_scalar(cg.forward(e_self_kl)), 1e-5f);
+}
+
+BOOST_AUTO_TEST_CASE(test_dynet_eisner_labeled)
+{
+    const unsigned size = 6u;
+    const unsigned n_labels = 3u;
+
+    int argc = 1;
+    char **argv;
+    dynet::initialize(argc, argv);
+
+    dynet::ParameterCollection pc;
+
+    std::vector<float> weights(size * size * n_labels);
+    for (unsigned i = 0 ; i < weights.size() ; ++i)
+        weights.at(i) = std::sin((float) i);
+    auto p_weights = pc.add_parameters(dynet::Dim({size, size, n_labels}), dynet::ParameterInitFromVector(weights));
+
+    dynet::ComputationGraph cg;
+    cg.set_immediate_compute(true);
+    cg.set_check_validity(true);
+
+    auto e_weights = dynet::parameter(cg, p_weights);
+    auto e_labeled_arcs = dynet::labeled_entropy_regularized_eisner(
+            e_weights,
+            diffdp::DependencyGraphMode::Adjacency,
+            diffdp::DependencyGraphMode::Adjacency
+    );
+    BOOST_CHECK(check_grad(pc, dynet::sum_elems(dynet::cmult(e_labeled_arcs, e_weights)), 0));
+
+    // labels are marginalized with a log-sum-exp: the sum over labels is the unlabeled relaxation
+    auto e_arcs = dynet::entropy_regularized_eisner(
+            dynet::logsumexp_dim(e_weights, 2u),
+            diffdp::DiscreteMode::ForwardRegularized,
+            diffdp::DependencyGraphMode::Adjacency,
+            diffdp::DependencyGraphMode::Adjacency
+    );
+    const auto arcs = dynet::as_vector(cg.forward(e_arcs));
+    const auto summed_arcs = dynet::as_vector(cg.forward(dynet::sum_dim(e_labeled_arcs, {2u})));
+    for (unsigned i = 0 ; i < arcs.size() ; ++i)
+        BOOST_CHECK_SMALL(arcs.at(i) - summed_arcs.at(i), 1e-5f);
+}
+
+// arcs whose labels are all masked have an output and a gradient of zero,
+// including an arc between adjacent words (its items have a single split) and a root arc
+BOOST_AUTO_TEST_CASE(test_dynet_eisner_labeled_masked)
+{
+    const unsigned size = 6u;
+    const unsigned n_labels = 3u;
+    const std::vector<std::pair<unsigned, unsigned>> masked_arcs = {{2u, 4u}, {2u, 3u}, {0u, 5u}};
+
+    int argc = 1;
+    char **argv;
+    dynet::initialize(argc, argv);
+
+    dynet::ParameterCollection pc;
+
+    std::vector<float> weights(size * size * n_labels);
+    for (unsigned i = 0 ; i < weights.size() ; ++i)
+        weights.at(i) = std::sin((float) i);
+    auto p_weights = pc.add_parameters(dynet::Dim({size, size, n_labels}), dynet::ParameterInitFromVector(weights));
+
+    std::vector<float> mask(size * size * n_labels, 0.f);
+    for (const auto& arc : masked_arcs)
+        for (unsigned label = 0u ; label < n_labels ; ++label)
+            mask.at(arc.first + arc.second * size + label * size * size) = -std::numeric_limits<float>::infinity();
+    std::vector<float> output_weights(size * size * n_labels);
+    for (unsigned i = 0 ; i < output_weights.size() ; ++i)
+        output_weights.at(i) = std::cos((float) i);
+
+    dynet::ComputationGraph cg;
+    auto e_weights = dynet::parameter(cg, p_weights) + dynet::input(cg, dynet::Dim({size, size, n_labels}), mask);
+    auto e_labeled_arcs = dynet::labeled_entropy_regularized_eisner(
+            e_weights,
+            diffdp::DependencyGraphMode::Adjacency,
+            diffdp::DependencyGraphMode::Adjacency
+    );
+
+    const auto labeled_arcs = dynet::as_vector(cg.forward(e_labeled_arcs));
+    for (unsigned i = 0 ; i < labeled_arcs.size() ; ++i)
+        BOOST_CHECK(std::isfinite(labeled_arcs.at(i)));
+    for (const auto& arc : masked_arcs)
+        for (unsigned label = 0u ; label < n_labels ; ++label)
+            BOOST_CHECK_EQUAL(labeled_arcs.at(arc.first + arc.second * size + label * size * size), 0.f);
+
+    auto e_loss = dynet::sum_elems(dynet::cmult(e_labeled_arcs, dynet::input(cg, dynet::Dim({size, size, n_labels}), output_weights)));
+    BOOST_CHECK(check_grad(pc, e_loss, 0));
+    pc.reset_gradient();
+    cg.backward(e_loss);
+    const auto gradient = dynet::as_vector(p_weights.get_storage().g);
+    for (unsigned i = 0 ; i < gradient.size() ; ++i)
+        BOOST_CHECK(std::isfinite(gradient.at(i)));
+    for (const auto& arc : masked_arcs)
+        for (unsigned label = 0u ; label < n_labels ; ++label)
+            BOOST_CHECK_EQUAL(gradient.at(arc.first + arc.second * size + label * size * size), 0.f);
+}
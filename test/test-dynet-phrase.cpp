@@ -7,6 +7,7 @@
 #include <boost/test/unit_test.hpp>
 namespace utf = boost::unit_test;
 
+#include <cmath>
 #include <vector>
 
 #include "dynet/expr.h"
@@ -76,4 +77,44 @@ BOOST_AUTO_TEST_CASE(test_dynet_phrase)
                         }
                     }
                 }
-        }
\ No newline at end of file
+        }
+
+// spans longer than the bound are only built on the right spine
+BOOST_AUTO_TEST_CASE(test_dynet_phrase_bounded)
+{
+    const unsigned size = 12u;
+    const unsigned max_span_length = 3u;
+
+    int argc = 1;
+    char **argv;
+    dynet::initialize(argc, argv);
+
+    dynet::ParameterCollection pc;
+
+    std::vector<float> weights(size * size);
+    for (unsigned i = 0 ; i < weights.size() ; ++i)
+        weights.at(i) = std::sin((float) i);
+    auto p_weights = pc.add_parameters(dynet::Dim({size, size}), dynet::ParameterInitFromVector(weights));
+
+    std::vector<float> output_weights(size * size);
+    for (unsigned i = 0 ; i < output_weights.size() ; ++i)
+        output_weights.at(i) = std::cos((float) i);
+
+    dynet::ComputationGraph cg;
+    auto e_weights = dynet::parameter(cg, p_weights);
+    auto e_spans = dynet::entropy_regularized_binary_phrase_structure(
+            e_weights,
+            diffdp::DiscreteMode::ForwardRegularized,
+            nullptr,
+            diffdp::SplitWeightsMode::Recomputed,
+            diffdp::GumbelPerturbation(),
+            max_span_length
+    );
+    auto e_loss = dynet::sum_elems(dynet::cmult(e_spans, dynet::input(cg, dynet::Dim({size, size}), output_weights)));
+    BOOST_CHECK(check_grad(pc, e_loss, 0));
+
+    const auto spans = dynet::as_vector(cg.forward(e_spans));
+    for (unsigned left = 0u ; left < size ; ++left)
+        for (unsigned right = left + max_span_length + 1u ; right < size - 1u ; ++right)
+            BOOST_CHECK_EQUAL(spans.at(left + right * size), 0.f);
+}
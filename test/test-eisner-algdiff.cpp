@@ -97,4 +97,80 @@ BOOST_AUTO_TEST_CASE(gradient)
             }
         }
     }
-}
\ No newline at end of file
+}
+
+
+// dropping the split weights must not change the result
+template<class Parser>
+void check_recomputed_split_weights()
+{
+    const unsigned size = 10;
+    std::vector<float> weights(size * size), gradients(size * size);
+    for (unsigned i = 0 ; i < size * size ; ++i)
+    {
+        weights[i] = std::sin(1.7f * i);
+        gradients[i] = std::cos(0.3f * i);
+    }
+
+    Parser stored(size);
+    Parser recomputed(size, diffdp::SplitWeightsMode::Recomputed);
+    for (Parser* parser : {&stored, &recomputed})
+    {
+        parser->forward([&] (const unsigned head, const unsigned mod) { return weights.at(head + mod * size); });
+        parser->backward([&] (const unsigned head, const unsigned mod) { return gradients.at(head + mod * size); });
+    }
+
+    for (unsigned head = 0 ; head < size ; ++head)
+    {
+        for (unsigned mod = 1 ; mod < size ; ++mod)
+        {
+            if (head == mod)
+                continue;
+            BOOST_CHECK_EQUAL(stored.output(head, mod), recomputed.output(head, mod));
+            BOOST_CHECK(check_grad(stored.gradient(head, mod), recomputed.gradient(head, mod)));
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(recomputed_split_weights)
+{
+    check_recomputed_split_weights<diffdp::AlgorithmicDifferentiableEisner>();
+    check_recomputed_split_weights<diffdp::EntropyRegularizedEisner>();
+}
+
+// with peaked weights, skipping the items with a negligible contribution must not change the result
+BOOST_AUTO_TEST_CASE(backtracking_threshold)
+{
+    const unsigned size = 15;
+    std::vector<float> weights(size * size), gradients(size * size);
+    for (unsigned i = 0 ; i < size * size ; ++i)
+    {
+        weights[i] = 10.f * std::sin(1.7f * i);
+        gradients[i] = std::cos(0.3f * i);
+    }
+
+    diffdp::AlgorithmicDifferentiableEisner exact(size);
+    diffdp::AlgorithmicDifferentiableEisner thresholded(size);
+    thresholded.backtracking_threshold = 1e-6f;
+    for (diffdp::AlgorithmicDifferentiableEisner* parser : {&exact, &thresholded})
+    {
+        parser->forward([&] (const unsigned head, const unsigned mod) { return weights.at(head + mod * size); });
+        parser->backward([&] (const unsigned head, const unsigned mod) { return gradients.at(head + mod * size); });
+    }
+
+    BOOST_CHECK_EQUAL(exact.dropped_mass, 0.f);
+    BOOST_CHECK(thresholded.dropped_mass > 0.f);
+    BOOST_CHECK(thresholded.dropped_mass < 1e-3f);
+
+    for (unsigned head = 0 ; head < size ; ++head)
+    {
+        for (unsigned mod = 1 ; mod < size ; ++mod)
+        {
+            if (head == mod)
+                continue;
+            // the contribution of an item is at least the one of each arc it would have reached
+            BOOST_CHECK_SMALL(exact.output(head, mod) - thresholded.output(head, mod), thresholded.dropped_mass + 1e-6f);
+            BOOST_CHECK_SMALL(exact.gradient(head, mod) - thresholded.gradient(head, mod), 1e-3f);
+        }
+    }
+}
@@ -0,0 +1,234 @@
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE "EisnerEntropy"
+
+#include <boost/test/unit_test.hpp>
+namespace utf = boost::unit_test;
+
+#include <vector>
+#include <random>
+#include <cmath>
+#include <limits>
+#include <utility>
+
+#include "diffdp/algorithm/eisner.h"
+
+const unsigned size = 5u;
+
+bool is_projective_tree(const std::vector<unsigned>& heads)
+{
+    // the root is reached from every word (no cycle)
+    for (unsigned mod = 1u ; mod < size ; ++mod)
+    {
+        unsigned ancestor = mod;
+        for (unsigned n_steps = 0u ; ancestor != 0u && n_steps < size ; ++n_steps)
+            ancestor = heads.at(ancestor);
+        if (ancestor != 0u)
+            return false;
+    }
+
+    for (unsigned mod = 1u ; mod < size ; ++mod)
+    {
+        // every word between the head and the modifier is dominated by the head
+        const unsigned head = heads.at(mod);
+        for (unsigned k = std::min(head, mod) + 1u ; k < std::max(head, mod) ; ++k)
+        {
+            unsigned ancestor = k;
+            while (ancestor != 0u && ancestor != head)
+                ancestor = heads.at(ancestor);
+            if (ancestor != head)
+                return false;
+        }
+    }
+    return true;
+}
+
+// scores of all projective trees, by enumeration of the head vectors
+std::vector<double> tree_scores(const std::vector<float>& weights, std::vector<std::vector<unsigned>>& trees)
+{
+    trees.clear();
+    std::vector<double> scores;
+    std::vector<unsigned> heads(size, 0u);
+    while (true)
+    {
+        if (is_projective_tree(heads))
+        {
+            double score = 0.;
+            for (unsigned mod = 1u ; mod < size ; ++mod)
+                score += weights.at(heads.at(mod) + mod * size);
+            scores.push_back(score);
+            trees.push_back(heads);
+        }
+
+        unsigned mod = 1u;
+        while (mod < size && ++heads.at(mod) == size)
+            heads.at(mod++) = 0u;
+        if (mod == size)
+            break;
+    }
+    return scores;
+}
+
+double log_sum_exp(const std::vector<double>& scores)
+{
+    double m = -std::numeric_limits<double>::infinity();
+    for (double s : scores)
+        m = std::max(m, s);
+    double z = 0.;
+    for (double s : scores)
+        z += std::exp(s - m);
+    return m + std::log(z);
+}
+
+std::vector<float> random_weights(std::default_random_engine& generator)
+{
+    std::uniform_real_distribution<float> distribution(-2.f, 2.f);
+    std::vector<float> weights(size * size);
+    for (auto& w : weights)
+        w = distribution(generator);
+    return weights;
+}
+
+BOOST_AUTO_TEST_CASE(entropy)
+{
+    std::default_random_engine generator;
+    const auto weights = random_weights(generator);
+    const auto weight = [&] (unsigned head, unsigned mod) { return weights.at(head + mod * size); };
+
+    std::vector<std::vector<unsigned>> trees;
+    const auto scores = tree_scores(weights, trees);
+    const double log_z = log_sum_exp(scores);
+    double expected_entropy = 0.;
+    for (double s : scores)
+        expected_entropy -= std::exp(s - log_z) * (s - log_z);
+
+    diffdp::EntropyRegularizedEisner parser(size);
+    parser.forward(weight);
+    BOOST_CHECK_SMALL(parser.log_partition() - (float) log_z, 1e-4f);
+    BOOST_CHECK_SMALL(parser.entropy(weight) - (float) expected_entropy, 1e-4f);
+
+    // dH/dw = -backward(w), compared with finite differences
+    parser.backward(weight);
+    const float eps = 1e-2f;
+    for (unsigned head = 0u ; head < size ; ++head)
+    {
+        for (unsigned mod = 1u ; mod < size ; ++mod)
+        {
+            if (head == mod)
+                continue;
+
+            auto perturbed_weights = weights;
+            perturbed_weights.at(head + mod * size) += eps;
+            const auto perturbed_weight = [&] (unsigned h, unsigned m) { return perturbed_weights.at(h + m * size); };
+            diffdp::EntropyRegularizedEisner perturbed_parser(size);
+            perturbed_parser.forward(perturbed_weight);
+            const float finite_difference = (perturbed_parser.entropy(perturbed_weight) - parser.entropy(weight)) / eps;
+
+            BOOST_CHECK_SMALL(-parser.gradient(head, mod) - finite_difference, 2e-2f);
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(kl_divergence)
+{
+    std::default_random_engine generator;
+    const auto p_weights = random_weights(generator);
+    const auto q_weights = random_weights(generator);
+
+    std::vector<std::vector<unsigned>> trees;
+    const auto p_scores = tree_scores(p_weights, trees);
+    const auto q_scores = tree_scores(q_weights, trees);
+    const double p_log_z = log_sum_exp(p_scores);
+    const double q_log_z = log_sum_exp(q_scores);
+    double expected_kl = 0.;
+    for (unsigned t = 0u ; t < p_scores.size() ; ++t)
+        expected_kl += std::exp(p_scores.at(t) - p_log_z) * ((p_scores.at(t) - p_log_z) - (q_scores.at(t) - q_log_z));
+
+    diffdp::EntropyRegularizedEisner p(size), q(size);
+    p.forward([&] (unsigned head, unsigned mod) { return p_weights.at(head + mod * size); });
+    q.forward([&] (unsigned head, unsigned mod) { return q_weights.at(head + mod * size); });
+
+    const float kl =
+            p.expected_score([&] (unsigned head, unsigned mod) { return p_weights.at(head + mod * size) - q_weights.at(head + mod * size); })
+            - p.log_partition() + q.log_partition();
+    BOOST_CHECK_SMALL(kl - (float) expected_kl, 1e-4f);
+    BOOST_CHECK(kl >= 0.f);
+
+    // dKL/dw = backward(w - v) and dKL/dv = q(a) - p(a), compared with finite differences
+    const auto kl_divergence = [&] (const std::vector<float>& w, const std::vector<float>& v)
+    {
+        diffdp::EntropyRegularizedEisner p(size), q(size);
+        p.forward([&] (unsigned head, unsigned mod) { return w.at(head + mod * size); });
+        q.forward([&] (unsigned head, unsigned mod) { return v.at(head + mod * size); });
+        return p.expected_score([&] (unsigned head, unsigned mod) { return w.at(head + mod * size) - v.at(head + mod * size); })
+                - p.log_partition() + q.log_partition();
+    };
+    p.backward([&] (unsigned head, unsigned mod) { return p_weights.at(head + mod * size) - q_weights.at(head + mod * size); });
+    const float eps = 1e-2f;
+    for (unsigned head = 0u ; head < size ; ++head)
+    {
+        for (unsigned mod = 1u ; mod < size ; ++mod)
+        {
+            if (head == mod)
+                continue;
+
+            auto perturbed_p_weights = p_weights;
+            perturbed_p_weights.at(head + mod * size) += eps;
+            BOOST_CHECK_SMALL(p.gradient(head, mod) - (kl_divergence(perturbed_p_weights, q_weights) - kl) / eps, 2e-2f);
+
+            auto perturbed_q_weights = q_weights;
+            perturbed_q_weights.at(head + mod * size) += eps;
+            BOOST_CHECK_SMALL(q.output(head, mod) - p.output(head, mod) - (kl_divergence(p_weights, perturbed_q_weights) - kl) / eps, 2e-2f);
+        }
+    }
+}
+
+// masked arcs (-inf weight) have a null marginal: they do not contribute to the entropy and their gradient is null
+BOOST_AUTO_TEST_CASE(masked_entropy)
+{
+    std::default_random_engine generator;
+    auto weights = random_weights(generator);
+    // an arc between adjacent words, another arc and a root arc
+    for (const auto& arc : std::vector<std::pair<unsigned, unsigned>>{{2u, 3u}, {2u, 4u}, {0u, 1u}})
+        weights.at(arc.first + arc.second * size) = -std::numeric_limits<float>::infinity();
+    const auto weight = [&] (unsigned head, unsigned mod) { return weights.at(head + mod * size); };
+
+    std::vector<std::vector<unsigned>> trees;
+    const auto scores = tree_scores(weights, trees);
+    const double log_z = log_sum_exp(scores);
+    double expected_entropy = 0.;
+    for (double s : scores)
+        if (std::isfinite(s))
+            expected_entropy -= std::exp(s - log_z) * (s - log_z);
+
+    diffdp::EntropyRegularizedEisner parser(size);
+    parser.forward(weight);
+    BOOST_CHECK_SMALL(parser.entropy(weight) - (float) expected_entropy, 1e-4f);
+
+    // the gradient callback skips the arcs with a null marginal, as the dynet node
+    parser.backward([&] (unsigned head, unsigned mod) { return parser.output(head, mod) > 0.f ? weight(head, mod) : 0.f; });
+    const float eps = 1e-2f;
+    for (unsigned head = 0u ; head < size ; ++head)
+    {
+        for (unsigned mod = 1u ; mod < size ; ++mod)
+        {
+            if (head == mod)
+                continue;
+            BOOST_CHECK(std::isfinite(parser.gradient(head, mod)));
+            if (!std::isfinite(weight(head, mod)))
+            {
+                BOOST_CHECK_EQUAL(parser.output(head, mod), 0.f);
+                BOOST_CHECK_EQUAL(parser.gradient(head, mod), 0.f);
+                continue;
+            }
+
+            auto perturbed_weights = weights;
+            perturbed_weights.at(head + mod * size) += eps;
+            const auto perturbed_weight = [&] (unsigned h, unsigned m) { return perturbed_weights.at(h + m * size); };
+            diffdp::EntropyRegularizedEisner perturbed_parser(size);
+            perturbed_parser.forward(perturbed_weight);
+            const float finite_difference = (perturbed_parser.entropy(perturbed_weight) - parser.entropy(weight)) / eps;
+
+            BOOST_CHECK_SMALL(-parser.gradient(head, mod) - finite_difference, 2e-2f);
+        }
+    }
+}
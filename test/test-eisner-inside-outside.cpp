@@ -0,0 +1,95 @@
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE "InsideOutsideEisner"
+
+#include <boost/test/unit_test.hpp>
+namespace utf = boost::unit_test;
+
+#include <vector>
+#include <cmath>
+
+#include "diffdp/algorithm/eisner.h"
+
+// using boost test with intolerance fails (too precise),
+// so let's just use the same test as in Dynet.
+bool check_grad(float g, float g_act)
+{
+    float f = std::fabs(g - g_act);
+    float m = std::max(std::fabs(g), std::fabs(g_act));
+    if (f > 0.01 && m > 0.f)
+        f /= m;
+
+    if (f > 0.01 || std::isnan(f))
+        return false;
+    else
+        return true;
+}
+
+// the inside-outside algorithm computes the same relaxation as the entropy regularized parser
+BOOST_AUTO_TEST_CASE(same_as_entropy_regularized)
+{
+    const unsigned size = 12;
+    std::vector<float> weights(size * size), gradients(size * size);
+    for (unsigned i = 0 ; i < size * size ; ++i)
+    {
+        weights[i] = 3.f * std::sin(1.7f * i);
+        gradients[i] = std::cos(0.3f * i);
+    }
+
+    diffdp::EntropyRegularizedEisner entropy_reg(size);
+    diffdp::InsideOutsideEisner inside_outside(size);
+
+    entropy_reg.forward([&] (const unsigned head, const unsigned mod) { return weights.at(head + mod * size); });
+    entropy_reg.backward([&] (const unsigned head, const unsigned mod) { return gradients.at(head + mod * size); });
+    inside_outside.forward([&] (const unsigned head, const unsigned mod) { return weights.at(head + mod * size); });
+    inside_outside.backward([&] (const unsigned head, const unsigned mod) { return gradients.at(head + mod * size); });
+
+    BOOST_CHECK_CLOSE(entropy_reg.chart_forward->c_cright(0, size - 1), inside_outside.log_partition(), 1e-3f);
+    for (unsigned head = 0 ; head < size ; ++head)
+    {
+        for (unsigned mod = 1 ; mod < size ; ++mod)
+        {
+            if (head == mod)
+                continue;
+            BOOST_CHECK_SMALL(entropy_reg.output(head, mod) - inside_outside.output(head, mod), 1e-5f);
+            BOOST_CHECK(check_grad(entropy_reg.gradient(head, mod), inside_outside.gradient(head, mod)));
+        }
+    }
+}
+
+// the marginals are the gradient of the log-partition
+BOOST_AUTO_TEST_CASE(marginals)
+{
+    const unsigned size = 8;
+    const float sensitivity = 1e-2;
+    std::vector<float> weights(size * size);
+    for (unsigned i = 0 ; i < size * size ; ++i)
+        weights[i] = std::sin(1.3f * i);
+
+    diffdp::InsideOutsideEisner inside_outside(size);
+    const auto log_partition = [&] () -> double
+    {
+        inside_outside.forward([&] (const unsigned head, const unsigned mod) { return weights.at(head + mod * size); });
+        return inside_outside.log_partition();
+    };
+
+    for (unsigned head = 0 ; head < size ; ++head)
+    {
+        for (unsigned mod = 1 ; mod < size ; ++mod)
+        {
+            if (head == mod)
+                continue;
+
+            log_partition();
+            const float marginal = inside_outside.output(head, mod);
+
+            const float original_weight = weights.at(head + mod * size);
+            weights.at(head + mod * size) = original_weight + sensitivity;
+            const double output_a = log_partition();
+            weights.at(head + mod * size) = original_weight - sensitivity;
+            const double output_b = log_partition();
+            weights.at(head + mod * size) = original_weight;
+
+            BOOST_CHECK(check_grad(marginal, (output_a - output_b) / (2.f * sensitivity)));
+        }
+    }
+}
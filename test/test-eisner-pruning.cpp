@@ -0,0 +1,101 @@
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE "EisnerPruning"
+
+#include <boost/test/unit_test.hpp>
+namespace utf = boost::unit_test;
+
+#include <vector>
+#include <random>
+#include <cmath>
+
+#include "diffdp/algorithm/eisner.h"
+#include "diffdp/algorithm/pruning.h"
+
+// a pruned parser must give the same result as a parser where the weights of pruned arcs are very low,
+// and exactly zero for pruned arcs
+template<class Parser>
+void check_pruning(const diffdp::PruningSettings& settings)
+{
+    const unsigned size = 15u;
+    std::default_random_engine generator;
+    std::uniform_real_distribution<float> distribution(-5.f, 5.f);
+    std::vector<float> weights(size * size), gradients(size * size);
+    for (unsigned i = 0u ; i < size * size ; ++i)
+    {
+        weights[i] = distribution(generator);
+        gradients[i] = distribution(generator);
+    }
+
+    diffdp::ArcPruning pruning;
+    pruning.build(size, settings, [&] (unsigned head, unsigned mod) { return weights.at(head + mod * size); });
+
+    Parser parser(size), pruned_parser(size);
+    pruned_parser.pruning = &pruning;
+
+    parser.forward([&] (unsigned head, unsigned mod) { return pruning.kept(head, mod) ? weights.at(head + mod * size) : -1000.f; });
+    pruned_parser.forward([&] (unsigned head, unsigned mod) { return weights.at(head + mod * size); });
+    for (Parser* p : {&parser, &pruned_parser})
+        p->backward([&] (unsigned head, unsigned mod) { return gradients.at(head + mod * size); });
+
+    unsigned n_pruned = 0u;
+    for (unsigned head = 0u ; head < size ; ++head)
+    {
+        for (unsigned mod = 1u ; mod < size ; ++mod)
+        {
+            if (head == mod)
+                continue;
+
+            if (pruning.kept(head, mod))
+            {
+                BOOST_CHECK_SMALL(parser.output(head, mod) - pruned_parser.output(head, mod), 1e-4f);
+                BOOST_CHECK_SMALL(parser.gradient(head, mod) - pruned_parser.gradient(head, mod), 1e-3f);
+            }
+            else
+            {
+                ++n_pruned;
+                BOOST_CHECK_EQUAL(pruned_parser.output(head, mod), 0.f);
+                BOOST_CHECK_EQUAL(pruned_parser.gradient(head, mod), 0.f);
+            }
+        }
+    }
+    BOOST_CHECK(n_pruned > 0u);
+}
+
+BOOST_AUTO_TEST_CASE(top_k)
+{
+    diffdp::PruningSettings settings;
+    settings.top_k = 3u;
+    check_pruning<diffdp::AlgorithmicDifferentiableEisner>(settings);
+    check_pruning<diffdp::EntropyRegularizedEisner>(settings);
+}
+
+BOOST_AUTO_TEST_CASE(margin)
+{
+    diffdp::PruningSettings settings;
+    settings.margin = 2.f;
+    check_pruning<diffdp::AlgorithmicDifferentiableEisner>(settings);
+    check_pruning<diffdp::EntropyRegularizedEisner>(settings);
+}
+
+BOOST_AUTO_TEST_CASE(kept_arcs)
+{
+    const unsigned size = 10u;
+    diffdp::PruningSettings settings;
+    settings.top_k = 1u;
+
+    // the best head of each word is the last word, except for itself
+    diffdp::ArcPruning pruning;
+    pruning.build(size, settings, [&] (unsigned head, unsigned) { return (float) head; });
+
+    for (unsigned mod = 1u ; mod < size ; ++mod)
+    {
+        for (unsigned head = 0u ; head < size ; ++head)
+        {
+            if (head == mod)
+                continue;
+            const bool best = (head == (mod == size - 1u ? size - 2u : size - 1u));
+            const bool adjacent = (head + 1u == mod || mod + 1u == head);
+            BOOST_CHECK_EQUAL(pruning.kept(head, mod), best || adjacent);
+        }
+    }
+}
@@ -0,0 +1,130 @@
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE "EisnerSampling"
+
+#include <boost/test/unit_test.hpp>
+namespace utf = boost::unit_test;
+
+#include <vector>
+#include <random>
+#include <cmath>
+
+#include "diffdp/algorithm/eisner.h"
+#include "diffdp/algorithm/pruning.h"
+
+// each word has a single head, the root has none, and no arc crosses another one
+bool is_projective_tree(const std::vector<unsigned>& heads)
+{
+    const unsigned size = heads.size();
+    if (heads.at(0u) != 0u)
+        return false;
+    for (unsigned mod = 1u ; mod < size ; ++mod)
+    {
+        const unsigned head = heads.at(mod);
+        if (head >= size || head == mod)
+            return false;
+        // every word between the head and the modifier is dominated by the head
+        for (unsigned k = std::min(head, mod) + 1u ; k < std::max(head, mod) ; ++k)
+        {
+            unsigned ancestor = k;
+            while (ancestor != 0u && ancestor != head)
+                ancestor = heads.at(ancestor);
+            if (ancestor != head)
+                return false;
+        }
+    }
+    return true;
+}
+
+// the output of the entropy regularized relaxation is the marginal distribution of arcs,
+// the frequencies of the arcs in the samples must converge to it
+void check_sampling(diffdp::SplitWeightsMode mode)
+{
+    const unsigned size = 7u;
+    const unsigned n_samples = 20000u;
+    std::default_random_engine generator;
+    std::uniform_real_distribution<float> distribution(-2.f, 2.f);
+    std::vector<float> weights(size * size);
+    for (unsigned i = 0u ; i < size * size ; ++i)
+        weights[i] = distribution(generator);
+
+    diffdp::EntropyRegularizedEisner parser(size, mode);
+    parser.forward([&] (unsigned head, unsigned mod) { return weights.at(head + mod * size); });
+
+    std::vector<float> frequencies(size * size, 0.f);
+    for (const auto& heads : parser.sample(generator, n_samples))
+    {
+        BOOST_REQUIRE(is_projective_tree(heads));
+        for (unsigned mod = 1u ; mod < size ; ++mod)
+            frequencies.at(heads.at(mod) + mod * size) += 1.f / n_samples;
+    }
+
+    for (unsigned head = 0u ; head < size ; ++head)
+        for (unsigned mod = 1u ; mod < size ; ++mod)
+            if (head != mod)
+                BOOST_CHECK_SMALL(frequencies.at(head + mod * size) - parser.output(head, mod), 2e-2f);
+}
+
+BOOST_AUTO_TEST_CASE(sampling)
+{
+    check_sampling(diffdp::SplitWeightsMode::Stored);
+    check_sampling(diffdp::SplitWeightsMode::Recomputed);
+}
+
+BOOST_AUTO_TEST_CASE(sampling_adjacency)
+{
+    const unsigned size = 9u;
+    const unsigned n_samples = 5u;
+    std::default_random_engine generator;
+    std::uniform_real_distribution<float> distribution(-2.f, 2.f);
+
+    diffdp::EntropyRegularizedEisner parser(size);
+    parser.forward([&] (unsigned, unsigned) { return distribution(generator); });
+
+    std::vector<float> adjacency(n_samples * size * size, -1.f);
+    parser.sample_adjacency(generator, n_samples, adjacency.data());
+    for (unsigned s = 0u ; s < n_samples ; ++s)
+    {
+        std::vector<unsigned> heads(size, 0u);
+        for (unsigned mod = 0u ; mod < size ; ++mod)
+        {
+            float n_heads = 0.f;
+            for (unsigned head = 0u ; head < size ; ++head)
+            {
+                const float v = adjacency.at(s * size * size + head + mod * size);
+                BOOST_CHECK(v == 0.f || v == 1.f);
+                n_heads += v;
+                if (v == 1.f)
+                    heads.at(mod) = head;
+            }
+            BOOST_CHECK_EQUAL(n_heads, mod == 0u ? 0.f : 1.f);
+        }
+        BOOST_CHECK(is_projective_tree(heads));
+    }
+}
+
+// pruned arcs have a null probability, so they are never sampled
+BOOST_AUTO_TEST_CASE(sampling_pruning)
+{
+    const unsigned size = 15u;
+    std::default_random_engine generator;
+    std::uniform_real_distribution<float> distribution(-5.f, 5.f);
+    std::vector<float> weights(size * size);
+    for (unsigned i = 0u ; i < size * size ; ++i)
+        weights[i] = distribution(generator);
+
+    diffdp::PruningSettings settings;
+    settings.top_k = 2u;
+    diffdp::ArcPruning pruning;
+    pruning.build(size, settings, [&] (unsigned head, unsigned mod) { return weights.at(head + mod * size); });
+
+    diffdp::EntropyRegularizedEisner parser(size);
+    parser.pruning = &pruning;
+    parser.forward([&] (unsigned head, unsigned mod) { return weights.at(head + mod * size); });
+
+    for (const auto& heads : parser.sample(generator, 1000u))
+    {
+        BOOST_REQUIRE(is_projective_tree(heads));
+        for (unsigned mod = 1u ; mod < size ; ++mod)
+            BOOST_CHECK(pruning.kept(heads.at(mod), mod));
+    }
+}
@@ -0,0 +1,146 @@
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE "SparsemaxEisner"
+
+#include <boost/test/unit_test.hpp>
+namespace utf = boost::unit_test;
+
+#include <vector>
+#include <random>
+#include <cmath>
+
+#include "diffdp/algorithm/eisner.h"
+
+// using boost test with intolerance fails (too precise),
+// so let's just use the same test as in Dynet.
+bool check_grad(float g, float g_act)
+{
+    float f = std::fabs(g - g_act);
+    float m = std::max(std::fabs(g), std::fabs(g_act));
+    if (f > 0.01 && m > 0.f)
+        f /= m;
+
+    if (f > 0.01 || std::isnan(f))
+        return false;
+    else
+        return true;
+}
+
+// the relaxation is piecewise linear:
+// the gradient of a random projection of the output is compared to finite differences
+BOOST_AUTO_TEST_CASE(gradient)
+{
+    const unsigned size = 8;
+    const float sensitivity = 1e-3;
+
+    std::default_random_engine generator;
+    std::uniform_real_distribution<float> distribution(-1.f, 1.f);
+    std::vector<float> weights(size * size), gradients(size * size);
+    for (unsigned i = 0 ; i < size * size ; ++i)
+    {
+        weights[i] = distribution(generator);
+        gradients[i] = distribution(generator);
+    }
+
+    diffdp::SparsemaxEisner sparsemax_eisner(size);
+    const auto projection = [&] () -> double
+    {
+        sparsemax_eisner.forward([&] (const unsigned head, const unsigned mod) { return weights.at(head + mod * size); });
+        double ret = 0.;
+        for (unsigned head = 0 ; head < size ; ++head)
+            for (unsigned mod = 1 ; mod < size ; ++mod)
+                if (head != mod)
+                    ret += gradients.at(head + mod * size) * sparsemax_eisner.output(head, mod);
+        return ret;
+    };
+
+    projection();
+    sparsemax_eisner.backward([&] (const unsigned head, const unsigned mod) { return gradients.at(head + mod * size); });
+    std::vector<float> computed_gradients(size * size);
+    for (unsigned head = 0 ; head < size ; ++head)
+        for (unsigned mod = 1 ; mod < size ; ++mod)
+            if (head != mod)
+                computed_gradients.at(head + mod * size) = sparsemax_eisner.gradient(head, mod);
+
+    for (unsigned head = 0 ; head < size ; ++head)
+    {
+        for (unsigned mod = 1 ; mod < size ; ++mod)
+        {
+            if (head == mod)
+                continue;
+
+            const float original_weight = weights.at(head + mod * size);
+            weights.at(head + mod * size) = original_weight + sensitivity;
+            const double output_a = projection();
+            weights.at(head + mod * size) = original_weight - sensitivity;
+            const double output_b = projection();
+            weights.at(head + mod * size) = original_weight;
+
+            const double estimated_gradient = (output_a - output_b) / (2.f * sensitivity);
+            BOOST_CHECK(check_grad(computed_gradients.at(head + mod * size), estimated_gradient));
+        }
+    }
+}
+
+// with spread weights, most arcs are exactly zero but each word still has one head
+BOOST_AUTO_TEST_CASE(sparse_output)
+{
+    const unsigned size = 12;
+
+    std::default_random_engine generator;
+    std::uniform_real_distribution<float> distribution(-10.f, 10.f);
+    std::vector<float> weights(size * size);
+    for (auto& w : weights)
+        w = distribution(generator);
+
+    diffdp::SparsemaxEisner sparsemax_eisner(size);
+    sparsemax_eisner.forward([&] (const unsigned head, const unsigned mod) { return weights.at(head + mod * size); });
+
+    unsigned n_zeros = 0u;
+    for (unsigned mod = 1 ; mod < size ; ++mod)
+    {
+        float sum = 0.f;
+        for (unsigned head = 0 ; head < size ; ++head)
+        {
+            if (head == mod)
+                continue;
+            const float v = sparsemax_eisner.output(head, mod);
+            BOOST_CHECK(v >= 0.f);
+            sum += v;
+            if (v == 0.f)
+                ++n_zeros;
+        }
+        BOOST_CHECK_CLOSE(sum, 1.f, 1e-3f);
+    }
+    BOOST_CHECK(n_zeros > (size - 1) * (size - 1) / 2);
+}
+
+// dropping the split weights must not change the result
+BOOST_AUTO_TEST_CASE(recomputed_split_weights)
+{
+    const unsigned size = 10;
+    std::vector<float> weights(size * size), gradients(size * size);
+    for (unsigned i = 0 ; i < size * size ; ++i)
+    {
+        weights[i] = std::sin(1.7f * i);
+        gradients[i] = std::cos(0.3f * i);
+    }
+
+    diffdp::SparsemaxEisner stored(size);
+    diffdp::SparsemaxEisner recomputed(size, diffdp::SplitWeightsMode::Recomputed);
+    for (diffdp::SparsemaxEisner* parser : {&stored, &recomputed})
+    {
+        parser->forward([&] (const unsigned head, const unsigned mod) { return weights.at(head + mod * size); });
+        parser->backward([&] (const unsigned head, const unsigned mod) { return gradients.at(head + mod * size); });
+    }
+
+    for (unsigned head = 0 ; head < size ; ++head)
+    {
+        for (unsigned mod = 1 ; mod < size ; ++mod)
+        {
+            if (head == mod)
+                continue;
+            BOOST_CHECK_EQUAL(stored.output(head, mod), recomputed.output(head, mod));
+            BOOST_CHECK(check_grad(stored.gradient(head, mod), recomputed.gradient(head, mod)));
+        }
+    }
+}
@@ -0,0 +1,239 @@
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE "EisnerVine"
+
+#include <boost/test/unit_test.hpp>
+namespace utf = boost::unit_test;
+
+#include <vector>
+#include <random>
+#include <cmath>
+
+#include "diffdp/algorithm/eisner.h"
+
+const unsigned size = 7u;
+const unsigned vine_length = 2u;
+
+// the trees built by the vine chart: projective trees where every word
+// is at most vine_length words away from the leftmost and the rightmost words of its subtree
+bool is_vine_tree(const std::vector<unsigned>& heads)
+{
+    for (unsigned mod = 1u ; mod < size ; ++mod)
+    {
+        unsigned ancestor = mod;
+        for (unsigned n_steps = 0u ; ancestor != 0u && n_steps < size ; ++n_steps)
+            ancestor = heads.at(ancestor);
+        if (ancestor != 0u)
+            return false;
+    }
+
+    for (unsigned mod = 1u ; mod < size ; ++mod)
+    {
+        const unsigned head = heads.at(mod);
+        for (unsigned k = std::min(head, mod) + 1u ; k < std::max(head, mod) ; ++k)
+        {
+            unsigned ancestor = k;
+            while (ancestor != 0u && ancestor != head)
+                ancestor = heads.at(ancestor);
+            if (ancestor != head)
+                return false;
+        }
+    }
+
+    // leftmost and rightmost words of the subtree of each word
+    for (unsigned word = 1u ; word < size ; ++word)
+    {
+        unsigned left = word, right = word;
+        for (unsigned k = 1u ; k < size ; ++k)
+        {
+            unsigned ancestor = k;
+            while (ancestor != 0u && ancestor != word)
+                ancestor = heads.at(ancestor);
+            if (ancestor == word)
+            {
+                left = std::min(left, k);
+                right = std::max(right, k);
+            }
+        }
+        if (word - left > vine_length || right - word > vine_length)
+            return false;
+    }
+    return true;
+}
+
+// log-partition and arc marginals of the vine trees, by enumeration of the head vectors
+double vine_marginals(const std::vector<float>& weights, std::vector<double>& marginals)
+{
+    std::vector<double> scores;
+    std::vector<std::vector<unsigned>> trees;
+    std::vector<unsigned> heads(size, 0u);
+    while (true)
+    {
+        if (is_vine_tree(heads))
+        {
+            double score = 0.;
+            for (unsigned mod = 1u ; mod < size ; ++mod)
+                score += weights.at(heads.at(mod) + mod * size);
+            scores.push_back(score);
+            trees.push_back(heads);
+        }
+
+        unsigned mod = 1u;
+        while (mod < size && ++heads.at(mod) == size)
+            heads.at(mod++) = 0u;
+        if (mod == size)
+            break;
+    }
+
+    double m = -std::numeric_limits<double>::infinity();
+    for (double s : scores)
+        m = std::max(m, s);
+    double z = 0.;
+    for (double s : scores)
+        z += std::exp(s - m);
+    const double log_z = m + std::log(z);
+
+    marginals.assign(size * size, 0.);
+    for (unsigned t = 0u ; t < trees.size() ; ++t)
+        for (unsigned mod = 1u ; mod < size ; ++mod)
+            marginals.at(trees.at(t).at(mod) + mod * size) += std::exp(scores.at(t) - log_z);
+    return log_z;
+}
+
+std::vector<float> random_weights(std::default_random_engine& generator)
+{
+    std::uniform_real_distribution<float> distribution(-2.f, 2.f);
+    std::vector<float> weights(size * size);
+    for (auto& w : weights)
+        w = distribution(generator);
+    return weights;
+}
+
+// the relaxation of the vine chart is the distribution over vine trees
+void check_marginals(diffdp::SplitWeightsMode mode)
+{
+    std::default_random_engine generator;
+    const auto weights = random_weights(generator);
+
+    std::vector<double> marginals;
+    const double log_z = vine_marginals(weights, marginals);
+
+    diffdp::EntropyRegularizedEisner parser(size, mode, vine_length);
+    parser.forward([&] (unsigned head, unsigned mod) { return weights.at(head + mod * size); });
+    BOOST_CHECK_SMALL(parser.log_partition() - (float) log_z, 1e-4f);
+
+    for (unsigned head = 0u ; head < size ; ++head)
+    {
+        for (unsigned mod = 1u ; mod < size ; ++mod)
+        {
+            if (head == mod)
+                continue;
+            BOOST_CHECK_SMALL(parser.output(head, mod) - (float) marginals.at(head + mod * size), 1e-4f);
+            // arcs longer than the bound are forbidden, except root arcs
+            if (head > 0u && std::max(head, mod) - std::min(head, mod) > vine_length)
+                BOOST_CHECK_EQUAL(parser.output(head, mod), 0.f);
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(vine_marginals_stored)
+{
+    check_marginals(diffdp::SplitWeightsMode::Stored);
+}
+
+BOOST_AUTO_TEST_CASE(vine_marginals_recomputed)
+{
+    check_marginals(diffdp::SplitWeightsMode::Recomputed);
+}
+
+// with a bound larger than the sentence, the band is the whole chart
+BOOST_AUTO_TEST_CASE(vine_unbounded)
+{
+    std::default_random_engine generator;
+    const auto weights = random_weights(generator);
+    const auto weight = [&] (unsigned head, unsigned mod) { return weights.at(head + mod * size); };
+
+    diffdp::AlgorithmicDifferentiableEisner dense(size), vine(size, diffdp::SplitWeightsMode::Stored, size);
+    dense.forward(weight);
+    vine.forward(weight);
+    dense.backward(weight);
+    vine.backward(weight);
+    for (unsigned head = 0u ; head < size ; ++head)
+    {
+        for (unsigned mod = 1u ; mod < size ; ++mod)
+        {
+            if (head == mod)
+                continue;
+            BOOST_CHECK_EQUAL(vine.output(head, mod), dense.output(head, mod));
+            BOOST_CHECK_EQUAL(vine.gradient(head, mod), dense.gradient(head, mod));
+        }
+    }
+    BOOST_CHECK_EQUAL(
+            diffdp::EisnerChart::required_cells(size, diffdp::SplitWeightsMode::Stored, size),
+            diffdp::EisnerChart::required_cells(size)
+    );
+}
+
+// the memory of the band is linear in the size of the sentence (up to the split weights of the root)
+BOOST_AUTO_TEST_CASE(vine_memory)
+{
+    const std::size_t cells_100 = diffdp::EisnerChart::required_cells(100u, diffdp::SplitWeightsMode::Stored, 5u);
+    const std::size_t cells_200 = diffdp::EisnerChart::required_cells(200u, diffdp::SplitWeightsMode::Stored, 5u);
+    BOOST_CHECK(cells_200 < 2u * cells_100 + 1000u);
+    BOOST_CHECK(cells_200 < diffdp::EisnerChart::required_cells(200u) / 100u);
+}
+
+// gradients of both relaxations compared with finite differences
+template<class Parser>
+void check_gradient(const float tolerance)
+{
+    std::default_random_engine generator;
+    const auto weights = random_weights(generator);
+    const auto output_weights = random_weights(generator);
+    const auto loss = [&] (const std::vector<float>& w)
+    {
+        Parser parser(size, diffdp::SplitWeightsMode::Stored, vine_length);
+        parser.forward([&] (unsigned head, unsigned mod) { return w.at(head + mod * size); });
+        float value = 0.f;
+        for (unsigned head = 0u ; head < size ; ++head)
+            for (unsigned mod = 1u ; mod < size ; ++mod)
+                if (head != mod)
+                    value += parser.output(head, mod) * output_weights.at(head + mod * size);
+        return value;
+    };
+
+    Parser parser(size, diffdp::SplitWeightsMode::Stored, vine_length);
+    parser.forward([&] (unsigned head, unsigned mod) { return weights.at(head + mod * size); });
+    parser.backward([&] (unsigned head, unsigned mod) { return output_weights.at(head + mod * size); });
+
+    const float eps = 1e-2f;
+    const float value = loss(weights);
+    for (unsigned head = 0u ; head < size ; ++head)
+    {
+        for (unsigned mod = 1u ; mod < size ; ++mod)
+        {
+            if (head == mod)
+                continue;
+            auto perturbed_weights = weights;
+            perturbed_weights.at(head + mod * size) += eps;
+            BOOST_CHECK_SMALL(parser.gradient(head, mod) - (loss(perturbed_weights) - value) / eps, tolerance);
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(vine_gradient)
+{
+    check_gradient<diffdp::EntropyRegularizedEisner>(2e-2f);
+    check_gradient<diffdp::AlgorithmicDifferentiableEisner>(2e-2f);
+}
+
+// samples of the vine chart satisfy the bound
+BOOST_AUTO_TEST_CASE(vine_sampling)
+{
+    std::default_random_engine generator;
+    const auto weights = random_weights(generator);
+
+    diffdp::EntropyRegularizedEisner parser(size, diffdp::SplitWeightsMode::Stored, vine_length);
+    parser.forward([&] (unsigned head, unsigned mod) { return weights.at(head + mod * size); });
+    for (const auto& heads : parser.sample(generator, 500u))
+        BOOST_CHECK(is_vine_tree(heads));
+}
@@ -0,0 +1,112 @@
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE "ViterbiEisner"
+
+#include <boost/test/unit_test.hpp>
+namespace utf = boost::unit_test;
+
+#include <vector>
+#include <random>
+#include <limits>
+#include <algorithm>
+
+#include "diffdp/algorithm/eisner.h"
+
+// heads[0] is unused, the root is vertex 0
+bool is_projective_tree(const std::vector<unsigned>& heads)
+{
+    const unsigned size = heads.size();
+
+    // every word must be reachable from the root
+    for (unsigned mod = 1u; mod < size; ++mod)
+    {
+        unsigned v = mod;
+        for (unsigned step = 0u; step < size && v != 0u; ++step)
+            v = heads[v];
+        if (v != 0u)
+            return false;
+    }
+
+    // no crossing arcs
+    for (unsigned m1 = 1u; m1 < size; ++m1)
+    {
+        const unsigned l1 = std::min(m1, heads[m1]), r1 = std::max(m1, heads[m1]);
+        for (unsigned m2 = 1u; m2 < size; ++m2)
+        {
+            const unsigned l2 = std::min(m2, heads[m2]), r2 = std::max(m2, heads[m2]);
+            if (l1 < l2 && l2 < r1 && r1 < r2)
+                return false;
+        }
+    }
+    return true;
+}
+
+// enumerate all head assignments and keep the best projective tree
+float brute_force_max(const std::vector<float>& weights, const unsigned size)
+{
+    std::vector<unsigned> heads(size, 0u);
+    float best = -std::numeric_limits<float>::infinity();
+    while (true)
+    {
+        bool valid = true;
+        for (unsigned mod = 1u; mod < size; ++mod)
+            valid = valid && heads[mod] != mod;
+
+        if (valid && is_projective_tree(heads))
+        {
+            float score = 0.f;
+            for (unsigned mod = 1u; mod < size; ++mod)
+                score += weights.at(heads[mod] + mod * size);
+            best = std::max(best, score);
+        }
+
+        // next assignment
+        unsigned mod = 1u;
+        while (mod < size && heads[mod] == size - 1u)
+            heads[mod++] = 0u;
+        if (mod == size)
+            break;
+        ++heads[mod];
+    }
+    return best;
+}
+
+BOOST_AUTO_TEST_CASE(best_tree)
+{
+    std::default_random_engine generator;
+    std::uniform_real_distribution<float> distribution(-5.f, 5.f);
+
+    for (unsigned size = 2u; size <= 6u; ++size)
+    {
+        diffdp::ViterbiEisner viterbi(size);
+
+        for (unsigned repeat = 0u; repeat < 10u; ++repeat)
+        {
+            std::vector<float> weights(size * size);
+            for (auto& w : weights)
+                w = distribution(generator);
+
+            viterbi.forward(
+                [&] (const unsigned head, const unsigned mod) -> float
+                {
+                    return weights.at(head + mod * size);
+                }
+            );
+
+            std::vector<unsigned> heads(size, 0u);
+            float score = 0.f;
+            for (unsigned mod = 1u; mod < size; ++mod)
+            {
+                heads[mod] = viterbi.head(mod);
+                score += weights.at(heads[mod] + mod * size);
+
+                for (unsigned head = 0u; head < size; ++head)
+                    if (head != mod)
+                        BOOST_CHECK_EQUAL(viterbi.output(head, mod), head == heads[mod] ? 1.f : 0.f);
+            }
+
+            BOOST_CHECK(is_projective_tree(heads));
+            BOOST_CHECK_CLOSE(score, viterbi.score(), 1e-3f);
+            BOOST_CHECK_CLOSE(score, brute_force_max(weights, size), 1e-3f);
+        }
+    }
+}
@@ -0,0 +1,94 @@
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE "Parallel"
+
+#include <boost/test/unit_test.hpp>
+namespace utf = boost::unit_test;
+
+#include <vector>
+#include <stdexcept>
+#include <random>
+
+#include "diffdp/parallel.h"
+#include "diffdp/algorithm/eisner.h"
+
+// each cell is updated by a single thread in the same order as in the sequential algorithm,
+// so the result of a parse must not depend on the number of threads
+template<class Parser>
+void check_wavefront()
+{
+    const unsigned size = 37;
+    std::default_random_engine generator;
+    std::uniform_real_distribution<float> distribution(-5.f, 5.f);
+    std::vector<float> weights(size * size), gradients(size * size);
+    for (unsigned i = 0u ; i < size * size ; ++i)
+    {
+        weights[i] = distribution(generator);
+        gradients[i] = distribution(generator);
+    }
+
+    diffdp::set_wavefront_threshold(0u);
+    std::vector<Parser> parsers;
+    for (const unsigned n_threads : {1u, 4u})
+    {
+        diffdp::set_num_threads(n_threads);
+        parsers.emplace_back(size);
+        parsers.back().forward([&] (unsigned head, unsigned mod) { return weights.at(head + mod * size); });
+        parsers.back().backward([&] (unsigned head, unsigned mod) { return gradients.at(head + mod * size); });
+    }
+    diffdp::set_num_threads(1u);
+    diffdp::set_wavefront_threshold(128u);
+
+    for (unsigned head = 0u ; head < size ; ++head)
+    {
+        for (unsigned mod = 1u ; mod < size ; ++mod)
+        {
+            if (head == mod)
+                continue;
+            BOOST_CHECK_EQUAL(parsers[0].output(head, mod), parsers[1].output(head, mod));
+            BOOST_CHECK_EQUAL(parsers[0].gradient(head, mod), parsers[1].gradient(head, mod));
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(all_elements)
+{
+    for (const unsigned n_threads : {1u, 4u, 0u})
+    {
+        diffdp::set_num_threads(n_threads);
+        const unsigned batch_size = 37u;
+        std::vector<unsigned> counts(batch_size, 0u);
+
+        diffdp::parallel_for_batch(
+                batch_size,
+                [] (const unsigned batch) { return (batch * 7u) % 11u; },
+                [&] (const unsigned batch) { ++counts[batch]; }
+        );
+
+        for (unsigned batch = 0u ; batch < batch_size ; ++batch)
+            BOOST_CHECK_EQUAL(counts[batch], 1u);
+    }
+    diffdp::set_num_threads(1u);
+}
+
+BOOST_AUTO_TEST_CASE(exception)
+{
+    for (const unsigned n_threads : {1u, 4u})
+    {
+        diffdp::set_num_threads(n_threads);
+        BOOST_CHECK_THROW(
+                diffdp::parallel_for_batch(
+                        10u,
+                        [] (const unsigned batch) { return batch; },
+                        [] (const unsigned batch) { if (batch == 3u) throw std::runtime_error("error"); }
+                ),
+                std::runtime_error
+        );
+    }
+    diffdp::set_num_threads(1u);
+}
+
+BOOST_AUTO_TEST_CASE(wavefront)
+{
+    check_wavefront<diffdp::AlgorithmicDifferentiableEisner>();
+    check_wavefront<diffdp::EntropyRegularizedEisner>();
+}
@@ -0,0 +1,101 @@
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE "Pool"
+
+#include <boost/test/unit_test.hpp>
+namespace utf = boost::unit_test;
+
+#include <vector>
+#include <random>
+#include <cmath>
+#include <algorithm>
+
+#include "diffdp/pool.h"
+#include "diffdp/algorithm/eisner.h"
+#include "diffdp/algorithm/binary_phrase.h"
+
+BOOST_AUTO_TEST_CASE(reuse)
+{
+    typedef diffdp::ChartPool<diffdp::EisnerChart> Pool;
+    Pool::clear();
+
+    diffdp::EisnerChart* chart = Pool::acquire(20u);
+    BOOST_CHECK_EQUAL(chart->size, 20u);
+    BOOST_CHECK_EQUAL(chart->memory_cells, diffdp::EisnerChart::required_cells(20u));
+    Pool::release(chart);
+    BOOST_CHECK_EQUAL(Pool::size(), 1u);
+
+    // a smaller chart is served by the free one
+    {
+        diffdp::PooledChart<diffdp::EisnerChart> small(7u);
+        BOOST_CHECK_EQUAL(small.get(), chart);
+        BOOST_CHECK_EQUAL(small.get()->size, 7u);
+        BOOST_CHECK_EQUAL(Pool::size(), 0u);
+
+        // a larger one must be allocated
+        diffdp::PooledChart<diffdp::EisnerChart> large(30u);
+        BOOST_CHECK(large.get() != chart);
+        BOOST_CHECK_EQUAL(large.get()->memory_cells, diffdp::EisnerChart::required_cells(30u));
+    }
+    BOOST_CHECK_EQUAL(Pool::size(), 2u);
+
+    Pool::clear();
+    BOOST_CHECK_EQUAL(Pool::size(), 0u);
+}
+
+// a parser on resized charts must give the same result as on charts of the exact size,
+// whatever the previous content of their memory
+template<class Parser, class Chart>
+void check_resized_charts(const unsigned size)
+{
+    std::default_random_engine generator;
+    std::uniform_real_distribution<float> distribution(-5.f, 5.f);
+    std::vector<float> weights(size * size), gradients(size * size);
+    for (unsigned i = 0u ; i < size * size ; ++i)
+    {
+        weights[i] = distribution(generator);
+        gradients[i] = distribution(generator);
+    }
+
+    Chart chart_forward(size + 10u), chart_backward(size + 5u);
+    for (Chart* chart : {&chart_forward, &chart_backward})
+    {
+        std::fill(chart->_memory, chart->_memory + chart->memory_cells, std::nanf(""));
+        chart->resize(size);
+    }
+
+    Parser parser(size), pooled_parser(&chart_forward, &chart_backward);
+    for (Parser* p : {&parser, &pooled_parser})
+    {
+        p->forward([&] (unsigned i, unsigned j) { return weights.at(i + j * size); });
+        p->backward([&] (unsigned i, unsigned j) { return gradients.at(i + j * size); });
+    }
+
+    for (unsigned i = 0u ; i < size ; ++i)
+    {
+        for (unsigned j = i + 1u ; j < size ; ++j)
+        {
+            BOOST_CHECK_EQUAL(parser.output(i, j), pooled_parser.output(i, j));
+            BOOST_CHECK_EQUAL(parser.gradient(i, j), pooled_parser.gradient(i, j));
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(resize)
+{
+    check_resized_charts<diffdp::AlgorithmicDifferentiableEisner, diffdp::EisnerChart>(13u);
+    check_resized_charts<diffdp::EntropyRegularizedEisner, diffdp::EisnerChart>(13u);
+    check_resized_charts<diffdp::AlgorithmicDifferentiableBinaryPhraseStructure, diffdp::BinaryPhraseStructureChart>(13u);
+    check_resized_charts<diffdp::EntropyRegularizedBinaryPhraseStructure, diffdp::BinaryPhraseStructureChart>(13u);
+}
+
+BOOST_AUTO_TEST_CASE(too_small)
+{
+    diffdp::EisnerChart chart(5u);
+    BOOST_CHECK_THROW(chart.resize(6u), std::runtime_error);
+
+    std::vector<float> memory(diffdp::EisnerChart::required_cells(8u));
+    diffdp::EisnerChart view(5u, memory.data());
+    view.rebind(8u, memory.data());
+    BOOST_CHECK_EQUAL(view.size, 8u);
+    BOOST_CHECK_THROW(chart.rebind(4u, memory.data()), std::runtime_error);
+}
@@ -0,0 +1,68 @@
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE "Random"
+
+#include <boost/test/unit_test.hpp>
+namespace utf = boost::unit_test;
+
+#include <cmath>
+#include <cstdint>
+
+#include "diffdp/random.h"
+
+// known answers of the reference implementation (Random123)
+BOOST_AUTO_TEST_CASE(philox_known_answers)
+{
+    {
+        std::uint32_t counter[4] = {0u, 0u, 0u, 0u};
+        const std::uint32_t key[2] = {0u, 0u};
+        diffdp::philox4x32(counter, key);
+        BOOST_CHECK_EQUAL(counter[0], 0x6627e8d5u);
+        BOOST_CHECK_EQUAL(counter[1], 0xe169c58du);
+        BOOST_CHECK_EQUAL(counter[2], 0xbc57ac4cu);
+        BOOST_CHECK_EQUAL(counter[3], 0x9b00dbd8u);
+    }
+    {
+        std::uint32_t counter[4] = {0x243f6a88u, 0x85a308d3u, 0x13198a2eu, 0x03707344u};
+        const std::uint32_t key[2] = {0xa4093822u, 0x299f31d0u};
+        diffdp::philox4x32(counter, key);
+        BOOST_CHECK_EQUAL(counter[0], 0xd16cfe09u);
+        BOOST_CHECK_EQUAL(counter[1], 0x94fdccebu);
+        BOOST_CHECK_EQUAL(counter[2], 0x5001e420u);
+        BOOST_CHECK_EQUAL(counter[3], 0x24126ea1u);
+    }
+}
+
+// mean and variance of the standard Gumbel distribution: Euler's constant and pi^2 / 6
+BOOST_AUTO_TEST_CASE(gumbel_moments)
+{
+    const unsigned size = 300u;
+    double sum = 0., sum_sq = 0.;
+    for (unsigned i = 0u ; i < size ; ++i)
+    {
+        for (unsigned j = 0u ; j < size ; ++j)
+        {
+            const double v = diffdp::gumbel_noise(42u, 3u, i, j);
+            BOOST_REQUIRE(std::isfinite(v));
+            sum += v;
+            sum_sq += v * v;
+        }
+    }
+    const double mean = sum / (size * size);
+    const double variance = sum_sq / (size * size) - mean * mean;
+    BOOST_CHECK_SMALL(mean - 0.5772156649, 2e-2);
+    BOOST_CHECK_SMALL(variance - M_PI * M_PI / 6., 5e-2);
+}
+
+BOOST_AUTO_TEST_CASE(perturbation)
+{
+    diffdp::GumbelPerturbation disabled;
+    BOOST_CHECK_EQUAL(disabled(0u, 1u, 2u), 0.f);
+
+    diffdp::GumbelPerturbation perturbation(1234u), other_seed(1235u);
+    // the noise of a weight can be drawn again
+    BOOST_CHECK_EQUAL(perturbation(0u, 1u, 2u), perturbation(0u, 1u, 2u));
+    // but it differs between weights, sentences and seeds
+    BOOST_CHECK(perturbation(0u, 1u, 2u) != perturbation(0u, 2u, 1u));
+    BOOST_CHECK(perturbation(0u, 1u, 2u) != perturbation(1u, 1u, 2u));
+    BOOST_CHECK(perturbation(0u, 1u, 2u) != other_seed(0u, 1u, 2u));
+}
@@ -0,0 +1,149 @@
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE "SIMD"
+
+#include <boost/test/unit_test.hpp>
+namespace utf = boost::unit_test;
+
+#include <vector>
+#include <random>
+#include <limits>
+
+#include "diffdp/math.h"
+#include "diffdp/simd.h"
+
+// using boost test with intolerance fails (too precise),
+// so let's just use the same test as in Dynet.
+bool check_grad(float g, float g_act)
+{
+    float f = std::fabs(g - g_act);
+    float m = std::max(std::fabs(g), std::fabs(g_act));
+    if (f > 0.01 && m > 0.f)
+        f /= m;
+
+    if (f > 0.01 || std::isnan(f))
+        return false;
+    else
+        return true;
+}
+
+// compare the vectorized kernels (float pointers) with the generic implementation (vector iterators)
+BOOST_AUTO_TEST_CASE(kernels)
+{
+    std::default_random_engine generator;
+    std::uniform_real_distribution<float> distribution(-10.f, 10.f);
+
+    for (const auto set : {
+            diffdp::simd::InstructionSet::Scalar,
+            diffdp::simd::InstructionSet::SSE,
+            diffdp::simd::InstructionSet::AVX2,
+            diffdp::simd::InstructionSet::AVX512
+    })
+    {
+        if (!diffdp::simd::is_supported(set))
+            continue;
+        diffdp::simd::set_instruction_set(set);
+
+        for (unsigned size = 1u; size < 70u; ++size)
+        {
+            std::vector<float> a(size), b(size), c(size), d(size);
+            for (unsigned i = 0u; i < size; ++i)
+            {
+                a[i] = distribution(generator);
+                b[i] = distribution(generator);
+                c[i] = distribution(generator);
+            }
+            // masked input
+            if (size > 1u)
+                a[size / 2] = -std::numeric_limits<float>::infinity();
+
+            std::vector<float> expected(size), output(size);
+
+            diffdp::cwise_add(expected.begin(), a.begin(), b.begin(), size);
+            diffdp::cwise_add(output.data(), a.data(), b.data(), size);
+            for (unsigned i = 0u; i < size; ++i)
+                BOOST_CHECK(expected[i] == output[i]);
+
+            BOOST_CHECK(diffdp::max(a.begin(), size) == diffdp::max(a.data(), size));
+            BOOST_CHECK(check_grad(diffdp::dot(b.begin(), c.begin(), size), diffdp::dot(b.data(), c.data(), size)));
+
+            const float m = diffdp::max(a.begin(), size);
+            const float z1 = diffdp::exp_minus_cst(expected.begin(), a.begin(), m, size);
+            const float z2 = diffdp::exp_minus_cst(output.data(), a.data(), m, size);
+            BOOST_CHECK(check_grad(z1, z2));
+            for (unsigned i = 0u; i < size; ++i)
+                BOOST_CHECK(check_grad(expected[i], output[i]));
+            if (size > 1u)
+                BOOST_CHECK(output[size / 2] == 0.f);
+
+            diffdp::softmax(expected.begin(), b.begin(), size);
+            diffdp::softmax(output.data(), b.data(), size);
+            for (unsigned i = 0u; i < size; ++i)
+                BOOST_CHECK(check_grad(expected[i], output[i]));
+
+            std::vector<float> expected_grad(b), output_grad(b);
+            diffdp::backprop_softmax(expected_grad.begin(), c.begin(), b.begin(), expected.begin(), size);
+            diffdp::backprop_softmax(output_grad.data(), c.data(), b.data(), output.data(), size);
+            for (unsigned i = 0u; i < size; ++i)
+                BOOST_CHECK(check_grad(expected_grad[i], output_grad[i]));
+
+            // fused softmax, compared with the unfused one,
+            // masked inputs are skipped by the dot product
+            std::vector<float> all_masked(size, -std::numeric_limits<float>::infinity());
+            for (const auto* p_input : {&a, &c, &all_masked})
+            {
+                const std::vector<float>& input = *p_input;
+                std::vector<float> split(size), backptr(size);
+                float m1, m2;
+                const float p1 = diffdp::cwise_add_partition(split.begin(), input.begin(), b.begin(), size, &m1);
+                const float p2 = diffdp::cwise_add_partition(output.data(), input.data(), b.data(), size, &m2);
+                if (p_input == &all_masked)
+                {
+                    // null backpointers and -inf value
+                    BOOST_CHECK(p1 == 0.f);
+                    BOOST_CHECK(p2 == 0.f);
+                    BOOST_CHECK(diffdp::normalized_exp_dot(d.begin(), split.begin(), m1, p1, size) == -std::numeric_limits<float>::infinity());
+                    BOOST_CHECK(diffdp::normalized_exp_dot(backptr.data(), output.data(), m2, p2, size) == -std::numeric_limits<float>::infinity());
+                    for (unsigned i = 0u; i < size; ++i)
+                        BOOST_CHECK(d[i] == 0.f && backptr[i] == 0.f);
+                    continue;
+                }
+
+                diffdp::cwise_add(expected.begin(), input.begin(), b.begin(), size);
+                const float m = diffdp::max(expected.begin(), size);
+                BOOST_CHECK(m1 == m);
+                BOOST_CHECK(m2 == m);
+                BOOST_CHECK(check_grad(diffdp::exp_minus_cst(d.begin(), expected.begin(), m, size), p1));
+                BOOST_CHECK(check_grad(p1, p2));
+                for (unsigned i = 0u; i < size; ++i)
+                    BOOST_CHECK(expected[i] == output[i] && expected[i] == split[i]);
+
+                const float v1 = diffdp::normalized_exp_dot(split.begin(), expected.begin(), m, p1, size);
+                const float v2 = diffdp::normalized_exp_dot(backptr.data(), output.data(), m, p2, size);
+                diffdp::softmax(d.begin(), expected.begin(), size);
+                float value = 0.f;
+                for (unsigned i = 0u; i < size; ++i)
+                    if (std::isfinite(expected[i]))
+                        value += d[i] * expected[i];
+                BOOST_CHECK(check_grad(value, v1));
+                BOOST_CHECK(check_grad(v1, v2));
+                for (unsigned i = 0u; i < size; ++i)
+                {
+                    BOOST_CHECK(check_grad(d[i], split[i]));
+                    BOOST_CHECK(check_grad(d[i], backptr[i]));
+                }
+            }
+
+            expected = c;
+            output = c;
+            diffdp::add_cwise_mult(expected.begin(), b.begin(), 0.5f, size);
+            diffdp::add_cwise_mult(output.data(), b.data(), 0.5f, size);
+            diffdp::add(expected.begin(), b.begin(), size);
+            diffdp::add(output.data(), b.data(), size);
+            diffdp::inplace_cwise_div(expected.begin(), 3.f, size);
+            diffdp::inplace_cwise_div(output.data(), 3.f, size);
+            for (unsigned i = 0u; i < size; ++i)
+                BOOST_CHECK(check_grad(expected[i], output[i]));
+        }
+    }
+    diffdp::simd::set_instruction_set(diffdp::simd::best_instruction_set());
+}